@@ -0,0 +1,67 @@
+/*
+ * lib_alloc.cpp
+ *
+ * Buffer placement for DaveSampleKontrol.
+ *
+ * The T7-S3 has 8 MB of octal PSRAM next to ~320 KB of internal SRAM, and
+ * WiFi, lwIP and the FreeRTOS stacks all compete for the internal part.
+ * PSRAM is slower (cache misses go over the OPI bus), cannot be touched
+ * while the flash cache is disabled (so never from IRAM ISRs during flash
+ * writes) and is not reachable by most peripheral DMA. So only buffers the
+ * loop task alone touches, at its own pace, come here: they go to PSRAM
+ * when the request is at least ALLOC_PSRAM_MIN_BYTES, to internal RAM
+ * otherwise or as fallback.
+ *
+ * Buffers are never freed, so the accounting is a running total per tag.
+ */
+
+#include "lib_alloc.hpp"
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+
+static const uint32_t kRegionCaps[ALLOC_REGION_COUNT] = {
+    MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, MALLOC_CAP_SPIRAM};
+
+static const char* const kTagNames[ALLOC_TAG_COUNT] = {"other", "net"};
+static const char* const kRegionNames[ALLOC_REGION_COUNT] = {"internal",
+                                                             "psram"};
+
+static uint32_t tagBytes[ALLOC_TAG_COUNT][ALLOC_REGION_COUNT];
+
+void* allocBuffer(size_t size, AllocTag tag) {
+  if (tag >= ALLOC_TAG_COUNT) tag = ALLOC_TAG_OTHER;
+  void*   buf    = nullptr;
+  uint8_t region = ALLOC_REGION_INTERNAL;
+  if (size >= ALLOC_PSRAM_MIN_BYTES &&
+      heap_caps_get_total_size(kRegionCaps[ALLOC_REGION_PSRAM]) > 0) {
+    buf    = heap_caps_malloc(size, kRegionCaps[ALLOC_REGION_PSRAM]);
+    region = ALLOC_REGION_PSRAM;
+  }
+  if (!buf) {
+    buf    = heap_caps_malloc(size, kRegionCaps[ALLOC_REGION_INTERNAL]);
+    region = ALLOC_REGION_INTERNAL;
+  }
+  if (buf) tagBytes[tag][region] += size;
+  return buf;
+}
+
+void allocGetRegionStats(AllocRegion region, AllocRegionStats* out) {
+  uint32_t caps         = kRegionCaps[region];
+  out->totalBytes       = heap_caps_get_total_size(caps);
+  out->freeBytes        = heap_caps_get_free_size(caps);
+  out->minFreeBytes     = heap_caps_get_minimum_free_size(caps);
+  out->largestFreeBlock = heap_caps_get_largest_free_block(caps);
+}
+
+uint32_t allocTagBytes(AllocTag tag, AllocRegion region) {
+  return tagBytes[tag][region];
+}
+
+const char* allocTagName(uint8_t tag) {
+  return tag < ALLOC_TAG_COUNT ? kTagNames[tag] : "?";
+}
+
+const char* allocRegionName(uint8_t region) {
+  return region < ALLOC_REGION_COUNT ? kRegionNames[region] : "?";
+}
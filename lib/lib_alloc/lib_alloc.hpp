@@ -0,0 +1,56 @@
+#ifndef LIB_ALLOC_HPP
+#define LIB_ALLOC_HPP
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * lib_alloc - header
+ *
+ * Placement of large, latency-tolerant buffers: PSRAM when present, else
+ * internal RAM, with usage per region and per purpose. ISR and DMA buffers
+ * are not allocated here; they stay static, in internal RAM. See
+ * lib_alloc.cpp for implementation details.
+ */
+
+/* Requests smaller than this stay internal. */
+#ifndef ALLOC_PSRAM_MIN_BYTES
+#define ALLOC_PSRAM_MIN_BYTES 512
+#endif
+
+/* What a buffer is for (usage accounting only). */
+enum AllocTag : uint8_t {
+  ALLOC_TAG_OTHER = 0,
+  ALLOC_TAG_NET,  // HTTP / protocol buffers
+  ALLOC_TAG_COUNT
+};
+
+enum AllocRegion : uint8_t {
+  ALLOC_REGION_INTERNAL = 0,
+  ALLOC_REGION_PSRAM,
+  ALLOC_REGION_COUNT
+};
+
+struct AllocRegionStats {
+  uint32_t totalBytes;
+  uint32_t freeBytes;
+  uint32_t minFreeBytes;
+  uint32_t largestFreeBlock;
+};
+
+/* Allocate size bytes, in PSRAM if possible. Returns nullptr on failure.
+ * Memory is not cleared. Buffers are kept for the life of the program. */
+void* allocBuffer(size_t size, AllocTag tag);
+
+/* Heap figures for a region (all zero for PSRAM when absent). */
+void allocGetRegionStats(AllocRegion region, AllocRegionStats* out);
+
+/* Bytes allocated through allocBuffer() per tag and region. */
+uint32_t allocTagBytes(AllocTag tag, AllocRegion region);
+
+/* Short lowercase names for reports. */
+const char* allocTagName(uint8_t tag);
+const char* allocRegionName(uint8_t region);
+
+#endif  // LIB_ALLOC_HPP
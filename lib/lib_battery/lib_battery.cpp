@@ -0,0 +1,131 @@
+/*
+ * lib_battery.cpp
+ *
+ * Battery monitoring for DaveSampleKontrol.
+ *
+ * The ADC is characterized once at init (eFuse calibration lookup is slow),
+ * then an esp_timer samples the battery pin in the background:
+ *
+ * - one raw ADC1 read every BAT_SAMPLE_PERIOD_US (~15 us each),
+ * - BAT_OVERSAMPLE reads are summed into one block (noise / sqrt(N)),
+ * - each block is converted to millivolts and fed to a first-order IIR
+ *   filter (alpha = 1/2^BAT_FILTER_SHIFT) to smooth out load transients.
+ *
+ * At 100 reads per second this costs well under 0.5 % of one core, and
+ * readers only load two cached values, so the status and metrics endpoints
+ * can query it on every request.
+ *
+ * State of charge comes from a single-cell LiPo open-circuit voltage table
+ * with linear interpolation. Under load the estimate reads a little low.
+ */
+
+#include "lib_battery.hpp"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <esp_adc_cal.h>
+#include <driver/adc.h>
+
+#define BAT_SAMPLE_PERIOD_US 10000  // 100 Hz
+#define BAT_OVERSAMPLE       16     // reads per block (~160 ms)
+#define BAT_FILTER_SHIFT     3      // IIR alpha = 1/8 per block
+
+static esp_adc_cal_characteristics_t adcChars;
+static adc1_channel_t                adcChannel;
+static uint8_t                       divider     = 2;
+static esp_timer_handle_t            sampleTimer = nullptr;
+
+// Accumulation (timer task only)
+static uint32_t rawSum   = 0;
+static uint8_t  rawCount = 0;
+static uint32_t filtered = 0;  // mV << BAT_FILTER_SHIFT
+
+// Published values (written by timer task, read anywhere)
+static volatile uint16_t voltageMv  = 0;
+static volatile uint8_t  percent    = 0;
+static volatile uint32_t blockCount = 0;
+
+// LiPo open-circuit voltage (mV) -> state of charge (%), descending
+struct SocPoint {
+  uint16_t mv;
+  uint8_t  pct;
+};
+static const SocPoint kSocTable[] = {
+    {4200, 100}, {4150, 95}, {4110, 90}, {4080, 85}, {4020, 80}, {3980, 75},
+    {3950, 70},  {3910, 65}, {3870, 60}, {3850, 55}, {3840, 50}, {3820, 45},
+    {3800, 40},  {3790, 35}, {3770, 30}, {3750, 25}, {3730, 20}, {3710, 15},
+    {3690, 10},  {3610, 5},  {3270, 0}};
+static const uint8_t kSocPoints = sizeof(kSocTable) / sizeof(kSocTable[0]);
+
+static uint8_t estimatePercent(uint16_t mv) {
+  if (mv >= kSocTable[0].mv) return 100;
+  for (uint8_t i = 1; i < kSocPoints; ++i) {
+    if (mv >= kSocTable[i].mv) {
+      const SocPoint& hi = kSocTable[i - 1];
+      const SocPoint& lo = kSocTable[i];
+      return lo.pct +
+             (uint32_t)(mv - lo.mv) * (hi.pct - lo.pct) / (hi.mv - lo.mv);
+    }
+  }
+  return 0;
+}
+
+static void sampleCallback(void* arg) {
+  (void)arg;
+  int raw = adc1_get_raw(adcChannel);
+  if (raw < 0) return;
+  rawSum += (uint32_t)raw;
+  if (++rawCount < BAT_OVERSAMPLE) return;
+
+  uint32_t avgRaw = (rawSum + BAT_OVERSAMPLE / 2) / BAT_OVERSAMPLE;
+  rawSum          = 0;
+  rawCount        = 0;
+
+  uint32_t mv = esp_adc_cal_raw_to_voltage(avgRaw, &adcChars) * divider;
+  if (blockCount == 0) {
+    filtered = mv << BAT_FILTER_SHIFT;  // seed the filter
+  } else {
+    filtered += mv - (filtered >> BAT_FILTER_SHIFT);
+  }
+
+  uint16_t out = (uint16_t)(filtered >> BAT_FILTER_SHIFT);
+  voltageMv    = out;
+  percent      = estimatePercent(out);
+  blockCount   = blockCount + 1;
+}
+
+bool batteryInit(uint8_t pin, uint8_t dividerRatio) {
+  int8_t channel = digitalPinToAnalogChannel(pin);
+  // ADC1 channels are numbered 0..9; ADC2 (shared with WiFi) is not usable
+  if (channel < 0 || channel >= ADC1_CHANNEL_MAX) return false;
+
+  adcChannel = (adc1_channel_t)channel;
+  divider    = dividerRatio;
+
+  adc1_config_width(ADC_WIDTH_BIT_12);
+  adc1_config_channel_atten(adcChannel, ADC_ATTEN_DB_12);
+  esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_12, ADC_WIDTH_BIT_12, 1100,
+                           &adcChars);
+
+  const esp_timer_create_args_t args = {
+      .callback              = &sampleCallback,
+      .arg                   = nullptr,
+      .dispatch_method       = ESP_TIMER_TASK,
+      .name                  = "battery",
+      .skip_unhandled_events = true,
+  };
+  if (esp_timer_create(&args, &sampleTimer) != ESP_OK) return false;
+  return esp_timer_start_periodic(sampleTimer, BAT_SAMPLE_PERIOD_US) == ESP_OK;
+}
+
+uint16_t batteryVoltageMv(void) {
+  return voltageMv;
+}
+
+uint8_t batteryPercent(void) {
+  return percent;
+}
+
+uint32_t batteryBlockCount(void) {
+  return blockCount;
+}
@@ -0,0 +1,31 @@
+#ifndef LIB_BATTERY_HPP
+#define LIB_BATTERY_HPP
+
+#include <Arduino.h>
+#include <stdint.h>
+
+/*
+ * lib_battery - header
+ *
+ * Background battery monitoring: calibrated, oversampled and filtered
+ * voltage with a LiPo state-of-charge estimate.
+ * See lib_battery.cpp for implementation details.
+ */
+
+/* Start monitoring.
+ * pin: ADC1-capable GPIO wired to the battery divider.
+ * dividerRatio: battery voltage / pin voltage (2 on the T7-S3).
+ * Returns false if the pin is not on ADC1 or the sampling timer failed.
+ */
+bool batteryInit(uint8_t pin, uint8_t dividerRatio = 2);
+
+/* Filtered battery voltage in millivolts (0 until the first block is in). */
+uint16_t batteryVoltageMv(void);
+
+/* Estimated state of charge, 0..100 %. */
+uint8_t batteryPercent(void);
+
+/* Number of oversampled blocks processed since init (for diagnostics). */
+uint32_t batteryBlockCount(void);
+
+#endif  // LIB_BATTERY_HPP
@@ -0,0 +1,62 @@
+#ifndef BOARD_ESP32S3_HPP
+#define BOARD_ESP32S3_HPP
+
+#include <stdint.h>
+
+/*
+ * board_esp32s3 - header
+ *
+ * What the ESP32-S3 allows on each GPIO, as constexpr functions for the
+ * compile-time checks of the board profiles (see lib_board.hpp). From the
+ * ESP32-S3 datasheet, "Peripheral Pin Configurations" and "Strapping Pins".
+ */
+
+/* One UART as wired on a board: controller number and its pins (-1 unused).
+ * The GPIO matrix routes any UART to any GPIO, so the pins are free. */
+struct BoardUart {
+  uint8_t num;
+  int8_t  rx;
+  int8_t  tx;
+};
+
+static const uint8_t ESP32S3_UART_COUNT = 3;
+
+/* GPIO0..21 and GPIO26..48 exist, 22..25 do not */
+constexpr bool esp32s3IsGpio(int pin) {
+  return (pin >= 0 && pin <= 21) || (pin >= 26 && pin <= 48);
+}
+
+/* SPI flash (26..32) and, on modules with octal PSRAM, 33..37 */
+constexpr bool esp32s3IsMemoryPin(int pin, bool octalPsram) {
+  return (pin >= 26 && pin <= 32) || (octalPsram && pin >= 33 && pin <= 37);
+}
+
+/* USB D-/D+ of the USB OTG / USB Serial/JTAG controllers */
+constexpr bool esp32s3IsUsbPin(int pin) {
+  return pin == 19 || pin == 20;
+}
+
+/* Sampled at reset: boot mode, VDD_SPI voltage, ROM log, JTAG source. An
+ * output driving one of these can keep the chip from booting. */
+constexpr bool esp32s3IsStrapping(int pin) {
+  return pin == 0 || pin == 3 || pin == 45 || pin == 46;
+}
+
+/* RTC GPIOs: only these can wake the chip from deep sleep (EXT0/EXT1) */
+constexpr bool esp32s3IsRtcGpio(int pin) {
+  return pin >= 0 && pin <= 21;
+}
+
+/* ADC1 channel of a pin, -1 if none. ADC2 (GPIO11..20) is unusable while
+ * WiFi is on, so it is not offered. */
+constexpr int esp32s3Adc1Channel(int pin) {
+  return (pin >= 1 && pin <= 10) ? pin - 1 : -1;
+}
+
+/* Level of pin in the GPIO_IN_REG / GPIO_IN1_REG values in0 and in1; with
+ * a constant pin this folds into one shift and mask. */
+constexpr uint32_t esp32s3InputLevel(int pin, uint32_t in0, uint32_t in1) {
+  return pin < 32 ? (in0 >> pin) & 1 : (in1 >> (pin - 32)) & 1;
+}
+
+#endif  // BOARD_ESP32S3_HPP
@@ -0,0 +1,56 @@
+#ifndef BOARD_T7S3_HPP
+#define BOARD_T7S3_HPP
+
+#include "board_esp32s3.hpp"
+
+/*
+ * board_t7s3 - header
+ *
+ * Pedalboard on a LilyGO T7-S3 (ESP32-S3, 16 MB flash, 8 MB octal PSRAM).
+ * Selected by default, see lib_board.hpp; checked at compile time there.
+ */
+
+struct BoardT7S3 {
+  static constexpr const char* kName = "T7-S3";
+
+  static constexpr bool kOctalPsram = true;
+  static constexpr bool kNativeUsb  = true;  // TinyUSB (MIDI, CDC console)
+
+  // Footswitches, active low with the internal pull-ups. S3 and S4 are on
+  // RTC GPIOs and wake the pedal from deep sleep.
+  static constexpr uint8_t kButtonCount              = 4;
+  static constexpr uint8_t kButtonPins[kButtonCount] = {
+      46,  // S1 top-left
+      45,  // S2 top-right
+      21,  // S3 bottom-left
+      9    // S4 bottom-right
+  };
+  static constexpr bool kButtonsActiveLow = true;
+  static constexpr bool kButtonsPullup    = true;  // no external resistors
+
+  // Built-in LED (not visible outside pedalboard case)
+  static constexpr uint8_t kLedPin = 17;
+
+  // WS2812 footswitch LEDs, chained in S1..S4 order
+  static constexpr uint8_t kLedStripPin = 12;
+
+  // Battery voltage divider (1:2) on ADC1
+  static constexpr uint8_t kBatteryAdcPin  = 2;
+  static constexpr uint8_t kBatteryDivider = 2;
+
+  // DFPlayer Minis (9600 baud). Player 1 is on UART1's default pins.
+  static constexpr BoardUart kMp3Uart[2] = {{1, 15, 16}, {2, 8, 5}};
+
+  // Serial MIDI (DIN/TRS) on UART0's default pins, free when the console
+  // is on native USB
+  static constexpr BoardUart kMidiDinUart = {0, 44, 43};
+
+  // 128x64 status display on I2C
+  static constexpr int8_t  kDisplaySda     = 10;
+  static constexpr int8_t  kDisplayScl     = 11;
+  static constexpr uint8_t kDisplayAddress = 0x3C;
+};
+
+using Board = BoardT7S3;
+
+#endif  // BOARD_T7S3_HPP
@@ -0,0 +1,173 @@
+#ifndef LIB_BOARD_HPP
+#define LIB_BOARD_HPP
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <utility>
+
+/*
+ * lib_board - header
+ *
+ * Board profile: every pin and hardware choice of one hardware variant in a
+ * single constexpr struct, checked at compile time (pin exists and is not
+ * taken by flash, PSRAM or USB, no pin used twice, no output on a strapping
+ * pin, UART numbers, ADC1 for the battery, a footswitch that can wake from
+ * deep sleep). A wiring mistake fails the build instead of the gig.
+ *
+ * The variant is board_t7s3.hpp unless the build names another one:
+ *   build_flags = -D BOARD_PROFILE_HEADER='"board_mine.hpp"'
+ * The header defines its struct and `using Board = ...;`.
+ *
+ * Code that knows its pins at compile time reads them through templates on
+ * the profile, e.g. boardButtonsDown<Board>(): the pin numbers, register
+ * masks and shifts fold into constants instead of a digitalRead() per pin.
+ */
+
+#if defined(BOARD_PROFILE_HEADER)
+#include BOARD_PROFILE_HEADER
+#else
+#include "board_t7s3.hpp"
+#endif
+
+#if defined(ARDUINO) && __has_include("soc/gpio_reg.h")
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+#define BOARD_GPIO_REGS 1
+#else
+#define BOARD_GPIO_REGS 0
+#endif
+
+#if defined(ARDUINO_USB_CDC_ON_BOOT) && ARDUINO_USB_CDC_ON_BOOT
+static const bool BOARD_CONSOLE_ON_UART0 = false;
+#else
+static const bool BOARD_CONSOLE_ON_UART0 = true;
+#endif
+
+/* Pressed footswitches, bit i = button i, from one read of the GPIO input
+ * registers (host builds: digitalRead() per pin). */
+template <typename B, size_t... I>
+inline uint32_t boardButtonsDownImpl(std::index_sequence<I...>) {
+  const uint32_t released = B::kButtonsActiveLow ? 1 : 0;
+#if BOARD_GPIO_REGS
+  const uint32_t in0 = REG_READ(GPIO_IN_REG);
+  const uint32_t in1 = REG_READ(GPIO_IN1_REG);
+  return (((esp32s3InputLevel(B::kButtonPins[I], in0, in1) ^ released) << I) |
+          ... | 0u);
+#else
+  return ((((uint32_t)digitalRead(B::kButtonPins[I]) ^ released) << I) | ... |
+          0u);
+#endif
+}
+
+template <typename B>
+inline uint32_t boardButtonsDown(void) {
+  return boardButtonsDownImpl<B>(std::make_index_sequence<B::kButtonCount>());
+}
+
+/* Compile-time checks. Each returns true when the profile passes. */
+
+// All pins of the profile that the firmware drives or reads; -1 = unused
+template <typename B>
+constexpr size_t boardPins(int8_t* out) {
+  size_t n = 0;
+  for (size_t i = 0; i < B::kButtonCount; ++i) out[n++] = B::kButtonPins[i];
+  out[n++] = B::kLedPin;
+  out[n++] = B::kLedStripPin;
+  out[n++] = B::kBatteryAdcPin;
+  for (const BoardUart& u : B::kMp3Uart) {
+    out[n++] = u.rx;
+    out[n++] = u.tx;
+  }
+  if (!BOARD_CONSOLE_ON_UART0) {
+    out[n++] = B::kMidiDinUart.rx;
+    out[n++] = B::kMidiDinUart.tx;
+  }
+  out[n++] = B::kDisplaySda;
+  out[n++] = B::kDisplayScl;
+  return n;
+}
+
+static const size_t BOARD_MAX_PINS = 48;
+
+template <typename B>
+constexpr bool boardPinsUsable(void) {
+  int8_t pins[BOARD_MAX_PINS] = {};
+  size_t n                    = boardPins<B>(pins);
+  for (size_t i = 0; i < n; ++i) {
+    if (pins[i] < 0) continue;
+    if (!esp32s3IsGpio(pins[i])) return false;
+    if (esp32s3IsMemoryPin(pins[i], B::kOctalPsram)) return false;
+    if (B::kNativeUsb && esp32s3IsUsbPin(pins[i])) return false;
+  }
+  return true;
+}
+
+template <typename B>
+constexpr bool boardPinsDistinct(void) {
+  int8_t pins[BOARD_MAX_PINS] = {};
+  size_t n                    = boardPins<B>(pins);
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < i; ++j) {
+      if (pins[i] >= 0 && pins[i] == pins[j]) return false;
+    }
+  }
+  return true;
+}
+
+template <typename B>
+constexpr bool boardOutputsSafe(void) {
+  if (esp32s3IsStrapping(B::kLedPin)) return false;
+  if (esp32s3IsStrapping(B::kLedStripPin)) return false;
+  for (const BoardUart& u : B::kMp3Uart) {
+    if (u.tx >= 0 && esp32s3IsStrapping(u.tx)) return false;
+  }
+  return true;
+}
+
+template <typename B>
+constexpr bool boardUartsValid(void) {
+  bool used[ESP32S3_UART_COUNT] = {};
+  if (!BOARD_CONSOLE_ON_UART0) {
+    if (B::kMidiDinUart.num >= ESP32S3_UART_COUNT) return false;
+    used[B::kMidiDinUart.num] = true;
+  } else {
+    used[0] = true;  // console
+  }
+  for (const BoardUart& u : B::kMp3Uart) {
+    if (u.num >= ESP32S3_UART_COUNT || used[u.num]) return false;
+    if (u.rx < 0 || u.tx < 0) return false;  // the DFPlayer protocol ACKs
+    used[u.num] = true;
+  }
+  return true;
+}
+
+template <typename B>
+constexpr bool boardCanWake(void) {
+  for (size_t i = 0; i < B::kButtonCount; ++i) {
+    if (esp32s3IsRtcGpio(B::kButtonPins[i])) return true;
+  }
+  return false;
+}
+
+static_assert(Board::kButtonCount > 0 && Board::kButtonCount <= 16,
+              "lib_button handles 1..16 footswitches");
+static_assert(Board::kButtonsActiveLow,
+              "lib_button reads footswitches as active low");
+static_assert(boardPinsUsable<Board>(),
+              "board profile: pin does not exist or is taken by flash, "
+              "PSRAM or USB");
+static_assert(boardPinsDistinct<Board>(),
+              "board profile: a pin is assigned twice");
+static_assert(boardOutputsSafe<Board>(),
+              "board profile: output on a strapping pin (0, 3, 45, 46)");
+static_assert(boardUartsValid<Board>(),
+              "board profile: UART number out of range, shared, or UART0 "
+              "while it carries the console");
+static_assert(esp32s3Adc1Channel(Board::kBatteryAdcPin) >= 0,
+              "board profile: battery must be on an ADC1 pin (GPIO1..10)");
+static_assert(boardCanWake<Board>(),
+              "board profile: no footswitch on an RTC GPIO, deep sleep "
+              "could never wake");
+
+#endif  // LIB_BOARD_HPP
@@ -0,0 +1,162 @@
+/*
+ * lib_bus.cpp
+ *
+ * Untyped half of the event bus (see lib_bus.hpp): the list of topics,
+ * subscriber statistics, the stamp clock and the tick source. Counters
+ * written by the publisher and read elsewhere are atomics; the latency
+ * figures are only written by the subscriber's task and may be read
+ * slightly stale.
+ */
+
+#include "lib_bus.hpp"
+
+#if defined(ARDUINO) && __has_include(<esp_timer.h>)
+#include <esp_timer.h>
+#define BUS_ESP_TIMER 1
+#else
+#include <chrono>
+#endif
+
+BusTopicBase* BusTopicBase::first_ = nullptr;
+
+uint32_t busNowUs(void) {
+#if BUS_ESP_TIMER
+  return (uint32_t)esp_timer_get_time();
+#else
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+/* Subscribers */
+
+BusSubscriberBase::BusSubscriberBase(const char* name, uint16_t capacity)
+    : name_(name),
+      capacity_(capacity),
+      next_(nullptr),
+      accepted_(0),
+      dropped_(0),
+      received_(0),
+      latencySumUs_(0),
+      latencyMaxUs_(0) {}
+
+const char* BusSubscriberBase::name() const {
+  return name_;
+}
+
+const BusSubscriberBase* BusSubscriberBase::next() const {
+  return next_;
+}
+
+void BusSubscriberBase::noteReceived(uint32_t stampUs) {
+  uint32_t us = busNowUs() - stampUs;
+  latencySumUs_ += us;
+  if (us > latencyMaxUs_) latencyMaxUs_ = us;
+  received_.store(received_.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+}
+
+void BusSubscriberBase::stats(BusSubscriberStats* out) const {
+  uint32_t received = received_.load(std::memory_order_relaxed);
+  uint32_t accepted = accepted_.load(std::memory_order_relaxed);
+  out->received     = received;
+  out->dropped      = dropped_.load(std::memory_order_relaxed);
+  out->pending      = (uint16_t)(accepted - received);
+  out->capacity     = capacity_;
+  out->latencyAvgUs = received ? (uint32_t)(latencySumUs_ / received) : 0;
+  out->latencyMaxUs = latencyMaxUs_;
+}
+
+/* Topics */
+
+BusTopicBase::BusTopicBase(const char* name)
+    : subs_(nullptr), name_(name), next_(nullptr), published_(0) {
+  // constructed during static initialisation, one at a time
+  BusTopicBase** tail = &first_;
+  while (*tail) tail = &(*tail)->next_;
+  *tail = this;
+}
+
+const char* BusTopicBase::name() const {
+  return name_;
+}
+
+uint32_t BusTopicBase::published() const {
+  return published_.load(std::memory_order_relaxed);
+}
+
+const BusSubscriberBase* BusTopicBase::subscribers() const {
+  return subs_;
+}
+
+const BusTopicBase* BusTopicBase::next() const {
+  return next_;
+}
+
+const BusTopicBase* BusTopicBase::first() {
+  return first_;
+}
+
+bool BusTopicBase::add(BusSubscriberBase* sub) {
+  BusSubscriberBase** tail = &subs_;
+  while (*tail) {
+    if (*tail == sub) return false;
+    tail = &(*tail)->next_;
+  }
+  *tail = sub;
+  return true;
+}
+
+void BusTopicBase::notePublished() {
+  published_.store(published_.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+}
+
+void BusTopicBase::noteDelivered(BusSubscriberBase* sub, bool ok) {
+  std::atomic<uint32_t>& n = ok ? sub->accepted_ : sub->dropped_;
+  n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+BusSubscriberBase* BusTopicBase::nextOf(BusSubscriberBase* sub) {
+  return sub->next_;
+}
+
+/* Ticks */
+
+BusTopic<BusTick> tickBus("ticks");
+
+#if BUS_ESP_TIMER
+static esp_timer_handle_t tickTimer = nullptr;
+static uint32_t           tickSeq   = 0;
+
+static void onTick(void* arg) {
+  (void)arg;
+  BusTick tick;
+  tick.seq = ++tickSeq;
+  tickBus.publish(tick);
+}
+
+bool busTickStart(uint32_t periodMs) {
+  if (!tickTimer) {
+    esp_timer_create_args_t args = {};
+    args.callback                = onTick;
+    args.dispatch_method         = ESP_TIMER_TASK;
+    args.name                    = "bus_tick";
+    args.skip_unhandled_events   = true;
+    if (esp_timer_create(&args, &tickTimer) != ESP_OK) return false;
+  } else {
+    esp_timer_stop(tickTimer);
+  }
+  return esp_timer_start_periodic(tickTimer, (uint64_t)periodMs * 1000) ==
+         ESP_OK;
+}
+
+#else
+
+bool busTickStart(uint32_t periodMs) {
+  (void)periodMs;
+  return false;
+}
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef LIB_BUS_HPP
+#define LIB_BUS_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#include "lib_event.hpp"
+
+/*
+ * lib_bus - header
+ *
+ * Typed publish/subscribe between subsystems, without heap or locks. A
+ * topic carries one message type, checked at compile time; each subscriber
+ * owns a fixed-capacity queue (lib_event) that publish() copies the message
+ * into, stamped with the publish time. A full queue loses the message for
+ * that subscriber only and counts it; poll() measures how long it waited.
+ *
+ * Every queue stays single-producer / single-consumer: a topic has one
+ * publishing task (or ISR), a subscriber is polled by one task. Topics are
+ * defined at namespace scope by the library that publishes them and list
+ * themselves for the statistics; subscribe from setup(), before the
+ * publisher runs. A subscriber belongs to one topic.
+ *
+ *   BusTopic<ButtonEvent> buttonBus("buttons");          // publisher's lib
+ *   static BusSubscriber<ButtonEvent, 16> sub("main");   // subscriber
+ *   buttonBus.subscribe(sub);                            // setup()
+ *   buttonBus.publish(ev);                               // publisher task
+ *   while (sub.poll(&ev)) ...                            // subscriber task
+ */
+
+/* Microsecond clock of the stamps (esp_timer on the pedal). */
+uint32_t busNowUs(void);
+
+struct BusSubscriberStats {
+  uint32_t received;      // messages polled
+  uint32_t dropped;       // lost to a full queue
+  uint16_t pending;       // queued, not polled yet
+  uint16_t capacity;
+  uint32_t latencyAvgUs;  // publish() to poll()
+  uint32_t latencyMaxUs;
+};
+
+/* What every subscriber has, whatever it receives: name, place in its
+ * topic's list and statistics. */
+class BusSubscriberBase {
+ public:
+  const char*              name() const;
+  const BusSubscriberBase* next() const;
+  void                     stats(BusSubscriberStats* out) const;
+
+ protected:
+  BusSubscriberBase(const char* name, uint16_t capacity);
+  // subscriber side, for each message polled
+  void noteReceived(uint32_t stampUs);
+
+ private:
+  friend class BusTopicBase;
+
+  const char*           name_;
+  uint16_t              capacity_;
+  BusSubscriberBase*    next_;
+  std::atomic<uint32_t> accepted_;  // publisher side
+  std::atomic<uint32_t> dropped_;
+  std::atomic<uint32_t> received_;  // subscriber side
+  uint64_t              latencySumUs_;
+  uint32_t              latencyMaxUs_;
+};
+
+/* What every topic has: name, subscribers and the list of all topics. */
+class BusTopicBase {
+ public:
+  const char*              name() const;
+  uint32_t                 published() const;
+  const BusSubscriberBase* subscribers() const;
+  const BusTopicBase*      next() const;
+
+  // all topics, in the order they were constructed
+  static const BusTopicBase* first();
+
+ protected:
+  explicit BusTopicBase(const char* name);
+  bool add(BusSubscriberBase* sub);
+  void notePublished();
+  static void               noteDelivered(BusSubscriberBase* sub, bool ok);
+  static BusSubscriberBase* nextOf(BusSubscriberBase* sub);
+
+  BusSubscriberBase* subs_;
+
+ private:
+  const char*           name_;
+  BusTopicBase*         next_;
+  std::atomic<uint32_t> published_;
+
+  static BusTopicBase* first_;
+};
+
+template <typename T>
+struct BusMsg {
+  T        data;
+  uint32_t us;  // busNowUs() at publish()
+};
+
+/* A subscriber as its topic sees it: somewhere to push a T. */
+template <typename T>
+class BusSink : public BusSubscriberBase {
+ public:
+  typedef bool (*PushFn)(BusSink* self, const BusMsg<T>& msg);
+
+ protected:
+  BusSink(const char* name, uint16_t capacity, PushFn push)
+      : BusSubscriberBase(name, capacity), push_(push) {}
+
+ private:
+  template <typename>
+  friend class BusTopic;
+
+  PushFn push_;
+};
+
+template <typename T>
+class BusTopic : public BusTopicBase {
+ public:
+  explicit BusTopic(const char* name) : BusTopicBase(name) {}
+
+  // false if sub is already subscribed
+  bool subscribe(BusSink<T>& sub) {
+    return add(&sub);
+  }
+
+  // publisher side: copy data to every subscriber. Returns how many took it.
+  uint8_t publish(const T& data) {
+    BusMsg<T> msg;
+    msg.data  = data;
+    msg.us    = busNowUs();
+    uint8_t n = 0;
+    for (BusSubscriberBase* s = subs_; s; s = nextOf(s)) {
+      BusSink<T>* sink = static_cast<BusSink<T>*>(s);
+      bool        ok   = sink->push_(sink, msg);
+      noteDelivered(s, ok);
+      if (ok) ++n;
+    }
+    notePublished();
+    return n;
+  }
+};
+
+template <typename T, uint16_t N>
+class BusSubscriber : public BusSink<T> {
+ public:
+  explicit BusSubscriber(const char* name) : BusSink<T>(name, N, push) {}
+
+  // subscriber side: oldest message, false when none is pending
+  bool poll(T* out) {
+    BusMsg<T> msg;
+    if (!queue_.pop(&msg)) return false;
+    this->noteReceived(msg.us);
+    *out = msg.data;
+    return true;
+  }
+
+ private:
+  static bool push(BusSink<T>* self, const BusMsg<T>& msg) {
+    return static_cast<BusSubscriber*>(self)->queue_.push(msg);
+  }
+
+  EventQueue<BusMsg<T>, N> queue_;
+};
+
+/* Timer events: a periodic esp_timer publishes a BusTick from the timer
+ * task once busTickStart() ran. */
+struct BusTick {
+  uint32_t seq;
+};
+
+extern BusTopic<BusTick> tickBus;
+
+/* Start the ticks every periodMs. False without esp_timer (host). */
+bool busTickStart(uint32_t periodMs);
+
+#endif  // LIB_BUS_HPP
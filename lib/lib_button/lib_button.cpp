@@ -11,16 +11,39 @@
  * support them and set a lightweight ISR flag when a pin-change occurs.
  * updateButtons() will then read pin states and run the usual logic.
  *
- * For non-AVR platforms or pins without PCINT support the library falls
+ * On the ESP32 each pin gets an any-edge GPIO interrupt the same way: the
+ * ISR queues the edge with its cycle count, and updateButtons() reads the
+ * pins only when edges are queued. Built with INPUT_IRAM
+ * (lib_event.hpp) the ISR is registered as IRAM-safe and, with the
+ * debounce core, placed in IRAM, so edges are still taken while flash is
+ * written. If an interrupt cannot be registered the pins are polled.
+ *
+ * For other platforms or pins without PCINT support the library falls
  * back to polling (reads every updateButtons()).
+ *
+ * Debounce windows, long presses and double-click windows are timers on
+ * the shared wheel (lib_timer), three per button: updateButtons() only
+ * compares the pins with their last reading and (re)arms the debounce
+ * timer of those that changed; nothing is rescanned for timeouts.
  */
 
 #include "lib_button.hpp"
+#include "lib_timer.hpp"
 
 #include <Arduino.h>
 
 #if defined(__AVR__)
 #include <avr/interrupt.h>
+#elif defined(ARDUINO_ARCH_ESP32) && __has_include(<hal/cpu_hal.h>)
+#include <driver/gpio.h>
+#include <hal/cpu_hal.h>
+#define BUTTON_GPIO_ISR 1
+#endif
+
+#if BUTTON_GPIO_ISR && defined(INPUT_IRAM)
+static const int kIsrFlags = ESP_INTR_FLAG_IRAM;
+#elif BUTTON_GPIO_ISR
+static const int kIsrFlags = 0;  // deferred while flash is written
 #endif
 
 static const uint8_t MAX_BUTTONS = 16;
@@ -34,9 +57,13 @@ static uint8_t btnCount = 0;
 static uint8_t btnPins[MAX_BUTTONS];
 
 // State arrays
-static bool          lastRawState[MAX_BUTTONS];
-static bool          stableState[MAX_BUTTONS];
-static unsigned long lastDebounceTime[MAX_BUTTONS];
+static bool lastRawState[MAX_BUTTONS];
+static bool stableState[MAX_BUTTONS];
+
+// Timers: debounce window, long press, double-click window
+static WheelTimer debounceTimer[MAX_BUTTONS];
+static WheelTimer longTimer[MAX_BUTTONS];
+static WheelTimer clickTimer[MAX_BUTTONS];
 
 // Event flags (set in update(), cleared when read)
 static bool evtPressed[MAX_BUTTONS];
@@ -44,10 +71,11 @@ static bool evtReleased[MAX_BUTTONS];
 static bool evtLongPress[MAX_BUTTONS];
 static bool evtDoubleClick[MAX_BUTTONS];
 
-static unsigned long lastChangeTime[MAX_BUTTONS];
-static unsigned long lastPressMillis[MAX_BUTTONS];
-static uint8_t       clickCount[MAX_BUTTONS];
-static bool          longReported[MAX_BUTTONS];
+// Optional all-at-once reader (see setButtonReader())
+static ButtonReadFn buttonReader = nullptr;
+
+// Ordered events, one queue per subscriber
+BusTopic<ButtonEvent> buttonBus("buttons");
 
 // Interrupt support bookkeeping (AVR)
 #if defined(__AVR__)
@@ -56,10 +84,81 @@ static volatile bool anyPinChange = false;  // set by ISR(s)
 static volatile uint8_t* pinInputReg[MAX_BUTTONS];
 static uint8_t           pinBitMask[MAX_BUTTONS];
 static bool              hasPCINT[MAX_BUTTONS];
+#elif BUTTON_GPIO_ISR
+static EventQueue<ButtonEdge, 64> edgeQueue;  // onPinEdge() -> loop
+static volatile uint32_t          isrEdges  = 0;
+static bool                       isrActive = false;
 #else
 // Non-AVR: always poll
 #endif
 
+static INPUT_IRAM_ATTR void publishEvent(uint8_t idx,
+                                         ButtonEventType type) {
+  ButtonEvent ev;
+  ev.button = idx;
+  ev.type   = type;
+  ev.us     = micros();
+  buttonBus.publish(ev);
+}
+
+/*
+ * Timer callbacks; arg is the button index.
+ */
+
+// The raw state held for debounceDelay: commit it
+static INPUT_IRAM_ATTR void onDebounce(void* arg) {
+  uint8_t i = (uint8_t)(uintptr_t)arg;
+  if (stableState[i] == lastRawState[i]) return;  // bounced back
+  stableState[i]    = lastRawState[i];
+  unsigned long now = millis();
+
+  if (stableState[i]) {
+    // Pressed
+    evtPressed[i] = true;
+    publishEvent(i, BUTTON_EVENT_PRESSED);
+    timerArmAt(longTimer[i], now + longPressTime);
+
+    // Double-click handling: a press inside the window of the last one
+    if (clickTimer[i].armed()) {
+      timerCancel(clickTimer[i]);
+      evtDoubleClick[i] = true;
+      publishEvent(i, BUTTON_EVENT_DOUBLE_CLICK);
+    } else {
+      timerArmAt(clickTimer[i], now + doubleClickTime + 1);
+    }
+  } else {
+    // Released
+    evtReleased[i] = true;
+    publishEvent(i, BUTTON_EVENT_RELEASED);
+    timerCancel(longTimer[i]);
+  }
+}
+
+// Held for longPressTime
+static INPUT_IRAM_ATTR void onLongPress(void* arg) {
+  uint8_t i       = (uint8_t)(uintptr_t)arg;
+  evtLongPress[i] = true;
+  publishEvent(i, BUTTON_EVENT_LONG_PRESS);
+  // on long-press, clear click counting to avoid accidental double-clicks
+  timerCancel(clickTimer[i]);
+}
+
+// No second press in time: the window closing is all there is to it
+static void onClickWindow(void* arg) {
+  (void)arg;
+}
+
+#if BUTTON_GPIO_ISR
+// GPIO interrupt, any edge on a button pin: queue it for updateButtons()
+static INPUT_IRAM_ATTR void onPinEdge(void* arg) {
+  ButtonEdge e;
+  e.cycles = cpu_hal_get_cycle_count();
+  e.button = (uint8_t)(uintptr_t)arg;
+  edgeQueue.push(e);
+  isrEdges = isrEdges + 1;
+}
+#endif
+
 /*
  * Initialize buttons.
  * pins: array of input pin numbers
@@ -80,6 +179,17 @@ void initButtons(const uint8_t* pins, const uint8_t count, bool usePullup) {
 #endif
 
   unsigned long now = millis();
+#if BUTTON_GPIO_ISR
+  bool isrOk = true;
+  isrActive  = false;
+#endif
+
+  // timers left from an earlier initButtons()
+  for (uint8_t i = 0; i < MAX_BUTTONS; ++i) {
+    timerCancel(debounceTimer[i]);
+    timerCancel(longTimer[i]);
+    timerCancel(clickTimer[i]);
+  }
 
   for (uint8_t i = 0; i < btnCount; ++i) {
     btnPins[i] = pins[i];
@@ -122,20 +232,35 @@ void initButtons(const uint8_t* pins, const uint8_t count, bool usePullup) {
     hasPCINT[i] = false;
 #endif
 
+#elif BUTTON_GPIO_ISR
+    // Already installed (ESP_ERR_INVALID_STATE) keeps the first flags
+    gpio_num_t pin = (gpio_num_t)btnPins[i];
+    esp_err_t  err = gpio_install_isr_service(kIsrFlags);
+    if (err == ESP_OK || err == ESP_ERR_INVALID_STATE) {
+      gpio_isr_handler_remove(pin);
+      err = gpio_set_intr_type(pin, GPIO_INTR_ANYEDGE);
+    }
+    if (err == ESP_OK) {
+      err = gpio_isr_handler_add(pin, onPinEdge, (void*)(uintptr_t)i);
+    }
+    if (err == ESP_OK) err = gpio_intr_enable(pin);
+    if (err != ESP_OK) isrOk = false;
 #else
     // Non-AVR: nothing special
 #endif
 
     bool raw = digitalRead(btnPins[i]) == LOW;  // active-low -> pressed = true
-    lastRawState[i]     = raw;
-    stableState[i]      = raw;
-    lastDebounceTime[i] = now;
-    lastChangeTime[i]   = now;
-    lastPressMillis[i]  = 0;
-    clickCount[i]       = 0;
+    lastRawState[i] = raw;
+    stableState[i]  = raw;
     evtPressed[i] = evtReleased[i] = evtLongPress[i] = evtDoubleClick[i] =
         false;
-    longReported[i] = false;
+
+    void* arg = (void*)(uintptr_t)i;
+    debounceTimer[i].set(onDebounce, arg);
+    longTimer[i].set(onLongPress, arg);
+    clickTimer[i].set(onClickWindow, arg);
+    // held at start: long press as if just pressed
+    if (raw) timerArmAt(longTimer[i], now + longPressTime);
   }
 
 #if defined(__AVR__)
@@ -147,12 +272,19 @@ void initButtons(const uint8_t* pins, const uint8_t count, bool usePullup) {
 
   // if any PCINT was enabled, clear the ISR flag initially
   anyPinChange = false;
+#elif BUTTON_GPIO_ISR
+  edgeQueue.clear();
+  isrActive = isrOk;
 #endif
 }
 
 /*
  * Configure timing parameters (milliseconds).
  */
+void setButtonReader(ButtonReadFn fn) {
+  buttonReader = fn;
+}
+
 void setButtonDebounceTimeMs(uint16_t ms) {
   debounceDelay = ms;
 }
@@ -168,9 +300,10 @@ void setButtonDoubleClickTimeMs(uint16_t ms) {
  * generate events.
  *
  * With AVR+PCINTs: this only re-reads pins when ISR flagged anyPinChange
- * (lightweight). Pins without PCINT support are polled every call.
+ * (lightweight). Pins without PCINT support are polled every call. On the
+ * ESP32 the pins are read when the GPIO ISR queued an edge.
  */
-void updateButtons(volatile bool* sState) {
+INPUT_IRAM_ATTR void updateButtons(void) {
   unsigned long now = millis();
 
 #if defined(__AVR__)
@@ -182,89 +315,55 @@ void updateButtons(volatile bool* sState) {
     // clear the flag as we'll handle reads now
     anyPinChange = false;
   }
+#elif BUTTON_GPIO_ISR
+  // Nothing to read without an edge. The queue is emptied first so an
+  // edge during the reads is seen next time; a full queue still reads.
+  bool       doRead = !isrActive;
+  ButtonEdge edge;
+  while (edgeQueue.pop(&edge)) doRead = true;
+  if (!doRead) {
+    timersRun();
+    return;
+  }
 #else
   // Non-AVR: always read
   bool doRead = true;
 #endif
 
+  // One register read for all buttons when the board supplies a reader
+  uint32_t down = buttonReader ? buttonReader() : 0;
+
   for (uint8_t i = 0; i < btnCount; ++i) {
     bool raw;
-#if defined(__AVR__)
-    if (hasPCINT[i]) {
-      // Only read when ISR has signaled something; otherwise skip to save
-      // cycles
-      if (!doRead) continue;
-      // Direct fast read using PINx register pointer and bitmask
-      raw = ((*pinInputReg[i] & pinBitMask[i]) ==
-             0);  // active-low -> pressed true
+    if (buttonReader) {
+      raw = (down >> i) & 1;
     } else {
-      // No PCINT for this pin: poll always
-      raw = digitalRead(btnPins[i]) == LOW;
-    }
+#if defined(__AVR__)
+      if (hasPCINT[i]) {
+        // Only read when ISR has signaled something; otherwise skip to save
+        // cycles
+        if (!doRead) continue;
+        // Direct fast read using PINx register pointer and bitmask
+        raw = ((*pinInputReg[i] & pinBitMask[i]) ==
+               0);  // active-low -> pressed true
+      } else {
+        // No PCINT for this pin: poll always
+        raw = digitalRead(btnPins[i]) == LOW;
+      }
 #else
-    raw = digitalRead(btnPins[i]) == LOW;
+      raw = digitalRead(btnPins[i]) == LOW;
 #endif
-
-    // If raw changed, start debounce timer
-    if (raw != lastRawState[i]) {
-      lastDebounceTime[i] = now;
-      lastRawState[i]     = raw;
-    }
-
-    // If the raw state has been stable for debounceDelay, consider it the
-    // stable state.
-    if ((now - lastDebounceTime[i]) >= debounceDelay) {
-      if (stableState[i] != raw) {
-        // State changed (debounced)
-        stableState[i]    = raw;
-        lastChangeTime[i] = now;
-        longReported[i]   = false;
-
-        if (stableState[i]) {
-          // Pressed
-          evtPressed[i] = true;
-
-          // Double-click handling: count presses
-          if ((now - lastPressMillis[i]) <= doubleClickTime) {
-            ++clickCount[i];
-          } else {
-            clickCount[i] = 1;
-          }
-          lastPressMillis[i] = now;
-
-          if (clickCount[i] == 2) {
-            evtDoubleClick[i]  = true;
-            clickCount[i]      = 0;
-            lastPressMillis[i] = 0;
-          }
-        } else {
-          // Released
-          evtReleased[i] = true;
-          // release handling left as before
-        }
-      }
-    }
-
-    // Long press detection: if button has been held long enough and not yet
-    // reported
-    if (stableState[i] && !longReported[i]) {
-      if ((now - lastChangeTime[i]) >= longPressTime) {
-        evtLongPress[i] = true;
-        longReported[i] = true;
-        // on long-press, clear click counting to avoid accidental double-clicks
-        clickCount[i]      = 0;
-        lastPressMillis[i] = 0;
-      }
     }
 
-    // Timeout double-click window: if waiting for second click and time
-    // exceeded, reset counter
-    if (clickCount[i] == 1 && ((now - lastPressMillis[i]) > doubleClickTime)) {
-      clickCount[i]      = 0;
-      lastPressMillis[i] = 0;
+    // If raw changed, (re)start the debounce window
+    if (raw != lastRawState[i]) {
+      lastRawState[i] = raw;
+      timerArmAt(debounceTimer[i], now + debounceDelay);
     }
-    sState[i] = checkIfButtonDown(i);
   }
+
+  // Debounced edges, long presses and double-click windows due by now
+  timersRun();
 }
 
 /*
@@ -306,7 +405,8 @@ bool checkIfButtonWasDoubleClicked(uint8_t idx) {
 }
 
 /*
- * Convenience: clear all pending events.
+ * Convenience: clear all pending "was" flags. Events already published stay
+ * with their subscribers.
  */
 void clearAllButtonEvents() {
   for (uint8_t i = 0; i < btnCount; ++i) {
@@ -315,6 +415,27 @@ void clearAllButtonEvents() {
   }
 }
 
+bool pollButtonEdge(ButtonEdge* out) {
+#if BUTTON_GPIO_ISR
+  return edgeQueue.pop(out);
+#else
+  (void)out;
+  return false;
+#endif
+}
+
+void buttonGetIsrStats(ButtonIsrStats* out) {
+#if BUTTON_GPIO_ISR
+  out->active  = isrActive;
+  out->edges   = isrEdges;
+  out->dropped = edgeQueue.dropped();
+#else
+  out->active  = false;
+  out->edges   = 0;
+  out->dropped = 0;
+#endif
+}
+
 /*
  * Optional: return number of configured buttons.
  */
@@ -5,13 +5,32 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "lib_bus.hpp"
+
 /*
  * lib_button - header
  *
- * Debounced button handling with optional AVR pin-change interrupt support.
- * See lib_button.cpp for implementation details.
+ * Debounced button handling with optional AVR pin-change and ESP32 GPIO
+ * interrupt support. See lib_button.cpp for implementation details.
  */
 
+/* Button events, published on buttonBus in the order they were detected. */
+enum ButtonEventType : uint8_t {
+  BUTTON_EVENT_PRESSED = 0,
+  BUTTON_EVENT_RELEASED,
+  BUTTON_EVENT_LONG_PRESS,
+  BUTTON_EVENT_DOUBLE_CLICK
+};
+
+struct ButtonEvent {
+  uint8_t  button;  // index as passed to initButtons()
+  uint8_t  type;    // ButtonEventType
+  uint32_t us;      // micros() when the event was detected
+};
+
+/* Published by updateButtons(), from the task that calls it. */
+extern BusTopic<ButtonEvent> buttonBus;
+
 /* Initialize buttons.
  * pins: pointer to array of Arduino digital pin numbers.
  * count: number of pins (max handled by implementation).
@@ -19,28 +38,53 @@
  */
 void initButtons(const uint8_t* pins, const uint8_t count, bool usePullup);
 
+/* Read all buttons at once instead of one digitalRead() per pin: returns
+ * bit i set while button i is pressed (raw, before debouncing), e.g.
+ * boardButtonsDown<Board> from lib_board. nullptr restores per-pin reads. */
+typedef uint32_t (*ButtonReadFn)(void);
+void setButtonReader(ButtonReadFn fn);
+
 /* Configure timing (milliseconds) */
 void setButtonDebounceTimeMs(uint16_t ms);
 void setButtonLongPressTimeMs(uint16_t ms);
 void setButtonDoubleClickTimeMs(uint16_t ms);
 
 /* Must be called regularly (e.g. inside loop()) to update state and generate
- * events. */
-void updateButtons(volatile bool* sState);
+ * events. Runs the lib_timer timers due, the buttons' among them. */
+void updateButtons(void);
 
 /* Query functions */
 /* Return debounced current state (true = pressed). Does not clear events. */
 bool checkIfButtonDown(uint8_t idx);
 
-/* "Was" helpers return true once and clear the corresponding event flag. */
+/* "Was" helpers return true once and clear the corresponding event flag.
+ * They are set alongside the events on buttonBus; use either. */
 bool checkIfButtonWasPressed(uint8_t idx);
 bool checkIfButtonWasReleased(uint8_t idx);
 bool checkIfButtonWasLongPressed(uint8_t idx);
 bool checkIfButtonWasDoubleClicked(uint8_t idx);
 
-/* Clear all pending events. */
+/* Clear all pending "was" flags. */
 void clearAllButtonEvents(void);
 
+/* Edge interrupts (ESP32). The ISR queues each edge it takes, stamped
+ * with the CPU cycle count on entry; updateButtons() consumes them. */
+struct ButtonEdge {
+  uint8_t  button;
+  uint32_t cycles;
+};
+
+struct ButtonIsrStats {
+  bool     active;   // false: pins polled on every updateButtons()
+  uint32_t edges;    // ISR runs
+  uint32_t dropped;  // edges lost to a full queue (pins read anyway)
+};
+void buttonGetIsrStats(ButtonIsrStats* out);
+
+/* Take the oldest queued edge instead of updateButtons(), for latency
+ * measurements (test/IsrLatency). False when none is queued. */
+bool pollButtonEdge(ButtonEdge* out);
+
 /* Return number of configured buttons. */
 uint8_t countButtons(void);
 
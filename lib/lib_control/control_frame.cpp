@@ -0,0 +1,117 @@
+/*
+ * control_frame.cpp
+ *
+ * COBS framing and CRC-16 of the control protocol (see control_frame.hpp).
+ * Bitwise CRC: frames are a few dozen bytes, not worth a 512-byte table.
+ */
+
+#include "control_frame.hpp"
+
+uint16_t controlCrc16(const uint8_t* data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; ++i) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; ++bit) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021)
+                           : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+size_t controlEncodeFrame(const uint8_t* payload, size_t len, uint8_t* out) {
+  if (len == 0 || len > CONTROL_MAX_PAYLOAD) return 0;
+
+  uint16_t crc = controlCrc16(payload, len);
+  size_t   n   = 0;
+  out[n++]     = 0x00;
+
+  // COBS: each code byte gives the distance to the next zero (or block end)
+  size_t  codePos = n++;
+  uint8_t code    = 1;
+  for (size_t i = 0; i < len + 2; ++i) {
+    uint8_t b = i < len ? payload[i] : (uint8_t)(i == len ? crc : crc >> 8);
+    if (b == 0) {
+      out[codePos] = code;
+      codePos      = n++;
+      code         = 1;
+    } else {
+      out[n++] = b;
+      ++code;
+    }
+  }
+  out[codePos] = code;
+  out[n++]     = 0x00;
+  return n;
+}
+
+size_t controlDecodeFrame(const uint8_t* in, size_t len, uint8_t* out) {
+  uint8_t buf[CONTROL_MAX_PAYLOAD + 2];
+  size_t  n = 0;
+  size_t  i = 0;
+  while (i < len) {
+    uint8_t code = in[i++];
+    if (code == 0 || i + code - 1 > len) return 0;
+    for (uint8_t k = 1; k < code; ++k) {
+      if (n >= sizeof(buf)) return 0;
+      buf[n++] = in[i++];
+    }
+    // a code below 0xFF stands for a zero, except at the end of the frame
+    if (code < 0xFF && i < len) {
+      if (n >= sizeof(buf)) return 0;
+      buf[n++] = 0;
+    }
+  }
+  if (n < 3) return 0;
+
+  size_t   payloadLen = n - 2;
+  uint16_t crc        = buf[payloadLen] | ((uint16_t)buf[payloadLen + 1] << 8);
+  if (crc != controlCrc16(buf, payloadLen)) return 0;
+  for (size_t k = 0; k < payloadLen; ++k) out[k] = buf[k];
+  return payloadLen;
+}
+
+ControlFrameParser::ControlFrameParser()
+    : pos_(0), length_(0), overflow_(false), errors_(0) {}
+
+bool ControlFrameParser::feed(uint8_t b) {
+  if (b != 0) {
+    if (pos_ < sizeof(buf_)) {
+      buf_[pos_++] = b;
+    } else {
+      overflow_ = true;
+    }
+    return false;
+  }
+
+  // delimiter: empty chunks are the gap between two frames
+  size_t n  = pos_;
+  bool   ov = overflow_;
+  pos_      = 0;
+  overflow_ = false;
+  if (n == 0) return false;
+
+  length_ = ov ? 0 : controlDecodeFrame(buf_, n, payload_);
+  if (length_ == 0) {
+    ++errors_;
+    return false;
+  }
+  return true;
+}
+
+const uint8_t* ControlFrameParser::payload() const {
+  return payload_;
+}
+
+size_t ControlFrameParser::length() const {
+  return length_;
+}
+
+uint32_t ControlFrameParser::errors() const {
+  return errors_;
+}
+
+void ControlFrameParser::reset() {
+  pos_      = 0;
+  overflow_ = false;
+}
@@ -0,0 +1,65 @@
+#ifndef CONTROL_FRAME_HPP
+#define CONTROL_FRAME_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * control_frame - header
+ *
+ * Framing of the binary control protocol (see lib_control.hpp):
+ *
+ *   00  COBS(payload, CRC_L, CRC_H)  00
+ *
+ * COBS (Consistent Overhead Byte Stuffing) removes every zero byte from
+ * the frame, so 0x00 only ever appears as the delimiter and a receiver
+ * resynchronizes at the next one whatever it missed. The CRC is
+ * CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) of the payload, little
+ * endian. The leading delimiter ends any console text written before the
+ * frame, so text and frames can share one serial port: chunks between two
+ * zeros that fail the CRC are text.
+ *
+ * No Arduino dependencies: shared by host builds and the target.
+ */
+
+#define CONTROL_MAX_PAYLOAD 48
+// payload + CRC + one COBS code byte (enough up to 254 bytes) + delimiters
+#define CONTROL_MAX_FRAME (CONTROL_MAX_PAYLOAD + 2 + 1 + 2)
+
+uint16_t controlCrc16(const uint8_t* data, size_t len);
+
+/* Encode payload into out[CONTROL_MAX_FRAME]. Returns the frame length
+ * including both delimiters, 0 if len is 0 or above CONTROL_MAX_PAYLOAD. */
+size_t controlEncodeFrame(const uint8_t* payload, size_t len, uint8_t* out);
+
+/* Decode the bytes between two delimiters (COBS data, no zeros) into
+ * out[CONTROL_MAX_PAYLOAD]. Returns the payload length, 0 on bad stuffing,
+ * size or CRC. */
+size_t controlDecodeFrame(const uint8_t* in, size_t len, uint8_t* out);
+
+/* Streaming decoder: feed bytes as they arrive. */
+class ControlFrameParser {
+ public:
+  ControlFrameParser();
+
+  // returns true when b completed a valid frame (available via payload())
+  bool feed(uint8_t b);
+
+  const uint8_t* payload() const;
+  size_t         length() const;
+
+  // frames dropped for bad stuffing, size or CRC since construction
+  uint32_t errors() const;
+
+  void reset();
+
+ private:
+  uint8_t  buf_[CONTROL_MAX_FRAME];
+  uint8_t  payload_[CONTROL_MAX_PAYLOAD];
+  size_t   pos_;
+  size_t   length_;
+  bool     overflow_;
+  uint32_t errors_;
+};
+
+#endif  // CONTROL_FRAME_HPP
@@ -0,0 +1,204 @@
+/*
+ * lib_control.cpp
+ *
+ * Binary control and telemetry link for DaveSampleKontrol (see
+ * lib_control.hpp for the message list).
+ *
+ * Runs in loop(): controlPoll() drains the port's RX buffer through the
+ * frame parser, the send functions encode into a stack buffer and write
+ * the whole frame at once, or not at all when the TX buffer lacks room.
+ * A frame is never split, so console text written by other code can only
+ * land between frames, where the host sees it as text.
+ */
+
+#include "lib_control.hpp"
+#include "control_frame.hpp"
+#include "net_bytes.hpp"
+
+#include <Arduino.h>
+#include <string.h>
+
+static Stream*            port = nullptr;
+static ControlFrameParser parser;
+
+static uint8_t       txSeq        = 0;
+static unsigned long lastHostMs   = 0;
+static bool          hostSeen     = false;
+static uint16_t      statusPeriod = 0;
+static unsigned long lastStatusMs = 0;
+static uint32_t      loopUsMax    = 0;
+static uint8_t       infoButtons  = 0;
+static uint8_t       infoPlayers  = 0;
+static uint8_t       infoScenes   = 0;
+static const char*   infoName     = "";
+
+static uint32_t rxFrames  = 0;
+static uint32_t txFrames  = 0;
+static uint32_t txBytes   = 0;
+static uint32_t txDropped = 0;
+
+static void sendFrame(uint8_t* payload, size_t len) {
+  if (!port) return;
+  uint8_t frame[CONTROL_MAX_FRAME];
+  payload[1] = txSeq;
+  size_t n   = controlEncodeFrame(payload, len, frame);
+  if (n == 0) return;
+  if ((size_t)port->availableForWrite() < n) {
+    ++txDropped;
+    return;
+  }
+  port->write(frame, n);
+  ++txSeq;
+  ++txFrames;
+  txBytes += n;
+}
+
+void controlInit(Stream& stream) {
+  port = &stream;
+  parser.reset();
+}
+
+void controlSetInfo(uint8_t buttons, uint8_t players, uint8_t scenes,
+                    const char* name) {
+  infoButtons = buttons;
+  infoPlayers = players;
+  infoScenes  = scenes;
+  infoName    = name ? name : "";
+}
+
+// Arguments by type; returns false if the length does not match
+static bool decodeCommand(const uint8_t* p, size_t len, ControlCommand* out) {
+  out->type  = p[0];
+  out->seq   = p[1];
+  out->arg8  = 0;
+  out->arg16 = 0;
+  switch (p[0]) {
+    case CONTROL_HELLO:
+      return len == 2;
+    case CONTROL_TELEMETRY:
+      if (len != 4) return false;
+      out->arg16 = leGet16(p + 2);
+      return true;
+    case CONTROL_BUTTON:
+    case CONTROL_ACTION:
+    case CONTROL_SCENE:
+      if (len != 3) return false;
+      out->arg8 = p[2];
+      return true;
+    case CONTROL_PLAY:
+      if (len != 5) return false;
+      out->arg8  = p[2];
+      out->arg16 = leGet16(p + 3);
+      return true;
+    case CONTROL_VOLUME:
+      if (len != 4) return false;
+      out->arg8  = p[2];
+      out->arg16 = p[3];
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool knownCommand(uint8_t type) {
+  return type == CONTROL_HELLO || type == CONTROL_TELEMETRY ||
+         (type >= CONTROL_BUTTON && type <= CONTROL_SCENE);
+}
+
+bool controlPoll(ControlCommand* out) {
+  if (!port) return false;
+  while (port->available() > 0) {
+    int b = port->read();
+    if (b < 0 || !parser.feed((uint8_t)b)) continue;
+
+    const uint8_t* p   = parser.payload();
+    size_t         len = parser.length();
+    if (len < 2) continue;
+    ++rxFrames;
+    lastHostMs = millis();
+    hostSeen   = true;
+
+    if (!decodeCommand(p, len, out)) {
+      ControlCommand bad = {p[0], p[1], 0, 0};
+      controlAck(bad, knownCommand(p[0]) ? CONTROL_ERR_ARGS
+                                         : CONTROL_ERR_UNKNOWN);
+      continue;
+    }
+    if (out->type == CONTROL_TELEMETRY) {
+      statusPeriod = out->arg16;
+      lastStatusMs = lastHostMs - statusPeriod;  // first STATUS right away
+    }
+    return true;
+  }
+  return false;
+}
+
+void controlAck(const ControlCommand& cmd, ControlResult result) {
+  uint8_t ack[5] = {CONTROL_ACK, 0, cmd.type, cmd.seq, result};
+  sendFrame(ack, sizeof(ack));
+  if (cmd.type != CONTROL_HELLO || result != CONTROL_OK) return;
+
+  uint8_t info[CONTROL_MAX_PAYLOAD] = {CONTROL_INFO, 0,
+                                       CONTROL_PROTOCOL_VERSION,
+                                       infoButtons, infoPlayers, infoScenes};
+  size_t  nameLen = strnlen(infoName, CONTROL_MAX_PAYLOAD - 6);
+  memcpy(info + 6, infoName, nameLen);
+  sendFrame(info, 6 + nameLen);
+}
+
+bool controlLinkUp(unsigned long nowMs) {
+  return hostSeen && nowMs - lastHostMs < CONTROL_LINK_TIMEOUT_MS;
+}
+
+bool controlStatusDue(unsigned long nowMs) {
+  return statusPeriod && controlLinkUp(nowMs) &&
+         nowMs - lastStatusMs >= statusPeriod;
+}
+
+void controlSendButton(uint8_t button, uint8_t type, uint32_t us) {
+  if (!controlLinkUp(millis())) return;
+  uint8_t p[8] = {CONTROL_BUTTON_EV, 0, button, type};
+  lePut32(p + 4, us);
+  sendFrame(p, sizeof(p));
+}
+
+void controlSendPlayer(uint8_t player, ControlPlayerState state,
+                       uint16_t track, uint8_t volume) {
+  if (!controlLinkUp(millis())) return;
+  uint8_t p[7] = {CONTROL_PLAYER, 0, player, state};
+  lePut16(p + 4, track);
+  p[6] = volume;
+  sendFrame(p, sizeof(p));
+}
+
+void controlSendStatus(const ControlStatus& s) {
+  unsigned long now = millis();
+  if (!controlLinkUp(now)) return;
+  lastStatusMs = now;
+
+  uint8_t p[25] = {CONTROL_STATUS, 0};
+  lePut32(p + 2, s.uptimeMs);
+  p[6] = s.scene;
+  p[7] = s.buttonsDown;
+  lePut16(p + 8, s.cpuMhz);
+  lePut16(p + 10, s.bpmX100);
+  p[12] = (uint8_t)s.batteryPercent;
+  lePut32(p + 13, s.pressUs);
+  lePut32(p + 17, loopUsMax);
+  lePut32(p + 21, txDropped);
+  sendFrame(p, sizeof(p));
+  loopUsMax = 0;
+}
+
+void controlNoteLoopUs(uint32_t us) {
+  if (us > loopUsMax) loopUsMax = us;
+}
+
+void controlGetStats(ControlStats* out) {
+  out->rxFrames  = rxFrames;
+  out->rxErrors  = parser.errors();
+  out->txFrames  = txFrames;
+  out->txBytes   = txBytes;
+  out->txDropped = txDropped;
+  out->loopUsMax = loopUsMax;
+}
@@ -0,0 +1,139 @@
+#ifndef LIB_CONTROL_HPP
+#define LIB_CONTROL_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+class Stream;
+
+/*
+ * lib_control - header
+ *
+ * Binary control and telemetry protocol on the console port (USB CDC):
+ * COBS frames with a CRC (control_frame.hpp), so a laptop can drive and
+ * monitor the pedal with a few bytes per message instead of HTTP requests.
+ * Console text keeps working on the same port; scripts/pedal_link.py
+ * separates the two.
+ *
+ * Every payload starts with [type, seq]; integers are little endian.
+ * The host's seq comes back in the ACK of its command; the pedal numbers
+ * its own frames so the host can count lost ones.
+ *
+ * Host -> pedal (each answered by ACK [cmd type, cmd seq, ControlResult]):
+ *   HELLO      -                   also answered by INFO; keeps the link up
+ *   TELEMETRY  u16 period_ms       STATUS period, 0 = events only
+ *   BUTTON     u8 button           run the footswitch's current action
+ *   ACTION     u8 action           run an action (application's numbering)
+ *   PLAY       u8 player, u16 track
+ *   VOLUME     u8 player, u8 volume (0..30)
+ *   SCENE      u8 scene
+ *
+ * Pedal -> host, only while the link is up (a HELLO or TELEMETRY within
+ * CONTROL_LINK_TIMEOUT_MS):
+ *   INFO       u8 version, u8 buttons, u8 players, u8 scenes, name...
+ *   BUTTON_EV  u8 button, u8 ButtonEventType, u32 us
+ *   PLAYER     u8 player, u8 ControlPlayerState, u16 track, u8 volume
+ *   STATUS     see controlSendStatus()
+ *
+ * Frames that do not fit in the port's TX buffer are dropped (counted),
+ * never waited for: telemetry must not stall loop().
+ *
+ * Usage in loop():
+ *   ControlCommand cmd;
+ *   while (controlPoll(&cmd)) controlAck(cmd, run(cmd));
+ *   if (controlStatusDue(now)) controlSendStatus(...);
+ */
+
+#define CONTROL_PROTOCOL_VERSION 1
+#define CONTROL_LINK_TIMEOUT_MS  5000
+
+enum ControlType : uint8_t {
+  // host -> pedal
+  CONTROL_HELLO     = 0x01,
+  CONTROL_TELEMETRY = 0x02,
+  CONTROL_BUTTON    = 0x10,
+  CONTROL_ACTION    = 0x11,
+  CONTROL_PLAY      = 0x12,
+  CONTROL_VOLUME    = 0x13,
+  CONTROL_SCENE     = 0x14,
+  // pedal -> host
+  CONTROL_ACK       = 0x80,
+  CONTROL_INFO      = 0x81,
+  CONTROL_BUTTON_EV = 0x90,
+  CONTROL_PLAYER    = 0x91,
+  CONTROL_STATUS    = 0x92
+};
+
+enum ControlResult : uint8_t {
+  CONTROL_OK = 0,
+  CONTROL_ERR_UNKNOWN,  // type not supported
+  CONTROL_ERR_ARGS,     // wrong length or value out of range
+  CONTROL_ERR_FAILED    // valid, but the device did not do it
+};
+
+enum ControlPlayerState : uint8_t {
+  CONTROL_PLAYER_OFFLINE = 0,
+  CONTROL_PLAYER_STOPPED,
+  CONTROL_PLAYER_PLAYING,
+  CONTROL_PLAYER_PAUSED
+};
+
+/* A command from the host, arguments decoded by type. */
+struct ControlCommand {
+  uint8_t  type;   // ControlType
+  uint8_t  seq;
+  uint8_t  arg8;   // button, action, player or scene
+  uint16_t arg16;  // period_ms, track or volume
+};
+
+/* Periodic status. The STATUS frame adds loop_us_max and tx_dropped. */
+struct ControlStatus {
+  uint32_t uptimeMs;
+  uint8_t  scene;
+  uint8_t  buttonsDown;     // bit i = button i
+  uint16_t cpuMhz;
+  uint16_t bpmX100;         // MIDI clock in, 0 when unlocked
+  int8_t   batteryPercent;  // -1 unknown
+  uint32_t pressUs;         // handling time of the last press
+};
+
+struct ControlStats {
+  uint32_t rxFrames;
+  uint32_t rxErrors;   // bad CRC / stuffing / size
+  uint32_t txFrames;
+  uint32_t txBytes;
+  uint32_t txDropped;  // no room in the TX buffer
+  uint32_t loopUsMax;  // worst loop() since the last STATUS
+};
+
+/* Use port (normally Serial) for the protocol. */
+void controlInit(Stream& port);
+
+/* Read what the host sent; returns the next complete command. Unknown
+ * types and bad arguments are answered here and not returned. */
+bool controlPoll(ControlCommand* out);
+
+/* Answer a command returned by controlPoll(). HELLO also sends INFO,
+ * with the counts and name given to controlSetInfo(). */
+void controlAck(const ControlCommand& cmd, ControlResult result);
+void controlSetInfo(uint8_t buttons, uint8_t players, uint8_t scenes,
+                    const char* name);
+
+/* True while a host keeps the link up. */
+bool controlLinkUp(unsigned long nowMs);
+
+/* True when a STATUS frame is due (link up, period elapsed). */
+bool controlStatusDue(unsigned long nowMs);
+
+/* Telemetry; no-ops while the link is down. */
+void controlSendButton(uint8_t button, uint8_t type, uint32_t us);
+void controlSendPlayer(uint8_t player, ControlPlayerState state,
+                       uint16_t track, uint8_t volume);
+void controlSendStatus(const ControlStatus& status);
+
+/* Loop time for the STATUS frame's loop_us_max. */
+void controlNoteLoopUs(uint32_t us);
+
+void controlGetStats(ControlStats* out);
+
+#endif  // LIB_CONTROL_HPP
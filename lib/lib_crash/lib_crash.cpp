@@ -0,0 +1,164 @@
+/*
+ * lib_crash.cpp
+ *
+ * Reset reason, crash counters and core dump access for DaveSampleKontrol.
+ *
+ * Counters live in RTC_NOINIT memory: it keeps its contents across panic,
+ * watchdog and software resets (RTC_DATA_ATTR variables are reloaded by
+ * the bootloader on those) and holds garbage after power-on, which the
+ * magic word catches.
+ *
+ * The core dump (CONFIG_ESP_COREDUMP_ENABLE_TO_FLASH, ELF with CRC32 in the
+ * framework's sdkconfig) starts with its total length. crashInit() reads
+ * that word only; esp_core_dump_image_get(), which checksums the whole
+ * image through the flash cache, runs when the dump is asked for.
+ */
+
+#include "lib_crash.hpp"
+
+#include <Arduino.h>
+#include <esp_system.h>
+
+static const uint32_t kCrashMagic = 0x43525348;  // "CRSH"
+
+RTC_NOINIT_ATTR static uint32_t rtcMagic;
+RTC_NOINIT_ATTR static uint32_t rtcBoots;
+RTC_NOINIT_ATTR static uint32_t rtcCrashes;
+
+static esp_reset_reason_t resetReason = ESP_RST_UNKNOWN;
+static size_t             dumpSize    = 0;
+
+static size_t dumpProbe(void);
+
+bool crashResetIsCrash(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void crashInit(void) {
+  resetReason = esp_reset_reason();
+  if (rtcMagic != kCrashMagic || resetReason == ESP_RST_POWERON) {
+    rtcMagic   = kCrashMagic;
+    rtcBoots   = 0;
+    rtcCrashes = 0;
+  }
+  ++rtcBoots;
+  if (crashResetIsCrash(resetReason)) ++rtcCrashes;
+  dumpSize = dumpProbe();
+}
+
+const char* crashResetReason(void) {
+  switch (resetReason) {
+    case ESP_RST_POWERON:
+      return "poweron";
+    case ESP_RST_EXT:
+      return "external";
+    case ESP_RST_SW:
+      return "software";
+    case ESP_RST_PANIC:
+      return "panic";
+    case ESP_RST_INT_WDT:
+      return "int_wdt";
+    case ESP_RST_TASK_WDT:
+      return "task_wdt";
+    case ESP_RST_WDT:
+      return "wdt";
+    case ESP_RST_DEEPSLEEP:
+      return "deepsleep";
+    case ESP_RST_BROWNOUT:
+      return "brownout";
+    case ESP_RST_SDIO:
+      return "sdio";
+    default:
+      return "unknown";
+  }
+}
+
+bool crashLastResetWasCrash(void) {
+  return crashResetIsCrash(resetReason);
+}
+
+uint32_t crashCount(void) {
+  return rtcCrashes;
+}
+
+uint32_t crashBootCount(void) {
+  return rtcBoots;
+}
+
+size_t crashDumpSize(void) {
+  return dumpSize;
+}
+
+#if defined(ARDUINO) && __has_include("esp_core_dump.h") && \
+    __has_include("esp_partition.h")
+
+#include <esp_core_dump.h>
+#include <esp_partition.h>
+
+static const esp_partition_t* dumpPartition(void) {
+  static const esp_partition_t* part = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_COREDUMP, nullptr);
+  return part;
+}
+
+static size_t dumpProbe(void) {
+  const esp_partition_t* part = dumpPartition();
+  uint32_t               len  = 0;
+  if (!part || esp_partition_read(part, 0, &len, sizeof(len)) != ESP_OK) {
+    return 0;
+  }
+  // erased flash reads 0xFFFFFFFF
+  return (len > sizeof(len) && len <= part->size) ? len : 0;
+}
+
+bool crashDumpValid(void) {
+  size_t addr = 0;
+  size_t size = 0;
+  return dumpSize && esp_core_dump_image_get(&addr, &size) == ESP_OK;
+}
+
+bool crashDumpRead(size_t offset, void* buf, size_t len) {
+  const esp_partition_t* part = dumpPartition();
+  if (!part || offset + len > dumpSize) return false;
+  return esp_partition_read(part, offset, buf, len) == ESP_OK;
+}
+
+bool crashDumpErase(void) {
+  const esp_partition_t* part = dumpPartition();
+  if (!part) return false;
+  if (esp_partition_erase_range(part, 0, part->size) != ESP_OK) return false;
+  dumpSize = 0;
+  return true;
+}
+
+#else
+
+// Host builds: no flash, never a dump
+static size_t dumpProbe(void) {
+  return 0;
+}
+
+bool crashDumpValid(void) {
+  return false;
+}
+
+bool crashDumpRead(size_t offset, void* buf, size_t len) {
+  (void)offset;
+  (void)buf;
+  (void)len;
+  return false;
+}
+
+bool crashDumpErase(void) {
+  return false;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef LIB_CRASH_HPP
+#define LIB_CRASH_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <esp_system.h>
+
+/*
+ * lib_crash - header
+ *
+ * Post-mortem data for resets in the middle of a set: the reason of the
+ * last reset, a crash counter kept in RTC memory across resets, and the
+ * panic core dump that ESP-IDF writes to the "coredump" flash partition
+ * (ELF, decoded on the host with esp-coredump, see scripts/coredump_fetch.py).
+ * The board's default_16MB.csv table ends with that partition (64 KB at
+ * 0xFF0000).
+ *
+ * The panic handler records the dump; lib_crash only reads it. At boot it
+ * reads the dump's length word and nothing else, so a crash adds no work to
+ * the next boot. The checksum is only verified when someone asks for it.
+ */
+
+/* Read the reset reason and update the counters. Call early in setup(). */
+void crashInit(void);
+
+/* Reason of the last reset: "poweron", "panic", "task_wdt", ... */
+const char* crashResetReason(void);
+
+/* True for a panic or watchdog reset. Not for a brownout: the power
+ * failed, not the firmware, and the DFPlayers most likely lost it too.
+ * Shared with lib_power's crash resume. */
+bool crashResetIsCrash(esp_reset_reason_t reason);
+
+/* True if the last reset was a crash (see crashResetIsCrash()). */
+bool crashLastResetWasCrash(void);
+
+/* Crashes (panic, watchdog) since power-on, and boots. */
+uint32_t crashCount(void);
+uint32_t crashBootCount(void);
+
+/* Size of the stored core dump, 0 if there is none (or no partition). */
+size_t crashDumpSize(void);
+
+/* Verify the stored dump's checksum (reads the whole image). */
+bool crashDumpValid(void);
+
+/* Copy len bytes of the dump from offset. */
+bool crashDumpRead(size_t offset, void* buf, size_t len);
+
+/* Erase the dump, e.g. once it has been downloaded. */
+bool crashDumpErase(void);
+
+#endif  // LIB_CRASH_HPP
@@ -0,0 +1,75 @@
+/*
+ * display_status.cpp
+ *
+ * Status screen layout (see display_status.hpp). Everything is redrawn on
+ * each call; the dirty tracking in displayFlush() keeps what goes over the
+ * bus down to the characters that changed.
+ */
+
+#include "display_status.hpp"
+#include "lib_display.hpp"
+
+#include <Arduino.h>
+#include <stdio.h>
+
+static uint32_t renderUsMax = 0;
+
+static const char* stateLabel(DisplayPlayerState state) {
+  switch (state) {
+    case DISPLAY_PLAYER_STOPPED:
+      return "STOP";
+    case DISPLAY_PLAYER_PLAYING:
+      return "PLAY";
+    case DISPLAY_PLAYER_PAUSED:
+      return "PAUS";
+    default:
+      return "OFF";
+  }
+}
+
+static void drawPlayer(uint8_t num, const DisplayPlayer& player, int16_t y) {
+  char line[24];
+  if (player.track) {
+    snprintf(line, sizeof(line), "%u %-4s  %03u", num,
+             stateLabel(player.state), player.track);
+  } else {
+    snprintf(line, sizeof(line), "%u %s", num, stateLabel(player.state));
+  }
+  displayText(0, y, line);
+  if (player.name) {
+    displayText(2 * DISPLAY_CHAR_WIDTH, y + DISPLAY_CHAR_HEIGHT, player.name);
+  }
+}
+
+void displayStatusDraw(const DisplayStatus& status) {
+  uint32_t start = micros();
+  char     line[24];
+
+  displayClear();
+  snprintf(line, sizeof(line), "SCENE %u", status.scene + 1);
+  displayText(0, 0, line);
+  if (status.batteryPercent >= 0) {
+    int n = snprintf(line, sizeof(line), "%d%%", status.batteryPercent);
+    displayText(DISPLAY_WIDTH - n * DISPLAY_CHAR_WIDTH, 0, line);
+  }
+
+  if (status.bpmX100) {
+    snprintf(line, sizeof(line), "%lu.%lu BPM",
+             (unsigned long)(status.bpmX100 / 100),
+             (unsigned long)(status.bpmX100 % 100 / 10));
+  } else {
+    snprintf(line, sizeof(line), "--.- BPM");
+  }
+  displayText(0, 10, line, 2);
+  displayFillRect(0, 28, DISPLAY_WIDTH, 1, true);
+
+  drawPlayer(1, status.players[0], 32);
+  drawPlayer(2, status.players[1], 48);
+
+  uint32_t us = micros() - start;
+  if (us > renderUsMax) renderUsMax = us;
+}
+
+uint32_t displayStatusRenderUsMax(void) {
+  return renderUsMax;
+}
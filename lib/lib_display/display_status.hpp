@@ -0,0 +1,49 @@
+#ifndef DISPLAY_STATUS_HPP
+#define DISPLAY_STATUS_HPP
+
+#include <stdint.h>
+
+/*
+ * display_status - header
+ *
+ * The pedal's status screen, drawn into the lib_display framebuffer:
+ *
+ *   SCENE 2          87%
+ *   120.0 BPM                (double size; "--.- BPM" without a clock)
+ *   ---------------------
+ *   1 PLAY  003
+ *     Verse loop
+ *   2 STOP  012
+ *     Sample 12
+ *
+ * Plain drawing code, so host programs render the same screen as the
+ * firmware (test/DisplayRender).
+ */
+
+enum DisplayPlayerState : uint8_t {
+  DISPLAY_PLAYER_OFFLINE = 0,
+  DISPLAY_PLAYER_STOPPED,
+  DISPLAY_PLAYER_PLAYING,
+  DISPLAY_PLAYER_PAUSED
+};
+
+struct DisplayPlayer {
+  DisplayPlayerState state;
+  uint16_t           track;  // 0 = none yet
+  const char*        name;   // nullptr if the track has no name
+};
+
+struct DisplayStatus {
+  uint8_t       scene;           // shown 1-based
+  uint32_t      bpmX100;         // 0 = no tempo
+  int8_t        batteryPercent;  // -1 = not measured
+  DisplayPlayer players[2];
+};
+
+/* Clear the framebuffer and draw status; displayFlush() sends it. */
+void displayStatusDraw(const DisplayStatus& status);
+
+/* Longest displayStatusDraw() so far, us */
+uint32_t displayStatusRenderUsMax(void);
+
+#endif  // DISPLAY_STATUS_HPP
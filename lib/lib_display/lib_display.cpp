@@ -0,0 +1,431 @@
+/*
+ * lib_display.cpp
+ *
+ * OLED framebuffer with dirty-region updates for SSD1306 / SH1106.
+ *
+ * Two 1 KB buffers: frame is drawn into by the application, shown is what
+ * the panel holds once the running transfer is done. displayFlush() finds,
+ * for each of the 8 pages, the first and last column that differ, copies
+ * that span into shown and wakes the bus task, which writes each span with
+ * page addressing (page, column low, column high, then the pixel bytes;
+ * both controllers support this mode). The task only reads shown and the
+ * span list, and displayFlush() only touches them once the task is idle,
+ * so no lock is needed.
+ *
+ * Bus: I2C through the IDF driver (the I2C peripheral has no DMA; the
+ * driver feeds its FIFO from the interrupt) or 4-wire SPI with DMA. Either
+ * way the bus task blocks while the bytes go out, and loop() never does.
+ */
+
+#include "lib_display.hpp"
+
+#include <Arduino.h>
+#include <string.h>
+
+// Classic 5x7 font, ASCII 0x20..0x7E, one byte per column, bit 0 on top
+static const uint8_t kFont[][5] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00},
+    {0x00, 0x07, 0x00, 0x07, 0x00}, {0x14, 0x7F, 0x14, 0x7F, 0x14},
+    {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+    {0x36, 0x49, 0x56, 0x20, 0x50}, {0x00, 0x08, 0x07, 0x03, 0x00},
+    {0x00, 0x1C, 0x22, 0x41, 0x00}, {0x00, 0x41, 0x22, 0x1C, 0x00},
+    {0x2A, 0x1C, 0x7F, 0x1C, 0x2A}, {0x08, 0x08, 0x3E, 0x08, 0x08},
+    {0x00, 0x80, 0x70, 0x30, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08},
+    {0x00, 0x00, 0x60, 0x60, 0x00}, {0x20, 0x10, 0x08, 0x04, 0x02},
+    {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00},
+    {0x72, 0x49, 0x49, 0x49, 0x46}, {0x21, 0x41, 0x49, 0x4D, 0x33},
+    {0x18, 0x14, 0x12, 0x7F, 0x10}, {0x27, 0x45, 0x45, 0x45, 0x39},
+    {0x3C, 0x4A, 0x49, 0x49, 0x31}, {0x41, 0x21, 0x11, 0x09, 0x07},
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x46, 0x49, 0x49, 0x29, 0x1E},
+    {0x00, 0x00, 0x14, 0x00, 0x00}, {0x00, 0x40, 0x34, 0x00, 0x00},
+    {0x00, 0x08, 0x14, 0x22, 0x41}, {0x14, 0x14, 0x14, 0x14, 0x14},
+    {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x59, 0x09, 0x06},
+    {0x3E, 0x41, 0x5D, 0x59, 0x4E}, {0x7C, 0x12, 0x11, 0x12, 0x7C},
+    {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},
+    {0x7F, 0x41, 0x41, 0x41, 0x3E}, {0x7F, 0x49, 0x49, 0x49, 0x41},
+    {0x7F, 0x09, 0x09, 0x09, 0x01}, {0x3E, 0x41, 0x41, 0x51, 0x73},
+    {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00},
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41},
+    {0x7F, 0x40, 0x40, 0x40, 0x40}, {0x7F, 0x02, 0x1C, 0x02, 0x7F},
+    {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E},
+    {0x7F, 0x09, 0x19, 0x29, 0x46}, {0x26, 0x49, 0x49, 0x49, 0x32},
+    {0x03, 0x01, 0x7F, 0x01, 0x03}, {0x3F, 0x40, 0x40, 0x40, 0x3F},
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F},
+    {0x63, 0x14, 0x08, 0x14, 0x63}, {0x03, 0x04, 0x78, 0x04, 0x03},
+    {0x61, 0x59, 0x49, 0x4D, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x41},
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x41, 0x7F},
+    {0x04, 0x02, 0x01, 0x02, 0x04}, {0x40, 0x40, 0x40, 0x40, 0x40},
+    {0x00, 0x03, 0x07, 0x08, 0x00}, {0x20, 0x54, 0x54, 0x78, 0x40},
+    {0x7F, 0x28, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x28},
+    {0x38, 0x44, 0x44, 0x28, 0x7F}, {0x38, 0x54, 0x54, 0x54, 0x18},
+    {0x00, 0x08, 0x7E, 0x09, 0x02}, {0x18, 0xA4, 0xA4, 0x9C, 0x78},
+    {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00},
+    {0x20, 0x40, 0x40, 0x3D, 0x00}, {0x7F, 0x10, 0x28, 0x44, 0x00},
+    {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x78, 0x04, 0x78},
+    {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38},
+    {0xFC, 0x18, 0x24, 0x24, 0x18}, {0x18, 0x24, 0x24, 0x18, 0xFC},
+    {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x24},
+    {0x04, 0x04, 0x3F, 0x44, 0x24}, {0x3C, 0x40, 0x40, 0x20, 0x7C},
+    {0x1C, 0x20, 0x40, 0x20, 0x1C}, {0x3C, 0x40, 0x30, 0x40, 0x3C},
+    {0x44, 0x28, 0x10, 0x28, 0x44}, {0x4C, 0x90, 0x90, 0x90, 0x7C},
+    {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00},
+    {0x00, 0x00, 0x77, 0x00, 0x00}, {0x00, 0x41, 0x36, 0x08, 0x00},
+    {0x02, 0x01, 0x02, 0x04, 0x02}};
+
+static const uint8_t kFontFirst = 0x20;
+static const uint8_t kFontLast  = 0x7E;
+
+// SSD1306 / SH1106 commands used for updates
+static const uint8_t CMD_PAGE     = 0xB0;  // | page
+static const uint8_t CMD_COL_LOW  = 0x00;  // | column & 0x0F
+static const uint8_t CMD_COL_HIGH = 0x10;  // | column >> 4
+static const uint8_t CMD_OFF      = 0xAE;
+static const uint8_t CMD_ON       = 0xAF;
+
+static DisplayConfig cfg;
+static bool          ready     = false;
+static bool          shownInit = false;  // shown matches the panel
+static uint8_t       colOffset = 0;
+
+static uint8_t frame[DISPLAY_PAGES][DISPLAY_WIDTH];
+static uint8_t shown[DISPLAY_PAGES][DISPLAY_WIDTH];
+
+// Span of each page to send, first > last when the page is clean
+static uint8_t spanFirst[DISPLAY_PAGES];
+static uint8_t spanLast[DISPLAY_PAGES];
+
+// Set by displayFlush(), cleared by the bus task
+static volatile bool busy = false;
+
+static uint32_t          frameCount    = 0;
+static uint32_t          byteCount     = 0;
+static uint32_t          deferredCount = 0;
+static uint32_t          flushUsMax    = 0;
+static volatile uint32_t txUsMax       = 0;
+
+static bool hwInit(void);
+static bool hwCommand(const uint8_t* cmd, size_t len);
+static bool hwData(const uint8_t* data, size_t len);
+static bool hwStartTask(void);
+static void hwKick(void);
+static void hwWaitIdle(void);
+
+// Bus task context (or loop() when there is no task)
+static void sendFrame(void) {
+  uint32_t start = micros();
+  for (uint8_t p = 0; p < DISPLAY_PAGES; ++p) {
+    if (spanFirst[p] > spanLast[p]) continue;
+    uint8_t col    = spanFirst[p] + colOffset;
+    uint8_t cmd[3] = {(uint8_t)(CMD_PAGE | p),
+                      (uint8_t)(CMD_COL_LOW | (col & 0x0F)),
+                      (uint8_t)(CMD_COL_HIGH | (col >> 4))};
+    hwCommand(cmd, sizeof(cmd));
+    hwData(&shown[p][spanFirst[p]], spanLast[p] - spanFirst[p] + 1);
+  }
+  uint32_t us = micros() - start;
+  if (us > txUsMax) txUsMax = us;
+  busy = false;
+}
+
+bool displayInit(const DisplayConfig& config) {
+  cfg       = config;
+  colOffset = cfg.controller == DISPLAY_SH1106 ? 2 : 0;
+  shownInit = false;
+  memset(frame, 0, sizeof(frame));
+  if (!hwInit()) return false;
+  hwStartTask();
+  ready = true;
+  displayFlush();
+  return true;
+}
+
+void displayClear(void) {
+  memset(frame, 0, sizeof(frame));
+}
+
+void displayPixel(int16_t x, int16_t y, bool on) {
+  if (x < 0 || x >= DISPLAY_WIDTH || y < 0 || y >= DISPLAY_HEIGHT) return;
+  uint8_t bit = (uint8_t)(1 << (y & 7));
+  if (on) {
+    frame[y >> 3][x] |= bit;
+  } else {
+    frame[y >> 3][x] &= (uint8_t)~bit;
+  }
+}
+
+void displayFillRect(int16_t x, int16_t y, int16_t w, int16_t h, bool on) {
+  int16_t x0 = x < 0 ? 0 : x;
+  int16_t y0 = y < 0 ? 0 : y;
+  int16_t x1 = x + w > DISPLAY_WIDTH ? DISPLAY_WIDTH : x + w;
+  int16_t y1 = y + h > DISPLAY_HEIGHT ? DISPLAY_HEIGHT : y + h;
+  for (int16_t yy = y0; yy < y1; ++yy) {
+    for (int16_t xx = x0; xx < x1; ++xx) displayPixel(xx, yy, on);
+  }
+}
+
+int16_t displayText(int16_t x, int16_t y, const char* text, uint8_t scale) {
+  if (scale == 0) scale = 1;
+  for (; *text && x < DISPLAY_WIDTH; ++text) {
+    uint8_t c = (uint8_t)*text;
+    if (c < kFontFirst || c > kFontLast) c = '?';
+    const uint8_t* glyph = kFont[c - kFontFirst];
+    for (uint8_t col = 0; col < DISPLAY_CHAR_WIDTH; ++col) {
+      uint8_t bits = col < 5 ? glyph[col] : 0;
+      for (uint8_t row = 0; row < DISPLAY_CHAR_HEIGHT; ++row) {
+        displayFillRect(x + col * scale, y + row * scale, scale, scale,
+                        bits & (1 << row));
+      }
+    }
+    x += DISPLAY_CHAR_WIDTH * scale;
+  }
+  return x;
+}
+
+bool displayFlush(void) {
+  if (!ready) return false;
+  if (busy) {
+    ++deferredCount;
+    return false;
+  }
+
+  uint32_t start = micros();
+  uint32_t bytes = 0;
+  for (uint8_t p = 0; p < DISPLAY_PAGES; ++p) {
+    spanFirst[p] = 1;
+    spanLast[p]  = 0;
+    if (shownInit && memcmp(frame[p], shown[p], DISPLAY_WIDTH) == 0) continue;
+
+    uint8_t first = 0;
+    uint8_t last  = DISPLAY_WIDTH - 1;
+    if (shownInit) {
+      while (frame[p][first] == shown[p][first]) ++first;
+      while (frame[p][last] == shown[p][last]) --last;
+    }
+    memcpy(&shown[p][first], &frame[p][first], last - first + 1);
+    spanFirst[p] = first;
+    spanLast[p]  = last;
+    bytes += last - first + 1;
+  }
+  shownInit = true;
+
+  if (bytes) {
+    ++frameCount;
+    byteCount += bytes;
+    busy = true;
+    hwKick();
+  }
+  uint32_t us = micros() - start;
+  if (us > flushUsMax) flushUsMax = us;
+  return bytes != 0;
+}
+
+void displayOff(void) {
+  if (!ready) return;
+  hwWaitIdle();
+  hwCommand(&CMD_OFF, 1);
+}
+
+const uint8_t* displayFrame(void) {
+  return &frame[0][0];
+}
+
+void displayGetStats(DisplayStats* out) {
+  out->frames     = frameCount;
+  out->bytes      = byteCount;
+  out->deferred   = deferredCount;
+  out->flushUsMax = flushUsMax;
+  out->txUsMax    = txUsMax;
+}
+
+#if defined(ARDUINO) && __has_include("driver/i2c.h") && \
+    __has_include("driver/spi_master.h")
+
+#include <driver/i2c.h>
+#include <driver/spi_master.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static const i2c_port_t        kI2cPort    = I2C_NUM_0;
+static const spi_host_device_t kSpiHost    = SPI2_HOST;
+static const TickType_t        kI2cTimeout = pdMS_TO_TICKS(20);
+
+// Bus task: below WiFi and the Arduino loop, on the core loop() is not on
+static const UBaseType_t kTaskPriority = 1;
+static const BaseType_t  kTaskCore     = 0;
+
+static spi_device_handle_t spiDevice = nullptr;
+static TaskHandle_t        busTask   = nullptr;
+
+// Control byte + one page span (132 columns on the SH1106)
+static uint8_t i2cBuf[1 + DISPLAY_WIDTH + 4];
+
+// Page addressing mode (SSD1306 default is horizontal)
+static const uint8_t kInitSsd1306[] = {
+    0xAE, 0xD5, 0x80, 0xA8, 0x3F, 0xD3, 0x00, 0x40, 0x8D, 0x14, 0x20,
+    0x02, 0xA1, 0xC8, 0xDA, 0x12, 0x81, 0xCF, 0xD9, 0xF1, 0xDB, 0x40,
+    0xA4, 0xA6, 0xAF};
+
+static const uint8_t kInitSh1106[] = {
+    0xAE, 0xD5, 0x80, 0xA8, 0x3F, 0xD3, 0x00, 0x40, 0xAD, 0x8B, 0xA1,
+    0xC8, 0xDA, 0x12, 0x81, 0x80, 0xD9, 0x22, 0xDB, 0x35, 0xA4, 0xA6,
+    0xAF};
+
+static bool i2cWrite(uint8_t control, const uint8_t* bytes, size_t len) {
+  if (len > sizeof(i2cBuf) - 1) return false;
+  i2cBuf[0] = control;
+  memcpy(&i2cBuf[1], bytes, len);
+  return i2c_master_write_to_device(kI2cPort, cfg.address, i2cBuf, len + 1,
+                                    kI2cTimeout) == ESP_OK;
+}
+
+static bool spiWrite(bool data, const uint8_t* bytes, size_t len) {
+  spi_transaction_t t = {};
+  t.length            = len * 8;
+  t.tx_buffer         = bytes;
+  digitalWrite(cfg.dcPin, data ? HIGH : LOW);
+  return spi_device_transmit(spiDevice, &t) == ESP_OK;
+}
+
+static bool hwCommand(const uint8_t* cmd, size_t len) {
+  if (cfg.bus == DISPLAY_BUS_SPI) return spiWrite(false, cmd, len);
+  return i2cWrite(0x00, cmd, len);
+}
+
+static bool hwData(const uint8_t* data, size_t len) {
+  if (cfg.bus == DISPLAY_BUS_SPI) return spiWrite(true, data, len);
+  return i2cWrite(0x40, data, len);
+}
+
+static bool hwInit(void) {
+  if (cfg.resetPin >= 0) {
+    pinMode(cfg.resetPin, OUTPUT);
+    digitalWrite(cfg.resetPin, LOW);
+    delay(1);
+    digitalWrite(cfg.resetPin, HIGH);
+    delay(1);
+  }
+
+  if (cfg.bus == DISPLAY_BUS_SPI) {
+    spi_bus_config_t bus = {};
+    bus.mosi_io_num      = cfg.dataPin;
+    bus.miso_io_num      = -1;
+    bus.sclk_io_num      = cfg.clockPin;
+    bus.quadwp_io_num    = -1;
+    bus.quadhd_io_num    = -1;
+    bus.max_transfer_sz  = DISPLAY_WIDTH + 4;
+    if (spi_bus_initialize(kSpiHost, &bus, SPI_DMA_CH_AUTO) != ESP_OK) {
+      return false;
+    }
+    spi_device_interface_config_t dev = {};
+    dev.clock_speed_hz                = (int)cfg.clockHz;
+    dev.mode                          = 0;
+    dev.spics_io_num                  = cfg.csPin;
+    dev.queue_size                    = 1;
+    if (spi_bus_add_device(kSpiHost, &dev, &spiDevice) != ESP_OK) {
+      return false;
+    }
+    pinMode(cfg.dcPin, OUTPUT);
+  } else {
+    i2c_config_t conf     = {};
+    conf.mode             = I2C_MODE_MASTER;
+    conf.sda_io_num       = cfg.dataPin;
+    conf.scl_io_num       = cfg.clockPin;
+    conf.sda_pullup_en    = GPIO_PULLUP_ENABLE;
+    conf.scl_pullup_en    = GPIO_PULLUP_ENABLE;
+    conf.master.clk_speed = cfg.clockHz;
+    if (i2c_param_config(kI2cPort, &conf) != ESP_OK) return false;
+    if (i2c_driver_install(kI2cPort, conf.mode, 0, 0, 0) != ESP_OK) {
+      return false;
+    }
+  }
+
+  // On I2C a missing panel shows up here as a NACK
+  if (cfg.controller == DISPLAY_SH1106) {
+    return hwCommand(kInitSh1106, sizeof(kInitSh1106));
+  }
+  return hwCommand(kInitSsd1306, sizeof(kInitSsd1306));
+}
+
+static void busTaskMain(void* arg) {
+  (void)arg;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    sendFrame();
+  }
+}
+
+static bool hwStartTask(void) {
+  return xTaskCreatePinnedToCore(busTaskMain, "display", 3072, nullptr,
+                                 kTaskPriority, &busTask,
+                                 kTaskCore) == pdPASS;
+}
+
+// Without the task, the transfer runs in loop()
+static void hwKick(void) {
+  if (busTask) {
+    xTaskNotifyGive(busTask);
+  } else {
+    sendFrame();
+  }
+}
+
+static void hwWaitIdle(void) {
+  for (uint8_t i = 0; busy && i < 50; ++i) vTaskDelay(pdMS_TO_TICKS(1));
+}
+
+const uint8_t* displayPanel(void) {
+  return nullptr;
+}
+
+#else
+
+// Host builds: a model of the controller RAM, page addressing commands only
+static uint8_t panel[DISPLAY_PAGES][DISPLAY_WIDTH];
+static uint8_t panelPage = 0;
+static uint8_t panelCol  = 0;
+
+static bool hwInit(void) {
+  memset(panel, 0, sizeof(panel));
+  return true;
+}
+
+static bool hwCommand(const uint8_t* cmd, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    uint8_t c = cmd[i];
+    if ((c & 0xF8) == CMD_PAGE) {
+      panelPage = c & 0x07;
+    } else if ((c & 0xF0) == CMD_COL_LOW) {
+      panelCol = (uint8_t)((panelCol & 0xF0) | (c & 0x0F));
+    } else if ((c & 0xF0) == CMD_COL_HIGH) {
+      panelCol = (uint8_t)((panelCol & 0x0F) | ((c & 0x0F) << 4));
+    } else if (c != CMD_OFF && c != CMD_ON) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool hwData(const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; ++i, ++panelCol) {
+    int16_t x = panelCol - colOffset;
+    if (x >= 0 && x < DISPLAY_WIDTH) panel[panelPage][x] = data[i];
+  }
+  return true;
+}
+
+static bool hwStartTask(void) {
+  return false;
+}
+
+static void hwKick(void) {
+  sendFrame();
+}
+
+static void hwWaitIdle(void) {}
+
+const uint8_t* displayPanel(void) {
+  return &panel[0][0];
+}
+
+#endif
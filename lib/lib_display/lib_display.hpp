@@ -0,0 +1,92 @@
+#ifndef LIB_DISPLAY_HPP
+#define LIB_DISPLAY_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * lib_display - header
+ *
+ * 128x64 monochrome OLED (SSD1306 or SH1106) on I2C or SPI. Drawing goes to
+ * a RAM framebuffer; displayFlush() compares it with what the panel shows,
+ * page by page (8 rows of 128 columns), and hands only the changed column
+ * span of each changed page to a low-priority bus task. A frame where
+ * nothing changed costs one memcmp per page and no bus traffic.
+ *
+ *   displayInit(config);
+ *   displayClear();
+ *   displayText(0, 0, "SCENE 1");
+ *   displayFlush();  // every redraw: sends only what changed
+ */
+
+#define DISPLAY_WIDTH  128
+#define DISPLAY_HEIGHT 64
+#define DISPLAY_PAGES  (DISPLAY_HEIGHT / 8)
+
+// Font cell: 5x7 glyph plus one column and one row of spacing
+#define DISPLAY_CHAR_WIDTH  6
+#define DISPLAY_CHAR_HEIGHT 8
+
+enum DisplayController : uint8_t {
+  DISPLAY_SSD1306 = 0,
+  DISPLAY_SH1106       // 132 column RAM, the glass starts at column 2
+};
+
+enum DisplayBus : uint8_t {
+  DISPLAY_BUS_I2C = 0,
+  DISPLAY_BUS_SPI  // 4-wire, DMA
+};
+
+struct DisplayConfig {
+  DisplayController controller;
+  DisplayBus        bus;
+  int8_t            dataPin;   // SDA / MOSI
+  int8_t            clockPin;  // SCL / SCK
+  int8_t            csPin;     // SPI only
+  int8_t            dcPin;     // SPI only
+  int8_t            resetPin;  // -1 if not wired
+  uint8_t           address;   // I2C only, usually 0x3C
+  uint32_t          clockHz;   // 400 kHz I2C, up to 10 MHz SPI
+};
+
+/* Reset and configure the controller and start the bus task. The first
+ * flush sends the whole frame. Returns false if the bus could not be set
+ * up or the controller did not answer. */
+bool displayInit(const DisplayConfig& config);
+
+/* Drawing, framebuffer only. Coordinates outside the screen are clipped. */
+void displayClear(void);
+void displayPixel(int16_t x, int16_t y, bool on);
+void displayFillRect(int16_t x, int16_t y, int16_t w, int16_t h, bool on);
+
+/* Draw text (printable ASCII, anything else shows as '?') with its top left
+ * corner at x, y, each font pixel scaled to scale x scale. Returns the x
+ * after the last character. */
+int16_t displayText(int16_t x, int16_t y, const char* text, uint8_t scale = 1);
+
+/* Hand the changed parts of the framebuffer to the bus task. Returns true
+ * if a transfer was started; while the previous one is still running
+ * nothing is sent and the changes go out on a later call. */
+bool displayFlush(void);
+
+/* Panel off, after the running transfer (before deep sleep). */
+void displayOff(void);
+
+/* Framebuffer, page-major: byte [page * DISPLAY_WIDTH + x], bit 0 on top */
+const uint8_t* displayFrame(void);
+
+/* Host builds: the panel as written over the bus (same layout), so tests
+ * can check the dirty tracking and save images. nullptr on the target. */
+const uint8_t* displayPanel(void);
+
+struct DisplayStats {
+  uint32_t frames;      // transfers started
+  uint32_t bytes;       // pixel bytes sent
+  uint32_t deferred;    // flushes that found the bus task still busy
+  uint32_t flushUsMax;  // displayFlush(): compare and hand-off, in loop()
+  uint32_t txUsMax;     // one transfer on the bus, in the bus task
+};
+
+void displayGetStats(DisplayStats* out);
+
+#endif  // LIB_DISPLAY_HPP
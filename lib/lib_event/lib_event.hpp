@@ -0,0 +1,99 @@
+#ifndef LIB_EVENT_HPP
+#define LIB_EVENT_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/*
+ * lib_event - header
+ *
+ * Fixed-capacity single-producer / single-consumer event queue. No heap, no
+ * locks: the producer only writes head_, the consumer only writes tail_, so
+ * one side may run in an ISR or another task. When full, push() drops the new
+ * event and counts it.
+ *
+ * Usage:
+ *   static EventQueue<ButtonEvent, 32> queue;
+ *   queue.push(ev);             // producer
+ *   while (queue.pop(&ev)) ...  // consumer
+ */
+
+/*
+ * Build option INPUT_IRAM: the input path -- GPIO ISR, debounce core and
+ * these queues -- is placed in IRAM. An ISR registered with
+ * ESP_INTR_FLAG_IRAM then keeps running while the flash cache is off for
+ * a write (NVS, OTA), and the loop side does not wait for cache refills.
+ * Everything such an ISR calls must be in IRAM too.
+ */
+#if defined(INPUT_IRAM) && defined(ARDUINO) && __has_include(<esp_attr.h>)
+#include <esp_attr.h>
+#define INPUT_IRAM_ATTR IRAM_ATTR
+#else
+#define INPUT_IRAM_ATTR
+#endif
+
+template <typename T, uint16_t N>
+class EventQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+ public:
+  // producer side; returns false (and counts a drop) when full
+  INPUT_IRAM_ATTR bool push(const T& item) {
+    uint16_t head = head_.load(std::memory_order_relaxed);
+    uint16_t tail = tail_.load(std::memory_order_acquire);
+    if ((uint16_t)(head - tail) >= N) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    buf_[head & (N - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side; returns false when empty
+  INPUT_IRAM_ATTR bool pop(T* out) {
+    uint16_t tail = tail_.load(std::memory_order_relaxed);
+    uint16_t head = head_.load(std::memory_order_acquire);
+    if (head == tail) return false;
+    *out = buf_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side: copy of the oldest item without removing it
+  INPUT_IRAM_ATTR bool peek(T* out) const {
+    uint16_t tail = tail_.load(std::memory_order_relaxed);
+    uint16_t head = head_.load(std::memory_order_acquire);
+    if (head == tail) return false;
+    *out = buf_[tail & (N - 1)];
+    return true;
+  }
+
+  uint16_t size() const {
+    return head_.load(std::memory_order_acquire) -
+           tail_.load(std::memory_order_acquire);
+  }
+
+  uint16_t capacity() const {
+    return N;
+  }
+
+  uint32_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  // consumer side: discard everything queued
+  void clear() {
+    tail_.store(head_.load(std::memory_order_acquire),
+                std::memory_order_release);
+  }
+
+ private:
+  T                     buf_[N];
+  std::atomic<uint16_t> head_{0};
+  std::atomic<uint16_t> tail_{0};
+  std::atomic<uint32_t> dropped_{0};
+};
+
+#endif  // LIB_EVENT_HPP
@@ -0,0 +1,116 @@
+/*
+ * lib_heap.cpp
+ *
+ * Heap fragmentation monitor for DaveSampleKontrol.
+ *
+ * Free heap, low-water mark and largest free block come from heap_caps and
+ * are cheap to query (no heap walk). Largest free block is the number to
+ * watch: free heap can look healthy while fragmentation slowly eats the
+ * biggest contiguous region until WiFi or TLS buffers no longer fit.
+ *
+ * Allocation counting is compiled in with -D HEAP_MONITOR together with
+ * the linker wraps below (see the debug env in platformio.ini):
+ *
+ *   -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+ *
+ * Every allocation call in the image (operator new, Arduino String, WiFi
+ * stack, ...) then goes through the __wrap_ functions, which bump a counter
+ * for the subsystem currently tagged with heapEnter() when called from the
+ * loop task, or HEAP_SUB_SYSTEM when called from any other task. The cost
+ * is one task handle compare and one atomic increment per call.
+ */
+
+#include "lib_heap.hpp"
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Internal RAM only: with PSRAM enabled the default 8-bit heap spans both,
+// and the multi-megabyte PSRAM region would hide internal fragmentation.
+static const uint32_t kInternal = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+
+static const char* const kSubsystemNames[HEAP_SUB_COUNT] = {
+    "other", "buttons", "mp3", "server", "system"};
+
+static TaskHandle_t           loopTask   = nullptr;
+static volatile HeapSubsystem currentSub = HEAP_SUB_OTHER;
+
+static volatile uint32_t allocCount[HEAP_SUB_COUNT];
+static volatile uint32_t freeCount[HEAP_SUB_COUNT];
+
+#if defined(HEAP_MONITOR)
+static inline uint8_t callerSubsystem() {
+  if (loopTask == nullptr) return HEAP_SUB_OTHER;  // before init
+  return xTaskGetCurrentTaskHandle() == loopTask ? currentSub
+                                                 : HEAP_SUB_SYSTEM;
+}
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void  __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size) {
+  __atomic_fetch_add(&allocCount[callerSubsystem()], 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+  __atomic_fetch_add(&allocCount[callerSubsystem()], 1, __ATOMIC_RELAXED);
+  return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  // a resize is a free + malloc as far as fragmentation is concerned
+  uint8_t sub = callerSubsystem();
+  __atomic_fetch_add(&allocCount[sub], 1, __ATOMIC_RELAXED);
+  if (ptr) __atomic_fetch_add(&freeCount[sub], 1, __ATOMIC_RELAXED);
+  return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr) {
+  if (ptr) __atomic_fetch_add(&freeCount[callerSubsystem()], 1,
+                              __ATOMIC_RELAXED);
+  __real_free(ptr);
+}
+}
+#endif
+
+void heapMonitorInit(void) {
+  loopTask = xTaskGetCurrentTaskHandle();
+}
+
+HeapSubsystem heapEnter(HeapSubsystem sub) {
+  HeapSubsystem prev = currentSub;
+  currentSub         = sub;
+  return prev;
+}
+
+void heapLeave(HeapSubsystem prev) {
+  currentSub = prev;
+}
+
+void heapGetStats(HeapStats* out) {
+  out->freeBytes        = heap_caps_get_free_size(kInternal);
+  out->minFreeBytes     = heap_caps_get_minimum_free_size(kInternal);
+  out->largestFreeBlock = heap_caps_get_largest_free_block(kInternal);
+  for (uint8_t i = 0; i < HEAP_SUB_COUNT; ++i) {
+    out->allocs[i] = allocCount[i];
+    out->frees[i]  = freeCount[i];
+  }
+}
+
+const char* heapSubsystemName(uint8_t sub) {
+  return sub < HEAP_SUB_COUNT ? kSubsystemNames[sub] : "?";
+}
+
+bool heapCountingEnabled(void) {
+#if defined(HEAP_MONITOR)
+  return true;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,51 @@
+#ifndef LIB_HEAP_HPP
+#define LIB_HEAP_HPP
+
+#include <Arduino.h>
+#include <stdint.h>
+
+/*
+ * lib_heap - header
+ *
+ * Heap fragmentation monitor: free heap, minimum free heap, largest free
+ * block and per-subsystem allocation counters.
+ * See lib_heap.cpp for implementation details.
+ */
+
+/* Subsystems allocations are attributed to. */
+enum HeapSubsystem : uint8_t {
+  HEAP_SUB_OTHER = 0,  // loop task outside any tagged section
+  HEAP_SUB_BUTTONS,
+  HEAP_SUB_MP3,
+  HEAP_SUB_SERVER,
+  HEAP_SUB_SYSTEM,  // other tasks (WiFi, lwIP, timers, ...)
+  HEAP_SUB_COUNT
+};
+
+/* Internal RAM figures (PSRAM is not included). */
+struct HeapStats {
+  uint32_t freeBytes;
+  uint32_t minFreeBytes;      // low-water mark since boot
+  uint32_t largestFreeBlock;  // biggest single allocation possible now
+  uint32_t allocs[HEAP_SUB_COUNT];
+  uint32_t frees[HEAP_SUB_COUNT];
+};
+
+/* Call once from setup(); the calling task is treated as the loop task. */
+void heapMonitorInit(void);
+
+/* Tag allocations made by the loop task until the matching heapLeave().
+ * Returns the previous tag so sections can nest. */
+HeapSubsystem heapEnter(HeapSubsystem sub);
+void          heapLeave(HeapSubsystem prev);
+
+/* Snapshot current heap state and counters. */
+void heapGetStats(HeapStats* out);
+
+/* Short lowercase name ("buttons", "server", ...). */
+const char* heapSubsystemName(uint8_t sub);
+
+/* True if allocation counting is compiled in (HEAP_MONITOR build flag). */
+bool heapCountingEnabled(void);
+
+#endif  // LIB_HEAP_HPP
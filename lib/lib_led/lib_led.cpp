@@ -0,0 +1,195 @@
+/*
+ * lib_led.cpp
+ *
+ * Footswitch LEDs (WS2812 / SK6812, GRB, 800 kHz) on one RMT TX channel.
+ *
+ * Uses the ESP-IDF 4.4 RMT driver with a sample translator: the driver
+ * converts the GRB bytes to RMT pulse items from its ISR as the channel
+ * memory drains, so a frame costs one rmt_write_sample() call that returns
+ * at once. The byte buffer handed to the driver is only rewritten once
+ * rmt_wait_tx_done() reports the previous frame finished.
+ *
+ * Pulse timing at a 40 MHz RMT clock (25 ns ticks):
+ *   0 bit: 350 ns high, 1000 ns low
+ *   1 bit: 1000 ns high, 350 ns low
+ * The >50 us reset gap comes from the idle time between frames.
+ */
+
+#include "lib_led.hpp"
+
+#include <string.h>
+
+static uint8_t  ledCount   = 0;
+static uint8_t  brightness = 255;
+static uint32_t colors[LED_MAX_COUNT];
+static uint32_t sentColors[LED_MAX_COUNT];
+static uint8_t  sentBrightness = 0;
+static bool     sentValid      = false;  // sentColors holds a real frame
+static uint8_t  txBuf[LED_MAX_COUNT * 3];
+static uint32_t frameCount    = 0;
+static uint32_t deferredCount = 0;
+
+static bool hwInit(uint8_t pin);
+static bool hwBusy(void);
+static void hwWrite(const uint8_t* buf, size_t len);
+static void hwWait(void);
+
+void ledEncodeFrame(const uint32_t* rgb, uint8_t count, uint8_t level,
+                    uint8_t* out) {
+  for (uint8_t i = 0; i < count; ++i) {
+    uint8_t r  = (uint8_t)(rgb[i] >> 16);
+    uint8_t g  = (uint8_t)(rgb[i] >> 8);
+    uint8_t b  = (uint8_t)rgb[i];
+    out[0]     = (uint8_t)((g * (level + 1)) >> 8);
+    out[1]     = (uint8_t)((r * (level + 1)) >> 8);
+    out[2]     = (uint8_t)((b * (level + 1)) >> 8);
+    out += 3;
+  }
+}
+
+bool ledInit(uint8_t pin, uint8_t count) {
+  if (count == 0 || count > LED_MAX_COUNT) return false;
+  ledCount  = count;
+  sentValid = false;
+  memset(colors, 0, sizeof(colors));
+  if (!hwInit(pin)) {
+    ledCount = 0;
+    return false;
+  }
+  ledShow();
+  return true;
+}
+
+void ledSet(uint8_t index, uint32_t rgb) {
+  if (index < ledCount) colors[index] = rgb & 0xFFFFFF;
+}
+
+uint32_t ledGet(uint8_t index) {
+  return index < ledCount ? colors[index] : LED_OFF;
+}
+
+void ledSetBrightness(uint8_t level) {
+  brightness = level;
+}
+
+bool ledShow(void) {
+  if (ledCount == 0) return false;
+  if (sentValid && brightness == sentBrightness &&
+      memcmp(colors, sentColors, ledCount * sizeof(uint32_t)) == 0) {
+    return false;
+  }
+  if (hwBusy()) {
+    ++deferredCount;
+    return false;
+  }
+  ledEncodeFrame(colors, ledCount, brightness, txBuf);
+  memcpy(sentColors, colors, ledCount * sizeof(uint32_t));
+  sentBrightness = brightness;
+  sentValid      = true;
+  hwWrite(txBuf, ledCount * 3);
+  ++frameCount;
+  return true;
+}
+
+void ledOff(void) {
+  if (ledCount == 0) return;
+  hwWait();
+  memset(colors, 0, sizeof(colors));
+  ledShow();
+  hwWait();
+}
+
+void ledGetStats(LedStats* out) {
+  out->frames   = frameCount;
+  out->deferred = deferredCount;
+}
+
+#if defined(ARDUINO) && __has_include("driver/rmt.h")
+
+#include <Arduino.h>
+#include <driver/rmt.h>
+
+static const rmt_channel_t kChannel = RMT_CHANNEL_0;
+
+// 25 ns ticks
+static const uint16_t kT0H = 14;
+static const uint16_t kT0L = 40;
+static const uint16_t kT1H = 40;
+static const uint16_t kT1L = 14;
+
+static bool hwReady = false;
+
+// RMT ISR context: GRB bytes -> one pulse item per bit, MSB first
+static void IRAM_ATTR translate(const void* src, rmt_item32_t* dest,
+                                size_t srcSize, size_t wantedNum,
+                                size_t* translatedSize, size_t* itemNum) {
+  if (!src || !dest) {
+    *translatedSize = 0;
+    *itemNum        = 0;
+    return;
+  }
+  rmt_item32_t bit0, bit1;
+  bit0.duration0 = kT0H;
+  bit0.level0    = 1;
+  bit0.duration1 = kT0L;
+  bit0.level1    = 0;
+  bit1.duration0 = kT1H;
+  bit1.level0    = 1;
+  bit1.duration1 = kT1L;
+  bit1.level1    = 0;
+
+  const uint8_t* in   = (const uint8_t*)src;
+  size_t         size = 0;
+  size_t         num  = 0;
+  while (size < srcSize && num + 8 <= wantedNum) {
+    for (uint8_t bit = 0x80; bit; bit >>= 1) {
+      dest[num++].val = (in[size] & bit) ? bit1.val : bit0.val;
+    }
+    ++size;
+  }
+  *translatedSize = size;
+  *itemNum        = num;
+}
+
+static bool hwInit(uint8_t pin) {
+  rmt_config_t config = RMT_DEFAULT_CONFIG_TX((gpio_num_t)pin, kChannel);
+  config.clk_div      = 2;  // 80 MHz APB / 2
+  if (rmt_config(&config) != ESP_OK) return false;
+  if (rmt_driver_install(kChannel, 0, 0) != ESP_OK) return false;
+  if (rmt_translator_init(kChannel, translate) != ESP_OK) return false;
+  hwReady = true;
+  return true;
+}
+
+static bool hwBusy(void) {
+  return hwReady && rmt_wait_tx_done(kChannel, 0) != ESP_OK;
+}
+
+static void hwWrite(const uint8_t* buf, size_t len) {
+  if (hwReady) rmt_write_sample(kChannel, buf, len, false);
+}
+
+static void hwWait(void) {
+  if (hwReady) rmt_wait_tx_done(kChannel, pdMS_TO_TICKS(10));
+}
+
+#else
+
+// Host builds: frames are "sent" at once
+static bool hwInit(uint8_t pin) {
+  (void)pin;
+  return true;
+}
+
+static bool hwBusy(void) {
+  return false;
+}
+
+static void hwWrite(const uint8_t* buf, size_t len) {
+  (void)buf;
+  (void)len;
+}
+
+static void hwWait(void) {}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef LIB_LED_HPP
+#define LIB_LED_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * lib_led - header
+ *
+ * WS2812-style addressable LEDs, one per footswitch, driven by the RMT
+ * peripheral. Colours can be set at any time; ledShow() only starts a
+ * transfer when the frame differs from the last one sent and the previous
+ * transfer is done. The transfer itself runs in the background (RMT
+ * hardware, refilled from its ISR), so loop() pays for a compare and a
+ * copy of a few bytes, never for the bit timing.
+ *
+ *   ledInit(12, 4);
+ *   ledSet(0, LED_GREEN);
+ *   ledShow();  // every loop: no-op unless something changed
+ */
+
+#define LED_MAX_COUNT 8
+
+// 0xRRGGBB
+#define LED_OFF   0x000000
+#define LED_RED   0xFF0000
+#define LED_GREEN 0x00FF00
+#define LED_BLUE  0x0000FF
+#define LED_AMBER 0xFF7000
+
+/* Start the strip on pin with count LEDs (at most LED_MAX_COUNT), all off.
+ * Returns false if the RMT channel could not be set up. */
+bool ledInit(uint8_t pin, uint8_t count);
+
+/* Colour of LED index, 0xRRGGBB. Takes effect on the next ledShow(). */
+void     ledSet(uint8_t index, uint32_t rgb);
+uint32_t ledGet(uint8_t index);
+
+/* Global brightness 0..255 applied when a frame is encoded. */
+void ledSetBrightness(uint8_t level);
+
+/* Push the frame if it changed. Returns true if a transfer was started; a
+ * frame that changed while the previous one was still going out is sent on
+ * a later call. */
+bool ledShow(void);
+
+/* All LEDs off, waiting for the transfer to finish (before deep sleep: the
+ * LEDs keep their colour as long as they are powered). */
+void ledOff(void);
+
+struct LedStats {
+  uint32_t frames;    // transfers started
+  uint32_t deferred;  // ledShow() calls that found the RMT still busy
+};
+
+void ledGetStats(LedStats* out);
+
+/* GRB byte order with brightness applied, as the LEDs expect it.
+ * out must hold 3 * count bytes. */
+void ledEncodeFrame(const uint32_t* rgb, uint8_t count, uint8_t level,
+                    uint8_t* out);
+
+#endif  // LIB_LED_HPP
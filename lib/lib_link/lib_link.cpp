@@ -0,0 +1,128 @@
+/*
+ * lib_link.cpp
+ *
+ * Sockets for the Link session (see lib_link.hpp), opened with lib_net.
+ * The session logic is in link_session.cpp and runs on the host too
+ * (test/LinkSync).
+ */
+
+#include "lib_link.hpp"
+
+static LinkSession session;
+
+#if defined(ARDUINO) && __has_include("lwip/sockets.h")
+
+#include <Arduino.h>
+
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "lib_net.hpp"
+
+static int     mcastSock = -1;  // discovery group
+static int     ucastSock = -1;  // sends, answers
+static uint8_t rxBuf[512];
+
+static void closeSockets(void) {
+  netClose(&mcastSock);
+  netClose(&ucastSock);
+}
+
+static void sendPacket(const LinkPacket& pkt) {
+  netSendTo(ucastSock, pkt.ip ? pkt.ip : LINK_MULTICAST_ADDR, pkt.port,
+            pkt.data, pkt.len);
+}
+
+static void readSocket(int sock) {
+  for (uint8_t i = 0; i < NET_MAX_READS_PER_POLL; ++i) {
+    uint32_t ip;
+    uint16_t port;
+    int      n = netReceive(sock, rxBuf, sizeof(rxBuf), &ip, &port);
+    if (n <= 0) return;
+    session.receive(rxBuf, (size_t)n, ip, port, esp_timer_get_time());
+  }
+}
+
+bool linkBegin(uint32_t bpmX100) {
+  uint32_t ip = netLocalIp();
+  if (ip == 0 || session.active()) return false;
+
+  // the unicast socket is on an ephemeral port of the WiFi interface and
+  // also sends to the group
+  uint16_t port = 0;
+  mcastSock = netOpenMulticast(LINK_MULTICAST_ADDR, LINK_DISCOVERY_PORT, ip);
+  ucastSock = netOpenUnicast(ip, &port);
+  if (mcastSock < 0 || ucastSock < 0) {
+    closeSockets();
+    return false;
+  }
+
+  // Link node ids are random alphanumeric characters
+  static const char kChars[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  LinkNodeId id;
+  for (uint8_t& b : id.bytes) b = kChars[esp_random() % (sizeof(kChars) - 1)];
+  session.begin(id, ip, port, esp_timer_get_time(), bpmX100);
+  return true;
+}
+
+void linkEnd(void) {
+  LinkPacket bye;
+  if (session.leave(&bye)) sendPacket(bye);
+  closeSockets();
+}
+
+void linkPoll(void) {
+  if (!session.active()) return;
+  readSocket(mcastSock);
+  readSocket(ucastSock);
+  LinkPacket pkt;
+  while (session.poll(esp_timer_get_time(), &pkt)) sendPacket(pkt);
+}
+
+bool linkSetTempo(uint32_t bpmX100) {
+  return session.active() &&
+         session.setTempo(bpmX100, esp_timer_get_time());
+}
+
+int64_t linkNextBeatUs(void) {
+  if (!session.active()) return 0;
+  int64_t beats = session.beatsAt(esp_timer_get_time());
+  int64_t beat  = beats >= 0 ? beats / 1000000 : -((999999 - beats) / 1000000);
+  return session.hostAt((beat + 1) * 1000000);
+}
+
+#else
+
+bool linkBegin(uint32_t bpmX100) {
+  (void)bpmX100;
+  return false;
+}
+
+void linkEnd(void) {}
+
+void linkPoll(void) {}
+
+bool linkSetTempo(uint32_t bpmX100) {
+  (void)bpmX100;
+  return false;
+}
+
+int64_t linkNextBeatUs(void) {
+  return 0;
+}
+
+#endif
+
+bool linkSynced(void) {
+  LinkStatus st;
+  session.status(&st);
+  return session.active() && st.peers > 0;
+}
+
+uint32_t linkBpmX100(void) {
+  return session.active() ? session.bpmX100() : 0;
+}
+
+void linkGetStatus(LinkStatus* out) {
+  session.status(out);
+}
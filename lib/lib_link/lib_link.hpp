@@ -0,0 +1,54 @@
+#ifndef LIB_LINK_HPP
+#define LIB_LINK_HPP
+
+#include <stdint.h>
+
+#include "link_session.hpp"
+
+/*
+ * lib_link - header
+ *
+ * Ableton Link tempo and beat sync on the WiFi network (station or access
+ * point): the pedal joins the session of Live, other Link apps and other
+ * pedals on the network, or founds one. Protocol in link_session.hpp.
+ *
+ * Two lwIP sockets, read without blocking from loop(): the discovery
+ * multicast group, and a unicast socket that sends everything and gets the
+ * answers. Datagrams are timestamped with esp_timer when read, so loop()
+ * latency adds to the measured round trips; the clock offset only uses the
+ * shortest ones. No heap use after linkBegin().
+ *
+ * Times are esp_timer_get_time() microseconds.
+ *
+ *   linkBegin(12000);                 // after WiFi is up
+ *   linkPoll();                       // every loop()
+ *   if (linkSynced()) midiClockOutAlign(linkNextBeatUs());
+ */
+
+/* Open the sockets and found a session at bpmX100. False without a
+ * network interface (offline builds, host builds). */
+bool linkBegin(uint32_t bpmX100);
+
+/* Say goodbye to the peers and close the sockets (before deep sleep). */
+void linkEnd(void);
+
+/* Read what arrived and send what is due. */
+void linkPoll(void);
+
+/* Change the session's tempo for everyone. False if out of range or not
+ * running. */
+bool linkSetTempo(uint32_t bpmX100);
+
+/* True while other peers are in our session: tempo and beats are shared. */
+bool linkSynced(void);
+
+/* Session tempo, 0 when not running. */
+uint32_t linkBpmX100(void);
+
+/* Time of the next beat (quarter note) of the session, 0 when not
+ * running. */
+int64_t linkNextBeatUs(void);
+
+void linkGetStatus(LinkStatus* out);
+
+#endif  // LIB_LINK_HPP
@@ -0,0 +1,581 @@
+/*
+ * link_session.cpp
+ *
+ * Link v1 session state (see link_session.hpp).
+ *
+ * Wire format, all integers big endian:
+ *   discovery:   "_asdp_v" 01, type (1 ALIVE, 2 RESPONSE, 3 BYEBYE), ttl s,
+ *                u16 group, node id[8], entries
+ *   measurement: "_link_v" 01, type (1 PING, 2 PONG), entries
+ *   entry:       u32 key, u32 size, value
+ * Entries: 'tmln' timeline (3 x i64), 'sess' session id[8], 'mep4' u32
+ * address + u16 port, 'hst_' / '__gt' / '_pgt' host, ghost and previous
+ * ghost time (i64). Unknown entries are skipped.
+ *
+ * A measurement takes LINK_PING_COUNT round trips. Each PONG carries the
+ * responder's ghost time; assuming symmetric delays it was read halfway
+ * through the round trip, so offset = ghost - (sent + received) / 2. WiFi
+ * queueing only ever adds delay, so the offset is averaged over the
+ * quarter of the samples with the shortest round trips.
+ */
+
+#include "link_session.hpp"
+#include "net_bytes.hpp"
+
+#include <string.h>
+
+static const uint8_t kDiscoveryHeader[8] = {'_', 'a', 's', 'd',
+                                            'p', '_', 'v', 1};
+static const uint8_t kMeasureHeader[8]   = {'_', 'l', 'i', 'n',
+                                            'k', '_', 'v', 1};
+
+enum : uint8_t { MSG_ALIVE = 1, MSG_RESPONSE = 2, MSG_BYEBYE = 3 };
+enum : uint8_t { MSG_PING = 1, MSG_PONG = 2 };
+
+static const uint32_t kKeyTimeline = 0x746d6c6e;  // 'tmln'
+static const uint32_t kKeySession  = 0x73657373;  // 'sess'
+static const uint32_t kKeyEndpoint = 0x6d657034;  // 'mep4'
+static const uint32_t kKeyHostTime = 0x6873745f;  // 'hst_'
+static const uint32_t kKeyGhost    = 0x5f5f6774;  // '__gt'
+
+// Peers are forgotten after ttl seconds without an ALIVE
+static const uint8_t kTtlS          = 5;
+static const int64_t kAlivePeriodUs = 250000;
+
+static const int64_t kPingSpacingUs   = 20000;
+static const int64_t kPingTimeoutUs   = 100000;
+static const uint8_t kMaxPingTimeouts = 4;
+static const uint8_t kMinSamples      = 4;
+
+// Members re-measure the session's clock this often. The rate of that
+// clock against ours (crystal tolerance) is fitted over at least
+// kMinRateBaseUs of measurements, at most kMaxRateBaseUs, and limited to
+// kMaxRatePpb.
+static const int64_t kRemeasureUs   = 10000000;
+static const int64_t kMinRateBaseUs = 5000000;
+static const int64_t kMaxRateBaseUs = 300000000;
+static const int64_t kMaxRatePpb    = 200000;
+
+// Sessions found younger than ours (or unreachable) are measured again
+// after this long
+static const int64_t kRetryUs = 30000000;
+
+static const uint8_t kQueueSize   = 4;
+static const uint8_t kMaxMeasured = 4;
+
+// Sessions whose ghost clocks are closer than this are tied: the lower
+// session id wins
+static const int64_t kSessionEpsUs = 500000;
+
+static bool sameId(const LinkNodeId& a, const LinkNodeId& b) {
+  return memcmp(a.bytes, b.bytes, sizeof(a.bytes)) == 0;
+}
+
+static bool lessId(const LinkNodeId& a, const LinkNodeId& b) {
+  return memcmp(a.bytes, b.bytes, sizeof(a.bytes)) < 0;
+}
+
+/* Appends entries to a packet; fails (and stays failed) once full. */
+struct Writer {
+  LinkPacket* pkt;
+  bool        ok;
+
+  void bytes(const void* src, size_t n) {
+    if (!ok || pkt->len + n > sizeof(pkt->data)) {
+      ok = false;
+      return;
+    }
+    memcpy(pkt->data + pkt->len, src, n);
+    pkt->len += (uint16_t)n;
+  }
+  void entry(uint32_t key, const uint8_t* value, uint32_t size) {
+    uint8_t head[8];
+    bePut32(head, key);
+    bePut32(head + 4, size);
+    bytes(head, sizeof(head));
+    bytes(value, size);
+  }
+  void entry64(uint32_t key, int64_t v) {
+    uint8_t value[8];
+    bePut64(value, v);
+    entry(key, value, sizeof(value));
+  }
+};
+
+/* Entries of a received message. Returns false on a truncated entry. */
+struct Entries {
+  const uint8_t* tmln = nullptr;
+  const uint8_t* sess = nullptr;
+  const uint8_t* mep4 = nullptr;
+  const uint8_t* hst  = nullptr;
+  const uint8_t* gt   = nullptr;
+
+  bool parse(const uint8_t* p, size_t len) {
+    while (len > 0) {
+      if (len < 8) return false;
+      uint32_t key  = beGet32(p);
+      uint32_t size = beGet32(p + 4);
+      p += 8;
+      len -= 8;
+      if (size > len) return false;
+      if (key == kKeyTimeline && size == 24) tmln = p;
+      if (key == kKeySession && size == 8) sess = p;
+      if (key == kKeyEndpoint && size == 6) mep4 = p;
+      if (key == kKeyHostTime && size == 8) hst = p;
+      if (key == kKeyGhost && size == 8) gt = p;
+      p += size;
+      len -= size;
+    }
+    return true;
+  }
+};
+
+static bool validTimeline(const LinkTimeline& tl) {
+  return tl.microsPerBeat >= 60000000 / LINK_MAX_BPM &&
+         tl.microsPerBeat <= 60000000 / LINK_MIN_BPM;
+}
+
+LinkSession::LinkSession() : active_(false) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+void LinkSession::begin(const LinkNodeId& id, uint32_t ip, uint16_t port,
+                        int64_t nowUs, uint32_t bpmX100) {
+  node_          = id;
+  session_       = id;
+  ip_            = ip;
+  port_          = port;
+  ghostOffsetUs_ = -nowUs;  // a new session's clock starts at 0
+  ghostRefUs_    = nowUs;
+  ghostPpb_      = 0;
+  anchorUs_      = 0;
+  timeline_      = {60000000, 0, 0};
+  memset(peers_, 0, sizeof(peers_));
+  memset(&measure_, 0, sizeof(measure_));
+  measuredCount_   = 0;
+  queueHead_       = 0;
+  queueCount_      = 0;
+  nextAliveUs_     = nowUs;
+  nextRemeasureUs_ = nowUs + kRemeasureUs;
+  nextRetryUs_     = nowUs + kRetryUs;
+  active_          = true;
+  setTempo(bpmX100, nowUs);
+}
+
+bool LinkSession::setTempo(uint32_t bpmX100, int64_t nowUs) {
+  if (bpmX100 < LINK_MIN_BPM * 100 || bpmX100 > LINK_MAX_BPM * 100) {
+    return false;
+  }
+  LinkTimeline tl;
+  tl.microsPerBeat = (6000000000LL + bpmX100 / 2) / bpmX100;
+  tl.beatOrigin    = beatsAt(nowUs);
+  tl.timeOrigin    = ghostAt(nowUs);
+  timeline_        = tl;
+  nextAliveUs_     = nowUs;  // announce right away
+  return true;
+}
+
+int64_t LinkSession::ghostAt(int64_t hostUs) const {
+  return hostUs + ghostOffsetUs_ +
+         (hostUs - ghostRefUs_) * ghostPpb_ / 1000000000;
+}
+
+// Inverse of ghostAt() to first order in the rate (error below 1 us for
+// any rate and time span that occurs)
+int64_t LinkSession::hostOf(int64_t ghostUs) const {
+  int64_t host = ghostUs - ghostOffsetUs_;
+  return host - (host - ghostRefUs_) * ghostPpb_ / 1000000000;
+}
+
+int64_t LinkSession::beatsAt(int64_t hostUs) const {
+  int64_t ghost = ghostAt(hostUs);
+  return timeline_.beatOrigin +
+         (ghost - timeline_.timeOrigin) * 1000000 / timeline_.microsPerBeat;
+}
+
+int64_t LinkSession::hostAt(int64_t microBeats) const {
+  int64_t ghost = timeline_.timeOrigin + (microBeats - timeline_.beatOrigin) *
+                                             timeline_.microsPerBeat /
+                                             1000000;
+  return hostOf(ghost);
+}
+
+uint32_t LinkSession::bpmX100() const {
+  return (uint32_t)((6000000000LL + timeline_.microsPerBeat / 2) /
+                    timeline_.microsPerBeat);
+}
+
+const LinkNodeId& LinkSession::sessionId() const {
+  return session_;
+}
+
+bool LinkSession::active() const {
+  return active_;
+}
+
+void LinkSession::status(LinkStatus* out) const {
+  *out         = stats_;
+  out->peers   = 0;
+  out->others  = 0;
+  out->founder = sameId(session_, node_);
+  for (const Peer& peer : peers_) {
+    if (!peer.used) continue;
+    if (sameId(peer.session, session_)) {
+      ++out->peers;
+    } else {
+      ++out->others;
+    }
+  }
+  out->bpmX100       = active_ ? bpmX100() : 0;
+  out->ghostOffsetUs = ghostOffsetUs_;
+  out->ghostPpb      = (int32_t)ghostPpb_;
+}
+
+LinkSession::Peer* LinkSession::findPeer(const LinkNodeId& node) {
+  for (Peer& peer : peers_) {
+    if (peer.used && sameId(peer.node, node)) return &peer;
+  }
+  return nullptr;
+}
+
+bool LinkSession::queue(const LinkPacket& pkt) {
+  if (queueCount_ >= kQueueSize) return false;
+  queue_[(queueHead_ + queueCount_) % kQueueSize] = pkt;
+  ++queueCount_;
+  return true;
+}
+
+void LinkSession::buildState(uint8_t type, LinkPacket* out) const {
+  out->len = 0;
+  Writer w = {out, true};
+  w.bytes(kDiscoveryHeader, sizeof(kDiscoveryHeader));
+  uint8_t head[4] = {type, type == MSG_BYEBYE ? (uint8_t)0 : kTtlS, 0, 0};
+  w.bytes(head, sizeof(head));
+  w.bytes(node_.bytes, sizeof(node_.bytes));
+  if (type == MSG_BYEBYE) return;
+
+  uint8_t tl[24];
+  bePut64(tl, timeline_.microsPerBeat);
+  bePut64(tl + 8, timeline_.beatOrigin);
+  bePut64(tl + 16, timeline_.timeOrigin);
+  w.entry(kKeyTimeline, tl, sizeof(tl));
+  w.entry(kKeySession, session_.bytes, sizeof(session_.bytes));
+  uint8_t ep[6];
+  bePut32(ep, ip_);
+  bePut16(ep + 4, port_);
+  w.entry(kKeyEndpoint, ep, sizeof(ep));
+}
+
+void LinkSession::receive(const uint8_t* data, size_t len, uint32_t ip,
+                          uint16_t port, int64_t nowUs) {
+  if (!active_ || len < 9) return;
+  ++stats_.rxPackets;
+  if (memcmp(data, kDiscoveryHeader, 8) == 0) {
+    receiveDiscovery(data + 8, len - 8, ip, port, nowUs);
+  } else if (memcmp(data, kMeasureHeader, 8) == 0) {
+    receiveMeasurement(data + 8, len - 8, ip, port, nowUs);
+  }
+}
+
+void LinkSession::receiveDiscovery(const uint8_t* p, size_t len, uint32_t ip,
+                                   uint16_t port, int64_t nowUs) {
+  if (len < 12) {
+    ++stats_.badPackets;
+    return;
+  }
+  uint8_t    type = p[0];
+  uint8_t    ttl  = p[1];
+  LinkNodeId node;
+  memcpy(node.bytes, p + 4, sizeof(node.bytes));
+  if (sameId(node, node_)) return;  // our own multicast looped back
+
+  Peer* peer = findPeer(node);
+  if (type == MSG_BYEBYE) {
+    if (peer) peer->used = false;
+    return;
+  }
+  if (type != MSG_ALIVE && type != MSG_RESPONSE) return;
+
+  Entries e;
+  if (!e.parse(p + 12, len - 12) || !e.tmln || !e.sess) {
+    ++stats_.badPackets;
+    return;
+  }
+  LinkTimeline tl = {beGet64(e.tmln), beGet64(e.tmln + 8),
+                     beGet64(e.tmln + 16)};
+  if (!validTimeline(tl)) {
+    ++stats_.badPackets;
+    return;
+  }
+
+  if (!peer) {
+    for (Peer& slot : peers_) {
+      if (!slot.used) {
+        peer = &slot;
+        break;
+      }
+    }
+    if (!peer) return;  // table full
+    peer->used = true;
+    peer->node = node;
+    // a newcomer learns about us without waiting for our next ALIVE
+    if (type == MSG_ALIVE) {
+      LinkPacket answer;
+      buildState(MSG_RESPONSE, &answer);
+      answer.ip   = ip;
+      answer.port = port;
+      queue(answer);
+    }
+  }
+  memcpy(peer->session.bytes, e.sess, sizeof(peer->session.bytes));
+  peer->timeline  = tl;
+  peer->ip        = e.mep4 && beGet32(e.mep4) ? beGet32(e.mep4) : ip;
+  peer->port      = e.mep4 ? beGet16(e.mep4 + 4) : port;
+  peer->expiresUs = nowUs + (int64_t)ttl * 1000000;
+  sawTimeline(peer->session, tl);
+}
+
+void LinkSession::sawTimeline(const LinkNodeId& session,
+                              const LinkTimeline& tl) {
+  if (sameId(session, session_) && tl.timeOrigin > timeline_.timeOrigin) {
+    timeline_ = tl;
+  }
+}
+
+bool LinkSession::latestTimeline(const LinkNodeId& session,
+                                 LinkTimeline* out) const {
+  bool found = false;
+  for (const Peer& peer : peers_) {
+    if (!peer.used || !sameId(peer.session, session)) continue;
+    if (!found || peer.timeline.timeOrigin > out->timeOrigin) {
+      *out = peer.timeline;
+    }
+    found = true;
+  }
+  return found;
+}
+
+void LinkSession::receiveMeasurement(const uint8_t* p, size_t len,
+                                     uint32_t ip, uint16_t port,
+                                     int64_t nowUs) {
+  uint8_t type = p[0];
+  Entries e;
+  if (!e.parse(p + 1, len - 1)) {
+    ++stats_.badPackets;
+    return;
+  }
+
+  if (type == MSG_PING) {
+    // PONG: our session and ghost time, then the PING's entries echoed
+    LinkPacket pong;
+    pong.len    = 0;
+    pong.ip     = ip;
+    pong.port   = port;
+    Writer  w   = {&pong, true};
+    uint8_t t[] = {MSG_PONG};
+    w.bytes(kMeasureHeader, sizeof(kMeasureHeader));
+    w.bytes(t, sizeof(t));
+    w.entry(kKeySession, session_.bytes, sizeof(session_.bytes));
+    w.entry64(kKeyGhost, ghostAt(nowUs));
+    w.bytes(p + 1, len - 1);
+    if (w.ok) queue(pong);
+    return;
+  }
+
+  if (type != MSG_PONG || !measure_.active || !measure_.waiting) return;
+  if (!e.sess || !e.gt || !e.hst || beGet64(e.hst) != measure_.pingUs) return;
+  LinkNodeId session;
+  memcpy(session.bytes, e.sess, sizeof(session.bytes));
+  if (!sameId(session, measure_.session)) {
+    // the peer changed sessions meanwhile
+    measure_.active = false;
+    ++stats_.failed;
+    return;
+  }
+  int64_t rtt = nowUs - measure_.pingUs;
+  int64_t mid = measure_.pingUs + rtt / 2;
+  uint8_t i   = measure_.samples++;
+  measure_.offsetUs[i] = beGet64(e.gt) - mid;
+  measure_.rttUs[i]    = (uint32_t)rtt;
+  measure_.waiting     = false;
+  measure_.timeouts    = 0;
+}
+
+bool LinkSession::wasMeasured(const LinkNodeId& session) const {
+  for (uint8_t i = 0; i < measuredCount_; ++i) {
+    if (sameId(measured_[i], session)) return true;
+  }
+  return false;
+}
+
+// Measure a session we have not decided on yet, else our own session's
+// clock once it is due (members only: the founder's clock is the session's)
+void LinkSession::startMeasurement(int64_t nowUs) {
+  if (nowUs >= nextRetryUs_) {
+    nextRetryUs_   = nowUs + kRetryUs;
+    measuredCount_ = 0;
+  }
+
+  const Peer* target = nullptr;
+  for (const Peer& peer : peers_) {
+    if (peer.used && !sameId(peer.session, session_) &&
+        !wasMeasured(peer.session)) {
+      target = &peer;
+      break;
+    }
+  }
+  if (!target && !sameId(session_, node_) && nowUs >= nextRemeasureUs_) {
+    nextRemeasureUs_ = nowUs + kRemeasureUs;
+    for (const Peer& peer : peers_) {
+      if (peer.used && sameId(peer.session, session_)) {
+        target = &peer;
+        break;
+      }
+    }
+  }
+  if (!target) return;
+
+  memset(&measure_, 0, sizeof(measure_));
+  measure_.active  = true;
+  measure_.session = target->session;
+  measure_.ip      = target->ip;
+  measure_.port    = target->port;
+  measure_.pingUs  = nowUs - kPingSpacingUs;
+}
+
+void LinkSession::finishMeasurement(int64_t nowUs) {
+  measure_.active = false;
+  uint8_t n       = measure_.samples;
+  if (n < kMinSamples) {
+    ++stats_.failed;
+    if (!sameId(measure_.session, session_) &&
+        measuredCount_ < kMaxMeasured) {
+      // unreachable (firewall?): not again before the retry
+      measured_[measuredCount_++] = measure_.session;
+    }
+    return;
+  }
+
+  // sort by round trip (insertion, at most LINK_PING_COUNT samples)
+  for (uint8_t i = 1; i < n; ++i) {
+    uint32_t rtt = measure_.rttUs[i];
+    int64_t  off = measure_.offsetUs[i];
+    uint8_t  j   = i;
+    for (; j > 0 && measure_.rttUs[j - 1] > rtt; --j) {
+      measure_.rttUs[j]    = measure_.rttUs[j - 1];
+      measure_.offsetUs[j] = measure_.offsetUs[j - 1];
+    }
+    measure_.rttUs[j]    = rtt;
+    measure_.offsetUs[j] = off;
+  }
+  uint8_t use = n / 4 ? n / 4 : 1;
+  int64_t sum = 0;
+  for (uint8_t i = 0; i < use; ++i) sum += measure_.offsetUs[i];
+  int64_t offset = sum / use;
+  ++stats_.measurements;
+  stats_.rttUs = measure_.rttUs[0];
+
+  if (sameId(measure_.session, session_)) {
+    if (anchorUs_ && nowUs - anchorUs_ >= kMinRateBaseUs) {
+      int64_t ppb =
+          (offset - anchorOffsetUs_) * 1000000000 / (nowUs - anchorUs_);
+      ghostPpb_ = ppb > kMaxRatePpb    ? kMaxRatePpb
+                  : ppb < -kMaxRatePpb ? -kMaxRatePpb
+                                       : ppb;
+    }
+    if (!anchorUs_ || nowUs - anchorUs_ > kMaxRateBaseUs) {
+      anchorUs_       = nowUs;
+      anchorOffsetUs_ = offset;
+    }
+    ghostOffsetUs_ = offset;
+    ghostRefUs_    = nowUs;
+    return;
+  }
+
+  int64_t diff = nowUs + offset - ghostAt(nowUs);  // their clock - ours
+  bool    join = diff > kSessionEpsUs ||
+              (diff > -kSessionEpsUs && diff < kSessionEpsUs &&
+               lessId(measure_.session, session_));
+  LinkTimeline tl;
+  if (!join || !latestTimeline(measure_.session, &tl)) {
+    if (measuredCount_ < kMaxMeasured) {
+      measured_[measuredCount_++] = measure_.session;
+    }
+    return;
+  }
+  session_         = measure_.session;
+  ghostOffsetUs_   = offset;
+  ghostRefUs_      = nowUs;
+  ghostPpb_        = 0;
+  anchorUs_        = nowUs;
+  anchorOffsetUs_  = offset;
+  timeline_        = tl;
+  measuredCount_   = 0;
+  nextAliveUs_     = nowUs;
+  nextRemeasureUs_ = nowUs + kMinRateBaseUs;  // first rate estimate
+  ++stats_.joins;
+}
+
+bool LinkSession::measurementPacket(int64_t nowUs, LinkPacket* out) {
+  if (!measure_.active) startMeasurement(nowUs);
+  if (!measure_.active) return false;
+
+  if (measure_.waiting && nowUs - measure_.pingUs > kPingTimeoutUs) {
+    measure_.waiting = false;
+    if (++measure_.timeouts >= kMaxPingTimeouts) {
+      finishMeasurement(nowUs);
+      return false;
+    }
+  }
+  if (measure_.waiting) return false;
+  if (measure_.sent >= LINK_PING_COUNT) {
+    finishMeasurement(nowUs);
+    return false;
+  }
+  if (nowUs - measure_.pingUs < kPingSpacingUs) return false;
+
+  out->len  = 0;
+  out->ip   = measure_.ip;
+  out->port = measure_.port;
+  Writer  w = {out, true};
+  uint8_t t[] = {MSG_PING};
+  w.bytes(kMeasureHeader, sizeof(kMeasureHeader));
+  w.bytes(t, sizeof(t));
+  w.entry64(kKeyHostTime, nowUs);
+  measure_.pingUs  = nowUs;
+  measure_.waiting = true;
+  ++measure_.sent;
+  return true;
+}
+
+bool LinkSession::poll(int64_t nowUs, LinkPacket* out) {
+  if (!active_) return false;
+
+  for (Peer& peer : peers_) {
+    if (peer.used && nowUs > peer.expiresUs) peer.used = false;
+  }
+
+  if (queueCount_) {
+    *out       = queue_[queueHead_];
+    queueHead_ = (queueHead_ + 1) % kQueueSize;
+    --queueCount_;
+  } else if (nowUs >= nextAliveUs_) {
+    buildState(MSG_ALIVE, out);
+    out->ip      = 0;
+    out->port    = LINK_DISCOVERY_PORT;
+    nextAliveUs_ = nowUs + kAlivePeriodUs;
+  } else if (!measurementPacket(nowUs, out)) {
+    return false;
+  }
+  ++stats_.txPackets;
+  return true;
+}
+
+bool LinkSession::leave(LinkPacket* out) {
+  if (!active_) return false;
+  active_ = false;
+  buildState(MSG_BYEBYE, out);
+  out->ip   = 0;
+  out->port = LINK_DISCOVERY_PORT;
+  return true;
+}
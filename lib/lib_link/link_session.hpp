@@ -0,0 +1,190 @@
+#ifndef LINK_SESSION_HPP
+#define LINK_SESSION_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * link_session - header
+ *
+ * Tempo and beat phase sync with the Ableton Link protocol (v1 discovery
+ * and measurement messages) on UDP, without the sockets: the caller feeds
+ * received datagrams in and sends what poll() hands out, so the same code
+ * runs on the pedal (lib_link.cpp) and in host tests (test/LinkSync).
+ *
+ * Peers announce themselves (ALIVE, every 250 ms and after a change) to
+ * the multicast group 224.76.78.75:20808 with their session id, the
+ * session's timeline and a unicast endpoint for clock measurements. The
+ * members of a session share a "ghost" clock; each one knows the offset
+ * from its own clock (ghost = host + offset), measured with PING/PONG
+ * round trips to another member and re-measured every few seconds; the
+ * offset's drift over those measurements gives the rate between the two
+ * clocks, which keeps the phase between measurements. The timeline maps
+ * ghost time to beats:
+ *
+ *   beats(t) = beatOrigin + (t - timeOrigin) / microsPerBeat
+ *
+ * so all members agree on the beat, and its phase, at any instant. A tempo
+ * change is a new timeline starting now at the current beat; the timeline
+ * with the latest timeOrigin wins. When two sessions meet, each side
+ * measures the other one's ghost clock and the session whose clock is
+ * ahead (the older one) wins: members of the other session join it.
+ *
+ * Not implemented: start/stop sync, IPv6 endpoints. Times are host
+ * microseconds, beats are micro-beats (1000000 = one beat) as on the wire.
+ *
+ *   session.begin(id, myIp, myPort, nowUs, 12000);
+ *   session.receive(data, len, fromIp, fromPort, nowUs);  // each datagram
+ *   while (session.poll(nowUs, &pkt)) send(pkt);          // often
+ *   session.beatsAt(nowUs);
+ */
+
+#define LINK_DISCOVERY_PORT 20808
+#define LINK_MULTICAST_ADDR 0xE04C4E4Bu  // 224.76.78.75
+
+#define LINK_MAX_PEERS  8
+#define LINK_MAX_PACKET 128  // largest datagram poll() produces
+
+// Tempo range of Link
+#define LINK_MIN_BPM 20
+#define LINK_MAX_BPM 999
+
+// Round trips per clock measurement
+#define LINK_PING_COUNT 16
+
+struct LinkNodeId {
+  uint8_t bytes[8];
+};
+
+struct LinkTimeline {
+  int64_t microsPerBeat;
+  int64_t beatOrigin;  // micro-beats
+  int64_t timeOrigin;  // ghost time, us
+};
+
+/* A datagram to send. ip 0 means the discovery multicast group. IPv4
+ * addresses are numbers, a.b.c.d = a << 24 | b << 16 | c << 8 | d. */
+struct LinkPacket {
+  uint32_t ip;
+  uint16_t port;
+  uint16_t len;
+  uint8_t  data[LINK_MAX_PACKET];
+};
+
+struct LinkStatus {
+  uint8_t  peers;      // in our session
+  uint8_t  others;     // seen in other sessions
+  bool     founder;    // the session is ours
+  uint32_t bpmX100;
+  int64_t  ghostOffsetUs;
+  int32_t  ghostPpb;  // session clock rate against ours, parts per billion
+  uint32_t rxPackets;
+  uint32_t txPackets;
+  uint32_t badPackets;    // malformed or truncated
+  uint32_t measurements;  // completed
+  uint32_t failed;        // measurements without enough answers
+  uint32_t joins;         // sessions joined
+  uint32_t rttUs;         // best round trip of the last measurement
+};
+
+class LinkSession {
+ public:
+  LinkSession();
+
+  // Found a session of our own at bpmX100. ip and port are the endpoint
+  // of the socket that sends everything and receives unicast answers.
+  void begin(const LinkNodeId& id, uint32_t ip, uint16_t port, int64_t nowUs,
+             uint32_t bpmX100);
+
+  // A datagram from either socket
+  void receive(const uint8_t* data, size_t len, uint32_t ip, uint16_t port,
+               int64_t nowUs);
+
+  // Next datagram to send; call until it returns false
+  bool poll(int64_t nowUs, LinkPacket* out);
+
+  // BYEBYE for the group, then the session stops
+  bool leave(LinkPacket* out);
+
+  // Start a new timeline at the current beat. False if out of range.
+  bool setTempo(uint32_t bpmX100, int64_t nowUs);
+
+  // Session beat at a host time, and the host time of a beat
+  int64_t beatsAt(int64_t hostUs) const;
+  int64_t hostAt(int64_t microBeats) const;
+
+  uint32_t          bpmX100() const;
+  const LinkNodeId& sessionId() const;
+  bool              active() const;
+  void              status(LinkStatus* out) const;
+
+ private:
+  struct Peer {
+    bool         used;
+    LinkNodeId   node;
+    LinkNodeId   session;
+    LinkTimeline timeline;
+    uint32_t     ip;
+    uint16_t     port;
+    int64_t      expiresUs;
+  };
+
+  struct Measurement {
+    bool       active;
+    LinkNodeId session;
+    uint32_t   ip;
+    uint16_t   port;
+    uint8_t    sent;
+    uint8_t    samples;
+    uint8_t    timeouts;
+    bool       waiting;
+    int64_t    pingUs;
+    int64_t    offsetUs[LINK_PING_COUNT];
+    uint32_t   rttUs[LINK_PING_COUNT];
+  };
+
+  int64_t ghostAt(int64_t hostUs) const;
+  int64_t hostOf(int64_t ghostUs) const;
+
+  void  receiveDiscovery(const uint8_t* p, size_t len, uint32_t ip,
+                         uint16_t port, int64_t nowUs);
+  void  receiveMeasurement(const uint8_t* p, size_t len, uint32_t ip,
+                           uint16_t port, int64_t nowUs);
+  void  startMeasurement(int64_t nowUs);
+  void  finishMeasurement(int64_t nowUs);
+  bool  measurementPacket(int64_t nowUs, LinkPacket* out);
+  void  sawTimeline(const LinkNodeId& session, const LinkTimeline& tl);
+  bool  latestTimeline(const LinkNodeId& session, LinkTimeline* out) const;
+  bool  wasMeasured(const LinkNodeId& session) const;
+  void  buildState(uint8_t type, LinkPacket* out) const;
+  Peer* findPeer(const LinkNodeId& node);
+  bool  queue(const LinkPacket& pkt);
+
+  bool         active_;
+  LinkNodeId   node_;
+  LinkNodeId   session_;
+  LinkTimeline timeline_;
+  int64_t      ghostOffsetUs_;  // at ghostRefUs_
+  int64_t      ghostRefUs_;
+  int64_t      ghostPpb_;
+  int64_t      anchorUs_;  // first measurement of the rate fit, 0 = none
+  int64_t      anchorOffsetUs_;
+  uint32_t     ip_;
+  uint16_t     port_;
+  int64_t      nextAliveUs_;
+  int64_t      nextRemeasureUs_;
+  int64_t      nextRetryUs_;
+
+  Peer        peers_[LINK_MAX_PEERS];
+  Measurement measure_;
+  LinkNodeId  measured_[4];  // decided on until the next retry
+  uint8_t     measuredCount_;
+
+  LinkPacket queue_[4];  // answers: RESPONSE, PONG
+  uint8_t    queueHead_;
+  uint8_t    queueCount_;
+
+  LinkStatus stats_;
+};
+
+#endif  // LINK_SESSION_HPP
@@ -0,0 +1,319 @@
+/*
+ * lib_macro.cpp
+ *
+ * Footswitch macro recorder and replayer (see lib_macro.hpp). One buffer
+ * serves the recording or the playback, so only one of them runs at a
+ * time.
+ */
+
+#include "lib_macro.hpp"
+
+#include "lib_event.hpp"
+
+#if defined(ARDUINO) && __has_include("driver/timer.h") && \
+    __has_include(<Preferences.h>)
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "driver/timer.h"
+#include "esp_timer.h"
+
+static const timer_group_t kGroup = TIMER_GROUP_1;
+static const timer_idx_t   kTimer = TIMER_0;
+
+static const char* kNamespace = "macro";
+
+/* A replayed event on its way from the interrupt to loop() */
+struct MacroFired {
+  ButtonEvent ev;
+  uint32_t    dueUs;  // esp_timer time it was recorded for
+};
+
+static uint8_t     buf[MACRO_MAX_BYTES];
+static MacroWriter writer;
+static MacroPlayer player;   // the interrupt's while playing
+static int64_t     startUs;  // esp_timer time of the sequence's 0
+
+static EventQueue<MacroFired, 16> firedQueue;
+
+static volatile bool playing    = false;
+static bool          recording  = false;
+static bool          timerReady = false;
+static int8_t        activeSlot = -1;
+static bool          haveFirst  = false;
+static bool          full       = false;  // the recording ran out of room
+static uint32_t      firstUs    = 0;
+
+static MacroSlotInfo slots[MACRO_SLOTS];
+static bool          slotsLoaded = false;
+
+// Written by the interrupt
+static volatile uint32_t played    = 0;
+static volatile uint32_t lateMaxUs = 0;
+static volatile uint64_t lateSumUs = 0;
+
+static uint32_t dispatched    = 0;
+static uint32_t dispatchMaxUs = 0;
+static uint64_t dispatchSumUs = 0;
+
+static void slotKey(uint8_t slot, char* key) {
+  key[0] = 's';
+  key[1] = (char)('0' + slot);
+  key[2] = '\0';
+}
+
+static void loadSlots(void) {
+  if (slotsLoaded) return;
+  slotsLoaded = true;
+  Preferences prefs;
+  if (!prefs.begin(kNamespace, true)) return;
+  uint8_t tmp[MACRO_MAX_BYTES];
+  for (uint8_t i = 0; i < MACRO_SLOTS; ++i) {
+    char key[3];
+    slotKey(i, key);
+    size_t len = 0;
+    if (prefs.isKey(key)) len = prefs.getBytes(key, tmp, sizeof(tmp));
+    if (!len || !macroInspect(tmp, len, &slots[i].events,
+                              &slots[i].durationUs)) {
+      slots[i] = MacroSlotInfo();
+      continue;
+    }
+    slots[i].bytes = (uint16_t)len;
+  }
+  prefs.end();
+}
+
+static size_t readSlot(uint8_t slot, uint8_t* dest, size_t cap) {
+  Preferences prefs;
+  if (!prefs.begin(kNamespace, true)) return 0;
+  char key[3];
+  slotKey(slot, key);
+  size_t len = prefs.isKey(key) ? prefs.getBytes(key, dest, cap) : 0;
+  prefs.end();
+  return len;
+}
+
+static bool writeSlot(uint8_t slot, const uint8_t* data, size_t len) {
+  Preferences prefs;
+  if (!prefs.begin(kNamespace, false)) return false;
+  char key[3];
+  slotKey(slot, key);
+  bool ok = prefs.putBytes(key, data, len) == len;
+  prefs.end();
+  return ok;
+}
+
+// Timer interrupt: hand the due events to loop() and arm the next alarm.
+// The timer's counter started at the sequence's 0; MacroPlayer gives the
+// alarm at the next event's time on it.
+static bool onAlarm(void* arg) {
+  (void)arg;
+  uint64_t   counter = timer_group_get_counter_value_in_isr(kGroup, kTimer);
+  uint32_t   nowUs   = (uint32_t)esp_timer_get_time();
+  MacroEvent ev;
+  while (player.take(counter, &ev)) {
+    uint32_t late =
+        counter > ev.offsetUs ? (uint32_t)(counter - ev.offsetUs) : 0;
+    lateSumUs += late;
+    if (late > lateMaxUs) lateMaxUs = late;
+    ++played;
+
+    MacroFired f;
+    f.ev.button = ev.button;
+    f.ev.type   = ev.type;
+    f.ev.us     = nowUs;
+    f.dueUs     = (uint32_t)(startUs + ev.offsetUs);
+    firedQueue.push(f);
+  }
+  if (player.done()) {
+    playing = false;
+    return false;
+  }
+  timer_group_set_alarm_value_in_isr(kGroup, kTimer, player.alarmUs());
+  timer_group_enable_alarm_in_isr(kGroup, kTimer);
+  return false;
+}
+
+// 1 MHz count, from the crystal where the timer group can use it: the APB
+// clock follows frequency scaling
+static bool setupTimer(void) {
+  timer_config_t cfg = {};
+  cfg.alarm_en       = TIMER_ALARM_EN;
+  cfg.counter_en     = TIMER_PAUSE;
+  cfg.intr_type      = TIMER_INTR_LEVEL;
+  cfg.counter_dir    = TIMER_COUNT_UP;
+  cfg.auto_reload    = TIMER_AUTORELOAD_DIS;
+#if SOC_TIMER_GROUP_SUPPORT_XTAL
+  cfg.clk_src = TIMER_SRC_CLK_XTAL;
+  cfg.divider = 40;  // 40 MHz crystal
+#else
+  cfg.divider = 80;  // 80 MHz APB
+#endif
+  if (timer_init(kGroup, kTimer, &cfg) != ESP_OK) return false;
+  if (timer_isr_callback_add(kGroup, kTimer, onAlarm, nullptr, 0) !=
+      ESP_OK) {
+    timer_deinit(kGroup, kTimer);
+    return false;
+  }
+  timerReady = true;
+  return true;
+}
+
+bool macroRecordStart(uint8_t slot) {
+  if (slot >= MACRO_SLOTS || playing || recording) return false;
+  writer.begin(buf, sizeof(buf));
+  haveFirst  = false;
+  full       = false;
+  recording  = true;
+  activeSlot = (int8_t)slot;
+  return true;
+}
+
+void macroNoteEvent(const ButtonEvent& ev) {
+  if (!recording || full) return;
+  if (!haveFirst) {
+    firstUs   = ev.us;
+    haveFirst = true;
+  }
+  MacroEvent m;
+  m.offsetUs = ev.us - firstUs;
+  m.button   = ev.button;
+  m.type     = ev.type;
+  full       = !writer.add(m);  // keeps what fitted
+}
+
+bool macroPlay(uint8_t slot) {
+  if (slot >= MACRO_SLOTS || playing || recording) return false;
+  size_t len = readSlot(slot, buf, sizeof(buf));
+  if (!len || !player.begin(buf, len)) return false;
+  if (!timerReady && !setupTimer()) return false;
+
+  firedQueue.clear();
+  timer_pause(kGroup, kTimer);
+  timer_set_counter_value(kGroup, kTimer, 0);
+  timer_set_alarm_value(kGroup, kTimer, player.alarmUs());
+  timer_set_alarm(kGroup, kTimer, TIMER_ALARM_EN);
+  playing    = true;
+  activeSlot = (int8_t)slot;
+  startUs    = esp_timer_get_time();
+  timer_start(kGroup, kTimer);
+  return true;
+}
+
+bool macroStop(void) {
+  if (!recording) {
+    if (activeSlot >= 0) {
+      timer_pause(kGroup, kTimer);
+      playing = false;
+      firedQueue.clear();
+      activeSlot = -1;
+    }
+    return true;
+  }
+
+  recording    = false;
+  uint8_t slot = (uint8_t)activeSlot;
+  activeSlot   = -1;
+  if (writer.count() == 0) return false;  // nothing to keep
+  if (!writeSlot(slot, buf, writer.size())) return false;
+  loadSlots();
+  slots[slot].events     = writer.count();
+  slots[slot].bytes      = (uint16_t)writer.size();
+  slots[slot].durationUs = writer.durationUs();
+  return true;
+}
+
+bool macroPollEvent(ButtonEvent* out) {
+  MacroFired f;
+  if (!firedQueue.pop(&f)) {
+    // played to the end: stop the timer
+    if (!playing && !recording && activeSlot >= 0) macroStop();
+    return false;
+  }
+  uint32_t late = (uint32_t)esp_timer_get_time() - f.dueUs;
+  if ((int32_t)late < 0) late = 0;
+  ++dispatched;
+  dispatchSumUs += late;
+  if (late > dispatchMaxUs) dispatchMaxUs = late;
+  *out = f.ev;
+  return true;
+}
+
+bool macroRecording(void) {
+  return recording;
+}
+
+bool macroPlaying(void) {
+  return playing || firedQueue.size() > 0;
+}
+
+int8_t macroActiveSlot(void) {
+  return activeSlot;
+}
+
+bool macroSlotInfo(uint8_t slot, MacroSlotInfo* out) {
+  if (slot >= MACRO_SLOTS) return false;
+  loadSlots();
+  *out = slots[slot];
+  return true;
+}
+
+void macroGetStats(MacroStats* out) {
+  uint32_t n         = played;
+  out->played        = n;
+  out->dropped       = firedQueue.dropped();
+  out->lateAvgUs     = n ? (uint32_t)(lateSumUs / n) : 0;
+  out->lateMaxUs     = lateMaxUs;
+  out->dispatchAvgUs = dispatched ? (uint32_t)(dispatchSumUs / dispatched)
+                                  : 0;
+  out->dispatchMaxUs = dispatchMaxUs;
+}
+
+#else
+
+bool macroRecordStart(uint8_t slot) {
+  (void)slot;
+  return false;
+}
+
+void macroNoteEvent(const ButtonEvent& ev) {
+  (void)ev;
+}
+
+bool macroPlay(uint8_t slot) {
+  (void)slot;
+  return false;
+}
+
+bool macroStop(void) {
+  return true;
+}
+
+bool macroPollEvent(ButtonEvent* out) {
+  (void)out;
+  return false;
+}
+
+bool macroRecording(void) {
+  return false;
+}
+
+bool macroPlaying(void) {
+  return false;
+}
+
+int8_t macroActiveSlot(void) {
+  return -1;
+}
+
+bool macroSlotInfo(uint8_t slot, MacroSlotInfo* out) {
+  *out = MacroSlotInfo();
+  return slot < MACRO_SLOTS;
+}
+
+void macroGetStats(MacroStats* out) {
+  *out = MacroStats();
+}
+
+#endif
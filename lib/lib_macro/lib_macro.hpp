@@ -0,0 +1,78 @@
+#ifndef LIB_MACRO_HPP
+#define LIB_MACRO_HPP
+
+#include <stdint.h>
+
+#include "lib_button.hpp"
+#include "macro_track.hpp"
+
+/*
+ * lib_macro - header
+ *
+ * Footswitch macros: record the button events of a rehearsal, e.g. an
+ * intro stinger, and play them back later with the same timing.
+ *
+ * Recording takes the events as lib_button timestamped them (micros() at
+ * detection) and stores them in NVS (namespace "macro", one key per slot)
+ * in the macro_track format. Playback runs from a hardware timer (timer
+ * group 1, timer 0, on the crystal clock so frequency scaling does not
+ * stretch it): each alarm interrupt hands the due events to loop() and
+ * sets the alarm of the next one, so timing errors do not add up over a
+ * sequence. Replayed events come out of macroPollEvent() stamped with the
+ * interrupt's time, to be handled like live ones.
+ *
+ * Two figures measure the replay (macroGetStats): how late the interrupt
+ * ran against the sequence (timer counter at entry minus the event's
+ * time), and how late loop() picked the event up.
+ *
+ *   macroRecordStart(0);               // HTTP /api/macro/record?slot=0
+ *   macroNoteEvent(ev);                // each live button event
+ *   macroStop();                       // saves the recording
+ *   macroPlay(0);
+ *   while (macroPollEvent(&ev)) ...    // every loop()
+ */
+
+#define MACRO_SLOTS 4
+
+struct MacroSlotInfo {
+  uint16_t events;  // 0: empty
+  uint16_t bytes;
+  uint32_t durationUs;
+};
+
+struct MacroStats {
+  uint32_t played;         // events replayed
+  uint32_t dropped;        // replayed events loop() had no room for
+  uint32_t lateAvgUs;      // interrupt against the sequence
+  uint32_t lateMaxUs;
+  uint32_t dispatchAvgUs;  // loop() pick-up against the sequence
+  uint32_t dispatchMaxUs;
+};
+
+/* Start recording into a slot; its old content stays until macroStop().
+ * False if the slot is out of range or a macro is playing. */
+bool macroRecordStart(uint8_t slot);
+
+/* Live button events, recorded while recording. */
+void macroNoteEvent(const ButtonEvent& ev);
+
+/* Start playing a slot. False if empty, out of range, or busy. */
+bool macroPlay(uint8_t slot);
+
+/* End the recording (and save it) or the playback. False if the recording
+ * could not be saved. */
+bool macroStop(void);
+
+/* Replayed events whose time has come, oldest first. */
+bool macroPollEvent(ButtonEvent* out);
+
+bool macroRecording(void);
+bool macroPlaying(void);
+
+/* Slot being recorded or played, -1 when idle. */
+int8_t macroActiveSlot(void);
+
+bool macroSlotInfo(uint8_t slot, MacroSlotInfo* out);
+void macroGetStats(MacroStats* out);
+
+#endif  // LIB_MACRO_HPP
@@ -0,0 +1,137 @@
+/*
+ * macro_track.cpp
+ *
+ * Encoder, decoder and replay schedule of recorded footswitch sequences
+ * (see macro_track.hpp). The decoder also runs in the replay timer's
+ * interrupt, so it only walks the buffer: no calls, no allocation.
+ */
+
+#include "macro_track.hpp"
+
+static const uint8_t kMagic0  = 'M';
+static const uint8_t kMagic1  = 'K';
+static const uint8_t kVersion = 1;
+
+static const size_t kHeaderLen = 3;
+static const size_t kMaxVarint = 5;  // 32 bits
+
+MacroWriter::MacroWriter()
+    : buf_(nullptr), cap_(0), len_(0), count_(0), lastUs_(0) {}
+
+void MacroWriter::begin(uint8_t* buf, size_t cap) {
+  buf_    = buf;
+  cap_    = cap;
+  len_    = 0;
+  count_  = 0;
+  lastUs_ = 0;
+  if (cap < kHeaderLen) return;
+  buf[0] = kMagic0;
+  buf[1] = kMagic1;
+  buf[2] = kVersion;
+  len_   = kHeaderLen;
+}
+
+bool MacroWriter::add(const MacroEvent& ev) {
+  if (len_ < kHeaderLen || ev.button > 15 || ev.type > 15 ||
+      ev.offsetUs < lastUs_ || count_ == UINT16_MAX) {
+    return false;
+  }
+  uint8_t  tmp[kMaxVarint + 1];
+  size_t   n     = 0;
+  uint32_t delta = ev.offsetUs - lastUs_;
+  do {
+    uint8_t b = delta & 0x7F;
+    delta >>= 7;
+    tmp[n++] = delta ? (uint8_t)(b | 0x80) : b;
+  } while (delta);
+  tmp[n++] = (uint8_t)(ev.button << 4 | ev.type);
+  if (len_ + n > cap_) return false;
+
+  for (size_t i = 0; i < n; ++i) buf_[len_ + i] = tmp[i];
+  len_ += n;
+  lastUs_ = ev.offsetUs;
+  ++count_;
+  return true;
+}
+
+size_t MacroWriter::size() const {
+  return len_;
+}
+
+uint16_t MacroWriter::count() const {
+  return count_;
+}
+
+uint32_t MacroWriter::durationUs() const {
+  return lastUs_;
+}
+
+MacroReader::MacroReader() : data_(nullptr), len_(0), pos_(0), lastUs_(0) {}
+
+bool MacroReader::begin(const uint8_t* data, size_t len) {
+  data_   = data;
+  len_    = len;
+  pos_    = kHeaderLen;
+  lastUs_ = 0;
+  return data && len >= kHeaderLen && data[0] == kMagic0 &&
+         data[1] == kMagic1 && data[2] == kVersion;
+}
+
+bool MacroReader::next(MacroEvent* out) {
+  uint32_t delta = 0;
+  size_t   pos   = pos_;
+  for (uint8_t shift = 0;; shift += 7) {
+    if (pos >= len_ || shift >= 7 * kMaxVarint) return false;
+    uint8_t b = data_[pos++];
+    delta |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) break;
+  }
+  if (pos >= len_) return false;
+  uint8_t what = data_[pos++];
+
+  pos_    = pos;
+  lastUs_ += delta;
+
+  out->offsetUs = lastUs_;
+  out->button   = what >> 4;
+  out->type     = what & 0x0F;
+  return true;
+}
+
+bool MacroReader::atEnd() const {
+  return pos_ == len_;
+}
+
+MacroPlayer::MacroPlayer() : next_(), more_(false) {}
+
+bool MacroPlayer::begin(const uint8_t* data, size_t len) {
+  more_ = reader_.begin(data, len) && reader_.next(&next_);
+  return more_;
+}
+
+bool MacroPlayer::take(uint64_t counter, MacroEvent* out) {
+  if (!more_ || next_.offsetUs > counter + MACRO_LEAD_US) return false;
+  *out  = next_;
+  more_ = reader_.next(&next_);
+  return true;
+}
+
+uint32_t MacroPlayer::alarmUs() const {
+  return next_.offsetUs;
+}
+
+bool MacroPlayer::done() const {
+  return !more_;
+}
+
+bool macroInspect(const uint8_t* data, size_t len, uint16_t* count,
+                  uint32_t* durationUs) {
+  MacroReader r;
+  MacroEvent  ev;
+  ev.offsetUs = 0;
+  *count      = 0;
+  if (!r.begin(data, len)) return false;
+  while (r.next(&ev)) ++*count;
+  *durationUs = ev.offsetUs;
+  return r.atEnd();  // else truncated
+}
@@ -0,0 +1,120 @@
+#ifndef MACRO_TRACK_HPP
+#define MACRO_TRACK_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * macro_track - header
+ *
+ * Stored format of a recorded footswitch sequence (lib_macro): button
+ * events with their time since the first one, to the microsecond. No
+ * Arduino dependency, so it is checked on the host (test/MacroTiming).
+ *
+ *   "MK", u8 version, then per event:
+ *   delta  LEB128 varint, microseconds since the previous event (first: 0)
+ *   what   u8, button << 4 | ButtonEventType
+ *
+ * Presses a few hundred ms apart take 4 bytes an event, so a slot of
+ * MACRO_MAX_BYTES holds a little over 120 of them.
+ *
+ *   MacroWriter w;
+ *   w.begin(buf, sizeof(buf));
+ *   w.add({ev.us - firstUs, ev.button, ev.type});
+ *   store(buf, w.size());
+ *
+ *   MacroReader r;
+ *   if (r.begin(data, len)) while (r.next(&ev)) ...
+ *
+ * MacroPlayer is the replay schedule lib_macro's timer interrupt runs: on
+ * a counter that starts at the sequence's 0, it hands out the events due
+ * at the counter value read on entry and gives the counter value of the
+ * next alarm. That is the next event's own time, not a delay from the
+ * interrupt, so a late interrupt does not shift the events after it.
+ *
+ *   MacroPlayer p;
+ *   if (p.begin(data, len)) setAlarm(p.alarmUs());
+ *   while (p.take(counter, &ev)) ...     // in the alarm interrupt
+ *   if (!p.done()) setAlarm(p.alarmUs());
+ */
+
+#define MACRO_MAX_BYTES 512
+
+// Events this close after the one firing go out with it
+#define MACRO_LEAD_US 20
+
+struct MacroEvent {
+  uint32_t offsetUs;  // since the first event
+  uint8_t  button;    // 0..15
+  uint8_t  type;      // ButtonEventType, 0..15
+};
+
+class MacroWriter {
+ public:
+  MacroWriter();
+
+  // Start a sequence in buf (the header goes in right away)
+  void begin(uint8_t* buf, size_t cap);
+
+  // False when full, out of order or out of range
+  bool add(const MacroEvent& ev);
+
+  size_t   size() const;
+  uint16_t count() const;
+  uint32_t durationUs() const;
+
+ private:
+  uint8_t* buf_;
+  size_t   cap_;
+  size_t   len_;
+  uint16_t count_;
+  uint32_t lastUs_;
+};
+
+class MacroReader {
+ public:
+  MacroReader();
+
+  // False if data is not a stored sequence
+  bool begin(const uint8_t* data, size_t len);
+
+  // Next event; false at the end, or on truncated data
+  bool next(MacroEvent* out);
+
+  // All of the data was read
+  bool atEnd() const;
+
+ private:
+  const uint8_t* data_;
+  size_t         len_;
+  size_t         pos_;
+  uint32_t       lastUs_;
+};
+
+class MacroPlayer {
+ public:
+  MacroPlayer();
+
+  // False if data is not a stored sequence or holds no event
+  bool begin(const uint8_t* data, size_t len);
+
+  // Next event due at counter, or less than MACRO_LEAD_US after it
+  bool take(uint64_t counter, MacroEvent* out);
+
+  // Counter value of the next event's alarm
+  uint32_t alarmUs() const;
+
+  // Every event was taken (or the data ended early)
+  bool done() const;
+
+ private:
+  MacroReader reader_;
+  MacroEvent  next_;
+  bool        more_;
+};
+
+/* Events and length of a stored sequence. False if it is malformed. */
+bool macroInspect(const uint8_t* data, size_t len, uint16_t* count,
+                  uint32_t* durationUs);
+
+#endif  // MACRO_TRACK_HPP
@@ -0,0 +1,66 @@
+/*
+ * din_midi.cpp
+ *
+ * Serial MIDI transport (5-pin DIN / TRS): 31250 baud 8N1 on a spare UART.
+ * The UART driver calls back after every byte (RX FIFO threshold 1), the
+ * callback runs the allocation-free MidiStreamParser in the UART event
+ * task and queues complete messages with midiPushEvent(). Real-time bytes
+ * interleaved with a message are queued as they arrive. Output is plain
+ * writes, without running status.
+ */
+
+#include "lib_midi.hpp"
+#include "midi_parser.hpp"
+
+static const unsigned long kMidiBaud = 31250;
+
+static MidiStreamParser parser;
+
+void midiDinReceive(uint8_t b, uint32_t us) {
+  MidiMessage msg;
+  if (parser.feed(b, &msg)) midiPushEvent(msg, MIDI_SOURCE_DIN, us);
+  midiSetRxErrors(MIDI_SOURCE_DIN, parser.errors());
+}
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+
+static HardwareSerial* dinSerial = nullptr;
+static bool            dinTx     = false;
+
+// UART event task context
+static void onDinReceive() {
+  int b;
+  while ((b = dinSerial->read()) >= 0) {
+    midiDinReceive((uint8_t)b, micros());
+  }
+}
+
+bool midiDinBegin(HardwareSerial& serial, int8_t rxPin, int8_t txPin) {
+  dinSerial = &serial;
+  dinTx     = txPin >= 0;
+  serial.begin(kMidiBaud, SERIAL_8N1, rxPin, txPin);
+  // one event per byte instead of per 120 bytes / RX timeout
+  serial.setRxFIFOFull(1);
+  serial.onReceive(onDinReceive);
+  return true;
+}
+
+bool midiDinSend(const MidiMessage& msg) {
+  if (!dinTx) return false;
+  // no running status on output: every message is complete on its own
+  uint8_t bytes[3] = {msg.status, msg.data1, msg.data2};
+  dinSerial->write(bytes, 1 + midiDataLength(msg.status));
+  midiNoteSent(MIDI_SOURCE_DIN);
+  return true;
+}
+
+#else
+
+bool midiDinSend(const MidiMessage& msg) {
+  (void)msg;
+  return false;
+}
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * lib_midi.cpp
+ *
+ * MIDI message helpers, USB-MIDI packet coding, action mapping and the
+ * incoming event queue shared by all MIDI transports.
+ *
+ * USB-MIDI code index numbers (CIN) used here:
+ *   0x8..0xE  channel voice, CIN = status >> 4
+ *   0x2, 0x3  system common with 1 / 2 data bytes
+ *   0x5       single byte (system common without data, or real-time)
+ *   0xF       single byte (real-time)
+ *   0x4, 0x6, 0x7  SysEx start/continue/end (not supported, skipped)
+ */
+
+#include "lib_midi.hpp"
+#include "lib_event.hpp"
+
+// One SPSC queue per source: each transport pushes from its own context
+static EventQueue<MidiEvent, 16> eventQueues[MIDI_SOURCE_COUNT];
+
+struct SourceCounters {
+  uint32_t tx;
+  uint32_t rx;
+  uint32_t rxErrors;
+  uint32_t dispatched;
+  uint64_t latencySumUs;
+  uint32_t latencyMaxUs;
+};
+static SourceCounters counters[MIDI_SOURCE_COUNT];
+
+static const char* const kSourceNames[MIDI_SOURCE_COUNT] = {"usb", "din"};
+
+const char* midiSourceName(uint8_t source) {
+  return source < MIDI_SOURCE_COUNT ? kSourceNames[source] : "?";
+}
+
+uint8_t midiDataLength(uint8_t status) {
+  if (status < 0x80) return 0;
+  if (status < MIDI_SYSTEM) {
+    uint8_t type = status & 0xF0;
+    return (type == MIDI_PROGRAM_CHANGE || type == MIDI_CHANNEL_PRESSURE) ? 1
+                                                                          : 2;
+  }
+  switch (status) {
+    case 0xF1:  // MTC quarter frame
+    case 0xF3:  // song select
+      return 1;
+    case 0xF2:  // song position
+      return 2;
+    default:
+      return 0;  // tune request, real-time, SysEx
+  }
+}
+
+bool midiFromUsbPacket(const uint8_t* packet, MidiMessage* out) {
+  uint8_t cin = packet[0] & 0x0F;
+  uint8_t len;
+  if (cin >= 0x8 && cin <= 0xE) {
+    // channel voice: the status nibble must agree with the CIN
+    if ((packet[1] >> 4) != cin) return false;
+    len = midiDataLength(packet[1]);
+  } else {
+    switch (cin) {
+      case 0x2:
+        len = 1;
+        break;
+      case 0x3:
+        len = 2;
+        break;
+      case 0x5:
+      case 0xF:
+        len = 0;
+        break;
+      default:
+        return false;
+    }
+  }
+  if (packet[1] < 0x80) return false;
+  out->status = packet[1];
+  out->data1  = len >= 1 ? (packet[2] & 0x7F) : 0;
+  out->data2  = len >= 2 ? (packet[3] & 0x7F) : 0;
+  return true;
+}
+
+void midiToUsbPacket(const MidiMessage& msg, uint8_t cable, uint8_t* packet) {
+  uint8_t cin;
+  if (msg.status < MIDI_SYSTEM) {
+    cin = msg.status >> 4;
+  } else {
+    uint8_t len = midiDataLength(msg.status);
+    cin         = len == 0 ? 0x5 : (len == 1 ? 0x2 : 0x3);
+    if (msg.status >= 0xF8) cin = 0xF;
+  }
+  packet[0] = (uint8_t)(cable << 4) | cin;
+  packet[1] = msg.status;
+  packet[2] = msg.data1;
+  packet[3] = msg.data2;
+}
+
+uint8_t midiMatchInRule(const MidiInRule* rules, uint8_t count,
+                        const MidiMessage& msg) {
+  uint8_t type = midiType(msg);
+  if (type == MIDI_NOTE_ON && msg.data2 == 0) return 0;       // Note Off
+  if (type == MIDI_CONTROL_CHANGE && msg.data2 < 64) return 0;  // CC off
+
+  for (uint8_t i = 0; i < count; ++i) {
+    const MidiInRule& r = rules[i];
+    if (r.type != type || r.number != msg.data1) continue;
+    if (r.channel != MIDI_CHANNEL_ANY && r.channel != midiChannel(msg)) {
+      continue;
+    }
+    return r.action;
+  }
+  return 0;
+}
+
+MidiMessage midiButtonMessage(const MidiOutRule& rule, bool pressed) {
+  uint8_t type = MIDI_CONTROL_CHANGE;
+  if (rule.type != MIDI_CONTROL_CHANGE) {
+    type = pressed ? MIDI_NOTE_ON : MIDI_NOTE_OFF;
+  }
+  MidiMessage m;
+  m.status = type | (rule.channel & 0x0F);
+  m.data1  = rule.number;
+  m.data2  = pressed ? 127 : 0;
+  return m;
+}
+
+bool midiPushEvent(const MidiMessage& msg, uint8_t source, uint32_t us) {
+  if (source >= MIDI_SOURCE_COUNT) return false;
+  MidiEvent ev = {msg, source, us};
+  ++counters[source].rx;
+  return eventQueues[source].push(ev);
+}
+
+bool midiPollEvent(MidiEvent* out) {
+  // Peek at each queue head and take the oldest one
+  int      best   = -1;
+  uint32_t bestUs = 0;
+  for (uint8_t s = 0; s < MIDI_SOURCE_COUNT; ++s) {
+    MidiEvent ev;
+    if (!eventQueues[s].peek(&ev)) continue;
+    if (best < 0 || (int32_t)(ev.us - bestUs) < 0) {
+      best   = s;
+      bestUs = ev.us;
+    }
+  }
+  return best >= 0 && eventQueues[best].pop(out);
+}
+
+void midiNoteDispatched(const MidiEvent& ev, uint32_t nowUs) {
+  if (ev.source >= MIDI_SOURCE_COUNT) return;
+  SourceCounters& c   = counters[ev.source];
+  uint32_t        lat = nowUs - ev.us;
+  ++c.dispatched;
+  c.latencySumUs += lat;
+  if (lat > c.latencyMaxUs) c.latencyMaxUs = lat;
+}
+
+void midiNoteSent(uint8_t source) {
+  if (source < MIDI_SOURCE_COUNT) ++counters[source].tx;
+}
+
+void midiSetRxErrors(uint8_t source, uint32_t errors) {
+  if (source < MIDI_SOURCE_COUNT) counters[source].rxErrors = errors;
+}
+
+void midiGetStats(uint8_t source, MidiStats* out) {
+  *out = MidiStats();
+  if (source >= MIDI_SOURCE_COUNT) return;
+  const SourceCounters& c = counters[source];
+
+  out->rxMessages   = c.rx;
+  out->rxErrors     = c.rxErrors;
+  out->txMessages   = c.tx;
+  out->dropped      = eventQueues[source].dropped();
+  out->dispatched   = c.dispatched;
+  out->latencyAvgUs = c.dispatched ? (uint32_t)(c.latencySumUs / c.dispatched)
+                                   : 0;
+  out->latencyMaxUs = c.latencyMaxUs;
+}
@@ -0,0 +1,163 @@
+#ifndef LIB_MIDI_HPP
+#define LIB_MIDI_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+class HardwareSerial;
+
+/*
+ * lib_midi - header
+ *
+ * MIDI messages, USB-MIDI event packets and the mapping between MIDI and
+ * footswitch actions. Everything here is plain C++ (no Arduino, no
+ * TinyUSB), so it runs in host builds; the transports are in usb_midi.cpp
+ * (USB device) and din_midi.cpp (serial MIDI, see midi_parser.hpp).
+ *
+ * Incoming messages from any transport are timestamped and queued; the
+ * application drains them with midiPollEvent() in loop(), next to the
+ * button events, and reports back when the mapped action has run so the
+ * transport-to-action latency is measured:
+ *
+ *   MidiEvent ev;
+ *   while (midiPollEvent(&ev)) {
+ *     uint8_t action = midiMatchInRule(rules, count, ev.msg);
+ *     if (action) runAction(action);
+ *     midiNoteDispatched(ev, micros());
+ *   }
+ */
+
+/* Status nibbles of channel voice messages */
+enum MidiType : uint8_t {
+  MIDI_NOTE_OFF         = 0x80,
+  MIDI_NOTE_ON          = 0x90,
+  MIDI_POLY_PRESSURE    = 0xA0,
+  MIDI_CONTROL_CHANGE   = 0xB0,
+  MIDI_PROGRAM_CHANGE   = 0xC0,
+  MIDI_CHANNEL_PRESSURE = 0xD0,
+  MIDI_PITCH_BEND       = 0xE0,
+  MIDI_SYSTEM           = 0xF0
+};
+
+#define MIDI_CHANNEL_ANY 0xFF
+
+struct MidiMessage {
+  uint8_t status;  // with channel in the low nibble (channel voice)
+  uint8_t data1;
+  uint8_t data2;
+};
+
+static inline uint8_t midiType(const MidiMessage& m) {
+  return m.status < MIDI_SYSTEM ? (m.status & 0xF0) : m.status;
+}
+
+static inline uint8_t midiChannel(const MidiMessage& m) {
+  return m.status & 0x0F;
+}
+
+/* Data bytes that follow a status byte (0..2; 0 for real-time/SysEx). */
+uint8_t midiDataLength(uint8_t status);
+
+/* USB-MIDI 1.0 event packet (4 bytes: cable/code index, 3 MIDI bytes).
+ * Decoding keeps channel voice, system common and real-time messages;
+ * SysEx packets are skipped (returns false). */
+bool midiFromUsbPacket(const uint8_t* packet, MidiMessage* out);
+void midiToUsbPacket(const MidiMessage& msg, uint8_t cable, uint8_t* packet);
+
+/* Mapping: incoming message -> application action (0 = none) */
+struct MidiInRule {
+  uint8_t type;     // MidiType (NOTE_ON, CONTROL_CHANGE, PROGRAM_CHANGE...)
+  uint8_t channel;  // 0..15 or MIDI_CHANNEL_ANY
+  uint8_t number;   // note, controller or program
+  uint8_t action;
+};
+
+/* Action of the first rule matching msg; 0 when none does. A Note On with
+ * velocity 0 is a Note Off and a CC only triggers on values >= 64. */
+uint8_t midiMatchInRule(const MidiInRule* rules, uint8_t count,
+                        const MidiMessage& msg);
+
+/* Mapping: footswitch -> outgoing message */
+struct MidiOutRule {
+  uint8_t type;     // MIDI_NOTE_ON or MIDI_CONTROL_CHANGE
+  uint8_t channel;  // 0..15
+  uint8_t number;   // note or controller
+};
+
+/* Message for a footswitch edge: Note On 127 / Note Off, or CC 127 / 0. */
+MidiMessage midiButtonMessage(const MidiOutRule& rule, bool pressed);
+
+/* Where an incoming message came from */
+enum MidiSource : uint8_t {
+  MIDI_SOURCE_USB = 0,
+  MIDI_SOURCE_DIN,
+  MIDI_SOURCE_COUNT
+};
+
+/* "usb", "din" */
+const char* midiSourceName(uint8_t source);
+
+struct MidiEvent {
+  MidiMessage msg;
+  uint8_t     source;  // MidiSource
+  uint32_t    us;      // micros() when the message was complete
+};
+
+/* Producer side. Each source has its own queue, so every transport may
+ * push from its own task or ISR. Returns false when the queue is full. */
+bool midiPushEvent(const MidiMessage& msg, uint8_t source, uint32_t us);
+
+/* Consumer side (loop): the oldest event of all sources. */
+bool midiPollEvent(MidiEvent* out);
+
+/* Record that ev has been acted upon at nowUs (micros()); feeds the
+ * latency statistics. */
+void midiNoteDispatched(const MidiEvent& ev, uint32_t nowUs);
+
+struct MidiStats {
+  uint32_t rxMessages;
+  uint32_t rxErrors;  // bytes or packets the transport could not decode
+  uint32_t txMessages;
+  uint32_t dropped;  // queue full
+  uint32_t dispatched;
+  uint32_t latencyAvgUs;  // receive -> action done
+  uint32_t latencyMaxUs;
+};
+
+void midiGetStats(uint8_t source, MidiStats* out);
+
+/* Transports */
+
+/* USB-MIDI device interface (TinyUSB, composite with the CDC console).
+ * Needs ARDUINO_USB_MODE=0; returns false where USB MIDI is not built in
+ * (host builds, HW CDC mode). */
+bool midiUsbAvailable(void);
+
+/* Send one message on USB (cable 0). Counted in txMessages when sent.
+ * False on the target when it was not (no host, or no USB MIDI built in);
+ * host builds count every message as sent. */
+bool midiUsbSend(const MidiMessage& msg);
+
+/* For transports: count one message sent / set the receive error count. */
+void midiNoteSent(uint8_t source);
+void midiSetRxErrors(uint8_t source, uint32_t errors);
+
+/* Entry point for received USB-MIDI packets: called by the TinyUSB
+ * receive callback, or directly by host simulations. */
+void midiUsbReceive(const uint8_t* packet, uint32_t us);
+
+/* Serial MIDI (5-pin DIN / TRS, input through an optocoupler) on a spare
+ * UART at 31250 baud; txPin -1 for input only. Bytes are parsed in the UART
+ * event task as they arrive (onReceive() with a one-byte RX FIFO
+ * threshold), so a message is timestamped when its last byte is in. */
+bool midiDinBegin(HardwareSerial& serial, int8_t rxPin, int8_t txPin = -1);
+
+/* Send one message on the serial MIDI output, if it has a TX pin. Counted
+ * in txMessages when sent. */
+bool midiDinSend(const MidiMessage& msg);
+
+/* Entry point for received serial MIDI bytes: called by the UART receive
+ * callback, or directly by host simulations. */
+void midiDinReceive(uint8_t b, uint32_t us);
+
+#endif  // LIB_MIDI_HPP
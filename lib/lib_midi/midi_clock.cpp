@@ -0,0 +1,353 @@
+/*
+ * midi_clock.cpp
+ *
+ * MIDI clock tracker (see midi_clock.hpp) and clock output.
+ *
+ * Tracker loop, per accepted tick with error e = tick - prediction:
+ *   period     += freqGain * e
+ *   prediction += period + phaseGain * e
+ * Acquisition uses high gains to settle within a beat. Once locked the
+ * gains drop, so a single late tick moves the tempo by a few hundredths of
+ * a percent while a tempo ramp is still followed within a couple of beats
+ * (see test/MidiClockReplay).
+ */
+
+#include "midi_clock.hpp"
+#include "lib_midi.hpp"
+
+#include <math.h>
+
+// Loop gains while acquiring and once locked (less jitter gets through)
+static const float kAcquirePhaseGain = 0.25f;
+static const float kAcquireFreqGain  = 0.05f;
+static const float kLockedPhaseGain  = 0.15f;
+static const float kLockedFreqGain   = 0.008f;
+
+// A tick further than this part of a period from the prediction is rejected
+static const float kRejectFraction = 0.4f;
+
+// Ticks in a row needed for the lock: one quarter note
+static const uint8_t kLockTicks = MIDI_CLOCK_PPQN;
+
+// Rejected ticks in a row before re-acquiring (tempo jump)
+static const uint8_t kMaxMisses = 4;
+
+// Missing ticks that are bridged at most
+static const uint8_t kMaxBridge = 4;
+
+// No tick for this many periods: the clock has stopped
+static const uint8_t kTimeoutPeriods = 4;
+
+static const float kMinPeriodUs =
+    60e6f / (MIDI_CLOCK_MAX_BPM * MIDI_CLOCK_PPQN);
+static const float kMaxPeriodUs =
+    60e6f / (MIDI_CLOCK_MIN_BPM * MIDI_CLOCK_PPQN);
+
+// bpm * 100 = kBpmX100Us / tick period in us
+static const float kBpmX100Us = 60e6f * 100 / MIDI_CLOCK_PPQN;
+
+MidiClockTracker::MidiClockTracker() {
+  reset();
+}
+
+void MidiClockTracker::reset() {
+  restart();
+  running_  = false;
+  ticks_    = 0;
+  rejected_ = 0;
+  bridged_  = 0;
+}
+
+// Forget the tempo, keep the counters
+void MidiClockTracker::restart() {
+  locked_      = false;
+  haveTick_    = false;
+  lastUs_      = 0;
+  predictedUs_ = 0;
+  phase_       = 0;
+  period_      = 0;
+  good_        = 0;
+  misses_      = 0;
+  jitter_      = 0;
+  jitterMaxUs_ = 0;
+}
+
+void MidiClockTracker::advance(float us) {
+  float    t     = phase_ + us;
+  uint32_t whole = (uint32_t)t;
+  predictedUs_ += whole;
+  phase_ = t - whole;
+}
+
+// Start over from the interval ending at us
+void MidiClockTracker::acquire(uint32_t us) {
+  float interval = (float)(us - lastUs_);
+  lastUs_        = us;
+  locked_        = false;
+  good_          = 0;
+  misses_        = 0;
+  jitter_        = 0;
+  if (interval < kMinPeriodUs || interval > kMaxPeriodUs) {
+    period_ = 0;  // out of range: wait for the next interval
+    return;
+  }
+  period_      = interval;
+  predictedUs_ = us;
+  phase_       = 0;
+  advance(period_);
+}
+
+void MidiClockTracker::tick(uint32_t us) {
+  if (!haveTick_) {
+    haveTick_ = true;
+    lastUs_   = us;
+    return;
+  }
+  if (period_ == 0) {
+    acquire(us);
+    ++ticks_;
+    return;
+  }
+
+  float err = (float)(int32_t)(us - predictedUs_) - phase_;
+
+  // Bridge ticks lost on the wire: the error is then close to a multiple
+  // of the period. Only once locked, before that the period itself may be
+  // a multiple of the real one.
+  if (locked_ && err > period_ / 2) {
+    float n    = floorf(err / period_ + 0.5f);
+    float rest = fabsf(err - n * period_);
+    if (n <= kMaxBridge && rest < kRejectFraction * period_) {
+      advance(n * period_);
+      err -= n * period_;
+      ticks_ += (uint32_t)n;
+      bridged_ += (uint32_t)n;
+    }
+  }
+
+  if (fabsf(err) > kRejectFraction * period_) {
+    ++rejected_;
+    if (!locked_ || ++misses_ >= kMaxMisses) acquire(us);
+    return;
+  }
+  misses_ = 0;
+  ++ticks_;
+  lastUs_ = us;
+
+  uint32_t absErr = (uint32_t)fabsf(err);
+  jitter_ += (fabsf(err) - jitter_) / 16;
+  if (locked_ && absErr > jitterMaxUs_) jitterMaxUs_ = absErr;
+
+  float phaseGain = locked_ ? kLockedPhaseGain : kAcquirePhaseGain;
+  float freqGain  = locked_ ? kLockedFreqGain : kAcquireFreqGain;
+  period_ += freqGain * err;
+  if (period_ < kMinPeriodUs) period_ = kMinPeriodUs;
+  if (period_ > kMaxPeriodUs) period_ = kMaxPeriodUs;
+  advance(period_ + phaseGain * err);
+
+  if (!locked_ && ++good_ >= kLockTicks && jitter_ < period_ / 8) {
+    locked_ = true;
+  }
+}
+
+void MidiClockTracker::feed(uint8_t status, uint32_t us) {
+  switch (status) {
+    case MIDI_CLOCK_TICK:
+      tick(us);
+      break;
+    case MIDI_CLOCK_START:
+      running_ = true;
+      ticks_   = 0;
+      break;
+    case MIDI_CLOCK_CONTINUE:
+      running_ = true;
+      break;
+    case MIDI_CLOCK_STOP:
+      running_ = false;
+      break;
+    default:
+      break;
+  }
+}
+
+void MidiClockTracker::update(uint32_t nowUs) {
+  if (!haveTick_) return;
+  float timeout = period_ > 0 ? period_ * kTimeoutPeriods : kMaxPeriodUs * 2;
+  if ((float)(nowUs - lastUs_) > timeout) {
+    restart();
+    running_ = false;
+  }
+}
+
+void MidiClockTracker::status(MidiClockStatus* out) const {
+  out->locked      = locked_;
+  out->running     = running_;
+  out->bpmX100     = locked_ ? (uint32_t)(kBpmX100Us / period_ + 0.5f) : 0;
+  out->periodUs    = (uint32_t)(period_ + 0.5f);
+  out->ticks       = ticks_;
+  out->jitterUs    = (uint32_t)(jitter_ + 0.5f);
+  out->jitterMaxUs = jitterMaxUs_;
+  out->rejected    = rejected_;
+  out->bridged     = bridged_;
+}
+
+uint32_t MidiClockTracker::nextTickUs() const {
+  return predictedUs_;
+}
+
+uint32_t MidiClockTracker::nextBeatUs() const {
+  uint32_t left = (MIDI_CLOCK_PPQN - ticks_ % MIDI_CLOCK_PPQN) %
+                  MIDI_CLOCK_PPQN;
+  return predictedUs_ + (uint32_t)(left * period_ + phase_);
+}
+
+MidiClockTracker& midiClockIn(void) {
+  static MidiClockTracker tracker;
+  return tracker;
+}
+
+/* Clock output */
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+
+#include "esp_timer.h"
+
+static esp_timer_handle_t outTimer       = nullptr;
+static volatile uint32_t  outPeriodNs    = 0;  // wanted, 0 = stopped
+static uint32_t           outRunNs       = 0;  // in use by the timer task
+static int64_t            outDueNs       = 0;  // next tick deadline
+static uint32_t           outBpmX100     = 0;
+static uint32_t           outTicks       = 0;
+static uint64_t           outJitterSumUs = 0;
+static uint32_t           outJitterMaxUs = 0;
+static uint8_t            outBeatTick    = 0;  // next tick's place in a beat
+
+// Beat time to line up with, handed to the timer task (0 = none)
+static portMUX_TYPE outMux     = portMUX_INITIALIZER_UNLOCKED;
+static int64_t      outAlignNs = 0;
+
+// Shift of the next deadline that brings the next beat tick closer to the
+// requested beat grid, at most a 16th of a period
+static int64_t alignShiftNs(uint32_t period) {
+  portENTER_CRITICAL(&outMux);
+  int64_t beatNs = outAlignNs;
+  outAlignNs     = 0;
+  portEXIT_CRITICAL(&outMux);
+  if (!beatNs) return 0;
+
+  int64_t beatLen = (int64_t)period * MIDI_CLOCK_PPQN;
+  int64_t tickNs  = outDueNs + (int64_t)(MIDI_CLOCK_PPQN - outBeatTick) %
+                                  MIDI_CLOCK_PPQN * period;
+  int64_t err     = (tickNs - beatNs) % beatLen;  // beats away do not count
+  if (err > beatLen / 2) err -= beatLen;
+  if (err < -beatLen / 2) err += beatLen;
+  int64_t step = period / 16;
+  return err > step ? -step : err < -step ? step : -err;
+}
+
+static void sendRealtime(uint8_t status) {
+  MidiMessage msg = {status, 0, 0};
+  midiUsbSend(msg);
+  midiDinSend(msg);
+}
+
+// esp_timer task context. Start, stop and tempo changes all take effect
+// here: the loop task only sets outPeriodNs and, to start or stop, fires
+// the timer.
+static void outCallback(void* arg) {
+  (void)arg;
+  uint32_t period = outPeriodNs;
+  int64_t  nowNs  = esp_timer_get_time() * 1000;
+  if (period && !outRunNs) {
+    sendRealtime(MIDI_CLOCK_START);
+    outDueNs    = nowNs;
+    outBeatTick = 0;
+  } else if (!period && outRunNs) {
+    sendRealtime(MIDI_CLOCK_STOP);
+  }
+  outRunNs = period;
+  if (!period) return;
+
+  int64_t  lateNs = nowNs - outDueNs;
+  uint32_t jitter = (uint32_t)((lateNs < 0 ? -lateNs : lateNs) / 1000);
+  sendRealtime(MIDI_CLOCK_TICK);
+  ++outTicks;
+  outBeatTick = (outBeatTick + 1) % MIDI_CLOCK_PPQN;
+  outJitterSumUs += jitter;
+  if (jitter > outJitterMaxUs) outJitterMaxUs = jitter;
+
+  // Next deadline from this one; after a stall longer than a period, drop
+  // the missed ticks instead of sending them in a burst
+  outDueNs += period;
+  outDueNs += alignShiftNs(period);
+  if (outDueNs <= nowNs) outDueNs = nowNs + period;
+  esp_timer_start_once(outTimer, (uint64_t)((outDueNs - nowNs) / 1000));
+}
+
+bool midiClockOutSetTempo(uint32_t bpmX100) {
+  if (bpmX100 && (bpmX100 < MIDI_CLOCK_MIN_BPM * 100 ||
+                  bpmX100 > MIDI_CLOCK_MAX_BPM * 100)) {
+    return false;
+  }
+  if (!outTimer) {
+    const esp_timer_create_args_t args = {
+        .callback              = &outCallback,
+        .arg                   = nullptr,
+        .dispatch_method       = ESP_TIMER_TASK,
+        .name                  = "midi_clock",
+        .skip_unhandled_events = false,
+    };
+    if (esp_timer_create(&args, &outTimer) != ESP_OK) return false;
+  }
+
+  // 60e9 ns per minute / (bpm * 24)
+  uint32_t periodNs =
+      bpmX100 ? (uint32_t)(60000000000ULL * 100 / MIDI_CLOCK_PPQN / bpmX100)
+              : 0;
+  bool wasRunning = outPeriodNs != 0;
+  outBpmX100      = bpmX100;
+  outPeriodNs     = periodNs;
+  // a new tempo waits for the next tick
+  if ((periodNs != 0) == wasRunning) return true;
+
+  // Start or stop now. If the callback re-arms the timer in between, the
+  // start fails as already armed: that run sees the new period too.
+  esp_timer_stop(outTimer);
+  esp_err_t err = esp_timer_start_once(outTimer, 0);
+  return err == ESP_OK || err == ESP_ERR_INVALID_STATE;
+}
+
+bool midiClockOutAlign(int64_t beatUs) {
+  if (!outPeriodNs || beatUs <= 0) return false;
+  portENTER_CRITICAL(&outMux);
+  outAlignNs = beatUs * 1000;
+  portEXIT_CRITICAL(&outMux);
+  return true;
+}
+
+void midiClockOutGetStats(MidiClockOutStats* out) {
+  out->bpmX100     = outBpmX100;
+  out->ticks       = outTicks;
+  out->jitterAvgUs = outTicks ? (uint32_t)(outJitterSumUs / outTicks) : 0;
+  out->jitterMaxUs = outJitterMaxUs;
+}
+
+#else
+
+bool midiClockOutSetTempo(uint32_t bpmX100) {
+  (void)bpmX100;
+  return false;
+}
+
+bool midiClockOutAlign(int64_t beatUs) {
+  (void)beatUs;
+  return false;
+}
+
+void midiClockOutGetStats(MidiClockOutStats* out) {
+  *out = MidiClockOutStats();
+}
+
+#endif
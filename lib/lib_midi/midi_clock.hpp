@@ -0,0 +1,114 @@
+#ifndef MIDI_CLOCK_HPP
+#define MIDI_CLOCK_HPP
+
+#include <stdint.h>
+
+/*
+ * midi_clock - header
+ *
+ * MIDI clock (24 ppqn) input tracking and clock output.
+ *
+ * MidiClockTracker follows an incoming clock with a second order PLL: each
+ * tick is compared with the predicted tick time, a fraction of the error
+ * corrects the phase and a smaller fraction the period. Timestamp jitter
+ * (USB frames, UART events, the sender's own timer) averages out instead of
+ * showing up in the tempo, a tick far from the prediction is rejected, and
+ * ticks lost on the wire are bridged. Plain C++, so recorded clock streams
+ * can be replayed on the host (test/MidiClockReplay).
+ *
+ *   tracker.feed(ev.msg.status, ev.us);  // 0xF8, 0xFA, 0xFB, 0xFC
+ *   tracker.update(micros());            // in loop(): detects a stopped clock
+ *   tracker.status(&st);                 // st.bpmX100 = 12000 at 120 BPM
+ */
+
+#define MIDI_CLOCK_PPQN 24
+
+#define MIDI_CLOCK_TICK     0xF8
+#define MIDI_CLOCK_START    0xFA
+#define MIDI_CLOCK_CONTINUE 0xFB
+#define MIDI_CLOCK_STOP     0xFC
+
+// Tempo range accepted by the tracker and the output
+#define MIDI_CLOCK_MIN_BPM 20
+#define MIDI_CLOCK_MAX_BPM 300
+
+struct MidiClockStatus {
+  bool     locked;       // tempo is valid
+  bool     running;      // between Start/Continue and Stop
+  uint32_t bpmX100;      // 0 while not locked
+  uint32_t periodUs;     // tick period estimate
+  uint32_t ticks;        // since Start (bridged ticks included)
+  uint32_t jitterUs;     // smoothed |tick - prediction|
+  uint32_t jitterMaxUs;  // while locked
+  uint32_t rejected;     // ticks too far from the prediction
+  uint32_t bridged;      // missing ticks filled in
+};
+
+class MidiClockTracker {
+ public:
+  MidiClockTracker();
+
+  // real-time message status (anything else is ignored) received at us
+  void feed(uint8_t status, uint32_t us);
+
+  // drops the lock once no tick arrived for a few periods
+  void update(uint32_t nowUs);
+
+  void status(MidiClockStatus* out) const;
+
+  // predicted time of the next tick and of the next quarter note; only
+  // meaningful while locked
+  uint32_t nextTickUs() const;
+  uint32_t nextBeatUs() const;
+
+  // back to the constructed state, counters included
+  void reset();
+
+ private:
+  void restart();
+  void tick(uint32_t us);
+  void acquire(uint32_t us);
+  void advance(float us);
+
+  bool     locked_;
+  bool     running_;
+  bool     haveTick_;
+  uint32_t lastUs_;       // last accepted tick
+  uint32_t predictedUs_;  // next tick, whole microseconds
+  float    phase_;        // and the fraction
+  float    period_;       // 0 until the first interval
+  uint8_t  good_;         // consecutive ticks accepted before the lock
+  uint8_t  misses_;       // consecutive rejected ticks
+  uint32_t ticks_;
+  float    jitter_;
+  uint32_t jitterMaxUs_;
+  uint32_t rejected_;
+  uint32_t bridged_;
+};
+
+/* Clock output on USB-MIDI and serial MIDI (when it has a TX pin), 24 ppqn.
+ * Ticks come from an esp_timer (system timer); each one is scheduled from
+ * the previous deadline rather than from when its callback ran, so
+ * dispatch delays show up as jitter but never as tempo drift. A tempo from
+ * 0 sends Start, 0 sends Stop. Returns false if the timer is unavailable. */
+bool midiClockOutSetTempo(uint32_t bpmX100);
+
+/* Line the running output up with an external beat grid (Link): beatUs is
+ * the esp_timer time of a quarter note. Each tick moves by at most 1/16 of
+ * a tick period, so receivers see a short tempo nudge instead of a jump;
+ * call it again as the grid moves on. False while the output is stopped. */
+bool midiClockOutAlign(int64_t beatUs);
+
+struct MidiClockOutStats {
+  uint32_t bpmX100;
+  uint32_t ticks;
+  uint32_t jitterAvgUs;  // |callback time - deadline|
+  uint32_t jitterMaxUs;
+};
+
+void midiClockOutGetStats(MidiClockOutStats* out);
+
+/* Tracker fed by the application with the clock of all MIDI inputs. */
+MidiClockTracker& midiClockIn(void);
+
+#endif  // MIDI_CLOCK_HPP
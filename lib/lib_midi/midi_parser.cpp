@@ -0,0 +1,63 @@
+/*
+ * midi_parser.cpp
+ *
+ * Serial MIDI byte stream -> messages (see midi_parser.hpp).
+ */
+
+#include "midi_parser.hpp"
+
+static const uint8_t kSysExStart = 0xF0;
+static const uint8_t kSysExEnd   = 0xF7;
+
+MidiStreamParser::MidiStreamParser()
+    : status_(0), data_(), count_(0), needed_(0), sysex_(false), errors_(0) {}
+
+void MidiStreamParser::reset() {
+  status_ = 0;
+  count_  = 0;
+  needed_ = 0;
+  sysex_  = false;
+}
+
+uint32_t MidiStreamParser::errors() const {
+  return errors_;
+}
+
+bool MidiStreamParser::feed(uint8_t b, MidiMessage* out) {
+  if (b >= 0xF8) {
+    // real-time: 0xF9 and 0xFD are undefined
+    if (b == 0xF9 || b == 0xFD) return false;
+    *out = {b, 0, 0};
+    return true;
+  }
+
+  if (b & 0x80) {
+    if (count_) ++errors_;  // previous message incomplete
+    count_ = 0;
+    sysex_ = b == kSysExStart;
+    if (b == kSysExStart || b == kSysExEnd || b == 0xF4 || b == 0xF5) {
+      status_ = 0;  // SysEx and undefined system common
+      return false;
+    }
+    status_ = b;
+    needed_ = midiDataLength(b);
+    if (needed_) return false;
+    // tune request: complete, and no running status after it
+    status_ = 0;
+    *out    = {b, 0, 0};
+    return true;
+  }
+
+  if (sysex_) return false;
+  if (!status_) {
+    ++errors_;
+    return false;
+  }
+  data_[count_++] = b;
+  if (count_ < needed_) return false;
+
+  *out   = {status_, data_[0], needed_ > 1 ? data_[1] : (uint8_t)0};
+  count_ = 0;
+  if (status_ >= 0xF0) status_ = 0;  // system common: not running
+  return true;
+}
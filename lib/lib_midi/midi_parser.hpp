@@ -0,0 +1,44 @@
+#ifndef MIDI_PARSER_HPP
+#define MIDI_PARSER_HPP
+
+#include <stdint.h>
+
+#include "lib_midi.hpp"
+
+/*
+ * midi_parser - header
+ *
+ * Streaming parser for serial MIDI (DIN / TRS, 31250 baud). Fed one byte at
+ * a time, fixed size, no allocation, so it can run in the UART event task
+ * (or an ISR) as bytes arrive:
+ * - running status: data bytes without a status reuse the last channel
+ *   voice status
+ * - real-time bytes (0xF8..0xFF) may appear anywhere, even between the data
+ *   bytes of another message; they are returned at once and leave the
+ *   message in progress untouched
+ * - system common messages cancel running status
+ * - SysEx (0xF0 ... 0xF7) is skipped
+ */
+class MidiStreamParser {
+ public:
+  MidiStreamParser();
+
+  // returns true when b completed a message, stored in *out
+  bool feed(uint8_t b, MidiMessage* out);
+
+  // data bytes with no status to apply to, and messages cut short by a new
+  // status byte, since construction
+  uint32_t errors() const;
+
+  void reset();
+
+ private:
+  uint8_t  status_;  // running (channel) or pending system common status
+  uint8_t  data_[2];
+  uint8_t  count_;   // data bytes received for status_
+  uint8_t  needed_;  // data bytes status_ takes
+  bool     sysex_;
+  uint32_t errors_;
+};
+
+#endif  // MIDI_PARSER_HPP
@@ -0,0 +1,105 @@
+/*
+ * usb_midi.cpp
+ *
+ * USB-MIDI transport. On the ESP32-S3 with the TinyUSB stack
+ * (ARDUINO_USB_MODE=0) a MIDI streaming interface is added next to the CDC
+ * console, making the pedal a composite CDC + MIDI device. arduino-esp32
+ * 2.0.x has no USBMIDI class, so the interface is registered with the core's
+ * TinyUSB glue directly, before USB.begin() runs (static constructor), the
+ * same way the core's own USB classes do it.
+ *
+ * Received packets are decoded in the TinyUSB task and queued with
+ * midiPushEvent(); loop() consumes them. Everywhere else (host builds, HW
+ * CDC mode) only midiUsbReceive() is live, so simulations can inject
+ * packets; sending fails on the target and is only counted on the host.
+ */
+
+#include "lib_midi.hpp"
+
+#if defined(ARDUINO) && defined(ARDUINO_ARCH_ESP32) && \
+    __has_include("esp32-hal-tinyusb.h")
+#define USB_MIDI_TARGET 1
+#include "sdkconfig.h"
+#if CONFIG_TINYUSB_MIDI_ENABLED && !ARDUINO_USB_MODE
+#define USB_MIDI_DEVICE 1
+#endif
+#endif
+
+#if defined(USB_MIDI_DEVICE)
+
+#include <Arduino.h>
+
+#include "esp32-hal-tinyusb.h"
+
+static const uint16_t kEndpointSize = 64;  // full speed bulk
+
+static uint16_t loadDescriptor(uint8_t* dst, uint8_t* itf) {
+  uint8_t str = tinyusb_add_string_descriptor("RigKontrol MIDI");
+  uint8_t ep  = tinyusb_get_free_duplex_endpoint();
+  // audio control + MIDI streaming interfaces
+  uint8_t desc[TUD_MIDI_DESC_LEN] = {
+      TUD_MIDI_DESCRIPTOR(*itf, str, ep, (uint8_t)(0x80 | ep), kEndpointSize)};
+  *itf += 2;
+  memcpy(dst, desc, sizeof(desc));
+  return sizeof(desc);
+}
+
+namespace {
+struct UsbMidiRegistrar {
+  UsbMidiRegistrar() {
+    tinyusb_enable_interface(USB_INTERFACE_MIDI, TUD_MIDI_DESC_LEN,
+                             loadDescriptor);
+  }
+};
+UsbMidiRegistrar registrar;
+}  // namespace
+
+// TinyUSB task context
+extern "C" void tud_midi_rx_cb(uint8_t itf) {
+  (void)itf;
+  uint8_t packet[4];
+  while (tud_midi_packet_read(packet)) {
+    midiUsbReceive(packet, micros());
+  }
+}
+
+bool midiUsbAvailable(void) {
+  return tud_midi_mounted();
+}
+
+bool midiUsbSend(const MidiMessage& msg) {
+  if (!tud_midi_mounted()) return false;
+  uint8_t packet[4];
+  midiToUsbPacket(msg, 0, packet);
+  if (!tud_midi_packet_write(packet)) return false;
+  midiNoteSent(MIDI_SOURCE_USB);
+  return true;
+}
+
+#else
+
+bool midiUsbAvailable(void) {
+  return false;
+}
+
+bool midiUsbSend(const MidiMessage& msg) {
+  (void)msg;
+#if defined(USB_MIDI_TARGET)
+  // no MIDI interface in this build: nothing leaves the device
+  return false;
+#else
+  // Host builds: no USB host either, but the message is counted so host
+  // runs see the same statistics as the target.
+  midiNoteSent(MIDI_SOURCE_USB);
+  return true;
+#endif
+}
+
+#endif
+
+void midiUsbReceive(const uint8_t* packet, uint32_t us) {
+  MidiMessage msg;
+  if (midiFromUsbPacket(packet, &msg)) {
+    midiPushEvent(msg, MIDI_SOURCE_USB, us);
+  }
+}
@@ -0,0 +1,77 @@
+#include "dfplayer_frame.hpp"
+
+static const uint8_t kStart   = 0x7E;
+static const uint8_t kVersion = 0xFF;
+static const uint8_t kLength  = 0x06;
+static const uint8_t kEnd     = 0xEF;
+
+static uint16_t checksum(const uint8_t* frame) {
+  uint16_t sum = 0;
+  for (uint8_t i = 1; i < 7; ++i) sum += frame[i];
+  return (uint16_t)(0 - sum);
+}
+
+void dfEncodeFrame(const DfFrame& frame, uint8_t* out) {
+  out[0]        = kStart;
+  out[1]        = kVersion;
+  out[2]        = kLength;
+  out[3]        = frame.cmd;
+  out[4]        = frame.ack ? 1 : 0;
+  out[5]        = (uint8_t)(frame.param >> 8);
+  out[6]        = (uint8_t)frame.param;
+  uint16_t csum = checksum(out);
+  out[7]        = (uint8_t)(csum >> 8);
+  out[8]        = (uint8_t)csum;
+  out[9]        = kEnd;
+}
+
+bool dfDecodeFrame(const uint8_t* in, DfFrame* out) {
+  if (in[0] != kStart || in[1] != kVersion || in[2] != kLength ||
+      in[9] != kEnd) {
+    return false;
+  }
+  uint16_t csum = ((uint16_t)in[7] << 8) | in[8];
+  if (csum != checksum(in)) return false;
+
+  out->cmd   = in[3];
+  out->ack   = in[4] != 0;
+  out->param = ((uint16_t)in[5] << 8) | in[6];
+  return true;
+}
+
+DfFrameParser::DfFrameParser() : pos_(0), frame_(), errors_(0) {}
+
+bool DfFrameParser::feed(uint8_t b) {
+  if (pos_ == 0) {
+    if (b == kStart) buf_[pos_++] = b;  // skip noise between frames
+    return false;
+  }
+
+  buf_[pos_++] = b;
+  if (pos_ < DF_FRAME_LEN) return false;
+
+  pos_ = 0;
+  if (dfDecodeFrame(buf_, &frame_)) return true;
+
+  ++errors_;
+  // resync: restart on the last start byte seen inside the bad frame
+  for (uint8_t i = 1; i < DF_FRAME_LEN; ++i) {
+    if (buf_[i] == kStart) {
+      for (uint8_t j = i; j < DF_FRAME_LEN; ++j) buf_[pos_++] = buf_[j];
+      break;
+    }
+  }
+  return false;
+}
+
+const DfFrame& DfFrameParser::frame() const {
+  return frame_;
+}
+
+uint32_t DfFrameParser::errors() const {
+  return errors_;
+}
+
+void DfFrameParser::reset() {
+  pos_ = 0;
+}
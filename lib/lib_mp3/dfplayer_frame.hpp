@@ -0,0 +1,56 @@
+#ifndef DFPLAYER_FRAME_HPP
+#define DFPLAYER_FRAME_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * dfplayer_frame - header
+ *
+ * Encoder/decoder for the 10-byte DFPlayer Mini serial frame:
+ *
+ *   7E FF 06 CMD ACK PARAM_H PARAM_L CSUM_H CSUM_L EF
+ *
+ * where the checksum is the 16-bit two's complement of the sum of bytes
+ * 1..6. No Arduino dependencies, so it is shared by host builds
+ * (benchmarks, simulator, fault injection tests) and the target.
+ */
+
+#define DF_FRAME_LEN 10
+
+struct DfFrame {
+  uint8_t  cmd;
+  bool     ack;    // feedback requested
+  uint16_t param;
+};
+
+/* Encode frame into out[DF_FRAME_LEN]. */
+void dfEncodeFrame(const DfFrame& frame, uint8_t* out);
+
+/* Decode a complete frame. Returns false on bad framing or checksum. */
+bool dfDecodeFrame(const uint8_t* in, DfFrame* out);
+
+/* Streaming decoder: feed bytes as they arrive; resynchronizes on the start
+ * byte after any corruption. */
+class DfFrameParser {
+ public:
+  DfFrameParser();
+
+  // returns true when b completed a valid frame (available via frame())
+  bool feed(uint8_t b);
+
+  const DfFrame& frame() const;
+
+  // frames dropped for bad length/checksum/end byte since construction
+  uint32_t errors() const;
+
+  void reset();
+
+ private:
+  uint8_t  buf_[DF_FRAME_LEN];
+  uint8_t  pos_;
+  DfFrame  frame_;
+  uint32_t errors_;
+};
+
+#endif  // DFPLAYER_FRAME_HPP
@@ -1,4 +1,10 @@
+// Target only: host builds use dfplayer_frame.cpp alone
+#if defined(ARDUINO)
+
 #include "lib_mp3.hpp"
+#include "uart_fault.hpp"
+
+BusTopic<PlayerEvent> playerBus("players");
 
 MP3Player::MP3Player(uint8_t uartNum, int rxPin, int txPin, unsigned long baud)
     : player_(),
@@ -7,9 +13,13 @@ MP3Player::MP3Player(uint8_t uartNum, int rxPin, int txPin, unsigned long baud)
       rxPin_(rxPin),
       txPin_(txPin),
       baud_(baud),
+      online_(false),
       playing_(false),
       paused_(false),
-      lastTrackIndex_(0) {
+      volume_(0),
+      lastTrackIndex_(0),
+      id_(uartNum),
+      sent_{} {
   // Map uartNum to HardwareSerial reference for ESP32
   switch (uartNum_) {
     case 0:
@@ -30,23 +40,29 @@ MP3Player::MP3Player(uint8_t uartNum, int rxPin, int txPin, unsigned long baud)
   if (serial_) {
     serial_->begin(baud_, SERIAL_8N1, rxPin_, txPin_);
   }
+  // Every byte goes through the fault layer (pass-through unless configured)
+  uartFault(uartNum_).attach(serial_);
 }
 
 bool MP3Player::begin(bool isACK, bool doReset) {
   if (!serial_) return false;
   // The DFRobot library expects a Stream reference
-  bool ok = player_.begin(*serial_, isACK, doReset);
+  bool ok = player_.begin(uartFault(uartNum_), isACK, doReset);
+  online_ = ok;
   if (ok) {
     // keep internal state consistent (device started but not playing yet)
     playing_        = false;
     paused_         = false;
     lastTrackIndex_ = 0;
   }
+  notify();
   return ok;
 }
 
 void MP3Player::setVolume(uint8_t vol) {
   player_.volume(vol);
+  volume_ = vol;
+  notify();
 }
 
 void MP3Player::play(uint16_t index) {
@@ -55,6 +71,7 @@ void MP3Player::play(uint16_t index) {
   lastTrackIndex_ = index;
   playing_        = true;
   paused_         = false;
+  notify();
 }
 
 void MP3Player::togglePlayPause() {
@@ -76,10 +93,85 @@ void MP3Player::togglePlayPause() {
     playing_        = true;
     paused_         = false;
   }
+  notify();
 }
 
 void MP3Player::stopPlayback() {
   player_.stop();
   playing_ = false;
   paused_  = false;
-}
\ No newline at end of file
+  notify();
+}
+
+void MP3Player::poll() {
+  if (!player_.available()) return;
+  switch (player_.readType()) {
+    case DFPlayerCardRemoved:
+      online_  = false;
+      playing_ = false;
+      paused_  = false;
+      break;
+    case DFPlayerPlayFinished:
+      playing_ = false;
+      paused_  = false;
+      break;
+    case DFPlayerCardInserted:
+    case DFPlayerCardOnline:
+      online_ = true;
+      break;
+    default:
+      break;
+  }
+  notify();
+}
+
+bool MP3Player::isPlaying() const {
+  return playing_ && !paused_;
+}
+
+bool MP3Player::isPaused() const {
+  return playing_ && paused_;
+}
+
+bool MP3Player::isOnline() const {
+  return online_;
+}
+
+uint8_t MP3Player::volume() const {
+  return volume_;
+}
+
+uint16_t MP3Player::lastTrack() const {
+  return lastTrackIndex_;
+}
+
+PlayerState MP3Player::state() const {
+  if (!online_) return PLAYER_OFFLINE;
+  if (!playing_) return PLAYER_STOPPED;
+  return paused_ ? PLAYER_PAUSED : PLAYER_PLAYING;
+}
+
+void MP3Player::setLastTrack(uint16_t index) {
+  lastTrackIndex_ = index;
+  notify();
+}
+
+void MP3Player::setId(uint8_t id) {
+  id_ = id;
+}
+
+void MP3Player::notify() {
+  PlayerEvent ev;
+  ev.player = id_;
+  ev.state  = state();
+  ev.volume = volume_;
+  ev.track  = lastTrackIndex_;
+  if (ev.player == sent_.player && ev.state == sent_.state &&
+      ev.volume == sent_.volume && ev.track == sent_.track) {
+    return;
+  }
+  sent_ = ev;
+  playerBus.publish(ev);
+}
+
+#endif  // ARDUINO
@@ -4,6 +4,8 @@
 #include <Arduino.h>
 #include <DFRobotDFPlayerMini.h>
 
+#include "lib_bus.hpp"
+
 /*
  * lib_mp3 - multi-instance wrapper around DFRobotDFPlayerMini for ESP32-S3
  *
@@ -14,8 +16,30 @@
  *   hw1.play(1);
  *   hw1.togglePlayPause();
  *   hw1.stopPlayback();
+ *
+ * The player talks to its UART through uartFault(uartNum) (uart_fault.hpp),
+ * which can inject link faults and reports command/ACK metrics.
+ *
+ * Every change of a player's state, track or volume is published on
+ * playerBus, from the task that drives the player.
  */
 
+enum PlayerState : uint8_t {
+  PLAYER_OFFLINE = 0,
+  PLAYER_STOPPED,
+  PLAYER_PLAYING,
+  PLAYER_PAUSED
+};
+
+struct PlayerEvent {
+  uint8_t  player;  // setId(), default: the UART number
+  uint8_t  state;   // PlayerState
+  uint8_t  volume;
+  uint16_t track;   // lastTrack()
+};
+
+extern BusTopic<PlayerEvent> playerBus;
+
 class MP3Player {
  public:
   // uartNum: 0..2 (ESP32 UART indices). rxPin/txPin: hardware pins for that
@@ -34,7 +58,27 @@ class MP3Player {
   // stop playback and reset playing state
   void stopPlayback();
 
+  // read pending DFPlayer messages (track finished, card removed, ...) and
+  // update playing state accordingly. Call regularly from loop().
+  void poll();
+
+  // state accessors (used to persist/restore state across deep sleep)
+  bool     isPlaying() const;
+  bool     isPaused() const;
+  // begin() succeeded and the SD card was not removed since
+  bool     isOnline() const;
+  uint8_t  volume() const;
+  uint16_t lastTrack() const;
+  PlayerState state() const;
+  // set the track resumed by togglePlayPause() without starting playback
+  void setLastTrack(uint16_t index);
+  // number carried by this player's PlayerEvents
+  void setId(uint8_t id);
+
  private:
+  // publish on playerBus if anything changed since the last event
+  void notify();
+
   DFRobotDFPlayerMini player_;
   HardwareSerial*     serial_;
   uint8_t             uartNum_;
@@ -43,9 +87,14 @@ class MP3Player {
   unsigned long       baud_;
 
   // internal state tracking for toggle behavior
+  bool     online_;
   bool     playing_;
   bool     paused_;
+  uint8_t  volume_;
   uint16_t lastTrackIndex_;
+
+  uint8_t     id_;
+  PlayerEvent sent_;
 };
 
 #endif  // LIB_MP3_HPP
\ No newline at end of file
@@ -0,0 +1,318 @@
+/*
+ * uart_fault.cpp
+ *
+ * Fault injection layer for the DFPlayer UARTs (see uart_fault.hpp).
+ *
+ * RX bytes are pulled from the real UART as soon as the library looks at
+ * the stream, faults are applied, and the result goes through a small queue
+ * that releases each byte at its (possibly delayed) ready time. TX bytes are
+ * written through directly unless a delay is pending, in which case they
+ * queue behind it so the byte order on the wire is kept.
+ *
+ * With no fault configured both queues stay empty and every call is a
+ * plain pass-through, apart from the protocol watch used for the metrics.
+ */
+
+#include "uart_fault.hpp"
+
+static const uint8_t kFrameStart = 0x7E;
+static const uint8_t kCmdAck     = 0x41;
+
+// Frame scope: bytes of a hit frame that UART_FAULT_CORRUPT may flip
+// (CMD .. CSUM_L), or all of them for the other classes
+static const uint8_t kFirstCorruptByte = 3;
+static const uint8_t kCorruptBytes     = 6;
+static const uint8_t kAllBytes         = 0xFF;
+
+UartFault::UartFault()
+    : inner_(nullptr),
+      cfg_(),
+      rng_(1),
+      rxQueue_(),
+      txQueue_(),
+      rxChan_(),
+      txChan_(),
+      txParser_(),
+      rxParser_(),
+      cmdPending_(false),
+      cmdSentUs_(0),
+      inFault_(false),
+      faultStartUs_(0),
+      ackLatencySumUs_(0),
+      stats_() {}
+
+void UartFault::attach(Stream* inner) {
+  inner_ = inner;
+}
+
+void UartFault::configure(const UartFaultConfig& cfg) {
+  cfg_    = cfg;
+  rng_    = cfg.seed ? cfg.seed : 1;
+  rxChan_ = Channel();
+  txChan_ = Channel();
+}
+
+const UartFaultConfig& UartFault::config() const {
+  return cfg_;
+}
+
+void UartFault::stats(UartFaultStats* out) const {
+  *out = stats_;
+  out->ackLatencyAvgUs =
+      stats_.acks ? (uint32_t)(ackLatencySumUs_ / stats_.acks) : 0;
+}
+
+void UartFault::resetStats() {
+  stats_           = UartFaultStats();
+  ackLatencySumUs_ = 0;
+  cmdPending_      = false;
+  inFault_         = false;
+}
+
+/* xorshift32: cheap, and the same sequence on target and host */
+uint32_t UartFault::nextRandom() {
+  rng_ ^= rng_ << 13;
+  rng_ ^= rng_ >> 17;
+  rng_ ^= rng_ << 5;
+  return rng_;
+}
+
+bool UartFault::decide(Channel& ch, uint8_t dir, uint8_t b) {
+  if (cfg_.cls == UART_FAULT_NONE || !(cfg_.dirs & dir)) return false;
+
+  if (cfg_.scope == UART_FAULT_BYTES) {
+    return nextRandom() % 1000 < cfg_.permille;
+  }
+  if (ch.framePos == 0) {
+    // bytes between frames are never touched in frame scope
+    if (b != kFrameStart) return false;
+    ch.framePos = DF_FRAME_LEN;
+    ch.frameHit = nextRandom() % 1000 < cfg_.permille;
+    // corrupt: one bit of one byte from CMD to the checksum, so the frame
+    // keeps its start and end bytes and the parser rejects it as an error
+    // instead of skipping it as noise
+    ch.hitByte = cfg_.cls == UART_FAULT_CORRUPT
+                     ? (uint8_t)(kFirstCorruptByte +
+                                 nextRandom() % kCorruptBytes)
+                     : kAllBytes;
+  }
+  uint8_t pos = DF_FRAME_LEN - ch.framePos--;
+  return ch.frameHit && (ch.hitByte == kAllBytes || ch.hitByte == pos);
+}
+
+uint8_t UartFault::corrupt(uint8_t b) {
+  return b ^ (uint8_t)(1u << (nextRandom() % 8));
+}
+
+// A fault starts an episode when it can hit a command exchange: any TX
+// fault, or an RX fault while an ACK is awaited. Faults on unsolicited
+// reports are only counted.
+void UartFault::noteFault(uint8_t dir, uint32_t now) {
+  ++stats_.injected;
+  if (!inFault_ && (dir == UART_FAULT_TX || cmdPending_)) {
+    inFault_      = true;
+    faultStartUs_ = now;
+  }
+}
+
+// The link is usable again: ACK received or the library timed out
+void UartFault::endFault(uint32_t now) {
+  if (!inFault_) return;
+  inFault_              = false;
+  stats_.lastRecoveryUs = now - faultStartUs_;
+  if (stats_.lastRecoveryUs > stats_.maxRecoveryUs) {
+    stats_.maxRecoveryUs = stats_.lastRecoveryUs;
+  }
+  ++stats_.recoveries;
+}
+
+bool UartFault::push(Queue& q, uint8_t b, uint32_t readyUs) {
+  if (q.count == UART_FAULT_QUEUE_LEN) {
+    ++stats_.overflows;
+    return false;
+  }
+  // keep FIFO order: a byte is never ready before the one ahead of it
+  if (q.count) {
+    uint8_t  last   = (q.head + q.count - 1) % UART_FAULT_QUEUE_LEN;
+    uint32_t prevUs = q.items[last].readyUs;
+    if ((int32_t)(readyUs - prevUs) < 0) readyUs = prevUs;
+  }
+  q.items[(q.head + q.count) % UART_FAULT_QUEUE_LEN] = {b, readyUs};
+  ++q.count;
+  return true;
+}
+
+void UartFault::sendRaw(uint8_t b) {
+  if (inner_) inner_->write(b);
+}
+
+/* Move due TX bytes to the wire and new RX bytes into the queue, as many
+ * as it has room for. */
+void UartFault::pump() {
+  if (!inner_) return;
+  uint32_t now = micros();
+
+  while (txQueue_.count &&
+         (int32_t)(now - txQueue_.items[txQueue_.head].readyUs) >= 0) {
+    sendRaw(txQueue_.items[txQueue_.head].b);
+    txQueue_.head = (txQueue_.head + 1) % UART_FAULT_QUEUE_LEN;
+    --txQueue_.count;
+  }
+
+  // a full queue leaves the rest in the UART's own buffer: nothing is lost
+  // to the layer, faults or not
+  while (rxQueue_.count < UART_FAULT_QUEUE_LEN && inner_->available() > 0) {
+    int r = inner_->read();
+    if (r < 0) break;
+    uint8_t b = (uint8_t)r;
+    if (!decide(rxChan_, UART_FAULT_RX, b)) {
+      push(rxQueue_, b, now);
+      continue;
+    }
+    noteFault(UART_FAULT_RX, now);
+    switch (cfg_.cls) {
+      case UART_FAULT_DROP:
+        break;
+      case UART_FAULT_DELAY:
+        push(rxQueue_, b, now + cfg_.delayUs);
+        break;
+      case UART_FAULT_DUPLICATE:
+        push(rxQueue_, b, now);
+        push(rxQueue_, b, now);
+        break;
+      case UART_FAULT_CORRUPT:
+        push(rxQueue_, corrupt(b), now);
+        break;
+      default:
+        push(rxQueue_, b, now);
+        break;
+    }
+  }
+}
+
+void UartFault::checkTimeout(uint32_t now) {
+  const uint32_t timeoutUs = (uint32_t)UART_FAULT_ACK_TIMEOUT_MS * 1000;
+  if (cmdPending_ && now - cmdSentUs_ >= timeoutUs) {
+    cmdPending_ = false;
+    ++stats_.ackTimeouts;
+    // the library gives up on the ACK here and carries on
+    endFault(cmdSentUs_ + timeoutUs);
+  }
+}
+
+/* Commands as the library meant to send them (before faults) */
+void UartFault::watchTx(uint8_t b) {
+  if (!txParser_.feed(b) || !txParser_.frame().ack) return;
+  uint32_t now = micros();
+  checkTimeout(now);
+  if (cmdPending_) {
+    ++stats_.ackTimeouts;  // superseded without an ACK
+    endFault(now);
+  }
+  cmdPending_ = true;
+  cmdSentUs_  = now;
+  ++stats_.commands;
+}
+
+/* Frames as the library receives them (after faults) */
+void UartFault::watchRx(uint8_t b) {
+  uint32_t errors = rxParser_.errors();
+  bool     done   = rxParser_.feed(b);
+  stats_.rxFrameErrors += rxParser_.errors() - errors;
+  if (!done || rxParser_.frame().cmd != kCmdAck || !cmdPending_) return;
+
+  uint32_t now = micros();
+  uint32_t lat = now - cmdSentUs_;
+  cmdPending_  = false;
+  ++stats_.acks;
+  ackLatencySumUs_ += lat;
+  if (lat > stats_.ackLatencyMaxUs) stats_.ackLatencyMaxUs = lat;
+  endFault(now);
+}
+
+int UartFault::available() {
+  pump();
+  uint32_t now = micros();
+  int      n   = 0;
+  for (uint8_t i = 0; i < rxQueue_.count; ++i) {
+    uint8_t idx = (rxQueue_.head + i) % UART_FAULT_QUEUE_LEN;
+    if ((int32_t)(now - rxQueue_.items[idx].readyUs) < 0) break;
+    ++n;
+  }
+  // like the library: a late ACK still counts if it is there to be read
+  if (n == 0) checkTimeout(now);
+  return n;
+}
+
+int UartFault::peek() {
+  if (available() == 0) return -1;
+  return rxQueue_.items[rxQueue_.head].b;
+}
+
+int UartFault::read() {
+  if (available() == 0) return -1;
+  uint8_t b     = rxQueue_.items[rxQueue_.head].b;
+  rxQueue_.head = (rxQueue_.head + 1) % UART_FAULT_QUEUE_LEN;
+  --rxQueue_.count;
+  watchRx(b);
+  return b;
+}
+
+size_t UartFault::write(uint8_t b) {
+  watchTx(b);
+  pump();
+  uint32_t now = micros();
+
+  bool hit = decide(txChan_, UART_FAULT_TX, b);
+  if (hit) noteFault(UART_FAULT_TX, now);
+  UartFaultClass cls = hit ? cfg_.cls : UART_FAULT_NONE;
+
+  switch (cls) {
+    case UART_FAULT_DROP:
+      return 1;  // the library believes it was sent
+    case UART_FAULT_DELAY:
+      push(txQueue_, b, now + cfg_.delayUs);
+      return 1;
+    case UART_FAULT_DUPLICATE:
+      break;
+    case UART_FAULT_CORRUPT:
+      b = corrupt(b);
+      break;
+    default:
+      break;
+  }
+
+  int copies = cls == UART_FAULT_DUPLICATE ? 2 : 1;
+  for (int i = 0; i < copies; ++i) {
+    if (txQueue_.count) {
+      push(txQueue_, b, now);  // stay behind delayed bytes
+    } else {
+      sendRaw(b);
+    }
+  }
+  return 1;
+}
+
+size_t UartFault::write(const uint8_t* buf, size_t len) {
+  for (size_t i = 0; i < len; ++i) write(buf[i]);
+  return len;
+}
+
+void UartFault::flush() {
+  pump();
+  if (inner_) inner_->flush();
+}
+
+/* Registry: one layer per ESP32 UART */
+
+UartFault& uartFault(uint8_t uartNum) {
+  static UartFault layers[3];
+  return layers[uartNum < 3 ? uartNum : 0];
+}
+
+static const char* const kClassNames[UART_FAULT_CLASS_COUNT] = {
+    "none", "drop", "delay", "duplicate", "corrupt"};
+
+const char* uartFaultClassName(uint8_t cls) {
+  return cls < UART_FAULT_CLASS_COUNT ? kClassNames[cls] : "?";
+}
@@ -0,0 +1,161 @@
+#ifndef UART_FAULT_HPP
+#define UART_FAULT_HPP
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include "dfplayer_frame.hpp"
+
+/*
+ * uart_fault - fault injection between lib_mp3 and a DFPlayer UART
+ *
+ * UartFault is a Stream that sits between the DFRobot library and the
+ * HardwareSerial. Disabled (the default) it passes bytes straight through.
+ * Configured, it drops, delays, duplicates or corrupts single bytes or
+ * whole 10-byte frames (a corrupted frame gets one bad byte between its
+ * start and end bytes), in either direction, with a seeded PRNG so a run
+ * can be reproduced.
+ *
+ * It also watches the DFPlayer protocol on both sides and keeps link
+ * metrics: command -> ACK latency, ACK timeouts and recovery time (fault
+ * on a command exchange until the next ACK, or until the library's ACK
+ * timeout lets it carry on).
+ *
+ * One instance per ESP32 UART, see uartFault(). MP3Player always talks
+ * through it, so faults can be enabled before begin() on target or host:
+ *
+ *   UartFaultConfig cfg = {UART_FAULT_CORRUPT, UART_FAULT_FRAMES,
+ *                          UART_FAULT_RX, 20, 0, 1};   // 2% of RX frames
+ *   uartFault(1).configure(cfg);
+ *
+ * The firmware does this at boot when built with -D UART_FAULT=<class>
+ * (env:uart-fault); the simulator with --fault.
+ *
+ * Not thread safe: use from the task that drives the player.
+ */
+
+enum UartFaultClass : uint8_t {
+  UART_FAULT_NONE = 0,
+  UART_FAULT_DROP,
+  UART_FAULT_DELAY,
+  UART_FAULT_DUPLICATE,
+  UART_FAULT_CORRUPT,  // one random bit flipped per affected byte
+  UART_FAULT_CLASS_COUNT
+};
+
+enum UartFaultScope : uint8_t {
+  UART_FAULT_BYTES = 0,  // each byte decided on its own
+  UART_FAULT_FRAMES      // decided on the 0x7E start byte, applied to 10
+                         // (corrupt: to one of CMD .. CSUM_L)
+};
+
+#define UART_FAULT_TX 0x01  // ESP32 -> DFPlayer
+#define UART_FAULT_RX 0x02  // DFPlayer -> ESP32
+
+struct UartFaultConfig {
+  UartFaultClass cls;
+  UartFaultScope scope;
+  uint8_t        dirs;      // UART_FAULT_TX | UART_FAULT_RX
+  uint16_t       permille;  // probability per byte or frame
+  uint32_t       delayUs;   // UART_FAULT_DELAY: added latency
+  uint32_t       seed;
+};
+
+struct UartFaultStats {
+  uint32_t injected;         // bytes affected
+  uint32_t commands;         // frames sent that request an ACK
+  uint32_t acks;             // ACKs received for them
+  uint32_t ackTimeouts;      // no ACK within UART_FAULT_ACK_TIMEOUT_MS
+  uint32_t rxFrameErrors;    // frames the parser rejected
+  uint32_t overflows;        // bytes lost because a delay queue was full
+  uint32_t ackLatencyAvgUs;  // command frame sent -> ACK read
+  uint32_t ackLatencyMaxUs;
+  uint32_t recoveries;       // fault episodes on command exchanges
+  uint32_t lastRecoveryUs;   // first fault -> next ACK or ACK timeout
+  uint32_t maxRecoveryUs;
+};
+
+// Same ACK timeout as DFRobotDFPlayerMini
+#define UART_FAULT_ACK_TIMEOUT_MS 500
+
+// Bytes held back by UART_FAULT_DELAY, per direction
+#define UART_FAULT_QUEUE_LEN 32
+
+class UartFault : public Stream {
+ public:
+  UartFault();
+
+  // inner: the real UART. Keeps the configuration and statistics.
+  void attach(Stream* inner);
+
+  // takes effect immediately and restarts the PRNG from cfg.seed
+  void                   configure(const UartFaultConfig& cfg);
+  const UartFaultConfig& config() const;
+
+  void stats(UartFaultStats* out) const;
+  void resetStats();
+
+  // Stream
+  int    available() override;
+  int    read() override;
+  int    peek() override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t len) override;
+  void   flush() override;
+
+ private:
+  struct Queued {
+    uint8_t  b;
+    uint32_t readyUs;
+  };
+  struct Queue {
+    Queued  items[UART_FAULT_QUEUE_LEN];
+    uint8_t head;
+    uint8_t count;
+  };
+  // per-direction fault decision state
+  struct Channel {
+    uint8_t framePos;  // bytes left in the current frame decision
+    bool    frameHit;  // current frame is affected
+    uint8_t hitByte;   // the one byte of it affected, or all
+  };
+
+  bool     decide(Channel& ch, uint8_t dir, uint8_t b);
+  uint8_t  corrupt(uint8_t b);
+  uint32_t nextRandom();
+  bool     push(Queue& q, uint8_t b, uint32_t readyUs);
+  void     pump();
+  void     sendRaw(uint8_t b);
+  void     noteFault(uint8_t dir, uint32_t now);
+  void     endFault(uint32_t now);
+  void     watchTx(uint8_t b);
+  void     watchRx(uint8_t b);
+  void     checkTimeout(uint32_t now);
+
+  Stream*         inner_;
+  UartFaultConfig cfg_;
+  uint32_t        rng_;
+  Queue           rxQueue_;
+  Queue           txQueue_;
+  Channel         rxChan_;
+  Channel         txChan_;
+
+  // protocol watch
+  DfFrameParser txParser_;
+  DfFrameParser rxParser_;
+  bool          cmdPending_;
+  uint32_t      cmdSentUs_;
+  bool          inFault_;
+  uint32_t      faultStartUs_;
+  uint64_t      ackLatencySumUs_;
+
+  UartFaultStats stats_;
+};
+
+/* Fault layer for ESP32 UART uartNum (0..2). */
+UartFault& uartFault(uint8_t uartNum);
+
+/* "none", "drop", "delay", "duplicate", "corrupt" */
+const char* uartFaultClassName(uint8_t cls);
+
+#endif  // UART_FAULT_HPP
@@ -0,0 +1,141 @@
+/*
+ * lib_net.cpp
+ *
+ * lwIP UDP sockets (see lib_net.hpp).
+ */
+
+#include "lib_net.hpp"
+
+#include <string.h>
+
+#if defined(ARDUINO) && __has_include("lwip/sockets.h")
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include "lwip/sockets.h"
+
+static void fillAddr(struct sockaddr_in* addr, uint32_t ip, uint16_t port) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family      = AF_INET;
+  addr->sin_port        = htons(port);
+  addr->sin_addr.s_addr = htonl(ip);
+}
+
+static bool sendThrough(int sock, uint32_t iface) {
+  struct in_addr ifAddr;
+  ifAddr.s_addr = htonl(iface);
+  return setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &ifAddr,
+                    sizeof(ifAddr)) == 0;
+}
+
+uint32_t netLocalIp(void) {
+  IPAddress ip =
+      WiFi.getMode() == WIFI_MODE_AP ? WiFi.softAPIP() : WiFi.localIP();
+  return (uint32_t)ip[0] << 24 | (uint32_t)ip[1] << 16 |
+         (uint32_t)ip[2] << 8 | ip[3];
+}
+
+int netOpenMulticast(uint32_t group, uint16_t port, uint32_t iface) {
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) return -1;
+
+  int one = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr;
+  fillAddr(&addr, INADDR_ANY, port);
+  struct ip_mreq join;
+  join.imr_multiaddr.s_addr = htonl(group);
+  join.imr_interface.s_addr = htonl(iface);
+  bool ok = bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+  ok      = ok && setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &join,
+                             sizeof(join)) == 0;
+  ok      = ok && sendThrough(sock, iface);
+  if (!ok) netClose(&sock);
+  return sock;
+}
+
+int netOpenUnicast(uint32_t iface, uint16_t* port) {
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) return -1;
+
+  struct sockaddr_in addr;
+  fillAddr(&addr, iface, 0);
+  socklen_t addrLen = sizeof(addr);
+  bool ok = bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+  ok = ok && getsockname(sock, (struct sockaddr*)&addr, &addrLen) == 0;
+  ok = ok && sendThrough(sock, iface);
+  if (!ok) {
+    netClose(&sock);
+    return -1;
+  }
+  *port = ntohs(addr.sin_port);
+  return sock;
+}
+
+void netClose(int* sock) {
+  if (*sock >= 0) close(*sock);
+  *sock = -1;
+}
+
+void netSendTo(int sock, uint32_t ip, uint16_t port, const uint8_t* data,
+               size_t len) {
+  struct sockaddr_in to;
+  fillAddr(&to, ip, port);
+  sendto(sock, data, len, 0, (struct sockaddr*)&to, sizeof(to));
+}
+
+int netReceive(int sock, uint8_t* buf, size_t size, uint32_t* ip,
+               uint16_t* port) {
+  struct sockaddr_in from;
+  socklen_t          fromLen = sizeof(from);
+  int n = recvfrom(sock, buf, size, MSG_DONTWAIT, (struct sockaddr*)&from,
+                   &fromLen);
+  if (n > 0 && ip) *ip = ntohl(from.sin_addr.s_addr);
+  if (n > 0 && port) *port = ntohs(from.sin_port);
+  return n;
+}
+
+#else
+
+uint32_t netLocalIp(void) {
+  return 0;
+}
+
+int netOpenMulticast(uint32_t group, uint16_t port, uint32_t iface) {
+  (void)group;
+  (void)port;
+  (void)iface;
+  return -1;
+}
+
+int netOpenUnicast(uint32_t iface, uint16_t* port) {
+  (void)iface;
+  (void)port;
+  return -1;
+}
+
+void netClose(int* sock) {
+  *sock = -1;
+}
+
+void netSendTo(int sock, uint32_t ip, uint16_t port, const uint8_t* data,
+               size_t len) {
+  (void)sock;
+  (void)ip;
+  (void)port;
+  (void)data;
+  (void)len;
+}
+
+int netReceive(int sock, uint8_t* buf, size_t size, uint32_t* ip,
+               uint16_t* port) {
+  (void)sock;
+  (void)buf;
+  (void)size;
+  (void)ip;
+  (void)port;
+  return -1;
+}
+
+#endif
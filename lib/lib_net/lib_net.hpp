@@ -0,0 +1,42 @@
+#ifndef LIB_NET_HPP
+#define LIB_NET_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "net_bytes.hpp"
+
+/*
+ * lib_net - header
+ *
+ * The UDP sockets of lib_link and lib_replica: lwIP sockets on the WiFi
+ * interface in use, read without blocking from loop(). Addresses and ports
+ * are in host order. Target only: on the host the functions fail (the
+ * protocol checks in test/ use the host's own sockets).
+ */
+
+/* Datagrams read per socket and poll; the rest wait for the next loop() */
+static const uint8_t NET_MAX_READS_PER_POLL = 8;
+
+/* Address of the access point or station interface, 0 without one. */
+uint32_t netLocalIp(void);
+
+/* Socket on port of all interfaces, joined to the multicast group on
+ * iface, that sends to the group through iface. -1 on failure. */
+int netOpenMulticast(uint32_t group, uint16_t port, uint32_t iface);
+
+/* Socket on an ephemeral port of iface, that sends to multicast groups
+ * through iface. The port goes to *port. -1 on failure. */
+int netOpenUnicast(uint32_t iface, uint16_t* port);
+
+void netClose(int* sock);
+
+void netSendTo(int sock, uint32_t ip, uint16_t port, const uint8_t* data,
+               size_t len);
+
+/* One datagram if there is one (its length), else 0 or less. ip and port
+ * of the sender may be null. */
+int netReceive(int sock, uint8_t* buf, size_t size, uint32_t* ip,
+               uint16_t* port);
+
+#endif  // LIB_NET_HPP
@@ -0,0 +1,56 @@
+#ifndef NET_BYTES_HPP
+#define NET_BYTES_HPP
+
+#include <stdint.h>
+
+/*
+ * net_bytes - header
+ *
+ * Byte order of the packet and frame formats: big-endian (network order)
+ * for the UDP protocols (link_session, replica_node), little-endian for the
+ * USB control link and script bytecode. No alignment needed. Header only,
+ * builds on the host too.
+ */
+
+inline void bePut16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)(v >> 8);
+  p[1] = (uint8_t)v;
+}
+
+inline void bePut32(uint8_t* p, uint32_t v) {
+  bePut16(p, (uint16_t)(v >> 16));
+  bePut16(p + 2, (uint16_t)v);
+}
+
+inline void bePut64(uint8_t* p, int64_t v) {
+  bePut32(p, (uint32_t)((uint64_t)v >> 32));
+  bePut32(p + 4, (uint32_t)v);
+}
+
+inline uint16_t beGet16(const uint8_t* p) {
+  return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+inline uint32_t beGet32(const uint8_t* p) {
+  return (uint32_t)beGet16(p) << 16 | beGet16(p + 2);
+}
+
+inline int64_t beGet64(const uint8_t* p) {
+  return (int64_t)((uint64_t)beGet32(p) << 32 | beGet32(p + 4));
+}
+
+inline void lePut16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+inline void lePut32(uint8_t* p, uint32_t v) {
+  lePut16(p, (uint16_t)v);
+  lePut16(p + 2, (uint16_t)(v >> 16));
+}
+
+inline uint16_t leGet16(const uint8_t* p) {
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+#endif  // NET_BYTES_HPP
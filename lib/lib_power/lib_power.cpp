@@ -0,0 +1,187 @@
+/*
+ * lib_power.cpp
+ *
+ * Deep sleep and fast resume for DaveSampleKontrol.
+ *
+ * The application reports activity (button presses, HTTP requests) and polls
+ * powerIdleExpired() from loop(). When idle it saves whatever it needs to
+ * resume (button mapping, volumes, last tracks, WiFi fast-connect data) with
+ * powerRtcSave() and calls powerEnterDeepSleep().
+ *
+ * RTC slow memory survives deep sleep, so on the next boot powerInit() checks
+ * the wakeup cause and the resume block; when both are good the application
+ * takes the warm path and skips the slow parts of its cold start (settle
+ * delays, DFPlayer reset, WiFi scan and DHCP).
+ *
+ * The resume block is in RTC_NOINIT memory, which also survives panic and
+ * watchdog resets (RTC_DATA_ATTR variables are reloaded on those). After
+ * such a reset the application gets POWER_BOOT_CRASH and can resume from
+ * the block it last saved instead of resetting the DFPlayers.
+ *
+ * Wakeup uses the RTC IO controller, which only covers GPIO0..21 on the
+ * ESP32-S3. The first RTC-capable footswitch is armed on ext1, the second on
+ * ext0 (ext1 can only wake on "all low" for active-low inputs, which would
+ * require every switch in its mask to be held at once).
+ */
+
+#include "lib_power.hpp"
+
+#include "lib_crash.hpp"
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <driver/rtc_io.h>
+
+static const uint32_t kRtcMagic = 0x44534b31;  // "DSK1"
+
+// RTC slow memory: survives deep sleep and software/panic resets, random
+// after power-on (the magic and CRC catch that)
+RTC_NOINIT_ATTR static uint32_t rtcMagic;
+RTC_NOINIT_ATTR static uint32_t rtcLen;
+RTC_NOINIT_ATTR static uint32_t rtcCrc;
+RTC_NOINIT_ATTR static uint8_t  rtcBlob[POWER_RTC_BLOB_SIZE];
+
+RTC_DATA_ATTR static uint32_t rtcColdBootUs = 0;
+RTC_DATA_ATTR static uint32_t rtcWarmBootUs = 0;
+static uint32_t               crashBootUs   = 0;
+
+static PowerBootPath bootPath       = POWER_BOOT_COLD;
+static uint32_t      idleTimeoutMs  = 0;
+static unsigned long lastActivityMs = 0;
+
+static uint32_t crc32(const uint8_t* data, size_t len) {
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < len; ++i) {
+    crc ^= data[i];
+    for (uint8_t b = 0; b < 8; ++b) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+  }
+  return ~crc;
+}
+
+static bool rtcBlobValid() {
+  return rtcMagic == kRtcMagic && rtcLen <= POWER_RTC_BLOB_SIZE &&
+         rtcCrc == crc32(rtcBlob, rtcLen);
+}
+
+PowerBootPath powerInit(uint32_t inactivityMs) {
+  idleTimeoutMs  = inactivityMs;
+  lastActivityMs = millis();
+
+  esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+  bool fromSleep =
+      cause == ESP_SLEEP_WAKEUP_EXT0 || cause == ESP_SLEEP_WAKEUP_EXT1;
+
+  // not brownouts, see crashResetIsCrash()
+  bool fromCrash = crashResetIsCrash(esp_reset_reason());
+
+  if (fromSleep && rtcBlobValid()) {
+    bootPath = POWER_BOOT_WARM;
+  } else if (fromCrash && rtcBlobValid()) {
+    bootPath = POWER_BOOT_CRASH;
+  } else {
+    bootPath = POWER_BOOT_COLD;
+    // Anything left in RTC memory after a non-sleep reset is stale
+    rtcMagic = 0;
+  }
+  return bootPath;
+}
+
+PowerBootPath powerBootPath(void) {
+  return bootPath;
+}
+
+void powerMarkBootPhase(const char* name) {
+  // esp_timer starts counting when the application starts, before setup()
+  uint32_t    us   = (uint32_t)esp_timer_get_time();
+  const char* path = bootPath == POWER_BOOT_WARM    ? "warm"
+                     : bootPath == POWER_BOOT_CRASH ? "crash"
+                                                    : "cold";
+  Serial.printf("[boot] %s t_us=%lu path=%s\n", name, (unsigned long)us,
+                path);
+
+  if (strcmp(name, "ready") == 0) {
+    if (bootPath == POWER_BOOT_WARM)
+      rtcWarmBootUs = us;
+    else if (bootPath == POWER_BOOT_CRASH)
+      crashBootUs = us;
+    else
+      rtcColdBootUs = us;
+  }
+}
+
+uint32_t powerLastColdBootUs(void) {
+  return rtcColdBootUs;
+}
+
+uint32_t powerLastWarmBootUs(void) {
+  return rtcWarmBootUs;
+}
+
+uint32_t powerLastCrashBootUs(void) {
+  return crashBootUs;
+}
+
+bool powerRtcSave(const void* data, size_t len) {
+  if (len > POWER_RTC_BLOB_SIZE) return false;
+  memcpy(rtcBlob, data, len);
+  rtcLen   = len;
+  rtcCrc   = crc32(rtcBlob, len);
+  rtcMagic = kRtcMagic;
+  return true;
+}
+
+bool powerRtcLoad(void* data, size_t len) {
+  if (!rtcBlobValid() || rtcLen != len) return false;
+  memcpy(data, rtcBlob, len);
+  return true;
+}
+
+void powerNoteActivity(unsigned long nowMs) {
+  // only move forward, callers may report older timestamps
+  if ((long)(nowMs - lastActivityMs) > 0) lastActivityMs = nowMs;
+}
+
+bool powerIdleExpired(unsigned long nowMs) {
+  if (idleTimeoutMs == 0) return false;  // sleep disabled
+  return (nowMs - lastActivityMs) >= idleTimeoutMs;
+}
+
+void powerEnterDeepSleep(const uint8_t* pins, uint8_t count) {
+  bool ext1Armed = false;
+  bool ext0Armed = false;
+
+  // Keep RTC peripherals powered so the pull-ups hold during sleep
+  esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+
+  for (uint8_t i = 0; i < count; ++i) {
+    gpio_num_t pin = (gpio_num_t)pins[i];
+    if (!rtc_gpio_is_valid_gpio(pin)) continue;
+
+    if (!ext1Armed) {
+      esp_sleep_enable_ext1_wakeup(1ULL << pins[i], ESP_EXT1_WAKEUP_ALL_LOW);
+      ext1Armed = true;
+    } else if (!ext0Armed) {
+      esp_sleep_enable_ext0_wakeup(pin, 0);
+      ext0Armed = true;
+    } else {
+      Serial.printf("GPIO%u cannot wake from deep sleep (no source left)\n",
+                    pins[i]);
+      continue;
+    }
+    rtc_gpio_pullup_en(pin);
+    rtc_gpio_pulldown_dis(pin);
+  }
+
+  if (!ext1Armed) {
+    Serial.println("No RTC-capable footswitch, not entering deep sleep");
+    return;
+  }
+
+  Serial.println("Entering deep sleep");
+  Serial.flush();
+  esp_deep_sleep_start();
+}
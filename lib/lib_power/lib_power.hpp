@@ -0,0 +1,122 @@
+#ifndef LIB_POWER_HPP
+#define LIB_POWER_HPP
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * lib_power - header
+ *
+ * Inactivity-driven deep sleep with footswitch wakeup and an RTC-memory
+ * resume block, so a wake from deep sleep can skip the cold-start path.
+ * See lib_power.cpp for implementation details.
+ *
+ * While awake, dynamic frequency scaling (power_dfs.cpp) keeps the CPU at
+ * its minimum clock unless a subsystem holds a power lock.
+ */
+
+/* Size of the opaque application block kept in RTC slow memory. */
+#define POWER_RTC_BLOB_SIZE 96
+
+/* How the current boot started. */
+enum PowerBootPath {
+  POWER_BOOT_COLD  = 0,  // power-on, reset button, brownout, ...
+  POWER_BOOT_WARM  = 1,  // deep-sleep wake with a valid resume block
+  POWER_BOOT_CRASH = 2   // panic / watchdog reset with a valid resume block
+};
+
+/* Initialize power management. Must be called first thing in setup().
+ * inactivityMs: idle time after which powerIdleExpired() returns true.
+ * Returns the boot path; POWER_BOOT_WARM only when woken from deep sleep
+ * and the RTC resume block passed its integrity check, POWER_BOOT_CRASH
+ * after a panic or watchdog reset with a valid block (the DFPlayers kept
+ * their power, so the application can resume the same way; it has to keep
+ * the block current with powerRtcSave() for that).
+ */
+PowerBootPath powerInit(uint32_t inactivityMs);
+
+/* Boot path determined by powerInit(). */
+PowerBootPath powerBootPath(void);
+
+/* Log a boot phase with the time elapsed since the application started,
+ * e.g. "[boot] ready t_us=48210 path=warm". The "ready" phase is also kept
+ * in RTC memory so the last cold and warm timings survive a sleep cycle. */
+void powerMarkBootPhase(const char* name);
+
+/* Last measured start-to-ready times (0 if never measured). The crash
+ * time only covers the current boot. */
+uint32_t powerLastColdBootUs(void);
+uint32_t powerLastWarmBootUs(void);
+uint32_t powerLastCrashBootUs(void);
+
+/* Store/restore an application-defined block in RTC slow memory.
+ * len must be <= POWER_RTC_BLOB_SIZE. powerRtcLoad() returns false if no
+ * valid block (bad magic, size or CRC) is present. */
+bool powerRtcSave(const void* data, size_t len);
+bool powerRtcLoad(void* data, size_t len);
+
+/* Inactivity tracking. Call powerNoteActivity() on any user or network
+ * activity (timestamps older than the last one are ignored);
+ * powerIdleExpired() tells whether the timeout has elapsed. */
+void powerNoteActivity(unsigned long nowMs);
+bool powerIdleExpired(unsigned long nowMs);
+
+/* Arm footswitch wakeup and enter deep sleep. Only RTC-capable pins
+ * (GPIO0..21 on the ESP32-S3) can wake the chip; others in the list are
+ * ignored. Buttons are active-low. Returns only if none of the pins can
+ * wake the chip. */
+void powerEnterDeepSleep(const uint8_t* pins, uint8_t count);
+
+/* Dynamic frequency scaling */
+
+/* Subsystems that raise the CPU to its maximum clock while active */
+enum PowerLock : uint8_t {
+  POWER_LOCK_INPUT = 0,  // footswitches, MIDI, MIDI clock
+  POWER_LOCK_AUDIO,      // DFPlayer commands
+  POWER_LOCK_NETWORK,    // HTTP requests
+  POWER_LOCK_COUNT
+};
+
+/* Distinct CPU frequencies the time counters keep apart */
+#define POWER_FREQ_SLOTS 4
+
+/* Let the CPU clock drop to minMhz while no lock is held (esp_pm; the
+ * WiFi and peripheral drivers take their own locks). Returns false if the
+ * framework was built without power management; the CPU then stays at its
+ * boot clock and the locks only count. */
+bool powerDfsInit(uint16_t maxMhz, uint16_t minMhz);
+
+/* Hold lock for at least holdMs from nowMs: acquires it if needed,
+ * otherwise extends the hold. powerDfsUpdate() releases it afterwards. */
+void powerLockHold(PowerLock lock, unsigned long nowMs, uint32_t holdMs);
+bool powerLockHeld(PowerLock lock);
+
+/* Call from loop(): releases expired locks and credits the time since the
+ * last call to the current CPU frequency. */
+void powerDfsUpdate(unsigned long nowMs);
+
+/* True when the CPU runs at its maximum clock (always without DFS). */
+bool powerCpuAtMax(void);
+
+/* Press handling time (detection to action done); atMax tells whether the
+ * CPU was already at its maximum clock when the press was detected. */
+void powerNotePressUs(uint32_t us, bool atMax);
+
+struct PowerDfsStats {
+  bool     enabled;
+  uint16_t maxMhz;
+  uint16_t minMhz;
+  uint16_t freqMhz[POWER_FREQ_SLOTS];  // 0 = unused slot
+  uint32_t freqMs[POWER_FREQ_SLOTS];   // time spent at freqMhz
+  uint32_t lockAcquired[POWER_LOCK_COUNT];
+  uint32_t lockHeldMs[POWER_LOCK_COUNT];
+  uint32_t pressCount[2];  // [0] detected at a lower clock, [1] at max
+  uint32_t pressAvgUs[2];
+  uint32_t pressMaxUs[2];
+};
+
+void        powerGetDfsStats(PowerDfsStats* out);
+const char* powerLockName(PowerLock lock);
+
+#endif  // LIB_POWER_HPP
@@ -0,0 +1,150 @@
+/*
+ * power_dfs.cpp
+ *
+ * Dynamic frequency scaling for DaveSampleKontrol.
+ *
+ * esp_pm switches the CPU between maxMhz and minMhz: at maxMhz while any
+ * ESP_PM_CPU_FREQ_MAX lock is held, at minMhz otherwise. The pedal spends
+ * most of its time waiting between songs, so the application holds one lock
+ * per subsystem only for a short window after that subsystem did something
+ * (a press, a DFPlayer command, an HTTP request); the window covers the
+ * follow-up work (debounced release, ACK wait, the next poll of a phone).
+ *
+ * minMhz should stay at 80 or above: below that the APB clock drops with
+ * the CPU and every UART, RMT and LEDC user has to cope with the change.
+ *
+ * Time per frequency is sampled in powerDfsUpdate(), once per loop(), from
+ * the clock actually running, so driver locks (WiFi) are accounted too.
+ */
+
+#include "lib_power.hpp"
+
+#include <Arduino.h>
+#include <esp_pm.h>
+
+static const char* const kLockNames[POWER_LOCK_COUNT] = {"input", "audio",
+                                                         "network"};
+
+struct LockState {
+  esp_pm_lock_handle_t handle;
+  bool                 held;
+  unsigned long        untilMs;
+  unsigned long        sinceMs;
+  uint32_t             acquired;
+  uint32_t             heldMs;
+};
+
+static LockState locks[POWER_LOCK_COUNT];
+static bool      dfsEnabled = false;
+static uint16_t  dfsMaxMhz  = 0;
+static uint16_t  dfsMinMhz  = 0;
+
+static uint16_t freqMhz[POWER_FREQ_SLOTS];
+static uint64_t freqUs[POWER_FREQ_SLOTS];
+static uint32_t lastSampleUs = 0;
+
+static uint32_t pressCount[2];
+static uint64_t pressSumUs[2];
+static uint32_t pressMaxUs[2];
+
+bool powerDfsInit(uint16_t maxMhz, uint16_t minMhz) {
+  dfsMaxMhz    = maxMhz;
+  dfsMinMhz    = minMhz;
+  lastSampleUs = micros();
+
+  esp_pm_config_esp32s3_t config = {};
+  config.max_freq_mhz            = maxMhz;
+  config.min_freq_mhz            = minMhz;
+  config.light_sleep_enable      = false;
+
+  dfsEnabled = esp_pm_configure(&config) == ESP_OK;
+
+  for (uint8_t i = 0; i < POWER_LOCK_COUNT; ++i) {
+    if (!dfsEnabled || locks[i].handle) continue;
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, kLockNames[i],
+                           &locks[i].handle) != ESP_OK) {
+      locks[i].handle = nullptr;
+    }
+  }
+  return dfsEnabled;
+}
+
+void powerLockHold(PowerLock lock, unsigned long nowMs, uint32_t holdMs) {
+  LockState&    l     = locks[lock];
+  unsigned long until = nowMs + holdMs;
+  if (l.held) {
+    if ((long)(until - l.untilMs) > 0) l.untilMs = until;
+    return;
+  }
+  if (l.handle) esp_pm_lock_acquire(l.handle);
+  l.held    = true;
+  l.untilMs = until;
+  l.sinceMs = nowMs;
+  ++l.acquired;
+}
+
+bool powerLockHeld(PowerLock lock) {
+  return locks[lock].held;
+}
+
+static void creditFrequency(uint32_t mhz, uint32_t us) {
+  for (uint8_t i = 0; i < POWER_FREQ_SLOTS; ++i) {
+    if (freqMhz[i] == mhz || freqMhz[i] == 0) {
+      freqMhz[i] = (uint16_t)mhz;
+      freqUs[i] += us;
+      return;
+    }
+  }
+}
+
+void powerDfsUpdate(unsigned long nowMs) {
+  uint32_t nowUs = micros();
+  creditFrequency(getCpuFrequencyMhz(), nowUs - lastSampleUs);
+  lastSampleUs = nowUs;
+
+  for (uint8_t i = 0; i < POWER_LOCK_COUNT; ++i) {
+    LockState& l = locks[i];
+    if (!l.held || (long)(nowMs - l.untilMs) < 0) continue;
+    if (l.handle) esp_pm_lock_release(l.handle);
+    l.held = false;
+    l.heldMs += nowMs - l.sinceMs;
+  }
+}
+
+bool powerCpuAtMax(void) {
+  return !dfsEnabled || getCpuFrequencyMhz() >= dfsMaxMhz;
+}
+
+void powerNotePressUs(uint32_t us, bool atMax) {
+  uint8_t i = atMax ? 1 : 0;
+  ++pressCount[i];
+  pressSumUs[i] += us;
+  if (us > pressMaxUs[i]) pressMaxUs[i] = us;
+}
+
+void powerGetDfsStats(PowerDfsStats* out) {
+  unsigned long nowMs = millis();
+  out->enabled        = dfsEnabled;
+  out->maxMhz         = dfsMaxMhz;
+  out->minMhz         = dfsMinMhz;
+  for (uint8_t i = 0; i < POWER_FREQ_SLOTS; ++i) {
+    out->freqMhz[i] = freqMhz[i];
+    out->freqMs[i]  = (uint32_t)(freqUs[i] / 1000);
+  }
+  for (uint8_t i = 0; i < POWER_LOCK_COUNT; ++i) {
+    uint32_t held = locks[i].heldMs;
+    if (locks[i].held) held += nowMs - locks[i].sinceMs;
+    out->lockAcquired[i] = locks[i].acquired;
+    out->lockHeldMs[i]   = held;
+  }
+  for (uint8_t i = 0; i < 2; ++i) {
+    out->pressCount[i] = pressCount[i];
+    out->pressAvgUs[i] =
+        pressCount[i] ? (uint32_t)(pressSumUs[i] / pressCount[i]) : 0;
+    out->pressMaxUs[i] = pressMaxUs[i];
+  }
+}
+
+const char* powerLockName(PowerLock lock) {
+  return lock < POWER_LOCK_COUNT ? kLockNames[lock] : "?";
+}
@@ -0,0 +1,94 @@
+/*
+ * lib_replica.cpp
+ *
+ * Socket for pedal replication (see lib_replica.hpp), opened with lib_net.
+ * The protocol is in replica_node.cpp and runs on the host too
+ * (test/ReplicaSync).
+ */
+
+#include "lib_replica.hpp"
+
+static ReplicaNode node;
+
+#if defined(ARDUINO) && __has_include("lwip/sockets.h")
+
+#include <Arduino.h>
+
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "lib_net.hpp"
+
+static int     sock = -1;
+static uint8_t rxBuf[REPLICA_MAX_PACKET];
+
+static void sendPacket(const ReplicaPacket& pkt) {
+  netSendTo(sock, REPLICA_MULTICAST_ADDR, REPLICA_PORT, pkt.data, pkt.len);
+}
+
+bool replicaBegin(void) {
+  uint32_t ip = netLocalIp();
+  if (ip == 0 || node.active()) return false;
+
+  sock = netOpenMulticast(REPLICA_MULTICAST_ADDR, REPLICA_PORT, ip);
+  if (sock < 0) return false;
+
+  node.begin(esp_random(), esp_timer_get_time());
+  return true;
+}
+
+void replicaEnd(void) {
+  ReplicaPacket bye;
+  if (node.leave(&bye)) sendPacket(bye);
+  netClose(&sock);
+}
+
+void replicaPoll(void) {
+  if (!node.active()) return;
+  for (uint8_t i = 0; i < NET_MAX_READS_PER_POLL; ++i) {
+    int n = netReceive(sock, rxBuf, sizeof(rxBuf), nullptr, nullptr);
+    if (n <= 0) break;
+    node.receive(rxBuf, (size_t)n, esp_timer_get_time());
+  }
+  ReplicaPacket pkt;
+  while (node.poll(esp_timer_get_time(), &pkt)) sendPacket(pkt);
+}
+
+void replicaNoteEvent(uint8_t button, uint8_t type) {
+  node.noteEvent(button, type, esp_timer_get_time());
+}
+
+#else
+
+bool replicaBegin(void) {
+  return false;
+}
+
+void replicaEnd(void) {}
+
+void replicaPoll(void) {}
+
+void replicaNoteEvent(uint8_t button, uint8_t type) {
+  (void)button;
+  (void)type;
+}
+
+#endif
+
+void replicaSetLocal(const ReplicaState& state) {
+  node.setLocal(state);
+}
+
+bool replicaPollEvent(ReplicaEvent* out) {
+  return node.pollEvent(out);
+}
+
+bool replicaPeerState(ReplicaState* out) {
+  ReplicaPeerInfo info;
+  if (!node.peer(0, &info)) return false;
+  *out = info.state;
+  return true;
+}
+
+void replicaGetStats(ReplicaStats* out) {
+  node.stats(out);
+}
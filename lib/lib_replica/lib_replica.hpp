@@ -0,0 +1,48 @@
+#ifndef LIB_REPLICA_HPP
+#define LIB_REPLICA_HPP
+
+#include <stdint.h>
+
+#include "replica_node.hpp"
+
+/*
+ * lib_replica - header
+ *
+ * Pedals on the same WiFi network (station or access point) share their
+ * state: footswitches held, scene and players, and their button events, on
+ * the multicast group 239.255.68.75:20810. What a pedal does with the
+ * other ones' state is up to the application. Protocol in replica_node.hpp.
+ *
+ * One lwIP socket, read without blocking from loop(). No heap use after
+ * replicaBegin().
+ *
+ *   replicaBegin();                            // after WiFi is up
+ *   replicaNoteEvent(ev.button, ev.type);      // each local button event
+ *   replicaSetLocal(state);                    // every loop()
+ *   replicaPoll();                             // every loop()
+ *   while (replicaPollEvent(&ev)) ...
+ */
+
+/* Open the socket and join the group. False without a network interface
+ * (offline builds, host builds). */
+bool replicaBegin(void);
+
+/* Say goodbye to the other pedals and close the socket (before deep
+ * sleep). */
+void replicaEnd(void);
+
+/* Read what arrived and send what is due. */
+void replicaPoll(void);
+
+void replicaSetLocal(const ReplicaState& state);
+void replicaNoteEvent(uint8_t button, uint8_t type);
+
+/* Button events of the other pedals, oldest first. */
+bool replicaPollEvent(ReplicaEvent* out);
+
+/* State of the first other pedal heard from. False when alone. */
+bool replicaPeerState(ReplicaState* out);
+
+void replicaGetStats(ReplicaStats* out);
+
+#endif  // LIB_REPLICA_HPP
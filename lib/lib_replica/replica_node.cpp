@@ -0,0 +1,414 @@
+/*
+ * replica_node.cpp
+ *
+ * Pedal state replication (see replica_node.hpp).
+ *
+ * Every datagram has a sequence number. A receiver keeps the newest one
+ * per node and which of the 32 before it are missing. Anything not newer
+ * is stale: it fills its gap, but only its button events are looked at.
+ * Gaps still open kReorderWaitUs later are losses, and a SYNC asks for a
+ * snapshot (at most every kSyncAskUs). Button events have a sequence of
+ * their own and are returned once, in order, however many datagrams carry
+ * them.
+ */
+
+#include "replica_node.hpp"
+#include "net_bytes.hpp"
+
+#include <string.h>
+
+static const uint8_t kMagic[4] = {'D', 'S', 'K', 'R'};
+static const uint8_t kVersion  = 1;
+
+enum : uint8_t { MSG_DELTA = 1, MSG_SNAPSHOT = 2, MSG_SYNC = 3, MSG_BYE = 4 };
+enum : uint8_t { HAS_BUTTONS = 1, HAS_SCENE = 2, HAS_PLAYER = 4 };
+
+static const size_t kHeaderLen = 12;
+static const size_t kPlayerLen = 4;
+static const size_t kEventLen  = 6;
+
+// Peers are forgotten after this long without a datagram (3 snapshots)
+static const int64_t kPeerTimeoutUs = 3 * REPLICA_SNAPSHOT_MS * 1000LL;
+
+// Spacing of the repeats of a button event
+static const int64_t kRepeatUs = 15000;
+
+// Time a gap in the sequence numbers is given to fill before it counts as
+// lost
+static const int64_t kReorderWaitUs = 20000;
+
+// At most one SYNC per peer, and one snapshot on request, this often
+static const int64_t kSyncAskUs    = 100000;
+static const int64_t kSyncAnswerUs = 50000;
+
+static const uint8_t kRecentEvents = 4;
+static const uint8_t kInboxSize    = 8;
+
+static uint8_t* putPlayer(uint8_t* p, const ReplicaPlayer& pl) {
+  p[0] = pl.state;
+  bePut16(p + 1, pl.track);
+  p[3] = pl.volume;
+  return p + kPlayerLen;
+}
+
+static const uint8_t* getPlayer(const uint8_t* p, ReplicaPlayer* pl) {
+  pl->state  = p[0];
+  pl->track  = beGet16(p + 1);
+  pl->volume = p[3];
+  return p + kPlayerLen;
+}
+
+static bool samePlayer(const ReplicaPlayer& a, const ReplicaPlayer& b) {
+  return a.state == b.state && a.track == b.track && a.volume == b.volume;
+}
+
+static uint8_t changes(const ReplicaState& now, const ReplicaState& sent) {
+  uint8_t flags = 0;
+  if (now.buttonsDown != sent.buttonsDown) flags |= HAS_BUTTONS;
+  if (now.scene != sent.scene) flags |= HAS_SCENE;
+  for (uint8_t i = 0; i < REPLICA_PLAYERS; ++i) {
+    if (!samePlayer(now.players[i], sent.players[i])) {
+      flags |= (uint8_t)(HAS_PLAYER << i);
+    }
+  }
+  return flags;
+}
+
+ReplicaNode::ReplicaNode() : active_(false) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+void ReplicaNode::begin(uint32_t node, int64_t nowUs) {
+  active_         = true;
+  node_           = node;
+  seq_            = 0;
+  snapshotAsked_  = false;
+  nextSnapshotUs_ = nowUs;  // announce ourselves right away
+  snapshotUs_     = nowUs - kSyncAnswerUs;
+  deltaUs_        = nowUs;
+  recentCount_    = 0;
+  eventSeq_       = 0;
+  inboxHead_      = 0;
+  inboxCount_     = 0;
+  memset(&local_, 0, sizeof(local_));
+  memset(&sent_, 0, sizeof(sent_));
+  memset(peers_, 0, sizeof(peers_));
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+bool ReplicaNode::active() const {
+  return active_;
+}
+
+void ReplicaNode::setLocal(const ReplicaState& state) {
+  local_ = state;
+}
+
+void ReplicaNode::noteEvent(uint8_t button, uint8_t type, int64_t nowUs) {
+  if (!active_) return;
+  if (recentCount_ == kRecentEvents) {
+    memmove(recent_, recent_ + 1, sizeof(recent_[0]) * (kRecentEvents - 1));
+    --recentCount_;
+  }
+  Sent& ev  = recent_[recentCount_++];
+  ev.seq    = ++eventSeq_;
+  ev.button = button;
+  ev.type   = type;
+  ev.us     = nowUs;
+  ev.sends  = 0;
+}
+
+void ReplicaNode::header(uint8_t type, ReplicaPacket* out) {
+  memcpy(out->data, kMagic, sizeof(kMagic));
+  out->data[4] = kVersion;
+  out->data[5] = type;
+  bePut32(out->data + 6, node_);
+  bePut16(out->data + 10, ++seq_);
+  out->len = kHeaderLen;
+  ++stats_.txPackets;
+}
+
+void ReplicaNode::buildDelta(int64_t nowUs, ReplicaPacket* out) {
+  header(MSG_DELTA, out);
+  uint8_t  flags = changes(local_, sent_);
+  uint8_t* p     = out->data + kHeaderLen;
+  *p++           = flags;
+  if (flags & HAS_BUTTONS) *p++ = local_.buttonsDown;
+  if (flags & HAS_SCENE) *p++ = local_.scene;
+  for (uint8_t i = 0; i < REPLICA_PLAYERS; ++i) {
+    if (flags & (HAS_PLAYER << i)) p = putPlayer(p, local_.players[i]);
+  }
+  sent_ = local_;
+
+  uint8_t* count = p++;
+  *count         = 0;
+  for (uint8_t i = 0; i < recentCount_; ++i) {
+    Sent&   ev  = recent_[i];
+    int64_t age = (nowUs - ev.us) / 1000;
+    if (ev.sends >= REPLICA_EVENT_SENDS || age > REPLICA_EVENT_MAX_AGE_MS) {
+      continue;
+    }
+    bePut16(p, ev.seq);
+    p[2] = ev.button;
+    p[3] = ev.type;
+    bePut16(p + 4, (uint16_t)age);
+    p += kEventLen;
+    ++ev.sends;
+    ++*count;
+  }
+  out->len = (uint16_t)(p - out->data);
+  deltaUs_ = nowUs;
+}
+
+void ReplicaNode::buildSnapshot(ReplicaPacket* out) {
+  header(MSG_SNAPSHOT, out);
+  uint8_t* p = out->data + kHeaderLen;
+  bePut16(p, eventSeq_);
+  p[2] = local_.buttonsDown;
+  p[3] = local_.scene;
+  p += 4;
+  for (uint8_t i = 0; i < REPLICA_PLAYERS; ++i) {
+    p = putPlayer(p, local_.players[i]);
+  }
+  sent_    = local_;
+  out->len = (uint16_t)(p - out->data);
+}
+
+bool ReplicaNode::poll(int64_t nowUs, ReplicaPacket* out) {
+  if (!active_) return false;
+
+  for (Peer& peer : peers_) {
+    if (peer.used && nowUs - peer.heardUs > kPeerTimeoutUs) peer.used = false;
+  }
+
+  for (Peer& peer : peers_) {
+    bool gap = peer.missing && nowUs - peer.missingUs >= kReorderWaitUs;
+    if (!peer.used || !(peer.syncAsked || gap)) continue;
+    if (nowUs - peer.syncUs < kSyncAskUs) continue;
+    stats_.lost += (uint32_t)__builtin_popcount(peer.missing);
+    peer.missing   = 0;
+    peer.syncAsked = false;
+    peer.syncUs    = nowUs;
+    header(MSG_SYNC, out);
+    bePut32(out->data + kHeaderLen, peer.node);
+    out->len += 4;
+    ++stats_.syncs;
+    stats_.txBytes += out->len;
+    return true;
+  }
+
+  // A delta for a change or a new event, repeats of events kRepeatUs apart
+  bool due    = changes(local_, sent_) != 0;
+  bool repeat = false;
+  for (uint8_t i = 0; i < recentCount_; ++i) {
+    const Sent& ev = recent_[i];
+    if (ev.sends == 0) due = true;
+    if (ev.sends > 0 && ev.sends < REPLICA_EVENT_SENDS &&
+        nowUs - ev.us <= REPLICA_EVENT_MAX_AGE_MS * 1000LL) {
+      repeat = true;
+    }
+  }
+  if (due || (repeat && nowUs - deltaUs_ >= kRepeatUs)) {
+    buildDelta(nowUs, out);
+    stats_.txBytes += out->len;
+    return true;
+  }
+
+  bool asked = snapshotAsked_ && nowUs - snapshotUs_ >= kSyncAnswerUs;
+  if (asked || nowUs >= nextSnapshotUs_) {
+    buildSnapshot(out);
+    snapshotAsked_  = false;
+    snapshotUs_     = nowUs;
+    nextSnapshotUs_ = nowUs + REPLICA_SNAPSHOT_MS * 1000LL;
+    stats_.txBytes += out->len;
+    return true;
+  }
+  return false;
+}
+
+bool ReplicaNode::leave(ReplicaPacket* out) {
+  if (!active_) return false;
+  header(MSG_BYE, out);
+  stats_.txBytes += out->len;
+  active_ = false;
+  return true;
+}
+
+ReplicaNode::Peer* ReplicaNode::findPeer(uint32_t node, int64_t nowUs) {
+  Peer* free = nullptr;
+  for (Peer& peer : peers_) {
+    if (peer.used && peer.node == node) return &peer;
+    if (!peer.used && !free) free = &peer;
+  }
+  if (!free) return nullptr;
+  memset(free, 0, sizeof(*free));
+  free->used   = true;
+  free->node   = node;
+  free->syncUs = nowUs - kSyncAskUs;
+  return free;
+}
+
+void ReplicaNode::takeEvents(Peer* peer, const uint8_t* p, uint8_t n) {
+  for (uint8_t i = 0; i < n; ++i, p += kEventLen) {
+    uint16_t seq = beGet16(p);
+    if (peer->eventsKnown) {
+      int16_t ahead = (int16_t)(seq - peer->eventSeq);
+      if (ahead <= 0) continue;  // had it
+      stats_.eventsLost += (uint32_t)(ahead - 1);
+    }
+    peer->eventsKnown = true;
+    peer->eventSeq    = seq;
+
+    ReplicaEvent ev;
+    ev.node   = peer->node;
+    ev.seq    = seq;
+    ev.button = p[2];
+    ev.type   = p[3];
+    ev.ageMs  = beGet16(p + 4);
+    if (ev.ageMs > REPLICA_EVENT_MAX_AGE_MS) {
+      ++stats_.eventsOld;
+    } else if (inboxCount_ == kInboxSize) {
+      ++stats_.eventsLost;
+    } else {
+      inbox_[(inboxHead_ + inboxCount_++) % kInboxSize] = ev;
+      ++stats_.events;
+    }
+  }
+}
+
+void ReplicaNode::receive(const uint8_t* data, size_t len, int64_t nowUs) {
+  if (!active_) return;
+  if (len < kHeaderLen || memcmp(data, kMagic, sizeof(kMagic)) != 0 ||
+      data[4] != kVersion) {
+    ++stats_.bad;
+    return;
+  }
+  uint8_t  type = data[5];
+  uint32_t node = beGet32(data + 6);
+  uint16_t seq  = beGet16(data + 10);
+  if (node == node_) return;  // our own, looped back
+  ++stats_.rxPackets;
+  stats_.rxBytes += (uint32_t)len;
+
+  const uint8_t* p   = data + kHeaderLen;
+  const uint8_t* end = data + len;
+
+  if (type == MSG_BYE) {
+    for (Peer& peer : peers_) {
+      if (peer.used && peer.node == node) peer.used = false;
+    }
+    return;
+  }
+
+  // Check the length before touching any state
+  size_t need = kHeaderLen;
+  if (type == MSG_DELTA) {
+    if (p == end) {
+      ++stats_.bad;
+      return;
+    }
+    uint8_t flags = p[0];
+    need += 1 + ((flags & HAS_BUTTONS) ? 1 : 0) + ((flags & HAS_SCENE) ? 1 : 0);
+    for (uint8_t i = 0; i < REPLICA_PLAYERS; ++i) {
+      if (flags & (HAS_PLAYER << i)) need += kPlayerLen;
+    }
+    need += 1;
+    if (len >= need) need += data[need - 1] * kEventLen;
+  } else if (type == MSG_SNAPSHOT) {
+    need += 4 + REPLICA_PLAYERS * kPlayerLen;
+  } else if (type == MSG_SYNC) {
+    need += 4;
+  } else {
+    ++stats_.bad;
+    return;
+  }
+  if (len < need) {
+    ++stats_.bad;
+    return;
+  }
+
+  Peer* peer = findPeer(node, nowUs);
+  if (!peer) return;  // full
+  int16_t ahead = (int16_t)(seq - peer->seq);
+  bool    fresh = !peer->seqKnown || ahead > 0;
+  if (!peer->seqKnown) {
+    // a node met halfway through its deltas: ask for the rest
+    if (type != MSG_SNAPSHOT) peer->syncAsked = true;
+  } else if (fresh) {
+    // bit k of missing: datagram seq - 1 - k did not arrive (yet)
+    uint32_t skipped = ahead > 32 ? ~0u : (1u << (ahead - 1)) - 1;
+    uint32_t out     = ahead >= 32 ? peer->missing
+                                   : peer->missing >> (32 - ahead);
+    stats_.lost += (uint32_t)__builtin_popcount(out);
+    if (ahead > 33) stats_.lost += (uint32_t)(ahead - 33);  // past the window
+    if (!peer->missing && skipped) peer->missingUs = nowUs;
+    peer->missing = (ahead >= 32 ? 0 : peer->missing << ahead) | skipped;
+  } else {
+    int16_t back = (int16_t)-ahead;
+    if (back >= 1 && back <= 32) peer->missing &= ~(1u << (back - 1));
+    ++stats_.stale;
+  }
+  if (fresh) {
+    peer->seqKnown = true;
+    peer->seq      = seq;
+  }
+  peer->heardUs = nowUs;
+
+  if (type == MSG_SYNC) {
+    if (beGet32(p) == node_) snapshotAsked_ = true;
+  } else if (type == MSG_SNAPSHOT) {
+    if (!fresh) return;
+    if (!peer->eventsKnown) {
+      peer->eventsKnown = true;
+      peer->eventSeq    = beGet16(p);
+    }
+    peer->state.buttonsDown = p[2];
+    peer->state.scene       = p[3];
+    p += 4;
+    for (uint8_t i = 0; i < REPLICA_PLAYERS; ++i) {
+      p = getPlayer(p, &peer->state.players[i]);
+    }
+  } else {
+    uint8_t      flags = *p++;
+    ReplicaState st    = peer->state;
+    if (flags & HAS_BUTTONS) st.buttonsDown = *p++;
+    if (flags & HAS_SCENE) st.scene = *p++;
+    for (uint8_t i = 0; i < REPLICA_PLAYERS; ++i) {
+      if (flags & (HAS_PLAYER << i)) p = getPlayer(p, &st.players[i]);
+    }
+    if (fresh) peer->state = st;
+    uint8_t n = *p++;
+    takeEvents(peer, p, n);
+  }
+}
+
+bool ReplicaNode::pollEvent(ReplicaEvent* out) {
+  if (inboxCount_ == 0) return false;
+  *out       = inbox_[inboxHead_];
+  inboxHead_ = (inboxHead_ + 1) % kInboxSize;
+  --inboxCount_;
+  return true;
+}
+
+uint8_t ReplicaNode::peerCount() const {
+  uint8_t n = 0;
+  for (const Peer& peer : peers_) n += peer.used ? 1 : 0;
+  return n;
+}
+
+bool ReplicaNode::peer(uint8_t index, ReplicaPeerInfo* out) const {
+  for (const Peer& peer : peers_) {
+    if (!peer.used) continue;
+    if (index-- > 0) continue;
+    out->node    = peer.node;
+    out->state   = peer.state;
+    out->heardUs = peer.heardUs;
+    return true;
+  }
+  return false;
+}
+
+void ReplicaNode::stats(ReplicaStats* out) const {
+  *out       = stats_;
+  out->peers = peerCount();
+}
@@ -0,0 +1,193 @@
+#ifndef REPLICA_NODE_HPP
+#define REPLICA_NODE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * replica_node - header
+ *
+ * State replication between pedals on one network (UDP multicast), so a
+ * press on one pedal can trigger or show up on the other. Like
+ * link_session, no sockets: datagrams go in through receive() and come
+ * out of poll(), so the same code runs on the pedal (lib_replica.cpp) and
+ * in host tests (test/ReplicaSync).
+ *
+ * Every node multicasts:
+ *   DELTA     what changed (buttons held, scene, a player), right away,
+ *             plus its recent button events
+ *   SNAPSHOT  the whole state, every REPLICA_SNAPSHOT_MS and on request
+ *   SYNC      "send me your snapshot", when a gap in a node's datagram
+ *             sequence numbers shows a lost delta (after a short wait
+ *             for reordered datagrams)
+ *   BYE       before sleeping
+ *
+ * Loss and reordering: datagrams older than the newest one seen from a
+ * node only contribute button events; state converges at the next delta,
+ * the SYNC answer or the next snapshot. Button events have their own
+ * sequence numbers and each one rides in REPLICA_EVENT_SENDS datagrams
+ * (the delta and repeats a few ms apart), so a single lost datagram loses
+ * no press; duplicates are dropped by sequence number.
+ *
+ * Wire format (big endian):
+ *   header   "DSKR", u8 version, u8 type, u32 node, u16 seq
+ *   DELTA    u8 flags (1 buttons, 2 scene, 4 player 1, 8 player 2),
+ *            [u8 buttons] [u8 scene] [player]..., u8 n, event x n
+ *   SNAPSHOT u16 last event seq, u8 buttons, u8 scene, player x 2
+ *   SYNC     u32 node asked
+ *   player   u8 state, u16 track, u8 volume
+ *   event    u16 seq, u8 button, u8 type, u16 age_ms
+ *
+ *   node.begin(randomId, nowUs);
+ *   node.setLocal(state);                     // every loop(), cheap
+ *   node.noteEvent(ev.button, ev.type, nowUs);
+ *   node.receive(data, len, nowUs);           // each datagram
+ *   while (node.poll(nowUs, &pkt)) send(pkt);
+ *   while (node.pollEvent(&ev)) ...
+ */
+
+#define REPLICA_PORT           20810
+#define REPLICA_MULTICAST_ADDR 0xEFFF444Bu  // 239.255.68.75
+
+#define REPLICA_MAX_PEERS   4
+#define REPLICA_PLAYERS     2
+#define REPLICA_MAX_PACKET  64  // largest datagram poll() produces
+#define REPLICA_SNAPSHOT_MS 1000
+#define REPLICA_EVENT_SENDS 3
+
+// Events older than this when they arrive are not returned (a pedal that
+// was out of range must not replay presses)
+#define REPLICA_EVENT_MAX_AGE_MS 250
+
+struct ReplicaPlayer {
+  uint8_t  state;  // application defined (the pedal uses ControlPlayerState)
+  uint16_t track;
+  uint8_t  volume;
+};
+
+struct ReplicaState {
+  uint8_t       buttonsDown;  // bit i = button i held
+  uint8_t       scene;
+  ReplicaPlayer players[REPLICA_PLAYERS];
+};
+
+struct ReplicaPacket {
+  uint16_t len;
+  uint8_t  data[REPLICA_MAX_PACKET];
+};
+
+/* A button event of another node */
+struct ReplicaEvent {
+  uint32_t node;
+  uint16_t seq;
+  uint8_t  button;
+  uint8_t  type;   // ButtonEventType
+  uint16_t ageMs;  // at the sender when sent
+};
+
+struct ReplicaPeerInfo {
+  uint32_t     node;
+  ReplicaState state;
+  int64_t      heardUs;
+};
+
+struct ReplicaStats {
+  uint8_t  peers;
+  uint32_t txPackets;
+  uint32_t txBytes;
+  uint32_t rxPackets;
+  uint32_t rxBytes;
+  uint32_t lost;       // datagrams of the peers that never arrived
+  uint32_t stale;      // arrived after a newer datagram, or duplicated
+  uint32_t syncs;      // snapshots requested
+  uint32_t bad;        // malformed
+  uint32_t events;     // remote events returned
+  uint32_t eventsLost;  // never arrived in any of their datagrams
+  uint32_t eventsOld;   // older than REPLICA_EVENT_MAX_AGE_MS
+};
+
+class ReplicaNode {
+ public:
+  ReplicaNode();
+
+  // node: random, unique on the network
+  void begin(uint32_t node, int64_t nowUs);
+
+  // Our state; a change is sent as a delta at the next poll()
+  void setLocal(const ReplicaState& state);
+
+  // A local button event, sent right away
+  void noteEvent(uint8_t button, uint8_t type, int64_t nowUs);
+
+  void receive(const uint8_t* data, size_t len, int64_t nowUs);
+
+  // Next datagram for the group; call until it returns false
+  bool poll(int64_t nowUs, ReplicaPacket* out);
+
+  // BYE, then the node stops
+  bool leave(ReplicaPacket* out);
+
+  // Button events of other nodes, oldest first
+  bool pollEvent(ReplicaEvent* out);
+
+  // Known peers, index 0..count-1
+  uint8_t peerCount() const;
+  bool    peer(uint8_t index, ReplicaPeerInfo* out) const;
+
+  bool active() const;
+  void stats(ReplicaStats* out) const;
+
+ private:
+  struct Peer {
+    bool         used;
+    bool         syncAsked;
+    bool         seqKnown;     // seq is valid
+    bool         eventsKnown;  // eventSeq is valid
+    uint32_t     node;
+    uint16_t     seq;
+    uint32_t     missing;  // of the 32 datagrams before seq
+    int64_t      missingUs;
+    uint16_t     eventSeq;
+    ReplicaState state;
+    int64_t      heardUs;
+    int64_t      syncUs;
+  };
+
+  struct Sent {
+    uint16_t seq;
+    uint8_t  button;
+    uint8_t  type;
+    int64_t  us;
+    uint8_t  sends;
+  };
+
+  Peer* findPeer(uint32_t node, int64_t nowUs);
+  void  takeEvents(Peer* peer, const uint8_t* p, uint8_t n);
+  void  header(uint8_t type, ReplicaPacket* out);
+  void  buildDelta(int64_t nowUs, ReplicaPacket* out);
+  void  buildSnapshot(ReplicaPacket* out);
+
+  bool         active_;
+  uint32_t     node_;
+  uint16_t     seq_;
+  ReplicaState local_;
+  ReplicaState sent_;
+  bool         snapshotAsked_;
+  int64_t      nextSnapshotUs_;
+  int64_t      snapshotUs_;
+  int64_t      deltaUs_;
+
+  Sent     recent_[4];  // own events, newest last
+  uint8_t  recentCount_;
+  uint16_t eventSeq_;
+
+  Peer peers_[REPLICA_MAX_PEERS];
+
+  ReplicaEvent inbox_[8];
+  uint8_t      inboxHead_;
+  uint8_t      inboxCount_;
+
+  ReplicaStats stats_;
+};
+
+#endif  // REPLICA_NODE_HPP
@@ -0,0 +1,202 @@
+/*
+ * lib_script.cpp
+ *
+ * Footswitch scripts on the pedal (see lib_script.hpp): storage, the
+ * running image and the timing of its handlers. A new script is compiled
+ * into a staging buffer, so a script that does not compile leaves the
+ * running one alone.
+ */
+
+#include "lib_script.hpp"
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+#include <string.h>
+
+#if __has_include(<Preferences.h>)
+#include <Preferences.h>
+#define SCRIPT_NVS 1
+
+static const char* kNamespace = "script";
+static const char* kKey       = "image";
+#endif
+
+static uint8_t      image[SCRIPT_MAX_IMAGE];    // running
+static uint8_t      staging[SCRIPT_MAX_IMAGE];  // being compiled
+static ScriptVm     vm;
+static ScriptCallFn appCall = nullptr;
+
+// led() colours, -1: the usual colour
+static int32_t leds[SCRIPT_BUTTONS];
+
+static uint32_t runs  = 0;
+static uint64_t usSum = 0;
+static uint32_t usMax = 0;
+
+static bool readImage(size_t* len) {
+#if SCRIPT_NVS
+  Preferences prefs;
+  if (!prefs.begin(kNamespace, true)) return false;
+  *len = 0;
+  if (prefs.isKey(kKey)) *len = prefs.getBytes(kKey, image, sizeof(image));
+  prefs.end();
+  return *len > 0;
+#else
+  (void)len;
+  return false;
+#endif
+}
+
+static bool writeImage(const uint8_t* data, size_t len) {
+#if SCRIPT_NVS
+  Preferences prefs;
+  if (!prefs.begin(kNamespace, false)) return false;
+  bool ok = len ? prefs.putBytes(kKey, data, len) == len
+                : !prefs.isKey(kKey) || prefs.remove(kKey);
+  prefs.end();
+  return ok;
+#else
+  (void)data;
+  (void)len;
+  return true;  // kept until reset
+#endif
+}
+
+// The VM's functions: LEDs here, the rest in the application
+static int32_t callFn(uint8_t fn, const int32_t* args, void* ctx) {
+  (void)ctx;
+  if (fn == SCRIPT_FN_LED) {
+    if (args[0] < 1 || args[0] > SCRIPT_BUTTONS) return 0;
+    leds[args[0] - 1] = args[1] < 0 ? -1 : args[1] & 0xFFFFFF;
+    return 1;
+  }
+  return appCall ? appCall(fn, args, nullptr) : 0;
+}
+
+static void noteRun(uint32_t us, uint8_t count) {
+  runs += count;
+  usSum += us;
+  if (us > usMax) usMax = us;
+}
+
+static bool runEvent(uint8_t event) {
+  if (!vm.hasHandler(event)) return false;
+  uint32_t start = micros();
+  vm.run(event, millis());
+  noteRun(micros() - start, 1);
+  return true;
+}
+
+// Start the image in image[]: fresh variables, timers and LEDs
+static bool start(size_t len) {
+  for (uint8_t i = 0; i < SCRIPT_BUTTONS; ++i) leds[i] = -1;
+  if (!vm.load(image, len, callFn, nullptr)) return false;
+  runEvent(SCRIPT_EVENT_START);
+  return true;
+}
+
+void scriptInit(ScriptCallFn call) {
+  appCall = call;
+  size_t len;
+  if (readImage(&len) && !start(len)) vm.unload();
+}
+
+bool scriptUpload(const char* src, size_t len, ScriptCompileError* err) {
+  size_t n = scriptCompile(src, len, staging, sizeof(staging), err);
+  if (!n) return false;
+  if (!writeImage(staging, n)) {
+    err->line = 0;
+    strncpy(err->msg, "cannot store the script", sizeof(err->msg));
+    return false;
+  }
+  vm.unload();
+  memcpy(image, staging, n);
+  vm.resetStats();
+  runs  = 0;
+  usSum = 0;
+  usMax = 0;
+  return start(n);
+}
+
+bool scriptClear(void) {
+  vm.unload();
+  for (uint8_t i = 0; i < SCRIPT_BUTTONS; ++i) leds[i] = -1;
+  return writeImage(nullptr, 0);
+}
+
+bool scriptButtonEvent(const ButtonEvent& ev) {
+  if (ev.button >= SCRIPT_BUTTONS || ev.type > BUTTON_EVENT_DOUBLE_CLICK) {
+    return false;
+  }
+  return runEvent((uint8_t)(ev.button * 4 + ev.type));
+}
+
+bool scriptPoll(void) {
+  if (!vm.timersArmed()) return false;
+  uint32_t startUs = micros();
+  uint8_t  ran     = vm.poll(millis());
+  if (ran) noteRun(micros() - startUs, ran);
+  return ran > 0;
+}
+
+bool scriptLed(uint8_t button, uint32_t* rgb) {
+  if (!vm.loaded() || button >= SCRIPT_BUTTONS || leds[button] < 0) {
+    return false;
+  }
+  *rgb = (uint32_t)leds[button];
+  return true;
+}
+
+void scriptGetStats(ScriptStats* out) {
+  ScriptVmStats vs;
+  vm.stats(&vs);
+  out->loaded     = vm.loaded();
+  out->bytes      = (uint16_t)vm.imageSize();
+  out->handlers   = vm.handlerCount();
+  out->vars       = vm.varCount();
+  out->events     = vs.events;
+  out->stepsAvg   = vs.events ? (uint32_t)(vs.steps / vs.events) : 0;
+  out->stepsMax   = vs.stepsMax;
+  out->overBudget = vs.overBudget;
+  out->errors     = vs.errors;
+  out->lastError  = vs.lastError;
+  out->usAvg      = runs ? (uint32_t)(usSum / runs) : 0;
+  out->usMax      = usMax;
+}
+
+#else
+
+void scriptInit(ScriptCallFn call) {
+  (void)call;
+}
+
+bool scriptUpload(const char* src, size_t len, ScriptCompileError* err) {
+  uint8_t out[SCRIPT_MAX_IMAGE];
+  return scriptCompile(src, len, out, sizeof(out), err) > 0;
+}
+
+bool scriptClear(void) {
+  return true;
+}
+
+bool scriptButtonEvent(const ButtonEvent& ev) {
+  (void)ev;
+  return false;
+}
+
+bool scriptPoll(void) {
+  return false;
+}
+
+bool scriptLed(uint8_t button, uint32_t* rgb) {
+  (void)button;
+  (void)rgb;
+  return false;
+}
+
+void scriptGetStats(ScriptStats* out) {
+  *out = ScriptStats();
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef LIB_SCRIPT_HPP
+#define LIB_SCRIPT_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lib_button.hpp"
+#include "script_vm.hpp"
+
+/*
+ * lib_script - header
+ *
+ * User-defined footswitch behaviours without reflashing: a script (language
+ * in script_vm.hpp) is uploaded over HTTP (POST /api/script), compiled on
+ * the spot and its bytecode kept in NVS (namespace "script"), so it runs
+ * again after a reset. Its handlers run from loop() with SCRIPT_BUDGET
+ * instructions each; a handler that runs out is stopped and counted.
+ *
+ * The application implements the player, button, action and scene
+ * functions (ScriptCallFn); led() colours are kept here for the
+ * application's LED refresh to pick up.
+ *
+ *   scriptInit(scriptCall);                  // setup(), runs "on start"
+ *   if (!scriptButtonEvent(ev)) ...          // each button event
+ *   scriptPoll();                            // every loop(), timers
+ *   if (scriptLed(i, &rgb)) ...              // instead of the usual colour
+ */
+
+struct ScriptStats {
+  bool     loaded;
+  uint16_t bytes;
+  uint8_t  handlers;
+  uint8_t  vars;
+  uint32_t events;         // handlers run
+  uint32_t stepsAvg;       // instructions per handler
+  uint32_t stepsMax;
+  uint32_t overBudget;     // handlers stopped at SCRIPT_BUDGET
+  uint32_t errors;         // other runtime errors
+  uint8_t  lastError;      // ScriptError
+  uint32_t usAvg;          // handler run time
+  uint32_t usMax;
+};
+
+/* Load the stored script, if any, and run its "on start". */
+void scriptInit(ScriptCallFn call);
+
+/* Compile src; on success store it, replace the running script and run its
+ * "on start". False with err filled if it does not compile or cannot be
+ * stored. */
+bool scriptUpload(const char* src, size_t len, ScriptCompileError* err);
+
+/* Remove the script: footswitches go back to their mapped actions. */
+bool scriptClear(void);
+
+/* Run the handler of a button event. True if there is one. */
+bool scriptButtonEvent(const ButtonEvent& ev);
+
+/* Run the handlers of the timers that are due. True if any ran. */
+bool scriptPoll(void);
+
+/* Colour a script gave a footswitch LED. False: the usual colour. */
+bool scriptLed(uint8_t button, uint32_t* rgb);
+
+void scriptGetStats(ScriptStats* out);
+
+#endif  // LIB_SCRIPT_HPP
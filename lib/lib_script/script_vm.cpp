@@ -0,0 +1,959 @@
+/*
+ * script_vm.cpp
+ *
+ * Compiler and interpreter of footswitch scripts (see script_vm.hpp). The
+ * compiler is a single pass over the source with one token of look-ahead;
+ * it writes the code straight into the output buffer and never allocates.
+ * The interpreter checks every operand, jump and stack access against the
+ * image, so a damaged image stops its handler instead of running wild.
+ */
+
+#include "script_vm.hpp"
+#include "net_bytes.hpp"
+
+#include <string.h>
+
+static const uint8_t kMagic0  = 'S';
+static const uint8_t kMagic1  = 'K';
+static const uint8_t kVersion = 1;
+
+static const size_t   kHeaderLen    = 5;
+static const size_t   kHandlerLen   = 3;  // event, offset
+static const size_t   kMaxHeaderLen = kHeaderLen +
+                                      kHandlerLen * SCRIPT_EVENT_COUNT;
+static const uint16_t kNoHandler    = 0xFFFF;
+
+static const uint8_t kMaxNameLen = 15;
+static const uint8_t kMaxNesting = 8;  // if/while, parentheses
+
+enum Op : uint8_t {
+  OP_END = 0,
+  OP_PUSH8,   // i8
+  OP_PUSH16,  // i16
+  OP_PUSH32,  // i32
+  OP_LOAD,    // u8 variable
+  OP_STORE,   // u8 variable
+  OP_POP,
+  OP_JMP,   // u16 code offset
+  OP_JZ,    // u16 code offset, pops the condition
+  OP_CALL,  // u8 ScriptFn, pops its arguments, pushes the result
+  OP_NEG,
+  OP_NOT,
+  // binary, a op b with b on top
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_MOD,
+  OP_EQ,
+  OP_NE,
+  OP_LT,
+  OP_LE,
+  OP_GT,
+  OP_GE,
+  OP_AND,
+  OP_OR
+};
+
+struct Builtin {
+  const char* name;
+  uint8_t     argc;
+};
+
+// Index = ScriptFn
+static const Builtin kBuiltins[SCRIPT_FN_COUNT] = {
+    {"play", 2},
+    {"toggle", 1},
+    {"stop", 1},
+    {"setvolume", 2},
+    {"volume", 1},
+    {"playing", 1},
+    {"track", 1},
+    {"down", 1},
+    {"led", 2},
+    {"action", 1},
+    {"scene", 1},
+    {"timer", 2},
+    {"now", 0},
+};
+
+struct Constant {
+  const char* name;
+  int32_t     value;
+};
+
+static const Constant kConstants[] = {
+    {"off", 0x000000},   {"red", 0xFF0000},   {"green", 0x00FF00},
+    {"blue", 0x0000FF},  {"amber", 0xFF7000}, {"white", 0xFFFFFF},
+    {"auto", -1},
+};
+static const uint8_t kConstantCount = sizeof(kConstants) / sizeof(*kConstants);
+
+static const char* const kKeywords[] = {"on",   "end",   "if",
+                                        "else", "while", "return"};
+static const uint8_t kKeywordCount = sizeof(kKeywords) / sizeof(*kKeywords);
+
+static const char* const kEventWords[] = {"press", "release", "long",
+                                          "double"};
+
+namespace {
+
+enum TokenKind : uint8_t { TOK_EOF, TOK_NL, TOK_NUM, TOK_NAME, TOK_OP };
+
+struct Token {
+  uint8_t     kind;
+  const char* text;
+  uint8_t     len;
+  int32_t     num;
+};
+
+struct Var {
+  const char* name;
+  uint8_t     len;
+};
+
+class Compiler {
+ public:
+  Compiler(const char* src, size_t len, uint8_t* out, size_t cap,
+           ScriptCompileError* err)
+      : end_(src + len),
+        pos_(src),
+        line_(1),
+        out_(out),
+        cap_(cap),
+        err_(err),
+        codeLen_(0),
+        depth_(0),
+        nesting_(0),
+        varCount_(0),
+        newLine_(false),
+        ok_(true) {
+    for (uint8_t i = 0; i < SCRIPT_EVENT_COUNT; ++i) handlers_[i] = kNoHandler;
+    err_->line   = 0;
+    err_->msg[0] = '\0';
+  }
+
+  size_t compile() {
+    if (cap_ < kMaxHeaderLen) {
+      fail("no room for the image");
+      return 0;
+    }
+    code_    = out_ + kMaxHeaderLen;
+    codeCap_ = cap_ - kMaxHeaderLen;
+
+    next();
+    while (ok_) {
+      while (tok_.kind == TOK_NL) next();
+      if (tok_.kind == TOK_EOF) break;
+      handler();
+    }
+    if (!ok_) return 0;
+
+    uint8_t count = 0;
+    uint8_t* p    = out_ + kHeaderLen;
+    for (uint8_t ev = 0; ev < SCRIPT_EVENT_COUNT; ++ev) {
+      if (handlers_[ev] == kNoHandler) continue;
+      p[0] = ev;
+      p[1] = (uint8_t)handlers_[ev];
+      p[2] = (uint8_t)(handlers_[ev] >> 8);
+      p += kHandlerLen;
+      ++count;
+    }
+    memmove(p, code_, codeLen_);
+    out_[0] = kMagic0;
+    out_[1] = kMagic1;
+    out_[2] = kVersion;
+    out_[3] = varCount_;
+    out_[4] = count;
+    return (size_t)(p - out_) + codeLen_;
+  }
+
+ private:
+  // Report the first error only
+  void fail(const char* msg) {
+    if (!ok_) return;
+    ok_        = false;
+    tok_.kind  = TOK_EOF;  // stops the parse
+    err_->line = line_;
+    strncpy(err_->msg, msg, sizeof(err_->msg) - 1);
+    err_->msg[sizeof(err_->msg) - 1] = '\0';
+  }
+
+  /* Lexer */
+
+  void next() {
+    // errors at a newline belong to the line it ends
+    if (newLine_) ++line_;
+    newLine_ = false;
+    while (pos_ < end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\r')) {
+      ++pos_;
+    }
+    if (pos_ < end_ && *pos_ == '#') {
+      while (pos_ < end_ && *pos_ != '\n') ++pos_;
+    }
+    tok_.text = pos_;
+    tok_.len  = 0;
+    if (pos_ >= end_) {
+      tok_.kind = TOK_EOF;
+      return;
+    }
+    char c = *pos_;
+    if (c == '\n') {
+      tok_.kind = TOK_NL;
+      newLine_  = true;
+      ++pos_;
+      return;
+    }
+    if (c >= '0' && c <= '9') return number();
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
+      return name();
+    }
+    static const char* const kOps2[] = {"==", "!=", "<=", ">=", "&&", "||"};
+    for (const char* op : kOps2) {
+      if (end_ - pos_ >= 2 && pos_[0] == op[0] && pos_[1] == op[1]) {
+        tok_.kind = TOK_OP;
+        tok_.len  = 2;
+        pos_ += 2;
+        return;
+      }
+    }
+    if (c && strchr("+-*/%(),=<>!", c)) {
+      tok_.kind = TOK_OP;
+      tok_.len  = 1;
+      ++pos_;
+      return;
+    }
+    tok_.kind = TOK_EOF;
+    fail("unexpected character");
+  }
+
+  void number() {
+    uint64_t v   = 0;
+    bool     hex = end_ - pos_ > 2 && pos_[0] == '0' &&
+               (pos_[1] == 'x' || pos_[1] == 'X');
+    uint64_t max = hex ? 0xFFFFFFFFu : 0x7FFFFFFFu;
+    if (hex) pos_ += 2;
+    const char* digits = pos_;
+    for (; pos_ < end_; ++pos_) {
+      char    c = *pos_;
+      uint8_t d;
+      if (c >= '0' && c <= '9') {
+        d = (uint8_t)(c - '0');
+      } else if (hex && c >= 'a' && c <= 'f') {
+        d = (uint8_t)(c - 'a' + 10);
+      } else if (hex && c >= 'A' && c <= 'F') {
+        d = (uint8_t)(c - 'A' + 10);
+      } else {
+        break;
+      }
+      v = v * (hex ? 16 : 10) + d;
+      if (v > max) return fail("number too large");
+    }
+    if (pos_ == digits) return fail("bad number");
+    tok_.kind = TOK_NUM;
+    tok_.num  = (int32_t)(uint32_t)v;
+    tok_.len  = (uint8_t)(pos_ - tok_.text < 255 ? pos_ - tok_.text : 255);
+  }
+
+  void name() {
+    const char* start = pos_;
+    while (pos_ < end_ &&
+           ((*pos_ >= 'a' && *pos_ <= 'z') || (*pos_ >= 'A' && *pos_ <= 'Z') ||
+            (*pos_ >= '0' && *pos_ <= '9') || *pos_ == '_')) {
+      ++pos_;
+    }
+    if (pos_ - start > kMaxNameLen) return fail("name too long");
+    tok_.kind = TOK_NAME;
+    tok_.len  = (uint8_t)(pos_ - start);
+  }
+
+  bool isOp(const char* op) const {
+    return tok_.kind == TOK_OP && tok_.len == strlen(op) &&
+           !memcmp(tok_.text, op, tok_.len);
+  }
+
+  bool isWord(const char* word) const {
+    return tok_.kind == TOK_NAME && tok_.len == strlen(word) &&
+           !memcmp(tok_.text, word, tok_.len);
+  }
+
+  void expectOp(const char* op, const char* msg) {
+    if (!isOp(op)) return fail(msg);
+    next();
+  }
+
+  void expectLineEnd() {
+    if (tok_.kind != TOK_NL && tok_.kind != TOK_EOF) {
+      return fail("expected end of line");
+    }
+    next();
+  }
+
+  /* Code */
+
+  void emit(uint8_t b) {
+    if (!ok_) return;
+    if (codeLen_ >= codeCap_) return fail("script too large");
+    code_[codeLen_++] = b;
+  }
+
+  void emit16(uint16_t v) {
+    emit((uint8_t)v);
+    emit((uint8_t)(v >> 8));
+  }
+
+  void patch(uint16_t at, uint16_t target) {
+    if (!ok_) return;
+    code_[at]     = (uint8_t)target;
+    code_[at + 1] = (uint8_t)(target >> 8);
+  }
+
+  // Emit a jump with its target to patch; returns where the target goes
+  uint16_t jump(uint8_t op) {
+    emit(op);
+    uint16_t at = (uint16_t)codeLen_;
+    emit16(0);
+    return at;
+  }
+
+  // Track the stack depth the code needs; the VM's stack is fixed
+  void push(int n) {
+    depth_ += n;
+    if (depth_ > SCRIPT_STACK) fail("expression too complex");
+  }
+
+  void emitPush(int32_t v) {
+    if (v >= -128 && v <= 127) {
+      emit(OP_PUSH8);
+      emit((uint8_t)v);
+    } else if (v >= -32768 && v <= 32767) {
+      emit(OP_PUSH16);
+      emit16((uint16_t)v);
+    } else {
+      emit(OP_PUSH32);
+      emit16((uint16_t)v);
+      emit16((uint16_t)((uint32_t)v >> 16));
+    }
+    push(1);
+  }
+
+  /* Names */
+
+  int findVar(const char* name, uint8_t len) const {
+    for (uint8_t i = 0; i < varCount_; ++i) {
+      if (vars_[i].len == len && !memcmp(vars_[i].name, name, len)) return i;
+    }
+    return -1;
+  }
+
+  int findBuiltin() const {
+    for (uint8_t i = 0; i < SCRIPT_FN_COUNT; ++i) {
+      if (isWord(kBuiltins[i].name)) return i;
+    }
+    return -1;
+  }
+
+  int findConstant() const {
+    for (uint8_t i = 0; i < kConstantCount; ++i) {
+      if (isWord(kConstants[i].name)) return i;
+    }
+    return -1;
+  }
+
+  bool isReserved() const {
+    for (uint8_t i = 0; i < kKeywordCount; ++i) {
+      if (isWord(kKeywords[i])) return true;
+    }
+    return findBuiltin() >= 0 || findConstant() >= 0;
+  }
+
+  /* Parser */
+
+  // on <event> NL <block> end
+  void handler() {
+    if (!isWord("on")) return fail("expected 'on'");
+    next();
+    int event = -1;
+    for (uint8_t type = 0; type < 4; ++type) {
+      if (!isWord(kEventWords[type])) continue;
+      next();
+      int button = -1;
+      if (tok_.kind == TOK_NUM) {
+        button = tok_.num - 1;
+      } else if (tok_.kind == TOK_NAME && tok_.len == 2 &&
+                 (tok_.text[0] == 'S' || tok_.text[0] == 's')) {
+        button = tok_.text[1] - '1';
+      }
+      if (button < 0 || button >= SCRIPT_BUTTONS) {
+        return fail("expected a button, S1..S4");
+      }
+      event = button * 4 + type;
+      break;
+    }
+    if (event < 0 && isWord("timer")) {
+      next();
+      if (tok_.kind != TOK_NUM || tok_.num < 0 || tok_.num >= SCRIPT_TIMERS) {
+        return fail("expected a timer, 0..3");
+      }
+      event = SCRIPT_EVENT_TIMER0 + tok_.num;
+    } else if (event < 0 && isWord("start")) {
+      event = SCRIPT_EVENT_START;
+    }
+    if (event < 0) return fail("unknown event");
+    if (handlers_[event] != kNoHandler) return fail("event handled twice");
+    handlers_[event] = (uint16_t)codeLen_;
+    next();
+    expectLineEnd();
+
+    if (block()) return fail("'else' without 'if'");
+    if (!isWord("end")) return fail("expected 'end'");
+    next();
+    expectLineEnd();
+    emit(OP_END);
+  }
+
+  // Statements up to 'end' or 'else' (not consumed). True at 'else'.
+  bool block() {
+    while (ok_) {
+      if (tok_.kind == TOK_NL) {
+        next();
+        continue;
+      }
+      if (tok_.kind == TOK_EOF) {
+        fail("expected 'end'");
+        return false;
+      }
+      if (isWord("end")) return false;
+      if (isWord("else")) return true;
+      statement();
+    }
+    return false;
+  }
+
+  void statement() {
+    if (isWord("if") || isWord("while")) {
+      if (++nesting_ > kMaxNesting) return fail("nested too deep");
+      if (isWord("if")) {
+        ifStatement();
+      } else {
+        whileStatement();
+      }
+      --nesting_;
+      return;
+    }
+    if (isWord("return")) {
+      next();
+      emit(OP_END);
+      return expectLineEnd();
+    }
+    if (isWord("on")) return fail("expected 'end'");
+    if (tok_.kind != TOK_NAME) return fail("expected a statement");
+
+    int fn = findBuiltin();
+    if (fn >= 0) {
+      call((uint8_t)fn);
+      emit(OP_POP);
+      push(-1);
+      return expectLineEnd();
+    }
+    if (isReserved()) return fail("reserved name");
+    Var target = {tok_.text, tok_.len};
+    next();
+    if (isOp("(")) return fail("unknown function");
+    expectOp("=", "expected '='");
+    expr(1);
+    // declared by its first assignment, after the value so that it cannot
+    // read itself
+    int var = findVar(target.name, target.len);
+    if (var < 0) {
+      if (varCount_ == SCRIPT_MAX_VARS) return fail("too many variables");
+      var        = varCount_++;
+      vars_[var] = target;
+    }
+    emit(OP_STORE);
+    emit((uint8_t)var);
+    push(-1);
+    expectLineEnd();
+  }
+
+  void ifStatement() {
+    next();
+    expr(1);
+    expectLineEnd();
+    uint16_t toElse = jump(OP_JZ);
+    push(-1);
+    if (block()) {
+      uint16_t toEnd = jump(OP_JMP);
+      patch(toElse, (uint16_t)codeLen_);
+      next();
+      expectLineEnd();
+      if (block()) return fail("'else' twice");
+      patch(toEnd, (uint16_t)codeLen_);
+    } else {
+      patch(toElse, (uint16_t)codeLen_);
+    }
+    if (!ok_) return;
+    next();  // end
+    expectLineEnd();
+  }
+
+  void whileStatement() {
+    uint16_t top = (uint16_t)codeLen_;
+    next();
+    expr(1);
+    expectLineEnd();
+    uint16_t toEnd = jump(OP_JZ);
+    push(-1);
+    if (block()) return fail("'else' without 'if'");
+    emit(OP_JMP);
+    emit16(top);
+    patch(toEnd, (uint16_t)codeLen_);
+    if (!ok_) return;
+    next();  // end
+    expectLineEnd();
+  }
+
+  // name(args), pushes the result
+  void call(uint8_t fn) {
+    next();
+    expectOp("(", "expected '('");
+    uint8_t argc = 0;
+    if (!isOp(")")) {
+      for (;;) {
+        expr(1);
+        ++argc;
+        if (!ok_ || !isOp(",")) break;
+        next();
+      }
+    }
+    expectOp(")", "expected ')'");
+    if (ok_ && argc != kBuiltins[fn].argc) return fail("wrong argument count");
+    emit(OP_CALL);
+    emit(fn);
+    push(1 - argc);
+  }
+
+  // Binary operator at the token: its precedence and opcode, 0 if none
+  uint8_t binary(uint8_t* op) const {
+    static const struct {
+      const char* text;
+      uint8_t     prec;
+      uint8_t     op;
+    } kOps[] = {{"||", 1, OP_OR}, {"&&", 2, OP_AND}, {"==", 3, OP_EQ},
+                {"!=", 3, OP_NE}, {"<", 3, OP_LT},   {"<=", 3, OP_LE},
+                {">", 3, OP_GT},  {">=", 3, OP_GE},  {"+", 4, OP_ADD},
+                {"-", 4, OP_SUB}, {"*", 5, OP_MUL},  {"/", 5, OP_DIV},
+                {"%", 5, OP_MOD}};
+    for (const auto& o : kOps) {
+      if (isOp(o.text)) {
+        *op = o.op;
+        return o.prec;
+      }
+    }
+    return 0;
+  }
+
+  // Precedence climbing: operators of minPrec and above
+  void expr(uint8_t minPrec) {
+    unary();
+    while (ok_) {
+      uint8_t op;
+      uint8_t prec = binary(&op);
+      if (!prec || prec < minPrec) return;
+      next();
+      expr(prec + 1);
+      emit(op);
+      push(-1);
+    }
+  }
+
+  void unary() {
+    if ((isOp("-") || isOp("!")) && nesting_ + 1 > kMaxNesting * 2) {
+      return fail("nested too deep");
+    }
+    if (isOp("-")) {
+      next();
+      if (tok_.kind == TOK_NUM) {
+        emitPush((int32_t)(0u - (uint32_t)tok_.num));
+        next();
+        return;
+      }
+      ++nesting_;
+      unary();
+      --nesting_;
+      return emit(OP_NEG);
+    }
+    if (isOp("!")) {
+      next();
+      ++nesting_;
+      unary();
+      --nesting_;
+      return emit(OP_NOT);
+    }
+    primary();
+  }
+
+  void primary() {
+    if (!ok_) return;
+    if (tok_.kind == TOK_NUM) {
+      emitPush(tok_.num);
+      return next();
+    }
+    if (isOp("(")) {
+      if (++nesting_ > kMaxNesting) return fail("nested too deep");
+      next();
+      expr(1);
+      expectOp(")", "expected ')'");
+      --nesting_;
+      return;
+    }
+    if (tok_.kind != TOK_NAME) return fail("expected a value");
+
+    int fn = findBuiltin();
+    if (fn >= 0) return call((uint8_t)fn);
+    int c = findConstant();
+    if (c >= 0) {
+      emitPush(kConstants[c].value);
+      return next();
+    }
+    int var = findVar(tok_.text, tok_.len);
+    if (var < 0) return fail("variable read before it is set");
+    emit(OP_LOAD);
+    emit((uint8_t)var);
+    push(1);
+    next();
+  }
+
+  const char*         end_;
+  const char*         pos_;
+  uint16_t            line_;
+  uint8_t*            out_;
+  size_t              cap_;
+  ScriptCompileError* err_;
+  uint8_t*            code_;
+  size_t              codeCap_;
+  size_t              codeLen_;
+  int                 depth_;
+  uint8_t             nesting_;
+  Var                 vars_[SCRIPT_MAX_VARS];
+  uint8_t             varCount_;
+  uint16_t            handlers_[SCRIPT_EVENT_COUNT];
+  Token               tok_ = {TOK_EOF, nullptr, 0, 0};
+  bool                newLine_;
+  bool                ok_;
+};
+
+}  // namespace
+
+size_t scriptCompile(const char* src, size_t len, uint8_t* out, size_t cap,
+                     ScriptCompileError* err) {
+  Compiler c(src, len, out, cap, err);
+  return c.compile();
+}
+
+const char* scriptErrorName(uint8_t error) {
+  switch (error) {
+    case SCRIPT_OK:
+      return "none";
+    case SCRIPT_ERR_BUDGET:
+      return "budget";
+    case SCRIPT_ERR_DIV0:
+      return "division by zero";
+    case SCRIPT_ERR_STACK:
+      return "stack";
+    default:
+      return "bad code";
+  }
+}
+
+ScriptVm::ScriptVm()
+    : code_(nullptr),
+      codeLen_(0),
+      imageLen_(0),
+      call_(nullptr),
+      ctx_(nullptr),
+      handlerCount_(0),
+      varCount_(0),
+      timersArmed_(0),
+      stats_() {
+  for (uint8_t i = 0; i < SCRIPT_EVENT_COUNT; ++i) handlers_[i] = kNoHandler;
+}
+
+bool ScriptVm::load(const uint8_t* image, size_t len, ScriptCallFn call,
+                    void* ctx) {
+  unload();
+  if (!image || len < kHeaderLen || image[0] != kMagic0 ||
+      image[1] != kMagic1 || image[2] != kVersion ||
+      image[3] > SCRIPT_MAX_VARS || image[4] > SCRIPT_EVENT_COUNT) {
+    return false;
+  }
+  size_t header = kHeaderLen + kHandlerLen * image[4];
+  if (len < header) return false;
+  for (uint8_t i = 0; i < image[4]; ++i) {
+    const uint8_t* h      = image + kHeaderLen + kHandlerLen * i;
+    uint16_t       offset = leGet16(h + 1);
+    if (h[0] >= SCRIPT_EVENT_COUNT || offset >= len - header) {
+      unload();
+      return false;
+    }
+    handlers_[h[0]] = offset;
+  }
+  code_         = image + header;
+  codeLen_      = len - header;
+  imageLen_     = len;
+  call_         = call;
+  ctx_          = ctx;
+  handlerCount_ = image[4];
+  varCount_     = image[3];
+  return true;
+}
+
+void ScriptVm::unload() {
+  for (uint8_t i = 0; i < SCRIPT_EVENT_COUNT; ++i) handlers_[i] = kNoHandler;
+  for (uint8_t i = 0; i < SCRIPT_MAX_VARS; ++i) vars_[i] = 0;
+  code_         = nullptr;
+  codeLen_      = 0;
+  imageLen_     = 0;
+  handlerCount_ = 0;
+  varCount_     = 0;
+  timersArmed_  = 0;
+}
+
+bool ScriptVm::loaded() const {
+  return code_ != nullptr;
+}
+
+bool ScriptVm::hasHandler(uint8_t event) const {
+  return event < SCRIPT_EVENT_COUNT && handlers_[event] != kNoHandler;
+}
+
+bool ScriptVm::run(uint8_t event, uint32_t nowMs) {
+  if (!hasHandler(event)) return false;
+  uint16_t steps = 0;
+  uint8_t  err   = exec(handlers_[event], nowMs, &steps);
+  ++stats_.events;
+  stats_.steps += steps;
+  if (steps > stats_.stepsMax) stats_.stepsMax = steps;
+  if (err == SCRIPT_ERR_BUDGET) {
+    ++stats_.overBudget;
+  } else if (err != SCRIPT_OK) {
+    ++stats_.errors;
+  }
+  if (err != SCRIPT_OK) stats_.lastError = err;
+  return true;
+}
+
+uint8_t ScriptVm::poll(uint32_t nowMs) {
+  uint8_t ran = 0;
+  for (uint8_t t = 0; timersArmed_ && t < SCRIPT_TIMERS; ++t) {
+    if (!(timersArmed_ & 1 << t) || (int32_t)(nowMs - timerDue_[t]) < 0) {
+      continue;
+    }
+    timersArmed_ &= (uint8_t)~(1 << t);
+    if (run(SCRIPT_EVENT_TIMER0 + t, nowMs)) ++ran;
+  }
+  return ran;
+}
+
+bool ScriptVm::timersArmed() const {
+  return timersArmed_ != 0;
+}
+
+uint8_t ScriptVm::handlerCount() const {
+  return handlerCount_;
+}
+
+uint8_t ScriptVm::varCount() const {
+  return varCount_;
+}
+
+size_t ScriptVm::imageSize() const {
+  return imageLen_;
+}
+
+void ScriptVm::stats(ScriptVmStats* out) const {
+  *out = stats_;
+}
+
+void ScriptVm::resetStats() {
+  stats_ = ScriptVmStats();
+}
+
+// a op b, with 32-bit wrap-around. False on division by zero.
+static bool binaryOp(uint8_t op, int32_t a, int32_t b, int32_t* out) {
+  uint32_t ua = (uint32_t)a, ub = (uint32_t)b;
+  switch (op) {
+    case OP_ADD:
+      *out = (int32_t)(ua + ub);
+      return true;
+    case OP_SUB:
+      *out = (int32_t)(ua - ub);
+      return true;
+    case OP_MUL:
+      *out = (int32_t)(ua * ub);
+      return true;
+    case OP_DIV:
+    case OP_MOD:
+      if (b == 0) return false;
+      if (b == -1) {  // INT32_MIN / -1 overflows
+        *out = op == OP_DIV ? (int32_t)(0u - ua) : 0;
+      } else {
+        *out = op == OP_DIV ? a / b : a % b;
+      }
+      return true;
+    case OP_EQ:
+      *out = a == b;
+      return true;
+    case OP_NE:
+      *out = a != b;
+      return true;
+    case OP_LT:
+      *out = a < b;
+      return true;
+    case OP_LE:
+      *out = a <= b;
+      return true;
+    case OP_GT:
+      *out = a > b;
+      return true;
+    case OP_GE:
+      *out = a >= b;
+      return true;
+    case OP_AND:
+      *out = a && b;
+      return true;
+    default:  // OP_OR
+      *out = a || b;
+      return true;
+  }
+}
+
+uint8_t ScriptVm::exec(uint16_t pc, uint32_t nowMs, uint16_t* steps) {
+  int32_t        stack[SCRIPT_STACK];
+  uint8_t        sp   = 0;
+  uint16_t       n    = 0;
+  uint8_t        err  = SCRIPT_OK;
+  const uint8_t* code = code_;
+  const size_t   len  = codeLen_;
+
+  for (;;) {
+    if (n == SCRIPT_BUDGET) {
+      err = SCRIPT_ERR_BUDGET;
+      break;
+    }
+    if (pc >= len) {
+      err = SCRIPT_ERR_CODE;
+      break;
+    }
+    ++n;
+    uint8_t op = code[pc++];
+
+    if (op >= OP_ADD && op <= OP_OR) {
+      if (sp < 2) {
+        err = SCRIPT_ERR_STACK;
+        break;
+      }
+      --sp;
+      if (!binaryOp(op, stack[sp - 1], stack[sp], &stack[sp - 1])) {
+        err = SCRIPT_ERR_DIV0;
+        break;
+      }
+      continue;
+    }
+
+    // operand bytes and stack room of the other instructions
+    static const uint8_t kOperand[] = {0, 1, 2, 4, 1, 1, 0, 2, 2, 1, 0, 0};
+    static const int8_t  kPush[]    = {0, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+    static const uint8_t kPop[]     = {0, 0, 0, 0, 0, 1, 1, 0, 1, 0, 1, 1};
+    if (op > OP_NOT) {
+      err = SCRIPT_ERR_CODE;
+      break;
+    }
+    if (pc + kOperand[op] > len) {
+      err = SCRIPT_ERR_CODE;
+      break;
+    }
+    if (sp < kPop[op] || sp + kPush[op] > SCRIPT_STACK) {
+      err = SCRIPT_ERR_STACK;
+      break;
+    }
+
+    if (op == OP_END) break;
+    switch (op) {
+      case OP_PUSH8:
+        stack[sp++] = (int8_t)code[pc++];
+        break;
+      case OP_PUSH16:
+        stack[sp++] = (int16_t)leGet16(code + pc);
+        pc += 2;
+        break;
+      case OP_PUSH32:
+        stack[sp++] = (int32_t)((uint32_t)leGet16(code + pc) |
+                                (uint32_t)leGet16(code + pc + 2) << 16);
+        pc += 4;
+        break;
+      case OP_LOAD:
+      case OP_STORE: {
+        uint8_t var = code[pc++];
+        if (var >= varCount_) {
+          err = SCRIPT_ERR_CODE;
+          break;
+        }
+        if (op == OP_LOAD) {
+          stack[sp++] = vars_[var];
+        } else {
+          vars_[var] = stack[--sp];
+        }
+        break;
+      }
+      case OP_POP:
+        --sp;
+        break;
+      case OP_JMP:
+        pc = leGet16(code + pc);
+        break;
+      case OP_JZ:
+        pc = stack[--sp] ? pc + 2 : leGet16(code + pc);
+        break;
+      case OP_CALL: {
+        uint8_t fn = code[pc++];
+        if (fn >= SCRIPT_FN_COUNT) {
+          err = SCRIPT_ERR_CODE;
+          break;
+        }
+        uint8_t argc = kBuiltins[fn].argc;
+        if (sp < argc || sp - argc >= SCRIPT_STACK) {
+          err = SCRIPT_ERR_STACK;
+          break;
+        }
+        int32_t* args = stack + sp - argc;
+        int32_t  result;
+        if (fn == SCRIPT_FN_TIMER) {
+          result = args[0] >= 0 && args[0] < SCRIPT_TIMERS;
+          if (result && args[1] > 0) {
+            timerDue_[args[0]] = nowMs + (uint32_t)args[1];
+            timersArmed_ |= (uint8_t)(1 << args[0]);
+          } else if (result) {
+            timersArmed_ &= (uint8_t)~(1 << args[0]);
+          }
+        } else if (fn == SCRIPT_FN_NOW) {
+          result = (int32_t)nowMs;
+        } else {
+          result = call_ ? call_(fn, args, ctx_) : 0;
+        }
+        sp -= argc;
+        stack[sp++] = result;
+        break;
+      }
+      case OP_NEG:
+        stack[sp - 1] = (int32_t)(0u - (uint32_t)stack[sp - 1]);
+        break;
+      case OP_NOT:
+        stack[sp - 1] = !stack[sp - 1];
+        break;
+    }
+    if (err != SCRIPT_OK) break;
+  }
+  *steps = n;
+  return err;
+}
@@ -0,0 +1,171 @@
+#ifndef SCRIPT_VM_HPP
+#define SCRIPT_VM_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * script_vm - header
+ *
+ * User-defined footswitch behaviours: a small line-based language, compiled
+ * once (on upload) into stack-machine bytecode that runs on each event with
+ * an instruction budget. No Arduino dependency, so it is checked and timed
+ * on the host (test/ScriptVm).
+ *
+ *   # S2 long press: fade player 1 out, then start track 7 on player 2
+ *   on long S2
+ *     vol = volume(1)
+ *     fade = vol
+ *     timer(0, 50)
+ *   end
+ *
+ *   on timer 0
+ *     fade = fade - 1
+ *     setvolume(1, fade)
+ *     if fade > 0
+ *       timer(0, 50)
+ *     else
+ *       stop(1)
+ *       setvolume(1, vol)
+ *       play(2, 7)
+ *     end
+ *   end
+ *
+ * Events: "on press|release|long|double S1..S4" (or 1..4), "on timer 0..3"
+ * and "on start" (when the script is loaded). A handler of a button press
+ * replaces the press's mapped action.
+ *
+ * Statements, one per line: "name = expr", "call(args)", "if expr ... [else
+ * ...] end", "while expr ... end" and "return". Values are 32-bit integers;
+ * variables are global, zero when the script loads, and must be assigned
+ * (earlier in the text) before they are read. Operators, by precedence:
+ * "||", "&&" (both sides evaluated), "== != < <= > >=", "+ -", "* / %",
+ * unary "- !". Constants: off, red, green, blue, amber, white (0xRRGGBB
+ * colours), auto (-1). "#" starts a comment.
+ *
+ * Functions (players 1..2, buttons 1..4; out of range does nothing, 0):
+ *   play(p, track)  toggle(p)  stop(p)  setvolume(p, 0..30)
+ *   volume(p)  playing(p)  track(p)
+ *   down(b)         1 while the footswitch is held
+ *   led(b, rgb)     set the footswitch LED; auto: back to the player colour
+ *   action(n)       run a built-in action (ButtonAction)
+ *   scene(n)        select a scene
+ *   timer(t, ms)    fire "on timer t" once after ms (0: cancel)
+ *   now()           milliseconds, wraps
+ *
+ * Image ("SK", u8 version, u8 variables, u8 handlers, then per handler u8
+ * event and u16 code offset, then the code): a typical handler takes
+ * 10 to 40 bytes.
+ */
+
+#define SCRIPT_MAX_IMAGE 1024
+#define SCRIPT_MAX_VARS 32
+#define SCRIPT_STACK 16
+#define SCRIPT_TIMERS 4
+#define SCRIPT_BUTTONS 4
+
+// Instructions one event may run before it is stopped
+#ifndef SCRIPT_BUDGET
+#define SCRIPT_BUDGET 256
+#endif
+
+/* Events: button * 4 + ButtonEventType, then the timers, then start */
+static const uint8_t SCRIPT_EVENT_TIMER0 = SCRIPT_BUTTONS * 4;
+static const uint8_t SCRIPT_EVENT_START  = SCRIPT_EVENT_TIMER0 + SCRIPT_TIMERS;
+static const uint8_t SCRIPT_EVENT_COUNT  = SCRIPT_EVENT_START + 1;
+
+/* Functions scripts call; the application implements the players, buttons,
+ * actions and scenes (ScriptCallFn), lib_script the LEDs, the VM the rest */
+enum ScriptFn : uint8_t {
+  SCRIPT_FN_PLAY = 0,
+  SCRIPT_FN_TOGGLE,
+  SCRIPT_FN_STOP,
+  SCRIPT_FN_SETVOLUME,
+  SCRIPT_FN_VOLUME,
+  SCRIPT_FN_PLAYING,
+  SCRIPT_FN_TRACK,
+  SCRIPT_FN_DOWN,
+  SCRIPT_FN_LED,
+  SCRIPT_FN_ACTION,
+  SCRIPT_FN_SCENE,
+  SCRIPT_FN_TIMER,
+  SCRIPT_FN_NOW,
+  SCRIPT_FN_COUNT
+};
+
+enum ScriptError : uint8_t {
+  SCRIPT_OK = 0,
+  SCRIPT_ERR_BUDGET,  // ran out of instructions
+  SCRIPT_ERR_DIV0,
+  SCRIPT_ERR_STACK,
+  SCRIPT_ERR_CODE  // malformed image
+};
+
+/* Runs fn with its arguments (see ScriptFn); the result is the call's
+ * value in the script. */
+typedef int32_t (*ScriptCallFn)(uint8_t fn, const int32_t* args, void* ctx);
+
+struct ScriptCompileError {
+  uint16_t line;  // 1-based
+  char     msg[48];
+};
+
+struct ScriptVmStats {
+  uint32_t events;      // handlers run
+  uint64_t steps;       // instructions run
+  uint16_t stepsMax;    // most in one event
+  uint32_t overBudget;  // handlers stopped at SCRIPT_BUDGET
+  uint32_t errors;      // other runtime errors
+  uint8_t  lastError;   // ScriptError
+};
+
+/* Compile source into an image. Returns its length, 0 with err filled on
+ * error. */
+size_t scriptCompile(const char* src, size_t len, uint8_t* out, size_t cap,
+                     ScriptCompileError* err);
+
+const char* scriptErrorName(uint8_t error);
+
+class ScriptVm {
+ public:
+  ScriptVm();
+
+  // Take an image (not copied; it must stay valid), reset the variables
+  // and timers. False if the image is malformed.
+  bool load(const uint8_t* image, size_t len, ScriptCallFn call, void* ctx);
+  void unload();
+  bool loaded() const;
+
+  bool hasHandler(uint8_t event) const;
+
+  // Run the handler of event, if any. False if there is none.
+  bool run(uint8_t event, uint32_t nowMs);
+
+  // Run the handlers of the timers that are due. Returns how many ran.
+  uint8_t poll(uint32_t nowMs);
+
+  bool     timersArmed() const;
+  uint8_t  handlerCount() const;
+  uint8_t  varCount() const;
+  size_t   imageSize() const;
+  void     stats(ScriptVmStats* out) const;
+  void     resetStats();
+
+ private:
+  uint8_t exec(uint16_t pc, uint32_t nowMs, uint16_t* steps);
+
+  const uint8_t* code_;
+  size_t         codeLen_;
+  size_t         imageLen_;
+  ScriptCallFn   call_;
+  void*          ctx_;
+  uint16_t       handlers_[SCRIPT_EVENT_COUNT];
+  uint8_t        handlerCount_;
+  uint8_t        varCount_;
+  int32_t        vars_[SCRIPT_MAX_VARS];
+  uint32_t       timerDue_[SCRIPT_TIMERS];
+  uint8_t        timersArmed_;  // bit per timer
+  ScriptVmStats  stats_;
+};
+
+#endif  // SCRIPT_VM_HPP
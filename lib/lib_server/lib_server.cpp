@@ -1,4 +1,26 @@
+// Target only: host builds use status_json.cpp alone
+#if defined(ARDUINO)
+
 #include "lib_server.hpp"
+#include "status_json.hpp"
+#include "lib_alloc.hpp"
+#include "lib_battery.hpp"
+#include "lib_button.hpp"
+#include "lib_control.hpp"
+#include "lib_crash.hpp"
+#include "lib_display.hpp"
+#include "display_status.hpp"
+#include "lib_heap.hpp"
+#include "lib_led.hpp"
+#include "lib_link.hpp"
+#include "lib_macro.hpp"
+#include "lib_replica.hpp"
+#include "lib_script.hpp"
+#include "lib_timer.hpp"
+#include "lib_midi.hpp"
+#include "lib_power.hpp"
+#include "midi_clock.hpp"
+#include "uart_fault.hpp"
 
 // application is expected to provide WiFiCredentials.h with WIFI_SSID /
 // WIFI_PASSWORD
@@ -15,40 +37,68 @@
 // internal server instance
 static WebServer server(80);
 
-// pointers to external state (supplied by main app)
-static volatile bool* g_ledPtr      = nullptr;
-static volatile bool* g_sStatePtr   = nullptr;
-static uint8_t        g_btnCount    = 0;
-static unsigned long  g_startMillis = 0;  // copy instead of pointer
+BusTopic<NetworkEvent>   networkBus("network");
+BusTopic<StatusLedEvent> statusLedBus("status_led");
 
-static const char* kMdnsNameDefault = "rigkontrol";
+static const uint8_t kMaxButtons = 16;
 
-static String buildStatusJson() {
-  unsigned long uptime = 0;
-  uptime               = millis() - g_startMillis;
+// Button states follow buttonBus, the LED is ours and published on change
+static BusSubscriber<ButtonEvent, 16> g_buttonSub("server");
+static bool          g_buttons[kMaxButtons];
+static uint8_t       g_btnCount    = 0;
+static bool          g_led         = false;
+static unsigned long g_startMillis = 0;
+static unsigned long g_lastRequest = 0;
 
-  String json = "{";
-  json += "\"uptime_ms\":" + String(uptime) + ",";
-  json += "\"wifi_mode\":\"" +
-          String(WiFi.getMode() == WIFI_MODE_AP ? "AP" : "STA") + "\",";
+// optional WiFi fast-connect storage (supplied by main app)
+static WiFiFastConnect* g_wifiCache = nullptr;
 
-  json += "\"ip\":\"" + WiFi.localIP().toString() + "\",";
-  json += "\"rssi\":" + String(WiFi.RSSI()) + ",";
-  json += "\"led\":" + String((g_ledPtr && *g_ledPtr) ? "true" : "false");
+static const char* kMdnsNameDefault = "rigkontrol";
 
-  if (g_sStatePtr && g_btnCount > 0) {
-    for (uint8_t i = 0; i < g_btnCount; ++i) {
-      bool v = g_sStatePtr[i];
-      json += ",\"s" + String(i + 1) + "\":" + String(v ? "true" : "false");
-    }
+// Response buffer shared by all handlers. WebServer handles one client at a
+// time from serverHandleClient(), so responses are built in place instead of
+// growing Strings on the heap for every request. HTTP is latency tolerant,
+// so the buffer lives in PSRAM (allocated once in serverStart()).
+// A small internal fallback keeps the short responses working if that
+// fails; longer ones get a 503 (see sendResp()). /api/metrics and
+// /api/coredump are streamed through it and work with either.
+static const size_t kRespBufSize = 2048;
+static char         g_respFallback[256];
+static char*        g_respBuf    = g_respFallback;
+static size_t       g_respCap    = sizeof(g_respFallback);
+
+/* Send the n bytes built in the response buffer. bufAppendf() stops at
+ * cap - 1, so a response that filled the buffer was cut off: 503 rather
+ * than a partial body with 200. */
+static void sendResp(int code, const char* type, size_t n) {
+  if (n + 1 >= g_respCap) {
+    server.send_P(503, "text/plain", "Response buffer too small\n");
+    return;
   }
+  server.send_P(code, type, g_respBuf, n);
+}
 
-  json += "}";
-  return json;
+static size_t buildStatusJson(char* buf, size_t cap) {
+  IPAddress      ip = WiFi.localIP();
+  StatusSnapshot snap;
+  snap.uptimeMs    = millis() - g_startMillis;
+  snap.apMode      = WiFi.getMode() == WIFI_MODE_AP;
+  snap.ip[0]       = ip[0];
+  snap.ip[1]       = ip[1];
+  snap.ip[2]       = ip[2];
+  snap.ip[3]       = ip[3];
+  snap.rssi        = WiFi.RSSI();
+  snap.led         = g_led;
+  snap.batteryMv   = batteryVoltageMv();
+  snap.batteryPct  = batteryPercent();
+  snap.buttons     = g_buttons;
+  snap.buttonCount = g_btnCount;
+  return formatStatusJson(snap, buf, cap);
 }
 
 /* HTTP handlers (use static functions so we can register with server) */
 static void handleRoot() {
+  g_lastRequest = millis();
   const char* html =
       "<!doctype html><html><head><meta charset='utf-8'><meta name='viewport' "
       "content='width=device-width,initial-scale=1'>"
@@ -64,7 +114,8 @@ static void handleRoot() {
       "  try{const r=await fetch('/api/status'); const j=await r.json();"
       "   document.getElementById('status').innerText = 'IP: '+j.ip+' | Mode: "
       "'+j.wifi_mode+' | RSSI: '+j.rssi+' | Uptime ms: '+j.uptime_ms+' | LED: "
-      "'+j.led+' | S1: '+j.s1+' | S2: '+j.s2+' | S3: '+j.s3+' | S4: '+j.s4; "
+      "'+j.led+' | Battery: '+j.bat_mv+' mV ('+j.bat_pct+'%) | S1: '+j.s1+' "
+      "| S2: '+j.s2+' | S3: '+j.s3+' | S4: '+j.s4; "
       "  }catch(e){document.getElementById('status').innerText='Error fetching "
       "status';}}"
       "document.getElementById('toggle').addEventListener('click', async ()=>{"
@@ -72,67 +123,596 @@ static void handleRoot() {
       "fetchStatus();}catch(e){alert('Error');}});"
       "fetchStatus(); setInterval(fetchStatus,2000);"
       "</script></body></html>";
-  server.send(200, "text/html", html);
+  // send_P streams the constant page instead of copying it into a String
+  server.send_P(200, "text/html", html);
 }
 
 static void handleStatus() {
-  server.send(200, "application/json", buildStatusJson());
+  g_lastRequest = millis();
+  size_t n      = buildStatusJson(g_respBuf, g_respCap);
+  sendResp(200, "application/json", n);
 }
 
-static void handleToggle() {
-  if (g_ledPtr) {
-    *g_ledPtr = !(*g_ledPtr);
-    // Let the main application actually write to the physical pin, the library
-    // does not manipulate pins directly. But for convenience, if user provided
-    // a valid pointer and the LED pin is managed externally, it will reflect
-    // here.
+/* Append one metric line behind len bytes of earlier ones. When it does
+ * not fit, those are sent as a chunk and the line starts the buffer anew,
+ * so the metrics are not bounded by the buffer's size. */
+static size_t metricLine(char* buf, size_t cap, size_t len, const char* name,
+                         const char* labels, const char* value) {
+  for (;;) {
+    size_t n = labels ? bufAppendf(buf, cap, len, "dsk_%s{%s} %s\n", name,
+                                   labels, value)
+                      : bufAppendf(buf, cap, len, "dsk_%s %s\n", name, value);
+    if (n + 1 < cap || len == 0) return n;
+    server.sendContent(buf, len);
+    len = 0;
+  }
+}
+
+/* One metric line: name{labels} value. labels may be nullptr.
+ * Counters are uint32_t and pass 2^31, so values are unsigned; the few
+ * that can go negative use metricSigned(). */
+static size_t metric(char* buf, size_t cap, size_t len, const char* name,
+                     const char* labels, unsigned long value) {
+  char text[12];
+  snprintf(text, sizeof(text), "%lu", value);
+  return metricLine(buf, cap, len, name, labels, text);
+}
+
+static size_t metricSigned(char* buf, size_t cap, size_t len,
+                           const char* name, long value) {
+  char text[12];
+  snprintf(text, sizeof(text), "%ld", value);
+  return metricLine(buf, cap, len, name, nullptr, text);
+}
+
+/* Plain-text metrics, one "name value" pair per line (Prometheus format),
+ * sent in chunks as the response buffer fills */
+static void handleMetrics() {
+  g_lastRequest = millis();
+  char*  buf    = g_respBuf;
+  size_t cap    = g_respCap;
+  char   labels[48];
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain", "");
+
+  size_t len = metric(buf, cap, 0, "uptime_ms", nullptr,
+                      millis() - g_startMillis);
+  len = metricSigned(buf, cap, len, "wifi_rssi_dbm", WiFi.RSSI());
+  len = metric(buf, cap, len, "battery_mv", nullptr, batteryVoltageMv());
+  len = metric(buf, cap, len, "battery_percent", nullptr, batteryPercent());
+  len = metric(buf, cap, len, "battery_blocks_total", nullptr,
+               batteryBlockCount());
+
+  HeapStats heap;
+  heapGetStats(&heap);
+  len = metric(buf, cap, len, "heap_free_bytes", nullptr, heap.freeBytes);
+  len = metric(buf, cap, len, "heap_min_free_bytes", nullptr,
+               heap.minFreeBytes);
+  len = metric(buf, cap, len, "heap_largest_free_block_bytes", nullptr,
+               heap.largestFreeBlock);
+  if (heapCountingEnabled()) {
+    for (uint8_t i = 0; i < HEAP_SUB_COUNT; ++i) {
+      snprintf(labels, sizeof(labels), "subsystem=\"%s\"",
+               heapSubsystemName(i));
+      len = metric(buf, cap, len, "heap_allocs_total", labels, heap.allocs[i]);
+      len = metric(buf, cap, len, "heap_frees_total", labels, heap.frees[i]);
+    }
+  }
+
+  for (uint8_t r = 0; r < ALLOC_REGION_COUNT; ++r) {
+    AllocRegionStats mem;
+    allocGetRegionStats((AllocRegion)r, &mem);
+    snprintf(labels, sizeof(labels), "region=\"%s\"", allocRegionName(r));
+    len = metric(buf, cap, len, "mem_total_bytes", labels, mem.totalBytes);
+    len = metric(buf, cap, len, "mem_free_bytes", labels, mem.freeBytes);
+    len = metric(buf, cap, len, "mem_min_free_bytes", labels,
+                 mem.minFreeBytes);
+    len = metric(buf, cap, len, "mem_largest_free_block_bytes", labels,
+                 mem.largestFreeBlock);
+    for (uint8_t t = 0; t < ALLOC_TAG_COUNT; ++t) {
+      snprintf(labels, sizeof(labels), "region=\"%s\",tag=\"%s\"",
+               allocRegionName(r), allocTagName(t));
+      len = metric(buf, cap, len, "alloc_bytes", labels,
+                   allocTagBytes((AllocTag)t, (AllocRegion)r));
+    }
+  }
+
+  // DFPlayer links (UARTs without a player have sent no commands)
+  for (uint8_t u = 0; u < 3; ++u) {
+    UartFaultStats link;
+    uartFault(u).stats(&link);
+    if (link.commands == 0) continue;
+    snprintf(labels, sizeof(labels), "uart=\"%u\",fault=\"%s\"", u,
+             uartFaultClassName(uartFault(u).config().cls));
+    len = metric(buf, cap, len, "mp3_commands_total", labels, link.commands);
+    len = metric(buf, cap, len, "mp3_ack_timeouts_total", labels,
+                 link.ackTimeouts);
+    len = metric(buf, cap, len, "mp3_ack_latency_avg_us", labels,
+                 link.ackLatencyAvgUs);
+    len = metric(buf, cap, len, "mp3_ack_latency_max_us", labels,
+                 link.ackLatencyMaxUs);
+    len = metric(buf, cap, len, "mp3_rx_frame_errors_total", labels,
+                 link.rxFrameErrors);
+    len = metric(buf, cap, len, "mp3_faults_injected_total", labels,
+                 link.injected);
+    len = metric(buf, cap, len, "mp3_recovery_max_us", labels,
+                 link.maxRecoveryUs);
+  }
+
+  // MIDI transports
+  for (uint8_t src = 0; src < MIDI_SOURCE_COUNT; ++src) {
+    MidiStats midi;
+    midiGetStats(src, &midi);
+    snprintf(labels, sizeof(labels), "source=\"%s\"", midiSourceName(src));
+    len = metric(buf, cap, len, "midi_rx_total", labels, midi.rxMessages);
+    len = metric(buf, cap, len, "midi_rx_errors_total", labels,
+                 midi.rxErrors);
+    len = metric(buf, cap, len, "midi_tx_total", labels, midi.txMessages);
+    len = metric(buf, cap, len, "midi_dropped_total", labels, midi.dropped);
+    len = metric(buf, cap, len, "midi_dispatched_total", labels,
+                 midi.dispatched);
+    len = metric(buf, cap, len, "midi_action_latency_avg_us", labels,
+                 midi.latencyAvgUs);
+    len = metric(buf, cap, len, "midi_action_latency_max_us", labels,
+                 midi.latencyMaxUs);
+  }
+
+  LedStats leds;
+  ledGetStats(&leds);
+  len = metric(buf, cap, len, "led_frames_total", nullptr, leds.frames);
+  len = metric(buf, cap, len, "led_frames_deferred_total", nullptr,
+               leds.deferred);
+
+  DisplayStats display;
+  displayGetStats(&display);
+  len = metric(buf, cap, len, "display_frames_total", nullptr, display.frames);
+  len = metric(buf, cap, len, "display_bytes_total", nullptr, display.bytes);
+  len = metric(buf, cap, len, "display_frames_deferred_total", nullptr,
+               display.deferred);
+  len = metric(buf, cap, len, "display_render_us_max", nullptr,
+               displayStatusRenderUsMax());
+  len = metric(buf, cap, len, "display_flush_us_max", nullptr,
+               display.flushUsMax);
+  len = metric(buf, cap, len, "display_tx_us_max", nullptr, display.txUsMax);
+
+  PowerDfsStats dfs;
+  powerGetDfsStats(&dfs);
+  len = metric(buf, cap, len, "cpu_dfs_enabled", nullptr, dfs.enabled);
+  for (uint8_t i = 0; i < POWER_FREQ_SLOTS && dfs.freqMhz[i]; ++i) {
+    snprintf(labels, sizeof(labels), "mhz=\"%u\"", dfs.freqMhz[i]);
+    len = metric(buf, cap, len, "cpu_freq_time_ms_total", labels,
+                 dfs.freqMs[i]);
+  }
+  for (uint8_t i = 0; i < POWER_LOCK_COUNT; ++i) {
+    snprintf(labels, sizeof(labels), "lock=\"%s\"",
+             powerLockName((PowerLock)i));
+    len = metric(buf, cap, len, "power_lock_acquired_total", labels,
+                 dfs.lockAcquired[i]);
+    len = metric(buf, cap, len, "power_lock_held_ms_total", labels,
+                 dfs.lockHeldMs[i]);
+  }
+  for (uint8_t i = 0; i < 2; ++i) {
+    snprintf(labels, sizeof(labels), "cpu=\"%s\"", i ? "max" : "scaled");
+    len = metric(buf, cap, len, "press_handling_total", labels,
+                 dfs.pressCount[i]);
+    len = metric(buf, cap, len, "press_handling_us_avg", labels,
+                 dfs.pressAvgUs[i]);
+    len = metric(buf, cap, len, "press_handling_us_max", labels,
+                 dfs.pressMaxUs[i]);
+  }
+
+  MidiClockStatus clock;
+  midiClockIn().status(&clock);
+  len = metric(buf, cap, len, "midi_clock_locked", nullptr, clock.locked);
+  len = metric(buf, cap, len, "midi_clock_bpm_x100", nullptr, clock.bpmX100);
+  len = metric(buf, cap, len, "midi_clock_in_jitter_us", nullptr,
+               clock.jitterUs);
+  len = metric(buf, cap, len, "midi_clock_in_jitter_max_us", nullptr,
+               clock.jitterMaxUs);
+  len = metric(buf, cap, len, "midi_clock_rejected_total", nullptr,
+               clock.rejected);
+  len = metric(buf, cap, len, "midi_clock_bridged_total", nullptr,
+               clock.bridged);
+
+  MidiClockOutStats clockOut;
+  midiClockOutGetStats(&clockOut);
+  len = metric(buf, cap, len, "midi_clock_out_ticks_total", nullptr,
+               clockOut.ticks);
+  len = metric(buf, cap, len, "midi_clock_out_jitter_avg_us", nullptr,
+               clockOut.jitterAvgUs);
+  len = metric(buf, cap, len, "midi_clock_out_jitter_max_us", nullptr,
+               clockOut.jitterMaxUs);
+
+  ControlStats control;
+  controlGetStats(&control);
+  len = metric(buf, cap, len, "control_link_up", nullptr,
+               controlLinkUp(millis()));
+  len = metric(buf, cap, len, "control_rx_frames_total", nullptr,
+               control.rxFrames);
+  len = metric(buf, cap, len, "control_rx_errors_total", nullptr,
+               control.rxErrors);
+  len = metric(buf, cap, len, "control_tx_frames_total", nullptr,
+               control.txFrames);
+  len = metric(buf, cap, len, "control_tx_bytes_total", nullptr,
+               control.txBytes);
+  len = metric(buf, cap, len, "control_tx_dropped_total", nullptr,
+               control.txDropped);
+
+  LinkStatus link;
+  linkGetStatus(&link);
+  len = metric(buf, cap, len, "link_peers", nullptr, link.peers);
+  len = metric(buf, cap, len, "link_other_peers", nullptr, link.others);
+  len = metric(buf, cap, len, "link_bpm_x100", nullptr, link.bpmX100);
+  len = metric(buf, cap, len, "link_rx_packets_total", nullptr,
+               link.rxPackets);
+  len = metric(buf, cap, len, "link_tx_packets_total", nullptr,
+               link.txPackets);
+  len = metric(buf, cap, len, "link_bad_packets_total", nullptr,
+               link.badPackets);
+  len = metric(buf, cap, len, "link_measurements_total", nullptr,
+               link.measurements);
+  len = metric(buf, cap, len, "link_measurements_failed_total", nullptr,
+               link.failed);
+  len = metric(buf, cap, len, "link_joins_total", nullptr, link.joins);
+  len = metric(buf, cap, len, "link_rtt_us", nullptr, link.rttUs);
+
+  MacroStats macro;
+  macroGetStats(&macro);
+  len = metric(buf, cap, len, "macro_replayed_events_total", nullptr,
+               macro.played);
+  len = metric(buf, cap, len, "macro_late_max_us", nullptr, macro.lateMaxUs);
+  len = metric(buf, cap, len, "macro_dispatch_max_us", nullptr,
+               macro.dispatchMaxUs);
+
+  ScriptStats script;
+  scriptGetStats(&script);
+  len = metric(buf, cap, len, "script_events_total", nullptr, script.events);
+  len = metric(buf, cap, len, "script_over_budget_total", nullptr,
+               script.overBudget);
+  len = metric(buf, cap, len, "script_errors_total", nullptr, script.errors);
+  len = metric(buf, cap, len, "script_event_us_max", nullptr, script.usMax);
+
+  ReplicaStats replica;
+  replicaGetStats(&replica);
+  len = metric(buf, cap, len, "replica_peers", nullptr, replica.peers);
+  len = metric(buf, cap, len, "replica_tx_bytes_total", nullptr,
+               replica.txBytes);
+  len = metric(buf, cap, len, "replica_rx_bytes_total", nullptr,
+               replica.rxBytes);
+  len = metric(buf, cap, len, "replica_lost_packets_total", nullptr,
+               replica.lost);
+  len = metric(buf, cap, len, "replica_events_total", nullptr, replica.events);
+  len = metric(buf, cap, len, "replica_events_lost_total", nullptr,
+               replica.eventsLost);
+
+  for (const BusTopicBase* t = BusTopicBase::first(); t; t = t->next()) {
+    snprintf(labels, sizeof(labels), "topic=\"%s\"", t->name());
+    len = metric(buf, cap, len, "bus_published_total", labels,
+                 t->published());
+    for (const BusSubscriberBase* s = t->subscribers(); s; s = s->next()) {
+      BusSubscriberStats st;
+      s->stats(&st);
+      snprintf(labels, sizeof(labels), "topic=\"%s\",subscriber=\"%s\"",
+               t->name(), s->name());
+      len = metric(buf, cap, len, "bus_received_total", labels, st.received);
+      len = metric(buf, cap, len, "bus_dropped_total", labels, st.dropped);
+      len = metric(buf, cap, len, "bus_pending", labels, st.pending);
+      len = metric(buf, cap, len, "bus_latency_avg_us", labels,
+                   st.latencyAvgUs);
+      len = metric(buf, cap, len, "bus_latency_max_us", labels,
+                   st.latencyMaxUs);
+    }
+  }
+
+  TimerWheelStats timers;
+  timerGetStats(&timers);
+  len = metric(buf, cap, len, "timers_armed", nullptr, timers.armed);
+  len = metric(buf, cap, len, "timers_fired_total", nullptr, timers.fired);
+  len = metric(buf, cap, len, "timers_cascaded_total", nullptr,
+               timers.cascaded);
+  len = metric(buf, cap, len, "timers_late_max_ms", nullptr, timers.lateMax);
+
+  snprintf(labels, sizeof(labels), "reason=\"%s\"", crashResetReason());
+  len = metric(buf, cap, len, "reset_reason", labels, 1);
+  len = metric(buf, cap, len, "crashes_total", nullptr, crashCount());
+  len = metric(buf, cap, len, "coredump_bytes", nullptr, crashDumpSize());
+
+  server.sendContent(buf, len);
+  server.sendContent(buf, 0);  // last chunk
+}
+
+static const char* bootPathName(PowerBootPath path) {
+  switch (path) {
+    case POWER_BOOT_WARM:
+      return "warm";
+    case POWER_BOOT_CRASH:
+      return "crash";
+    default:
+      return "cold";
+  }
+}
+
+/* Last reset and stored core dump. "valid" checksums the whole dump. */
+static void handleCrash() {
+  g_lastRequest = millis();
+  size_t dump   = crashDumpSize();
+  size_t n      = bufAppendf(
+      g_respBuf, g_respCap, 0,
+      "{\"reset_reason\":\"%s\",\"crash\":%s,\"crashes\":%lu,"
+      "\"boots\":%lu,\"boot_path\":\"%s\",\"crash_ready_us\":%lu,"
+      "\"coredump\":{\"present\":%s,\"bytes\":%lu,\"valid\":%s}}",
+      crashResetReason(), crashLastResetWasCrash() ? "true" : "false",
+      (unsigned long)crashCount(), (unsigned long)crashBootCount(),
+      bootPathName(powerBootPath()), (unsigned long)powerLastCrashBootUs(),
+      dump ? "true" : "false", (unsigned long)dump,
+      crashDumpValid() ? "true" : "false");
+  sendResp(200, "application/json", n);
+}
+
+/* Raw core dump, streamed from flash through the response buffer. Decode
+ * it with scripts/coredump_fetch.py. */
+static void handleCoredump() {
+  g_lastRequest = millis();
+  size_t size   = crashDumpSize();
+  if (!size) {
+    server.send_P(404, "text/plain", "No core dump\n");
+    return;
+  }
+  server.setContentLength(size);
+  server.send(200, "application/octet-stream", "");
+  for (size_t off = 0; off < size;) {
+    size_t n = size - off < g_respCap ? size - off : g_respCap;
+    if (!crashDumpRead(off, g_respBuf, n)) break;
+    server.sendContent(g_respBuf, n);
+    off += n;
+  }
+}
+
+static void handleCoredumpErase() {
+  g_lastRequest = millis();
+  bool   ok     = crashDumpErase();
+  size_t n = bufAppendf(g_respBuf, g_respCap, 0, "{\"erased\":%s}",
+                        ok ? "true" : "false");
+  sendResp(ok ? 200 : 500, "application/json", n);
+}
+
+/* Footswitch macros: slots, what runs, replay timing */
+static void handleMacro() {
+  g_lastRequest = millis();
+  MacroStats st;
+  macroGetStats(&st);
+  size_t n = bufAppendf(
+      g_respBuf, g_respCap, 0,
+      "{\"recording\":%s,\"playing\":%s,\"slot\":%d,\"slots\":[",
+      macroRecording() ? "true" : "false",
+      macroPlaying() ? "true" : "false", macroActiveSlot());
+  for (uint8_t i = 0; i < MACRO_SLOTS; ++i) {
+    MacroSlotInfo info;
+    macroSlotInfo(i, &info);
+    n = bufAppendf(g_respBuf, g_respCap, n,
+                   "%s{\"events\":%u,\"bytes\":%u,\"duration_ms\":%lu}",
+                   i ? "," : "", info.events, info.bytes,
+                   (unsigned long)(info.durationUs / 1000));
   }
-  server.send(200, "application/json", buildStatusJson());
+  n = bufAppendf(g_respBuf, g_respCap, n,
+                 "],\"replay\":{\"events\":%lu,\"dropped\":%lu,"
+                 "\"late_avg_us\":%lu,\"late_max_us\":%lu,"
+                 "\"dispatch_avg_us\":%lu,\"dispatch_max_us\":%lu}}",
+                 (unsigned long)st.played, (unsigned long)st.dropped,
+                 (unsigned long)st.lateAvgUs, (unsigned long)st.lateMaxUs,
+                 (unsigned long)st.dispatchAvgUs,
+                 (unsigned long)st.dispatchMaxUs);
+  sendResp(200, "application/json", n);
+}
+
+static void replyMacro(bool ok) {
+  g_lastRequest = millis();
+  size_t n = bufAppendf(g_respBuf, g_respCap, 0, "{\"ok\":%s}",
+                        ok ? "true" : "false");
+  sendResp(ok ? 200 : 409, "application/json", n);
+}
+
+// ?slot=N (default 0). arg() returns a String copy, paid only on these
+// rare commands.
+static int macroSlotArg() {
+  return server.hasArg("slot") ? (int)server.arg("slot").toInt() : 0;
+}
+
+static void handleMacroRecord() {
+  int slot = macroSlotArg();
+  replyMacro(slot >= 0 && macroRecordStart((uint8_t)slot));
+}
+
+static void handleMacroPlay() {
+  int slot = macroSlotArg();
+  replyMacro(slot >= 0 && macroPlay((uint8_t)slot));
+}
+
+static void handleMacroStop() {
+  replyMacro(macroStop());
+}
+
+/* Footswitch script: what runs and what it costs */
+static void handleScript() {
+  g_lastRequest = millis();
+  ScriptStats st;
+  scriptGetStats(&st);
+  size_t n = bufAppendf(
+      g_respBuf, g_respCap, 0,
+      "{\"loaded\":%s,\"bytes\":%u,\"handlers\":%u,\"vars\":%u,"
+      "\"budget\":%d,\"events\":%lu,\"instructions_avg\":%lu,"
+      "\"instructions_max\":%lu,\"over_budget\":%lu,\"errors\":%lu,"
+      "\"last_error\":\"%s\",\"us_avg\":%lu,\"us_max\":%lu}",
+      st.loaded ? "true" : "false", st.bytes, st.handlers, st.vars,
+      SCRIPT_BUDGET, (unsigned long)st.events, (unsigned long)st.stepsAvg,
+      (unsigned long)st.stepsMax, (unsigned long)st.overBudget,
+      (unsigned long)st.errors, scriptErrorName(st.lastError),
+      (unsigned long)st.usAvg, (unsigned long)st.usMax);
+  sendResp(200, "application/json", n);
+}
+
+// Body: the script source. arg() returns a String copy, paid only on
+// uploads.
+static void handleScriptUpload() {
+  g_lastRequest = millis();
+  String             src = server.arg("plain");
+  ScriptCompileError err;
+  bool               ok = scriptUpload(src.c_str(), src.length(), &err);
+  size_t             n;
+  if (ok) {
+    ScriptStats st;
+    scriptGetStats(&st);
+    n = bufAppendf(g_respBuf, g_respCap, 0,
+                   "{\"ok\":true,\"bytes\":%u,\"handlers\":%u}", st.bytes,
+                   st.handlers);
+  } else {
+    n = bufAppendf(g_respBuf, g_respCap, 0,
+                   "{\"ok\":false,\"line\":%u,\"error\":\"%s\"}",
+                   err.line, err.msg);
+  }
+  sendResp(ok ? 200 : 400, "application/json", n);
+}
+
+static void handleScriptClear() {
+  g_lastRequest = millis();
+  bool   ok = scriptClear();
+  size_t n  = bufAppendf(g_respBuf, g_respCap, 0, "{\"ok\":%s}",
+                         ok ? "true" : "false");
+  sendResp(ok ? 200 : 500, "application/json", n);
+}
+
+static void handleToggle() {
+  g_lastRequest = millis();
+  // the application drives the pin, the library does not touch pins
+  g_led = !g_led;
+  StatusLedEvent ev;
+  ev.on = g_led;
+  statusLedBus.publish(ev);
+  size_t n = buildStatusJson(g_respBuf, g_respCap);
+  sendResp(200, "application/json", n);
 }
 
 static void handleNotFound() {
-  String message = "Not found\n\n";
-  message += "URI: ";
-  message += server.uri();
-  message += "\nMethod: ";
-  message += (server.method() == HTTP_GET) ? "GET" : "POST";
-  message += "\n";
-  server.send(404, "text/plain", message);
+  g_lastRequest = millis();
+
+  // uri() returns a String copy; unavoidable with the WebServer API, but
+  // only paid on the 404 path.
+  size_t n = bufAppendf(g_respBuf, g_respCap, 0,
+                        "Not found\n\nURI: %s\nMethod: %s\n",
+                        server.uri().c_str(),
+                        (server.method() == HTTP_GET) ? "GET" : "POST");
+  sendResp(404, "text/plain", n);
 }
 
 /* WiFi helpers (moved from main) */
+
+// WiFi event task: link changes go out on networkBus
+static void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+  NetworkEvent ev;
+  switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+      ev.type = NETWORK_STA_UP;
+      ev.ip   = info.got_ip.ip_info.ip.addr;
+      break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+      ev.type = NETWORK_STA_DOWN;
+      ev.ip   = 0;
+      break;
+    case ARDUINO_EVENT_WIFI_AP_START:
+      ev.type = NETWORK_AP_UP;
+      ev.ip   = (uint32_t)WiFi.softAPIP();
+      break;
+    default:
+      return;
+  }
+  networkBus.publish(ev);
+}
+
 static void startAPMode() {
-  String apName =
-      "DaveSK-" + String((uint32_t)ESP.getEfuseMac(), HEX).substring(10);
+  // Suffix with the last two bytes of the factory MAC so several pedals can
+  // coexist. getEfuseMac() stores MAC byte 0 in the lowest bits.
+  uint64_t mac = ESP.getEfuseMac();
+  char     apName[16];
+  snprintf(apName, sizeof(apName), "DaveSK-%02X%02X",
+           (unsigned)((mac >> 32) & 0xFF), (unsigned)((mac >> 40) & 0xFF));
   WiFi.mode(WIFI_MODE_AP);
-  WiFi.softAP(apName.c_str());
+  WiFi.softAP(apName);
   IPAddress apIP = WiFi.softAPIP();
-  Serial.printf("Started AP '%s' IP=%s\n", apName.c_str(),
-                apIP.toString().c_str());
+  Serial.printf("Started AP '%s' IP=%u.%u.%u.%u\n", apName, apIP[0], apIP[1],
+                apIP[2], apIP[3]);
+}
+
+/* Try to reconnect using cached BSSID/channel and static IP settings.
+ * Returns true when connected; on failure the cache is invalidated and DHCP
+ * re-enabled so the normal path can run. */
+static bool connectWiFiFast() {
+  if (!g_wifiCache || !g_wifiCache->valid) return false;
+
+  Serial.printf("Fast-connecting to WiFi SSID='%s' ch=%u\n", WIFI_SSID,
+                g_wifiCache->channel);
+  WiFi.mode(WIFI_MODE_STA);
+  WiFi.config(IPAddress(g_wifiCache->ip), IPAddress(g_wifiCache->gateway),
+              IPAddress(g_wifiCache->subnet), IPAddress(g_wifiCache->dns));
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD, g_wifiCache->channel,
+             g_wifiCache->bssid);
+
+  unsigned long       start   = millis();
+  const unsigned long timeout = 3000;  // 3s, AP may have moved channel
+  while (WiFi.status() != WL_CONNECTED && (millis() - start) < timeout) {
+    delay(10);
+  }
+  if (WiFi.status() == WL_CONNECTED) return true;
+
+  Serial.println("Fast connect failed, falling back to full connect");
+  g_wifiCache->valid = false;
+  WiFi.disconnect();
+  WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+  return false;
+}
+
+static void storeWiFiCache() {
+  if (!g_wifiCache) return;
+  memcpy(g_wifiCache->bssid, WiFi.BSSID(), sizeof(g_wifiCache->bssid));
+  g_wifiCache->channel = (uint8_t)WiFi.channel();
+  g_wifiCache->ip      = (uint32_t)WiFi.localIP();
+  g_wifiCache->gateway = (uint32_t)WiFi.gatewayIP();
+  g_wifiCache->subnet  = (uint32_t)WiFi.subnetMask();
+  g_wifiCache->dns     = (uint32_t)WiFi.dnsIP();
+  g_wifiCache->valid   = true;
 }
 
 void serverConnectWiFi(void) {
+  static bool eventsOn = false;
+  if (!eventsOn) {
+    WiFi.onEvent(onWiFiEvent);
+    eventsOn = true;
+  }
+
   if (strlen(WIFI_SSID) == 0) {
     Serial.println("No SSID configured, starting AP mode");
     startAPMode();
     return;
   }
 
-  Serial.printf("Connecting to WiFi SSID='%s'\n", WIFI_SSID);
-  WiFi.mode(WIFI_MODE_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  if (!connectWiFiFast()) {
+    Serial.printf("Connecting to WiFi SSID='%s'\n", WIFI_SSID);
+    WiFi.mode(WIFI_MODE_STA);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
 
-  unsigned long       start   = millis();
-  const unsigned long timeout = 10000;  // 10s
-  while (WiFi.status() != WL_CONNECTED && (millis() - start) < timeout) {
-    Serial.print(".");
-    delay(250);
+    unsigned long       start   = millis();
+    const unsigned long timeout = 10000;  // 10s
+    while (WiFi.status() != WL_CONNECTED && (millis() - start) < timeout) {
+      Serial.print(".");
+      delay(250);
+    }
+    Serial.println();
   }
-  Serial.println();
 
   if (WiFi.status() == WL_CONNECTED) {
     Serial.print("Connected. IP=");
     Serial.println(WiFi.localIP());
+    storeWiFiCache();
 #ifdef ARDUINO_ARCH_ESP32
     if (MDNS.begin(kMdnsNameDefault)) {
       Serial.println("mDNS responder started: rigkontrol.local");
@@ -145,10 +725,29 @@ void serverConnectWiFi(void) {
 }
 
 void serverStart(void) {
+  if (g_respBuf == g_respFallback) {
+    char* buf = (char*)allocBuffer(kRespBufSize, ALLOC_TAG_NET);
+    if (buf) {
+      g_respBuf = buf;
+      g_respCap = kRespBufSize;
+    }
+  }
+
   // register handlers
   server.on("/", HTTP_GET, handleRoot);
   server.on("/api/status", HTTP_GET, handleStatus);
   server.on("/api/toggle", HTTP_POST, handleToggle);
+  server.on("/api/metrics", HTTP_GET, handleMetrics);
+  server.on("/api/crash", HTTP_GET, handleCrash);
+  server.on("/api/coredump", HTTP_GET, handleCoredump);
+  server.on("/api/coredump/erase", HTTP_POST, handleCoredumpErase);
+  server.on("/api/macro", HTTP_GET, handleMacro);
+  server.on("/api/macro/record", HTTP_POST, handleMacroRecord);
+  server.on("/api/macro/play", HTTP_POST, handleMacroPlay);
+  server.on("/api/macro/stop", HTTP_POST, handleMacroStop);
+  server.on("/api/script", HTTP_GET, handleScript);
+  server.on("/api/script", HTTP_POST, handleScriptUpload);
+  server.on("/api/script/clear", HTTP_POST, handleScriptClear);
   server.onNotFound(handleNotFound);
 
   server.begin();
@@ -159,17 +758,38 @@ void serverStart(void) {
 
 /* Public API */
 
-void serverInit(volatile bool* ledPtr, volatile bool* sStatePtr,
-                uint8_t btnCount, unsigned long startMillis) {
-  g_ledPtr      = ledPtr;
-  g_sStatePtr   = sStatePtr;
-  g_btnCount    = btnCount;
+void serverInit(uint8_t btnCount, unsigned long startMillis) {
+  g_btnCount    = btnCount < kMaxButtons ? btnCount : kMaxButtons;
   g_startMillis = startMillis;
+  buttonBus.subscribe(g_buttonSub);
 
+#if defined(SERVER_OFFLINE)
+  // No radio (QEMU builds): routes and WiFi are skipped entirely
+  Serial.println("Server offline build, WiFi disabled");
+#else
   serverConnectWiFi();
   serverStart();
+#endif
+}
+
+void serverSetWiFiCache(WiFiFastConnect* cache) {
+  g_wifiCache = cache;
 }
 
 void serverHandleClient(void) {
+  ButtonEvent ev;
+  while (g_buttonSub.poll(&ev)) {
+    if (ev.button >= kMaxButtons) continue;
+    if (ev.type == BUTTON_EVENT_PRESSED) g_buttons[ev.button] = true;
+    if (ev.type == BUTTON_EVENT_RELEASED) g_buttons[ev.button] = false;
+  }
+#if !defined(SERVER_OFFLINE)
   server.handleClient();
+#endif
 }
+
+unsigned long serverLastRequestMillis(void) {
+  return g_lastRequest;
+}
+
+#endif  // ARDUINO
@@ -9,22 +9,67 @@
 #include <ESPmDNS.h>
 #endif
 
+#include "lib_bus.hpp"
+
+/* Network changes, published from the WiFi event task. */
+enum NetworkEventType : uint8_t {
+  NETWORK_STA_UP = 0,  // station got its IP address
+  NETWORK_STA_DOWN,    // station lost the AP
+  NETWORK_AP_UP        // fallback access point started
+};
+
+struct NetworkEvent {
+  uint8_t  type;  // NetworkEventType
+  uint32_t ip;    // byte 0 = first octet; 0 for NETWORK_STA_DOWN
+};
+
+extern BusTopic<NetworkEvent> networkBus;
+
+/* Status LED requested over HTTP (/api/toggle), published from the task
+ * that calls serverHandleClient(). The application drives the pin. */
+struct StatusLedEvent {
+  bool on;
+};
+
+extern BusTopic<StatusLedEvent> statusLedBus;
+
+/* WiFi fast-connect data: BSSID/channel skip the scan, static IP settings
+ * skip DHCP. Filled in after a successful connection, so it can be kept
+ * across deep sleep by the application. */
+struct WiFiFastConnect {
+  bool     valid;
+  uint8_t  channel;
+  uint8_t  bssid[6];
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+/* Optional: provide fast-connect storage before serverInit(). When it holds
+ * valid data the first connection attempt reuses it; it is refreshed on every
+ * successful connection and invalidated if the fast attempt fails. */
+void serverSetWiFiCache(WiFiFastConnect* cache);
+
 /* Initialize server + WiFi and register HTTP routes.
- * ledPtr: pointer to external volatile bool representing LED state.
- * sStatePtr: pointer to external volatile bool array of button states.
- * btnCount: number of buttons in sStatePtr.
+ * btnCount: number of buttons reported by /api/status, whose states follow
+ * buttonBus.
  * startMillis: application start time in milliseconds (used to
  * compute uptime).
  *
  * This function will attempt to connect to WiFi using WiFiCredentials.h. It
- * will fall back to AP mode.
+ * will fall back to AP mode. Built with -D SERVER_OFFLINE (targets without a
+ * radio, e.g. QEMU) it only subscribes to the buttons.
  */
-void serverInit(volatile bool* ledPtr, volatile bool* sStatePtr,
-                uint8_t btnCount, unsigned long startMillis);
+void serverInit(uint8_t btnCount, unsigned long startMillis);
 
-/* Call frequently from loop() to let the HTTP server process clients */
+/* Call frequently from loop() to let the HTTP server process clients and
+ * follow the button events */
 void serverHandleClient(void);
 
+/* millis() timestamp of the last HTTP request (0 if none yet) */
+unsigned long serverLastRequestMillis(void);
+
 /* Expose low-level connect/start functions if needed externally */
 void serverConnectWiFi(void);
 void serverStart(void);
@@ -0,0 +1,35 @@
+#include "status_json.hpp"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+size_t bufAppendf(char* buf, size_t cap, size_t len, const char* fmt, ...) {
+  if (len >= cap) return len;
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buf + len, cap - len, fmt, args);
+  va_end(args);
+  if (n < 0) return len;
+  return (len + n < cap) ? len + n : cap - 1;
+}
+
+size_t formatStatusJson(const StatusSnapshot& s, char* buf, size_t cap) {
+  size_t len = bufAppendf(buf, cap, 0, "{\"uptime_ms\":%lu,", s.uptimeMs);
+  len = bufAppendf(buf, cap, len, "\"wifi_mode\":\"%s\",",
+                   s.apMode ? "AP" : "STA");
+  len = bufAppendf(buf, cap, len, "\"ip\":\"%u.%u.%u.%u\",", s.ip[0], s.ip[1],
+                   s.ip[2], s.ip[3]);
+  len = bufAppendf(buf, cap, len, "\"rssi\":%d,", s.rssi);
+  len = bufAppendf(buf, cap, len, "\"led\":%s", s.led ? "true" : "false");
+  len = bufAppendf(buf, cap, len, ",\"bat_mv\":%u,\"bat_pct\":%u",
+                   s.batteryMv, s.batteryPct);
+
+  if (s.buttons) {
+    for (uint8_t i = 0; i < s.buttonCount; ++i) {
+      len = bufAppendf(buf, cap, len, ",\"s%u\":%s", i + 1,
+                       s.buttons[i] ? "true" : "false");
+    }
+  }
+
+  return bufAppendf(buf, cap, len, "}");
+}
@@ -0,0 +1,36 @@
+#ifndef STATUS_JSON_HPP
+#define STATUS_JSON_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * status_json - header
+ *
+ * Allocation-free formatting of the /api/status document. Kept free of
+ * Arduino/WiFi dependencies so host builds (benchmarks, simulator) can use
+ * it; lib_server fills the snapshot from the live system.
+ */
+
+struct StatusSnapshot {
+  unsigned long        uptimeMs;
+  bool                 apMode;
+  uint8_t              ip[4];
+  int                  rssi;
+  bool                 led;
+  uint16_t             batteryMv;
+  uint8_t              batteryPct;
+  const volatile bool* buttons;  // may be nullptr
+  uint8_t              buttonCount;
+};
+
+/* Format snapshot as JSON into buf. Returns the length written (output is
+ * truncated, and still NUL-terminated, if cap is too small). */
+size_t formatStatusJson(const StatusSnapshot& s, char* buf, size_t cap);
+
+/* Bounded printf-append into buf at offset len; returns the new length
+ * (clamped to cap-1 when the output is truncated). */
+size_t bufAppendf(char* buf, size_t cap, size_t len, const char* fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+#endif  // STATUS_JSON_HPP
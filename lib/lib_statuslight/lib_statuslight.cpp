@@ -0,0 +1,266 @@
+/*
+ * lib_statuslight.cpp
+ *
+ * Status LED patterns (see lib_statuslight.hpp). A pattern is a loop of
+ * steps; a pattern of one step is set once and holds. Each step starts an
+ * LEDC hardware fade (or sets the duty at once) and, if the pattern has
+ * more steps, arms a one-shot esp_timer for the step's length. Every LEDC
+ * call is made from that timer's callback: statusLightRaise() and
+ * statusLightOff() only store the pattern wanted and fire the timer at
+ * once, so the loop task and the timer task never drive the channel
+ * together.
+ *
+ * The IDF 4.4 driver cannot stop a fade: any other duty call waits for it
+ * to end. A new pattern therefore starts when the running fade ends, and
+ * the breathing is cut into 500 ms fades so that is never long; the
+ * segments also bend the linear fades towards what the eye sees as even.
+ *
+ * 8-bit duty at 5 kHz on a low-speed channel.
+ */
+
+#include "lib_statuslight.hpp"
+
+#include <atomic>
+
+#if defined(ARDUINO) && __has_include(<esp_timer.h>)
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#define STATUSLIGHT_ESP_TIMER 1
+#endif
+
+struct StatusLightStep {
+  uint8_t  duty;    // 0..255
+  uint16_t fadeMs;  // 0: at once
+  uint16_t holdMs;
+};
+
+struct StatusLightPatternDef {
+  const char*            name;
+  const StatusLightStep* steps;
+  uint8_t                count;
+};
+
+static const StatusLightStep kOff[]     = {{0, 0, 0}};
+static const StatusLightStep kOn[]      = {{255, 0, 0}};
+static const StatusLightStep kBreathe[] = {
+    {24, 500, 0}, {72, 500, 0}, {160, 500, 150},
+    {72, 500, 0}, {24, 500, 0}, {4, 500, 400}};
+static const StatusLightStep kBlinkFast[]   = {{255, 0, 100}, {0, 0, 100}};
+static const StatusLightStep kDoublePulse[] = {
+    {255, 0, 80}, {0, 0, 120}, {255, 0, 80}, {0, 0, 920}};
+
+#define STEPS(s) s, (uint8_t)(sizeof(s) / sizeof(s[0]))
+
+static const StatusLightPatternDef kPatterns[STATUS_LIGHT_PATTERN_COUNT] = {
+    {"off", STEPS(kOff)},
+    {"on", STEPS(kOn)},
+    {"breathe", STEPS(kBreathe)},
+    {"blink_fast", STEPS(kBlinkFast)},
+    {"double_pulse", STEPS(kDoublePulse)},
+};
+
+// Pattern of each cause, least urgent first
+static const StatusLightPattern kCausePattern[STATUS_CAUSE_COUNT] = {
+    STATUS_LIGHT_ON, STATUS_LIGHT_BLINK_FAST, STATUS_LIGHT_DOUBLE_PULSE};
+
+static bool                 ready  = false;
+static uint8_t              causes = 0;  // bit per StatusLightCause
+static std::atomic<uint8_t> wanted{STATUS_LIGHT_BREATHE};
+
+// Longest statusLightOff() waits: a fade, or a step whose timer beat the
+// kick (double pulse: 920 ms)
+static const uint32_t kOffWaitMs = 1500;
+
+// written by the timer task only
+static std::atomic<uint8_t> shown{STATUS_LIGHT_PATTERN_COUNT};  // none yet
+static uint8_t              step      = 0;
+static uint32_t             fadeEndUs = 0;
+
+static bool hwInit(uint8_t pin);
+static void hwFade(uint8_t duty, uint16_t ms);
+
+static StatusLightPattern patternFor(uint8_t active) {
+  for (int8_t c = STATUS_CAUSE_COUNT - 1; c >= 0; --c) {
+    if (active & (1u << c)) return kCausePattern[c];
+  }
+  return STATUS_LIGHT_BREATHE;
+}
+
+// Next step of the pattern shown, or the first of the one wanted
+static void onStep(void* arg);
+
+#if STATUSLIGHT_ESP_TIMER
+static esp_timer_handle_t stepTimer = nullptr;
+
+static uint32_t nowUs(void) {
+  return (uint32_t)esp_timer_get_time();
+}
+
+static void schedule(uint32_t us) {
+  esp_timer_start_once(stepTimer, us);
+}
+
+static void kick(void) {
+  esp_timer_stop(stepTimer);
+  esp_timer_start_once(stepTimer, 0);
+}
+
+static bool timerInit(void) {
+  if (stepTimer) return true;
+  esp_timer_create_args_t args = {};
+  args.callback                = onStep;
+  args.dispatch_method         = ESP_TIMER_TASK;
+  args.name                    = "status_light";
+  return esp_timer_create(&args, &stepTimer) == ESP_OK;
+}
+
+// Until the timer task shows pattern p, or timeoutMs
+static bool waitShown(uint8_t p, uint32_t timeoutMs) {
+  int64_t end = esp_timer_get_time() + (int64_t)timeoutMs * 1000;
+  while (shown.load(std::memory_order_acquire) != p) {
+    if (esp_timer_get_time() >= end) return false;
+    vTaskDelay(1);
+  }
+  return true;
+}
+#else
+// Host builds: no timer, the first step of each pattern holds
+static uint32_t nowUs(void) {
+  return 0;
+}
+
+static void schedule(uint32_t us) {
+  (void)us;
+}
+
+static void kick(void) {
+  fadeEndUs = 0;
+  onStep(nullptr);
+}
+
+static bool timerInit(void) {
+  return true;
+}
+
+static bool waitShown(uint8_t p, uint32_t timeoutMs) {
+  (void)timeoutMs;
+  return shown.load(std::memory_order_acquire) == p;
+}
+#endif
+
+static void onStep(void* arg) {
+  (void)arg;
+  uint8_t  want = wanted.load(std::memory_order_acquire);
+  uint8_t  cur  = shown.load(std::memory_order_relaxed);
+  uint32_t now  = nowUs();
+  if (want != cur) {
+    // the driver would block until the fade ends: come back then
+    int32_t left = (int32_t)(fadeEndUs - now);
+    if (left > 0) {
+      schedule((uint32_t)left);
+      return;
+    }
+    cur  = want;
+    step = 0;
+  } else if (++step >= kPatterns[cur].count) {
+    step = 0;
+  }
+  const StatusLightPatternDef& p = kPatterns[cur];
+  const StatusLightStep&       s = p.steps[step];
+  hwFade(s.duty, s.fadeMs);
+  fadeEndUs = now + (uint32_t)s.fadeMs * 1000;
+  shown.store(cur, std::memory_order_release);
+  if (p.count > 1) schedule(((uint32_t)s.fadeMs + s.holdMs) * 1000);
+}
+
+bool statusLightBegin(uint8_t pin) {
+  if (!timerInit() || !hwInit(pin)) return false;
+  ready = true;
+  wanted.store(patternFor(causes), std::memory_order_release);
+  kick();
+  return true;
+}
+
+void statusLightRaise(StatusLightCause cause, bool active) {
+  if (cause >= STATUS_CAUSE_COUNT) return;
+  uint8_t bit  = (uint8_t)(1u << cause);
+  uint8_t next = active ? (uint8_t)(causes | bit) : (uint8_t)(causes & ~bit);
+  if (next == causes) return;
+  causes               = next;
+  StatusLightPattern p = patternFor(causes);
+  if (p == wanted.load(std::memory_order_relaxed)) return;
+  wanted.store(p, std::memory_order_release);
+  if (ready) kick();
+}
+
+StatusLightPattern statusLightPattern(void) {
+  return (StatusLightPattern)wanted.load(std::memory_order_relaxed);
+}
+
+const char* statusLightPatternName(StatusLightPattern p) {
+  return p < STATUS_LIGHT_PATTERN_COUNT ? kPatterns[p].name : "?";
+}
+
+void statusLightOff(void) {
+  wanted.store(STATUS_LIGHT_OFF, std::memory_order_release);
+  if (!ready) return;
+  // the off step runs on the timer task, once the running fade ends
+  kick();
+  waitShown(STATUS_LIGHT_OFF, kOffWaitMs);
+}
+
+#if defined(ARDUINO) && __has_include(<driver/ledc.h>)
+
+#include <driver/ledc.h>
+
+static const ledc_mode_t    kMode    = LEDC_LOW_SPEED_MODE;
+static const ledc_channel_t kChannel = LEDC_CHANNEL_0;
+static const ledc_timer_t   kTimer   = LEDC_TIMER_0;
+
+static bool hwInit(uint8_t pin) {
+  ledc_timer_config_t timer = {};
+  timer.speed_mode          = kMode;
+  timer.duty_resolution     = LEDC_TIMER_8_BIT;
+  timer.timer_num           = kTimer;
+  timer.freq_hz             = 5000;
+  timer.clk_cfg             = LEDC_AUTO_CLK;
+  if (ledc_timer_config(&timer) != ESP_OK) return false;
+
+  ledc_channel_config_t channel = {};
+  channel.gpio_num              = pin;
+  channel.speed_mode            = kMode;
+  channel.channel               = kChannel;
+  channel.timer_sel             = kTimer;
+  channel.duty                  = 0;
+  channel.hpoint                = 0;
+  if (ledc_channel_config(&channel) != ESP_OK) return false;
+  // ESP_ERR_INVALID_STATE: installed already
+  esp_err_t err = ledc_fade_func_install(0);
+  return err == ESP_OK || err == ESP_ERR_INVALID_STATE;
+}
+
+static void hwFade(uint8_t duty, uint16_t ms) {
+  if (ms) {
+    ledc_set_fade_with_time(kMode, kChannel, duty, ms);
+    ledc_fade_start(kMode, kChannel, LEDC_FADE_NO_WAIT);
+  } else {
+    ledc_set_duty(kMode, kChannel, duty);
+    ledc_update_duty(kMode, kChannel);
+  }
+}
+
+#else
+
+// Host builds: nothing to drive
+static bool hwInit(uint8_t pin) {
+  (void)pin;
+  return true;
+}
+
+static void hwFade(uint8_t duty, uint16_t ms) {
+  (void)duty;
+  (void)ms;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef LIB_STATUSLIGHT_HPP
+#define LIB_STATUSLIGHT_HPP
+
+#include <stdint.h>
+
+/*
+ * lib_statuslight - header
+ *
+ * The board's single status LED on the LEDC PWM peripheral. What it shows
+ * comes from a small table of patterns, each a loop of steps "fade to
+ * this duty in so many ms, then hold": the fades run in the LEDC hardware
+ * and an esp_timer starts the next step, so neither loop() nor any task
+ * touches the LED between changes.
+ *
+ * The pattern follows the causes raised, the most urgent winning:
+ *   player error  double pulse
+ *   reconnecting  fast blink
+ *   manual        on (HTTP /api/toggle)
+ *   none          breathing
+ * Call statusLightRaise() when a cause starts or ends, e.g. from the
+ * events on playerBus, networkBus and statusLedBus.
+ *
+ *   statusLightBegin(Board::kLedPin);                 // setup()
+ *   statusLightRaise(STATUS_CAUSE_RECONNECT, true);   // on NETWORK_STA_DOWN
+ */
+
+enum StatusLightPattern : uint8_t {
+  STATUS_LIGHT_OFF = 0,
+  STATUS_LIGHT_ON,
+  STATUS_LIGHT_BREATHE,
+  STATUS_LIGHT_BLINK_FAST,
+  STATUS_LIGHT_DOUBLE_PULSE,
+  STATUS_LIGHT_PATTERN_COUNT
+};
+
+/* Least urgent first */
+enum StatusLightCause : uint8_t {
+  STATUS_CAUSE_MANUAL = 0,
+  STATUS_CAUSE_RECONNECT,
+  STATUS_CAUSE_PLAYER_ERROR,
+  STATUS_CAUSE_COUNT
+};
+
+/* Drive the LED on pin and start breathing. Returns false if the LEDC
+ * channel could not be set up. */
+bool statusLightBegin(uint8_t pin);
+
+/* A cause started (active) or ended. Changes the pattern only when the
+ * most urgent cause changes. Loop task. */
+void statusLightRaise(StatusLightCause cause, bool active);
+
+StatusLightPattern statusLightPattern(void);
+const char*        statusLightPatternName(StatusLightPattern p);
+
+/* Stop the pattern and turn the LED off (before deep sleep). Waits for
+ * the running fade to end, at most 1.5 s. */
+void statusLightOff(void);
+
+#endif  // LIB_STATUSLIGHT_HPP
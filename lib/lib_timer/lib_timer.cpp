@@ -0,0 +1,59 @@
+/*
+ * lib_timer.cpp
+ *
+ * The shared millisecond timer wheel (see lib_timer.hpp). Times are
+ * millis() values, so a timer armed outside a callback counts from the
+ * current time, not from the last timersRun(). Arming with nothing else
+ * armed first moves the wheel to the current time, so the first
+ * timersRun() after a quiet spell does not walk the ticks in between.
+ */
+
+#include "lib_timer.hpp"
+
+#if __has_include(<Arduino.h>)
+#include <Arduino.h>
+
+static uint32_t nowMs(void) {
+  return (uint32_t)millis();
+}
+#else
+#include <chrono>
+
+// host programs without the Arduino shim
+static uint32_t nowMs(void) {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+#endif
+
+static TimerWheel wheel;
+
+void timerArmAt(WheelTimer& t, uint32_t whenMs) {
+  wheel.sync(nowMs());
+  wheel.armAt(t, whenMs);
+}
+
+void timerArm(WheelTimer& t, uint32_t delayMs) {
+  uint32_t now = nowMs();
+  wheel.sync(now);
+  wheel.armAt(t, now + delayMs);
+}
+
+void timerArmPeriodic(WheelTimer& t, uint32_t periodMs) {
+  uint32_t now = nowMs();
+  wheel.sync(now);
+  wheel.armPeriodic(t, now + periodMs, periodMs);
+}
+
+void timerCancel(WheelTimer& t) {
+  wheel.cancel(t);
+}
+
+void timersRun(void) {
+  wheel.advance(nowMs());
+}
+
+void timerGetStats(TimerWheelStats* out) {
+  wheel.stats(out);
+}
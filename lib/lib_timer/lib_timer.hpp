@@ -0,0 +1,37 @@
+#ifndef LIB_TIMER_HPP
+#define LIB_TIMER_HPP
+
+#include <stdint.h>
+
+#include "timer_wheel.hpp"
+
+/*
+ * lib_timer - header
+ *
+ * The pedal's software timers: one TimerWheel (timer_wheel.hpp) counting
+ * milliseconds, shared by everything that runs from loop(): debounce, long
+ * press and double click in lib_button, periodic work in the application.
+ * Timers belong to their users (a WheelTimer, usually static). Arming and
+ * cancelling are O(1) and timersRun() only visits the slots that hold
+ * something, so loop() costs the same however many timers wait.
+ *
+ * Loop task only: from ISRs and other tasks, use esp_timer and lib_bus.
+ *
+ *   static WheelTimer blink(onBlink, nullptr);
+ *   timerArmPeriodic(blink, 1000);  // setup()
+ *   timersRun();                    // loop()
+ */
+
+/* Fire at millis() == whenMs, delayMs from now, or every periodMs from
+ * now. Re-arms an armed timer. */
+void timerArmAt(WheelTimer& t, uint32_t whenMs);
+void timerArm(WheelTimer& t, uint32_t delayMs);
+void timerArmPeriodic(WheelTimer& t, uint32_t periodMs);
+void timerCancel(WheelTimer& t);
+
+/* Run the callbacks of the timers due by millis(). */
+void timersRun(void);
+
+void timerGetStats(TimerWheelStats* out);
+
+#endif  // LIB_TIMER_HPP
@@ -0,0 +1,191 @@
+/*
+ * timer_wheel.cpp
+ *
+ * Hierarchical timer wheel (see timer_wheel.hpp). The slot of a timer
+ * follows from its distance to next_, the first tick not expired yet:
+ * under 64 ticks level 0, slot = expiry & 63; under 64^2 level 1, slot =
+ * (expiry >> 6) & 63; and so on. A slot of level L is cascaded at the tick
+ * its range starts, when everything in it comes within the reach of the
+ * levels below. Beyond the top level a timer waits in the top level's
+ * furthest slot and is placed again when that slot is cascaded.
+ */
+
+#include "timer_wheel.hpp"
+
+static const uint8_t kIdle = 0xFF;  // level_ of a timer not armed
+
+WheelTimer::WheelTimer()
+    : next_(nullptr),
+      pprev_(nullptr),
+      expires_(0),
+      period_(0),
+      fn_(nullptr),
+      arg_(nullptr),
+      level_(kIdle),
+      slot_(0) {}
+
+WheelTimer::WheelTimer(TimerFn fn, void* arg) : WheelTimer() {
+  fn_  = fn;
+  arg_ = arg;
+}
+
+void WheelTimer::set(TimerFn fn, void* arg) {
+  if (armed()) return;
+  fn_  = fn;
+  arg_ = arg;
+}
+
+bool WheelTimer::armed() const {
+  return pprev_ != nullptr;
+}
+
+uint32_t WheelTimer::expires() const {
+  return expires_;
+}
+
+TimerWheel::TimerWheel(uint32_t now)
+    : next_(now + 1),
+      expiring_(false),
+      armed_(0),
+      fired_(0),
+      cascaded_(0),
+      lateMax_(0) {
+  for (uint8_t l = 0; l < kLevels; ++l) {
+    for (uint32_t s = 0; s < kSlots; ++s) slots_[l][s] = nullptr;
+    used_[l] = 0;
+  }
+}
+
+void TimerWheel::link(WheelTimer& t) {
+  int32_t  delta = (int32_t)(t.expires_ - next_);
+  uint32_t when  = delta < 0 ? next_ : t.expires_;
+  uint32_t dist  = when - next_;
+  uint8_t  level = 0;
+  while (level + 1 < kLevels && dist >= (1u << (kBits * (level + 1)))) {
+    ++level;
+  }
+  uint32_t reach = 1u << (kBits * (level + 1));
+  if (level + 1 == kLevels && dist >= reach) when = next_ + reach - 1;
+
+  uint8_t slot = (uint8_t)((when >> (kBits * level)) & (kSlots - 1));
+  WheelTimer** head = &slots_[level][slot];
+  t.next_           = *head;
+  if (t.next_) t.next_->pprev_ = &t.next_;
+  t.pprev_ = head;
+  *head    = &t;
+  t.level_ = level;
+  t.slot_  = slot;
+  used_[level] |= 1ULL << slot;
+}
+
+void TimerWheel::unlink(WheelTimer& t) {
+  *t.pprev_ = t.next_;
+  if (t.next_) t.next_->pprev_ = t.pprev_;
+  if (!slots_[t.level_][t.slot_]) used_[t.level_] &= ~(1ULL << t.slot_);
+  t.next_  = nullptr;
+  t.pprev_ = nullptr;
+  t.level_ = kIdle;
+}
+
+void TimerWheel::armAt(WheelTimer& t, uint32_t when) {
+  if (t.armed()) {
+    unlink(t);
+  } else {
+    ++armed_;
+  }
+  t.expires_ = when;
+  t.period_  = 0;
+  link(t);
+}
+
+void TimerWheel::arm(WheelTimer& t, uint32_t delay) {
+  armAt(t, now() + delay);
+}
+
+void TimerWheel::armPeriodic(WheelTimer& t, uint32_t first, uint32_t period) {
+  armAt(t, first);
+  t.period_ = period ? period : 1;
+}
+
+void TimerWheel::cancel(WheelTimer& t) {
+  if (!t.armed()) return;
+  unlink(t);
+  --armed_;
+}
+
+uint32_t TimerWheel::now() const {
+  return expiring_ ? next_ : next_ - 1;
+}
+
+// tick starts a slot of level 1: move that slot down, and so on up the
+// levels while the slot cascaded is the first of its level
+void TimerWheel::cascade(uint32_t tick) {
+  for (uint8_t level = 1; level < kLevels; ++level) {
+    uint8_t     slot = (uint8_t)((tick >> (kBits * level)) & (kSlots - 1));
+    WheelTimer* list = slots_[level][slot];
+    slots_[level][slot] = nullptr;
+    used_[level] &= ~(1ULL << slot);
+    while (list) {
+      WheelTimer* t = list;
+      list          = t->next_;
+      link(*t);
+      ++cascaded_;
+    }
+    if (slot) break;
+  }
+}
+
+void TimerWheel::expire(uint32_t tick, uint32_t slot, uint32_t late) {
+  if (late > lateMax_) lateMax_ = late;
+  // next_ stays at tick meanwhile: a timer the callbacks arm for now or
+  // earlier joins this slot and fires in this loop
+  WheelTimer* t;
+  expiring_ = true;
+  while ((t = slots_[0][slot]) != nullptr) {
+    unlink(*t);
+    if (t->period_) {
+      t->expires_ = tick + t->period_;
+      link(*t);
+    } else {
+      --armed_;
+    }
+    ++fired_;
+    t->fn_(t->arg_);
+  }
+  expiring_ = false;
+}
+
+void TimerWheel::advance(uint32_t now) {
+  while ((int32_t)(now - next_) >= 0) {
+    if (!armed_) {
+      next_ = now + 1;
+      return;
+    }
+    uint32_t tick = next_;
+    uint32_t slot = tick & (kSlots - 1);
+    if (!slot) cascade(tick);
+    if (used_[0] & (1ULL << slot)) {
+      expire(tick, slot, now - tick);
+      next_ = tick + 1;
+      continue;
+    }
+    // nothing at tick: skip to the next slot in use, at most to the next
+    // cascade
+    uint64_t ahead = used_[0] >> slot;
+    uint32_t step  = ahead ? (uint32_t)__builtin_ctzll(ahead) : kSlots - slot;
+    uint32_t left  = now - tick + 1;
+    next_          = tick + (step < left ? step : left);
+  }
+}
+
+void TimerWheel::sync(uint32_t now) {
+  if (armed_ || expiring_) return;
+  if ((int32_t)(now - next_) >= 0) next_ = now + 1;
+}
+
+void TimerWheel::stats(TimerWheelStats* out) const {
+  out->armed    = armed_;
+  out->fired    = fired_;
+  out->cascaded = cascaded_;
+  out->lateMax  = lateMax_;
+}
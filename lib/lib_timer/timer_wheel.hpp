@@ -0,0 +1,111 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <stdint.h>
+
+/*
+ * timer_wheel - header
+ *
+ * Hierarchical timer wheel: TIMER_WHEEL_LEVELS levels of 64 slots, level 0
+ * one tick per slot, each level above 64 times coarser (4 levels: 2^24
+ * ticks, 4.6 h at 1 ms). A timer sits in the slot of its expiry time at
+ * the finest level that reaches it, in an intrusive list, so arm() and
+ * cancel() are O(1) and take no memory. advance() expires the level 0 slot
+ * of each tick and, every 64 ticks, moves the next slot of the level above
+ * down ("cascade"); slots with nothing armed are skipped with the
+ * occupancy bitmaps, so the cost does not grow with the number of timers
+ * waiting. No Arduino dependency, so it is checked on the host
+ * (test/TimerWheel).
+ *
+ * Not locked: arm, cancel and advance from one task. Callbacks run inside
+ * advance() and may arm or cancel any timer, their own included. Delays
+ * up to 2^31 - 1 ticks; a due or past time fires on the next tick.
+ *
+ *   static WheelTimer t(onTimeout, ctx);
+ *   wheel.armAt(t, now + 50);
+ *   wheel.advance(now);   // regularly, with the current tick count
+ */
+
+#ifndef TIMER_WHEEL_LEVELS
+#define TIMER_WHEEL_LEVELS 4
+#endif
+
+typedef void (*TimerFn)(void* arg);
+
+class WheelTimer {
+ public:
+  WheelTimer();
+  WheelTimer(TimerFn fn, void* arg);
+
+  // callback; only while not armed
+  void set(TimerFn fn, void* arg);
+
+  bool     armed() const;
+  uint32_t expires() const;  // tick it fires at, while armed
+
+ private:
+  friend class TimerWheel;
+
+  WheelTimer*  next_;
+  WheelTimer** pprev_;  // link pointing at this timer, nullptr: not armed
+  uint32_t     expires_;
+  uint32_t     period_;  // 0: one-shot
+  TimerFn      fn_;
+  void*        arg_;
+  uint8_t      level_;
+  uint8_t      slot_;
+};
+
+struct TimerWheelStats {
+  uint32_t armed;     // timers waiting
+  uint32_t fired;
+  uint32_t cascaded;  // timers moved down a level
+  uint32_t lateMax;   // ticks between expiry and the advance() that ran it
+};
+
+class TimerWheel {
+ public:
+  static const uint8_t  kBits   = 6;
+  static const uint32_t kSlots  = 1u << kBits;
+  static const uint8_t  kLevels = TIMER_WHEEL_LEVELS;
+
+  // now: the current tick; timers armed before the first advance() count
+  // from it
+  explicit TimerWheel(uint32_t now = 0);
+
+  // one-shot at tick when / delay ticks after now(). Re-arms an armed
+  // timer.
+  void armAt(WheelTimer& t, uint32_t when);
+  void arm(WheelTimer& t, uint32_t delay);
+  // at tick first, then every period ticks (at least 1)
+  void armPeriodic(WheelTimer& t, uint32_t first, uint32_t period);
+  void cancel(WheelTimer& t);
+
+  // Run the timers due up to and including tick now
+  void advance(uint32_t now);
+  // Move to tick now without visiting the ticks between, when nothing is
+  // armed: arm after a long idle time without advance() paying for it
+  void sync(uint32_t now);
+
+  // Tick being expired inside a callback, else the last one advanced to
+  uint32_t now() const;
+
+  void stats(TimerWheelStats* out) const;
+
+ private:
+  void        link(WheelTimer& t);
+  void        unlink(WheelTimer& t);
+  void        cascade(uint32_t tick);
+  void        expire(uint32_t tick, uint32_t slot, uint32_t late);
+
+  WheelTimer* slots_[kLevels][kSlots];
+  uint64_t    used_[kLevels];  // bit i: slots_[level][i] not empty
+  uint32_t    next_;           // first tick not expired yet
+  bool        expiring_;       // inside expire(), next_ is the tick
+  uint32_t    armed_;
+  uint32_t    fired_;
+  uint32_t    cascaded_;
+  uint32_t    lateMax_;
+};
+
+#endif  // TIMER_WHEEL_HPP
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""Compare two benchmark runs (JSON lines from the bench env).
+
+    .pio/build/bench/program > base.jsonl       # on the base branch
+    .pio/build/bench/program > new.jsonl        # on the feature branch
+    scripts/bench_compare.py base.jsonl new.jsonl --threshold 10
+
+Prints one line per benchmark with the relative change in median ns/op and
+exits with status 1 if any benchmark got slower than the threshold (%).
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith("{"):
+                continue
+            r = json.loads(line)
+            results[(r["bench"], r["param"])] = r
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("base")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="regression threshold in percent (default 10)")
+    args = parser.parse_args()
+
+    base = load(args.base)
+    new = load(args.new)
+    regressions = 0
+
+    for key in sorted(set(base) | set(new)):
+        name = "%s/%s" % key
+        if key not in base or key not in new:
+            print("%-28s %s" % (name, "only in " +
+                                (args.new if key in new else args.base)))
+            continue
+        b = base[key]["ns_per_op"]
+        n = new[key]["ns_per_op"]
+        delta = (n - b) / b * 100.0 if b else 0.0
+        flag = ""
+        if delta > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print("%-28s %10.2f -> %10.2f ns/op  %+6.1f%%%s" %
+              (name, b, n, delta, flag))
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
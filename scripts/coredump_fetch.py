@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Fetch the pedal's panic core dump over HTTP and decode it.
+
+    scripts/coredump_fetch.py --host rigkontrol.local --env release
+    scripts/coredump_fetch.py --host 192.168.4.1 --out dump.bin --erase
+
+Reads GET /api/crash (reset reason, crash counter, dump size), downloads the
+raw dump from GET /api/coredump and runs esp-coredump on it against the
+firmware ELF of the same build, which prints the panic reason, the crashed
+task's backtrace and the other tasks' stacks. With --erase the dump is
+cleared afterwards (POST /api/coredump/erase), so the next crash is not
+mistaken for this one.
+
+The ELF must be the one that was running when the pedal crashed. Requires
+esp-coredump (pip install esp-coredump) and the xtensa-esp32s3-elf-gdb that
+PlatformIO installs with the toolchain.
+"""
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import urllib.error
+import urllib.request
+
+
+def fetch(url, method="GET", timeout=10.0):
+    req = urllib.request.Request(url, method=method)
+    with urllib.request.urlopen(req, timeout=timeout) as resp:
+        return resp.read()
+
+
+def default_gdb():
+    core = os.environ.get("PLATFORMIO_CORE_DIR",
+                          os.path.expanduser("~/.platformio"))
+    path = os.path.join(core, "packages", "toolchain-xtensa-esp32s3", "bin",
+                        "xtensa-esp32s3-elf-gdb")
+    return path if os.path.exists(path) else shutil.which(
+        "xtensa-esp32s3-elf-gdb")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="rigkontrol.local")
+    parser.add_argument("--env", default="release",
+                        help="PlatformIO env the running firmware came from")
+    parser.add_argument("--elf", default=None,
+                        help="default .pio/build/ENV/firmware.elf")
+    parser.add_argument("--out", default="coredump.bin")
+    parser.add_argument("--gdb", default=default_gdb())
+    parser.add_argument("--erase", action="store_true",
+                        help="erase the dump on the pedal once decoded")
+    parser.add_argument("--no-decode", action="store_true",
+                        help="only download the dump")
+    args = parser.parse_args()
+
+    base = "http://%s" % args.host
+    try:
+        info = json.loads(fetch(base + "/api/crash"))
+    except (urllib.error.URLError, OSError) as e:
+        sys.exit("cannot reach %s: %s" % (base, e))
+    print(json.dumps(info, separators=(",", ":")))
+    if not info["coredump"]["present"]:
+        print("no core dump stored", file=sys.stderr)
+        return 0
+    if not info["coredump"]["valid"]:
+        print("warning: core dump checksum does not match", file=sys.stderr)
+
+    data = fetch(base + "/api/coredump", timeout=60.0)
+    if len(data) != info["coredump"]["bytes"]:
+        sys.exit("short download: %d of %d bytes" %
+                 (len(data), info["coredump"]["bytes"]))
+    with open(args.out, "wb") as f:
+        f.write(data)
+    print("wrote %s (%d bytes)" % (args.out, len(data)), file=sys.stderr)
+
+    status = 0
+    if not args.no_decode:
+        elf = args.elf or os.path.join(".pio", "build", args.env,
+                                       "firmware.elf")
+        if not os.path.exists(elf):
+            sys.exit("missing %s (build the env that crashed first)" % elf)
+        cmd = [sys.executable, "-m", "esp_coredump", "--chip", "esp32s3",
+               "info_corefile", "--core-format", "raw", "--core", args.out]
+        if args.gdb:
+            cmd += ["--gdb", args.gdb]
+        status = subprocess.call(cmd + [elf])
+
+    if args.erase and status == 0:
+        fetch(base + "/api/coredump/erase", method="POST")
+        print("erased the dump on the pedal", file=sys.stderr)
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
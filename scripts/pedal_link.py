@@ -0,0 +1,269 @@
+#!/usr/bin/env python3
+"""Drive and monitor the pedal over its binary control link (USB CDC).
+
+    scripts/pedal_link.py --port /dev/ttyACM0 monitor --period 20
+    scripts/pedal_link.py --port /dev/ttyACM0 button 0
+    scripts/pedal_link.py --port /dev/ttyACM0 play 2 7
+    scripts/pedal_link.py --port /dev/ttyACM0 volume 1 18
+    scripts/pedal_link.py --port /dev/ttyACM0 scene 1
+
+Speaks the protocol of lib/lib_control (COBS frames with CRC-16, see
+lib_control.hpp) on the console port. Telemetry is printed as JSON lines:
+
+    {"type":"status","seq":12,"uptime_ms":73410,"scene":0,...}
+    {"type":"button","button":2,"event":"pressed","us":73391022}
+    {"type":"player","player":1,"state":"playing","track":3,"volume":10}
+
+Console text from the firmware shares the port; with --text it is printed
+as {"text": ...} lines, otherwise dropped. monitor sends a HELLO every
+2 s to keep the link up (the pedal stops streaming after 5 s of silence)
+and reports lost frames from the sequence numbers at the end.
+
+Requires pyserial (pip install pyserial).
+"""
+
+import argparse
+import json
+import struct
+import sys
+import time
+
+PROTOCOL_VERSION = 1
+
+HELLO, TELEMETRY = 0x01, 0x02
+BUTTON, ACTION, PLAY, VOLUME, SCENE = 0x10, 0x11, 0x12, 0x13, 0x14
+ACK, INFO, BUTTON_EV, PLAYER, STATUS = 0x80, 0x81, 0x90, 0x91, 0x92
+
+RESULTS = ["ok", "unknown", "bad_args", "failed"]
+PLAYER_STATES = ["offline", "stopped", "playing", "paused"]
+BUTTON_EVENTS = ["pressed", "released", "long_press", "double_click"]
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_pos, code = 0, 1
+    for b in data:
+        if b == 0:
+            out[code_pos] = code
+            code_pos, code = len(out), 1
+            out.append(0)
+        else:
+            out.append(b)
+            code += 1
+    out[code_pos] = code
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            return None
+        out += data[i:i + code - 1]
+        i += code - 1
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(payload):
+    body = payload + struct.pack("<H", crc16(payload))
+    return b"\x00" + cobs_encode(body) + b"\x00"
+
+
+def decode_frame(chunk):
+    """Payload of a chunk between two zero bytes, None if it is not one."""
+    body = cobs_decode(chunk)
+    if body is None or len(body) < 4:
+        return None
+    payload, crc = body[:-2], struct.unpack("<H", body[-2:])[0]
+    return payload if crc16(payload) == crc else None
+
+
+def describe(p):
+    kind, seq = p[0], p[1]
+    if kind == ACK:
+        return {"type": "ack", "seq": seq, "cmd": p[2], "cmd_seq": p[3],
+                "result": RESULTS[p[4]] if p[4] < len(RESULTS) else p[4]}
+    if kind == INFO:
+        return {"type": "info", "seq": seq, "version": p[2], "buttons": p[3],
+                "players": p[4], "scenes": p[5],
+                "name": p[6:].decode("ascii", "replace")}
+    if kind == BUTTON_EV:
+        us = struct.unpack("<I", p[4:8])[0]
+        event = BUTTON_EVENTS[p[3]] if p[3] < len(BUTTON_EVENTS) else p[3]
+        return {"type": "button", "seq": seq, "button": p[2], "event": event,
+                "us": us}
+    if kind == PLAYER:
+        track = struct.unpack("<H", p[4:6])[0]
+        state = PLAYER_STATES[p[3]] if p[3] < len(PLAYER_STATES) else p[3]
+        return {"type": "player", "seq": seq, "player": p[2], "state": state,
+                "track": track, "volume": p[6]}
+    if kind == STATUS:
+        (uptime, scene, buttons, mhz, bpm, battery, press_us, loop_us,
+         dropped) = struct.unpack("<IBBHHbIII", p[2:25])
+        return {"type": "status", "seq": seq, "uptime_ms": uptime,
+                "scene": scene, "buttons_down": buttons, "cpu_mhz": mhz,
+                "bpm": bpm / 100.0, "battery_pct": battery,
+                "press_us": press_us, "loop_us_max": loop_us,
+                "tx_dropped": dropped}
+    return {"type": "0x%02X" % kind, "seq": seq, "raw": p[2:].hex()}
+
+
+class Link:
+    def __init__(self, port, baud, show_text):
+        import serial  # pyserial, only needed on real ports
+        self.ser = serial.Serial(port, baud, timeout=0.05)
+        self.seq = 0
+        self.buf = bytearray()
+        self.text = bytearray()
+        self.show_text = show_text
+        self.last_rx_seq = None
+        self.frames = self.lost = self.bad = 0
+
+    def send(self, kind, args=b""):
+        seq = self.seq
+        self.seq = (self.seq + 1) & 0xFF
+        self.ser.write(encode_frame(bytes([kind, seq]) + args))
+        return seq
+
+    def _text(self, chunk):
+        self.text += chunk
+        while b"\n" in self.text:
+            line, _, self.text = self.text.partition(b"\n")
+            if self.show_text:
+                emit({"text": line.decode("utf-8", "replace").rstrip("\r")})
+
+    def read(self):
+        """Decoded payloads received so far."""
+        self.buf += self.ser.read(self.ser.in_waiting or 1)
+        out = []
+        while b"\x00" in self.buf:
+            chunk, _, self.buf = self.buf.partition(b"\x00")
+            if not chunk:
+                continue
+            payload = decode_frame(bytes(chunk))
+            if payload is None:
+                # console text, or a frame cut short when the port opened
+                if all(32 <= b < 127 or b in (9, 10, 13) for b in chunk):
+                    self._text(chunk)
+                else:
+                    self.bad += 1
+                continue
+            self.frames += 1
+            if self.last_rx_seq is not None:
+                self.lost += (payload[1] - self.last_rx_seq - 1) & 0xFF
+            self.last_rx_seq = payload[1]
+            out.append(payload)
+        return out
+
+    def command(self, kind, args=b"", timeout=1.0):
+        """Send a command and wait for its ACK; returns (ack, other frames)."""
+        seq = self.send(kind, args)
+        others = []
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            for p in self.read():
+                if p[0] == ACK and p[2] == kind and p[3] == seq:
+                    return describe(p), others
+                others.append(p)
+        return None, others
+
+
+def emit(obj):
+    print(json.dumps(obj, separators=(",", ":")))
+    sys.stdout.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", required=True)
+    parser.add_argument("--baud", type=int, default=115200,
+                        help="ignored by USB CDC, used on a UART console")
+    parser.add_argument("--text", action="store_true",
+                        help="print console text as well")
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    mon = sub.add_parser("monitor", help="stream telemetry")
+    mon.add_argument("--period", type=int, default=100,
+                     help="STATUS period in ms, 0 = events only")
+    mon.add_argument("--seconds", type=float, default=None)
+    sub.add_parser("info")
+    for name, help_ in (("button", "run footswitch N's action (0-based)"),
+                        ("action", "run action N"),
+                        ("scene", "select scene N")):
+        p = sub.add_parser(name, help=help_)
+        p.add_argument("n", type=int)
+    p = sub.add_parser("play")
+    p.add_argument("player", type=int, choices=(1, 2))
+    p.add_argument("track", type=int)
+    p = sub.add_parser("volume")
+    p.add_argument("player", type=int, choices=(1, 2))
+    p.add_argument("volume", type=int)
+    args = parser.parse_args()
+
+    link = Link(args.port, args.baud, args.text)
+
+    ack, others = link.command(HELLO)
+    if ack is None:
+        sys.exit("no answer from %s" % args.port)
+    for p in others:
+        if p[0] == INFO:
+            info = describe(p)
+            if info["version"] != PROTOCOL_VERSION:
+                print("warning: protocol version %d, expected %d" %
+                      (info["version"], PROTOCOL_VERSION), file=sys.stderr)
+            if args.cmd == "info":
+                emit(info)
+
+    if args.cmd == "monitor":
+        link.command(TELEMETRY, struct.pack("<H", args.period))
+        start = time.monotonic()
+        next_hello = start + 2.0
+        try:
+            while args.seconds is None or \
+                    time.monotonic() - start < args.seconds:
+                for p in link.read():
+                    if p[0] not in (ACK, INFO):
+                        emit(describe(p))
+                if time.monotonic() >= next_hello:
+                    link.send(HELLO)
+                    next_hello += 2.0
+        except KeyboardInterrupt:
+            pass
+        link.command(TELEMETRY, struct.pack("<H", 0))
+        emit({"summary": "link", "frames": link.frames, "lost": link.lost,
+              "bad": link.bad})
+        return 0
+
+    commands = {
+        "button": (BUTTON, lambda a: bytes([a.n])),
+        "action": (ACTION, lambda a: bytes([a.n])),
+        "scene": (SCENE, lambda a: bytes([a.n])),
+        "play": (PLAY, lambda a: struct.pack("<BH", a.player, a.track)),
+        "volume": (VOLUME, lambda a: bytes([a.player, a.volume])),
+    }
+    if args.cmd in commands:
+        kind, pack = commands[args.cmd]
+        ack, _ = link.command(kind, pack(args))
+        if ack is None:
+            sys.exit("no ACK")
+        emit(ack)
+        return 0 if ack["result"] == "ok" else 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,269 @@
+#!/usr/bin/env python3
+"""Boot the ESP32-S3 firmware image under Espressif's QEMU.
+
+    pio run -e qemu
+    scripts/qemu_run.py --seconds 60 > qemu.jsonl
+
+Builds a flash image from .pio/build/qemu (bootloader, partition table,
+boot_app0, application), starts qemu-system-xtensa with UART0 as the console
+and UART1/UART2 connected to emulated DFPlayer Minis, and turns the console
+into JSON lines:
+
+    {"boot":"players","t_us":3712345,"path":"cold"}    [boot] phases
+    {"loop":{"n":41234,"avg_us":212,"max_us":5120}}    [loop] reports
+    {"dfplayer":1,"cmd":"0x0C","param":0,"t_s":0.84}   commands received
+    {"summary":"qemu",...}                             at the end
+
+Exits with status 1 if the firmware never reports the "ready" phase, panics,
+or (with --max-loop-us) a loop report exceeds the limit.
+
+Espressif's QEMU fork is required (idf_tools.py install qemu-xtensa). It has
+no radio and no USB, so the qemu env builds with -D SERVER_OFFLINE and the
+console on UART0. Wall-clock timing depends on the host; use --icount for
+instruction-counted, repeatable timing instead.
+"""
+
+import argparse
+import json
+import os
+import re
+import select
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+FLASH_SIZE = "16MB"
+FLASH_PARTS = [
+    (0x0000, "bootloader.bin"),
+    (0x8000, "partitions.bin"),
+    (0xE000, None),  # boot_app0.bin from the framework
+    (0x10000, "firmware.bin"),
+]
+
+BOOT_RE = re.compile(r"\[boot\] (\S+) t_us=(\d+) path=(\w+)")
+LOOP_RE = re.compile(r"\[loop\] n=(\d+) avg_us=(\d+) max_us=(\d+)")
+PANIC_RE = re.compile(r"Guru Meditation|abort\(\) was called|Backtrace:")
+
+
+def emit(obj):
+    print(json.dumps(obj, separators=(",", ":")))
+    sys.stdout.flush()
+
+
+def default_boot_app0():
+    core = os.environ.get("PLATFORMIO_CORE_DIR",
+                          os.path.expanduser("~/.platformio"))
+    return os.path.join(core, "packages", "framework-arduinoespressif32",
+                        "tools", "partitions", "boot_app0.bin")
+
+
+def build_flash_image(build_dir, boot_app0, out_path):
+    args = [sys.executable, "-m", "esptool", "--chip", "esp32s3",
+            "merge_bin", "--fill-flash-size", FLASH_SIZE, "-o", out_path]
+    for offset, name in FLASH_PARTS:
+        path = boot_app0 if name is None else os.path.join(build_dir, name)
+        if not os.path.exists(path):
+            sys.exit("missing %s (run 'pio run -e qemu' first)" % path)
+        args += ["0x%x" % offset, path]
+    subprocess.check_call(args, stdout=subprocess.DEVNULL)
+
+
+class DfPlayer(threading.Thread):
+    """DFPlayer Mini on a QEMU UART socket.
+
+    Same behavior as test/SimPedal/dfplayer_model: ACK 20 ms after a command
+    that asks for one, "card online" 1.5 s after reset, "track finished"
+    when a track ends (moved by pause/start, cancelled by stop/play).
+    """
+
+    ACK_S = 0.020
+    RESET_S = 1.5
+
+    def __init__(self, num, listener, t0):
+        super().__init__(daemon=True)
+        self.num = num
+        self.listener = listener
+        self.t0 = t0
+        self.pending = []  # (due, cmd, param), sorted
+        self.buf = bytearray()
+        self.track = 0
+        self.track_end = None
+        self.remaining = 0.0
+        self.commands = 0
+        self.errors = 0
+
+    @staticmethod
+    def track_length_s(track):
+        return 150 + 17 * (track % 5)
+
+    @staticmethod
+    def encode(cmd, param):
+        body = bytes([0xFF, 0x06, cmd, 0, param >> 8, param & 0xFF])
+        csum = (-sum(body)) & 0xFFFF
+        return bytes([0x7E]) + body + bytes([csum >> 8, csum & 0xFF, 0xEF])
+
+    def schedule(self, delay, cmd, param):
+        self.pending.append((time.monotonic() + delay, cmd, param))
+        self.pending.sort()
+
+    def cancel_finished(self):
+        self.pending = [p for p in self.pending if p[1] != 0x3D]
+
+    def handle(self, cmd, ack, param):
+        self.commands += 1
+        emit({"dfplayer": self.num, "cmd": "0x%02X" % cmd, "param": param,
+              "t_s": round(time.monotonic() - self.t0, 3)})
+        if ack:
+            self.schedule(self.ACK_S, 0x41, 0)
+        now = time.monotonic()
+        if cmd == 0x0C:  # reset
+            self.cancel_finished()
+            self.track_end = None
+            self.schedule(self.RESET_S, 0x3F, 0x02)
+        elif cmd == 0x03:  # play
+            self.cancel_finished()
+            self.track = param
+            self.track_end = now + self.track_length_s(param)
+            self.schedule(self.track_end - now, 0x3D, param)
+        elif cmd == 0x0E and self.track_end is not None:  # pause
+            self.cancel_finished()
+            self.remaining = max(0.0, self.track_end - now)
+            self.track_end = None
+        elif cmd == 0x0D and self.track_end is None and self.remaining:
+            self.track_end = now + self.remaining  # start (resume)
+            self.remaining = 0.0
+            self.schedule(self.track_end - now, 0x3D, self.track)
+        elif cmd == 0x16:  # stop
+            self.cancel_finished()
+            self.track_end = None
+            self.remaining = 0.0
+
+    def feed(self, data):
+        for b in data:
+            if not self.buf and b != 0x7E:
+                continue  # noise between frames
+            self.buf.append(b)
+            if len(self.buf) < 10:
+                continue
+            f, self.buf = bytes(self.buf), bytearray()
+            csum = (-sum(f[1:7])) & 0xFFFF
+            if f[1:3] != b"\xff\x06" or f[9] != 0xEF or \
+                    (f[7] << 8 | f[8]) != csum:
+                self.errors += 1
+                continue
+            self.handle(f[3], f[4] != 0, f[5] << 8 | f[6])
+
+    def run(self):
+        conn, _ = self.listener.accept()
+        while True:
+            now = time.monotonic()
+            while self.pending and self.pending[0][0] <= now:
+                _, cmd, param = self.pending.pop(0)
+                if cmd == 0x3D:
+                    self.track_end = None
+                conn.sendall(self.encode(cmd, param))
+            timeout = 0.05
+            if self.pending:
+                timeout = min(timeout, max(0.0, self.pending[0][0] - now))
+            ready, _, _ = select.select([conn], [], [], timeout)
+            if ready:
+                data = conn.recv(256)
+                if not data:
+                    return
+                self.feed(data)
+
+
+def listen():
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    s.bind(("127.0.0.1", 0))
+    s.listen(1)
+    return s
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--build-dir", default=".pio/build/qemu")
+    parser.add_argument("--boot-app0", default=default_boot_app0())
+    parser.add_argument("--qemu", default="qemu-system-xtensa")
+    parser.add_argument("--seconds", type=float, default=30.0,
+                        help="run time after the ready phase (default 30)")
+    parser.add_argument("--boot-timeout", type=float, default=60.0)
+    parser.add_argument("--icount", type=int, default=None,
+                        help="QEMU -icount shift (instruction-counted time)")
+    parser.add_argument("--max-loop-us", type=int, default=None,
+                        help="fail if any [loop] report has a larger max_us")
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp(prefix="qemu-")
+    flash = os.path.join(workdir, "flash.bin")
+    build_flash_image(args.build_dir, args.boot_app0, flash)
+
+    t0 = time.monotonic()
+    players = [DfPlayer(n, listen(), t0) for n in (1, 2)]
+    for p in players:
+        p.start()
+
+    cmd = [args.qemu, "-display", "none", "-monitor", "none",
+           "-machine", "esp32s3",
+           "-drive", "file=%s,if=mtd,format=raw" % flash,
+           "-serial", "stdio"]
+    for p in players:  # UART1, UART2
+        cmd += ["-serial", "tcp:127.0.0.1:%d" % p.listener.getsockname()[1]]
+    if args.icount is not None:
+        cmd += ["-icount", "shift=%d,align=off,sleep=off" % args.icount]
+    qemu = subprocess.Popen(cmd, stdin=subprocess.DEVNULL,
+                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+
+    os.set_blocking(qemu.stdout.fileno(), False)
+    phases, loops = {}, []
+    ready_at, panic, line = None, False, b""
+    deadline = t0 + args.boot_timeout
+    try:
+        while time.monotonic() < deadline and qemu.poll() is None:
+            select.select([qemu.stdout], [], [], 0.1)
+            chunk = qemu.stdout.read() or b""
+            line += chunk
+            while b"\n" in line:
+                raw, line = line.split(b"\n", 1)
+                text = raw.decode("utf-8", "replace").rstrip("\r")
+                m = BOOT_RE.search(text)
+                if m:
+                    phases[m.group(1)] = int(m.group(2))
+                    emit({"boot": m.group(1), "t_us": int(m.group(2)),
+                          "path": m.group(3)})
+                    if m.group(1) == "ready" and ready_at is None:
+                        ready_at = time.monotonic()
+                        deadline = ready_at + args.seconds
+                m = LOOP_RE.search(text)
+                if m:
+                    n, avg, mx = (int(g) for g in m.groups())
+                    loops.append((n, avg, mx))
+                    emit({"loop": {"n": n, "avg_us": avg, "max_us": mx}})
+                if PANIC_RE.search(text):
+                    panic = True
+                    emit({"panic": text})
+    finally:
+        qemu.kill()
+        qemu.wait()
+
+    worst = max((mx for _, _, mx in loops), default=0)
+    total = sum(n for n, _, _ in loops)
+    mean = sum(n * avg for n, avg, _ in loops) / total if total else 0
+    emit({"summary": "qemu", "ready_us": phases.get("ready"),
+          "phases": len(phases), "loop_reports": len(loops),
+          "loop_avg_us": round(mean, 1), "loop_max_us": worst,
+          "dfplayer_commands": [p.commands for p in players],
+          "dfplayer_frame_errors": [p.errors for p in players],
+          "panic": panic})
+
+    failed = panic or "ready" not in phases
+    if args.max_loop_us is not None and worst > args.max_loop_us:
+        failed = True
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -8,126 +8,984 @@
 // contains . static const char* WIFI_SSID     = "YOUR_SSID"; static const char*
 // WIFI_PASSWORD = "YOUR_PASSWORD";
 
+#include "lib_battery.hpp"
+#include "lib_board.hpp"
+#include "lib_bus.hpp"
 #include "lib_button.hpp"
+#include "lib_control.hpp"
+#include "lib_crash.hpp"
+#include "lib_display.hpp"
+#include "display_status.hpp"
+#include "lib_heap.hpp"
+#include "lib_led.hpp"
+#include "lib_link.hpp"
+#include "lib_macro.hpp"
+#include "lib_midi.hpp"
+#include "midi_clock.hpp"
 #include "lib_mp3.hpp"
+#include "uart_fault.hpp"
+#include "lib_power.hpp"
+#include "lib_replica.hpp"
+#include "lib_script.hpp"
 #include "lib_server.hpp"
+#include "lib_statuslight.hpp"
+#include "lib_timer.hpp"
 #include <Arduino.h>
 
+// Pins and wiring come from the board profile (lib_board), checked at
+// compile time.
+
 // MP3 players
-static MP3Player mp3Reader1(1, RX1, TX1);
-static MP3Player mp3Reader2(2, 8, 5);
-
-// Built-in LED (not visible outside pedalboard case)
-static const int LED_PIN = 17;
-
-// 4 pedalboard buttons
-static const uint8_t BUTTON_COUNT              = 4;
-static const uint8_t BUTTON_PINS[BUTTON_COUNT] = {
-    46,  // S1 top-left
-    45,  // S2 top-right
-    21,  // S3 bottom-left
-    9    // S4 bottom-right
+static MP3Player mp3Reader1(Board::kMp3Uart[0].num, Board::kMp3Uart[0].rx,
+                            Board::kMp3Uart[0].tx);
+static MP3Player mp3Reader2(Board::kMp3Uart[1].num, Board::kMp3Uart[1].rx,
+                            Board::kMp3Uart[1].tx);
+
+// WS2812 footswitch LEDs
+static const uint8_t LED_STRIP_BRIGHTNESS = 64;  // 0..255, indoor stage
+
+// 128x64 SSD1306 status display on I2C
+static const DisplayConfig DISPLAY_CONFIG = {DISPLAY_SSD1306,
+                                             DISPLAY_BUS_I2C,
+                                             Board::kDisplaySda,
+                                             Board::kDisplayScl,
+                                             -1,
+                                             -1,
+                                             -1,
+                                             Board::kDisplayAddress,
+                                             400000};
+
+// Status screen redraw period
+static const uint32_t DISPLAY_REFRESH_MS = 100;
+
+// 4 pedalboard buttons: S1 top-left, S2 top-right, S3 bottom-left, S4
+// bottom-right
+static const uint8_t BUTTON_COUNT = Board::kButtonCount;
+static_assert(BUTTON_COUNT == 4, "mappings below are written for 4 buttons");
+
+// Enter deep sleep after this long without presses, HTTP requests or
+// playback. Any footswitch on an RTC-capable pin (S3, S4) wakes the pedal.
+static const uint32_t IDLE_SLEEP_MS = 15UL * 60UL * 1000UL;
+
+// Refresh the RTC resume block this often, so that after a panic or watchdog
+// reset the pedal comes back with the current mapping and tracks.
+static const uint32_t RESUME_SAVE_MS = 1000;
+
+// CPU clock range for dynamic frequency scaling (see lib_power). The CPU
+// only runs at the maximum while a subsystem holds its power lock: for
+// these windows after it last did something.
+static const uint16_t CPU_MAX_MHZ     = 240;
+static const uint16_t CPU_MIN_MHZ     = 80;
+static const uint32_t INPUT_HOLD_MS   = 1000;  // release, double click
+static const uint32_t AUDIO_HOLD_MS   = 500;   // DFPlayer ACK and status
+static const uint32_t NETWORK_HOLD_MS = 250;   // one request and response
+
+// Default volume on cold boot. From 0 to 30
+static const uint8_t DEFAULT_VOLUME = 10;
+
+// Footswitch actions
+enum ButtonAction : uint8_t {
+  ACTION_NONE = 0,
+  ACTION_P1_TOGGLE,
+  ACTION_P1_STOP,
+  ACTION_P2_TOGGLE,
+  ACTION_P2_STOP
+};
+
+// Button mapping (index = button)
+static uint8_t buttonActions[BUTTON_COUNT] = {
+    ACTION_P1_TOGGLE,  // S1: player1 LEFT -> toggle play/pause
+    ACTION_P1_STOP,    // S2: player1 RIGHT -> stop
+    ACTION_P2_TOGGLE,  // S3: player2 LEFT -> toggle play/pause
+    ACTION_P2_STOP     // S4: player2 RIGHT -> stop
+};
+
+// MIDI sent for each footswitch (index = button), on press and release
+static const MidiOutRule midiOutRules[BUTTON_COUNT] = {
+    {MIDI_NOTE_ON, 0, 60},         // S1: Note C4
+    {MIDI_NOTE_ON, 0, 61},         // S2: Note C#4
+    {MIDI_CONTROL_CHANGE, 0, 80},  // S3: CC 80 (general purpose 5)
+    {MIDI_CONTROL_CHANGE, 0, 81}   // S4: CC 81 (general purpose 6)
+};
+
+// Scenes: footswitch mappings, selected by MIDI Program Change 0..2
+static const uint8_t SCENE_COUNT                              = 3;
+static const uint8_t sceneActions[SCENE_COUNT][BUTTON_COUNT] = {
+    // 0: default, one player per row
+    {ACTION_P1_TOGGLE, ACTION_P1_STOP, ACTION_P2_TOGGLE, ACTION_P2_STOP},
+    // 1: both toggles on the top row, stops below
+    {ACTION_P1_TOGGLE, ACTION_P2_TOGGLE, ACTION_P1_STOP, ACTION_P2_STOP},
+    // 2: player 1 only
+    {ACTION_P1_TOGGLE, ACTION_P1_STOP, ACTION_NONE, ACTION_NONE}
+};
+
+// Incoming MIDI -> action, any channel. Notes 36..39 are the first pads of
+// most drum controllers.
+static const uint8_t    MIDI_IN_RULE_COUNT              = 4;
+static const MidiInRule midiInRules[MIDI_IN_RULE_COUNT] = {
+    {MIDI_NOTE_ON, MIDI_CHANNEL_ANY, 36, ACTION_P1_TOGGLE},
+    {MIDI_NOTE_ON, MIDI_CHANNEL_ANY, 37, ACTION_P1_STOP},
+    {MIDI_NOTE_ON, MIDI_CHANNEL_ANY, 38, ACTION_P2_TOGGLE},
+    {MIDI_NOTE_ON, MIDI_CHANNEL_ANY, 39, ACTION_P2_STOP}
+};
+
+// Note On 48..59 (any channel) plays sample track 1..12 on player 2
+static const uint8_t SAMPLE_NOTE_FIRST = 48;
+static const uint8_t SAMPLE_COUNT      = 12;
+
+// Track names on the status display (edit to match the SD cards); tracks
+// not listed show their number only
+struct TrackName {
+  uint8_t     player;
+  uint16_t    track;
+  const char* name;
+};
+static const TrackName TRACK_NAMES[] = {
+    {1, 1, "Intro"},
+    {1, 2, "Verse loop"},
+    {1, 3, "Chorus loop"},
+    {1, 4, "Outro"},
 };
+static const uint8_t TRACK_NAME_COUNT =
+    sizeof(TRACK_NAMES) / sizeof(TRACK_NAMES[0]);
+
+// Tempo of the Link session the pedal founds when it is alone (see lib_link)
+static const uint32_t LINK_TEMPO_X100 = 12000;
+
+#if defined(REPLICA)
+// Optional state sharing with other pedals on the network, -D REPLICA (see
+// lib_replica). What each footswitch does with the other pedal:
+// - REPLICA_TRIGGER: its presses run this pedal's action of the switch
+// - REPLICA_REFLECT: the LED shows the other pedal's players
+// - REPLICA_IGNORE: nothing
+enum ReplicaMode : uint8_t { REPLICA_IGNORE, REPLICA_TRIGGER, REPLICA_REFLECT };
+static const ReplicaMode replicaModes[BUTTON_COUNT] = {
+    REPLICA_TRIGGER, REPLICA_TRIGGER, REPLICA_REFLECT, REPLICA_REFLECT};
+#endif
+
+#if defined(UART_FAULT)
+// Optional fault injection on both DFPlayer links, to try the players'
+// recovery on the pedal (see uart_fault.hpp), e.g.
+// -D UART_FAULT=UART_FAULT_CORRUPT -D UART_FAULT_PERMILLE=20. Whole frames
+// in both directions; dsk_mp3_* in /api/metrics shows the effect.
+#ifndef UART_FAULT_PERMILLE
+#define UART_FAULT_PERMILLE 10
+#endif
+#ifndef UART_FAULT_DELAY_US
+#define UART_FAULT_DELAY_US 200000  // UART_FAULT_DELAY only
+#endif
+static const UartFaultConfig UART_FAULT_CONFIG = {
+    UART_FAULT,          UART_FAULT_FRAMES,   UART_FAULT_TX | UART_FAULT_RX,
+    UART_FAULT_PERMILLE, UART_FAULT_DELAY_US, 1};
+#endif
+
+// Serial MIDI (DIN/TRS) on Serial0, only when the console is on native USB
+static_assert(Board::kMidiDinUart.num == 0, "serial MIDI runs on Serial0");
+
+// Application state kept in RTC memory across deep sleep
+struct ResumeState {
+  uint8_t         buttonActions[BUTTON_COUNT];
+  uint8_t         scene;
+  uint8_t         volume[2];
+  uint16_t        lastTrack[2];
+  WiFiFastConnect wifi;
+};
+static ResumeState resume;
 
 unsigned long startMillis = 0;
 
-// Buttons and LED state trackers
-volatile bool ledState             = false;
-volatile bool sState[BUTTON_COUNT] = {false, false, false, false};
+// Scene last selected by Program Change (index into sceneActions)
+static uint8_t currentScene = 0;
+
+static bool batteryOk = false;
+
+// What the application hears from the other subsystems (see lib_bus).
+// All of them are polled from loop().
+static BusSubscriber<ButtonEvent, 32>   buttonSub("main");
+static BusSubscriber<PlayerEvent, 8>    playerSub("control");
+static BusSubscriber<NetworkEvent, 4>   networkSub("main");
+static BusSubscriber<StatusLedEvent, 4> statusLedSub("main");
+static BusSubscriber<BusTick, 2>        tickSub("resume");
+
+// Footswitches held down (bit i: button i), from the button events
+static uint32_t buttonsDown = 0;
+
+// Handling time of the last footswitch press (telemetry)
+static uint32_t lastPressUs = 0;
+
+static void runButtonAction(uint8_t action) {
+  if (action != ACTION_NONE) {
+    powerLockHold(POWER_LOCK_AUDIO, millis(), AUDIO_HOLD_MS);
+  }
+  switch (action) {
+    case ACTION_P1_TOGGLE:
+      mp3Reader1.togglePlayPause();
+      break;
+    case ACTION_P1_STOP:
+      mp3Reader1.stopPlayback();
+      break;
+    case ACTION_P2_TOGGLE:
+      mp3Reader2.togglePlayPause();
+      break;
+    case ACTION_P2_STOP:
+      mp3Reader2.stopPlayback();
+      break;
+    default:
+      break;
+  }
+}
+
+// PlayerEvent states go to the host as they are
+static_assert(PLAYER_OFFLINE == (int)CONTROL_PLAYER_OFFLINE &&
+                  PLAYER_STOPPED == (int)CONTROL_PLAYER_STOPPED &&
+                  PLAYER_PLAYING == (int)CONTROL_PLAYER_PLAYING &&
+                  PLAYER_PAUSED == (int)CONTROL_PLAYER_PAUSED,
+              "PlayerState and ControlPlayerState differ");
+
+static ControlPlayerState controlPlayerState(const MP3Player& player) {
+  return (ControlPlayerState)player.state();
+}
+
+// Colour of a footswitch LED from what pressing it would do, with players 1
+// and 2 in the given states:
+// - play/pause switch: green playing, amber paused, dim blue armed (stopped,
+//   player ready), red player offline
+// - stop switch: red while its player is playing or paused
+static uint32_t switchColor(uint8_t action,
+                            const ControlPlayerState players[2]) {
+  ControlPlayerState state;
+  bool               toggle = false;
+  switch (action) {
+    case ACTION_P1_TOGGLE:
+      toggle = true;
+      // fall through
+    case ACTION_P1_STOP:
+      state = players[0];
+      break;
+    case ACTION_P2_TOGGLE:
+      toggle = true;
+      // fall through
+    case ACTION_P2_STOP:
+      state = players[1];
+      break;
+    default:
+      return LED_OFF;
+  }
+
+  bool active =
+      state == CONTROL_PLAYER_PLAYING || state == CONTROL_PLAYER_PAUSED;
+  if (!toggle) return active ? LED_RED : LED_OFF;
+  if (state == CONTROL_PLAYER_OFFLINE) return LED_RED;
+  if (state == CONTROL_PLAYER_PLAYING) return LED_GREEN;
+  if (state == CONTROL_PLAYER_PAUSED) return LED_AMBER;
+  return 0x000040;  // armed: dim blue
+}
+
+// Refresh the footswitch LEDs. Only a changed frame reaches the RMT, and
+// the transfer runs in the background.
+static void manageLeds() {
+  ControlPlayerState local[2] = {controlPlayerState(mp3Reader1),
+                                 controlPlayerState(mp3Reader2)};
+#if defined(REPLICA)
+  ControlPlayerState remote[2];
+  ReplicaState       peer;
+  bool               reflect = replicaPeerState(&peer);
+  for (uint8_t i = 0; reflect && i < 2; ++i) {
+    remote[i] = (ControlPlayerState)peer.players[i].state;
+  }
+#endif
+  for (uint8_t i = 0; i < BUTTON_COUNT; ++i) {
+    const ControlPlayerState* players = local;
+#if defined(REPLICA)
+    if (reflect && replicaModes[i] == REPLICA_REFLECT) players = remote;
+#endif
+    uint32_t rgb;
+    if (!scriptLed(i, &rgb)) rgb = switchColor(buttonActions[i], players);
+    ledSet(i, rgb);
+  }
+  ledShow();
+}
+
+static const char* trackName(uint8_t player, uint16_t track) {
+  for (uint8_t i = 0; i < TRACK_NAME_COUNT; ++i) {
+    if (TRACK_NAMES[i].player == player && TRACK_NAMES[i].track == track) {
+      return TRACK_NAMES[i].name;
+    }
+  }
+  return nullptr;
+}
+
+// Tempo on the display and the control link: the MIDI clock input while it
+// is locked, else the Link session's while other peers share it, else 0.
+static uint32_t currentBpmX100() {
+  MidiClockStatus clock;
+  midiClockIn().status(&clock);
+  if (clock.locked) return clock.bpmX100;
+  return linkSynced() ? linkBpmX100() : 0;
+}
+
+static DisplayPlayer displayPlayer(const MP3Player& player, uint8_t num) {
+  DisplayPlayer out;
+  if (!player.isOnline()) {
+    out.state = DISPLAY_PLAYER_OFFLINE;
+  } else if (player.isPlaying()) {
+    out.state = DISPLAY_PLAYER_PLAYING;
+  } else if (player.isPaused()) {
+    out.state = DISPLAY_PLAYER_PAUSED;
+  } else {
+    out.state = DISPLAY_PLAYER_STOPPED;
+  }
+  out.track = player.lastTrack();
+  out.name  = trackName(num, out.track);
+  return out;
+}
+
+// Redraw the status screen, every DISPLAY_REFRESH_MS once the display is
+// up. Only the pages (and columns) that changed go to the panel, from the
+// display's bus task.
+static void onDisplayRefresh(void* arg) {
+  (void)arg;
+  DisplayStatus status;
+  status.scene          = currentScene;
+  status.bpmX100        = currentBpmX100();
+  status.batteryPercent = batteryOk ? (int8_t)batteryPercent() : -1;
+  status.players[0]     = displayPlayer(mp3Reader1, 1);
+  status.players[1]     = displayPlayer(mp3Reader2, 2);
+  displayStatusDraw(status);
+  displayFlush();
+}
+
+static WheelTimer displayRefresh(onDisplayRefresh, nullptr);
+
+// Handle one button event, live or replayed by a macro:
+// - Runs the script's handler of the event (see lib_script), else on press
+//   the action mapped to the button (see buttonActions)
+// - Sends the MIDI message of the button on press and release
+// - Holds the input power lock and records how long the press took to
+//   handle, split by the CPU clock it was detected at
+// Returns true if it was a press.
+static bool handleButtonEvent(const ButtonEvent& ev) {
+  if (ev.button >= BUTTON_COUNT) return false;
+  bool atMax = powerCpuAtMax();
+  powerLockHold(POWER_LOCK_INPUT, millis(), INPUT_HOLD_MS);
+  controlSendButton(ev.button, ev.type, ev.us);
+#if defined(REPLICA)
+  replicaNoteEvent(ev.button, ev.type);
+#endif
+  bool scripted = scriptButtonEvent(ev);
+  if (ev.type == BUTTON_EVENT_PRESSED) {
+    if (!scripted) runButtonAction(buttonActions[ev.button]);
+    midiUsbSend(midiButtonMessage(midiOutRules[ev.button], true));
+    lastPressUs = micros() - ev.us;
+    powerNotePressUs(lastPressUs, atMax);
+    return true;
+  }
+  if (ev.type == BUTTON_EVENT_RELEASED) {
+    midiUsbSend(midiButtonMessage(midiOutRules[ev.button], false));
+  }
+  return false;
+}
 
 // Manage button-driven actions for MP3 players.
 // - Updates button state (debounce + events)
-// - S1 (idx 0): player1 LEFT -> toggle play/pause
-// - S2 (idx 1): player1 RIGHT -> stop
-// - S3 (idx 2): player2 LEFT -> toggle play/pause
-// - S4 (idx 3): player2 RIGHT -> stop
-static void manageButtonActions() {
+// - Handles the events in the order the presses were detected, and records
+//   them while a macro is being recorded (see lib_macro)
+// - Then handles the events of a playing macro that are due
+// Returns true if any button was pressed.
+static bool manageButtonActions() {
+  bool        pressed = false;
+  ButtonEvent ev;
+
   // Update debounced states and generate events
-  updateButtons(sState);
+  updateButtons();
 
-  // Player 1: S1 (0) = left (toggle), S2 (1) = right (stop)
-  if (checkIfButtonWasPressed(0)) {
-    mp3Reader1.togglePlayPause();
-  }
-  if (checkIfButtonWasPressed(1)) {
-    mp3Reader1.stopPlayback();
+  while (buttonSub.poll(&ev)) {
+    if (ev.type == BUTTON_EVENT_PRESSED) buttonsDown |= 1UL << ev.button;
+    if (ev.type == BUTTON_EVENT_RELEASED) buttonsDown &= ~(1UL << ev.button);
+    macroNoteEvent(ev);
+    if (handleButtonEvent(ev)) pressed = true;
   }
 
-  // Player 2: S3 (2) = left (toggle), S4 (3) = right (stop)
-  if (checkIfButtonWasPressed(2)) {
-    mp3Reader2.togglePlayPause();
+  // A playing macro keeps the CPU at its maximum clock, like a locked MIDI
+  // clock
+  if (macroPlaying()) {
+    powerLockHold(POWER_LOCK_INPUT, millis(), INPUT_HOLD_MS);
   }
-  if (checkIfButtonWasPressed(3)) {
-    mp3Reader2.stopPlayback();
+  while (macroPollEvent(&ev)) {
+    if (handleButtonEvent(ev)) pressed = true;
   }
 
-  // Note: checkIfButtonWasPressed() clears the "pressed" event for that
-  // button automatically when it returns true, satisfying the "clear
+  // Note: poll() removes each event from our queue, satisfying the "clear
   // the button press events after they have been managed" requirement.
+  return pressed;
+}
+
+// Switch the footswitch mapping to a scene. Returns false if out of range.
+static bool selectScene(uint8_t scene) {
+  if (scene >= SCENE_COUNT) return false;
+  memcpy(buttonActions, sceneActions[scene], sizeof(buttonActions));
+  currentScene = scene;
+  return true;
+}
+
+// Functions of footswitch scripts (see lib_script): players 1..2, buttons
+// 1..4. Out of range arguments do nothing and return 0.
+static int32_t scriptCall(uint8_t fn, const int32_t* args, void* ctx) {
+  (void)ctx;
+  MP3Player* player = args[0] == 1   ? &mp3Reader1
+                      : args[0] == 2 ? &mp3Reader2
+                                     : nullptr;
+  // play, toggle, stop and setvolume talk to a DFPlayer
+  if (player && fn <= SCRIPT_FN_SETVOLUME) {
+    powerLockHold(POWER_LOCK_AUDIO, millis(), AUDIO_HOLD_MS);
+  }
+  switch (fn) {
+    case SCRIPT_FN_PLAY:
+      if (!player || args[1] < 1 || args[1] > 0xFFFF) return 0;
+      player->play((uint16_t)args[1]);
+      return 1;
+    case SCRIPT_FN_TOGGLE:
+      if (!player) return 0;
+      player->togglePlayPause();
+      return 1;
+    case SCRIPT_FN_STOP:
+      if (!player) return 0;
+      player->stopPlayback();
+      return 1;
+    case SCRIPT_FN_SETVOLUME:
+      if (!player || args[1] < 0 || args[1] > 30) return 0;
+      player->setVolume((uint8_t)args[1]);
+      return 1;
+    case SCRIPT_FN_VOLUME:
+      return player ? player->volume() : 0;
+    case SCRIPT_FN_PLAYING:
+      return player && player->isPlaying();
+    case SCRIPT_FN_TRACK:
+      return player ? player->lastTrack() : 0;
+    case SCRIPT_FN_DOWN:
+      return args[0] >= 1 && args[0] <= BUTTON_COUNT &&
+             ((buttonsDown >> (args[0] - 1)) & 1);
+    case SCRIPT_FN_ACTION:
+      if (args[0] < ACTION_NONE || args[0] > ACTION_P2_STOP) return 0;
+      runButtonAction((uint8_t)args[0]);
+      return 1;
+    case SCRIPT_FN_SCENE:
+      return args[0] >= 0 && args[0] < SCENE_COUNT &&
+             selectScene((uint8_t)args[0]);
+    default:
+      return 0;
+  }
+}
+
+// Act on one incoming MIDI message: Program Change selects a scene, notes
+// in midiInRules run footswitch actions, sample notes play on player 2.
+// Returns true if the message did something.
+static bool runMidiMessage(const MidiMessage& msg) {
+  uint8_t type = midiType(msg);
+  if (type == MIDI_PROGRAM_CHANGE) return selectScene(msg.data1);
+
+  uint8_t action = midiMatchInRule(midiInRules, MIDI_IN_RULE_COUNT, msg);
+  if (action != ACTION_NONE) {
+    runButtonAction(action);
+    return true;
+  }
+
+  if (type == MIDI_NOTE_ON && msg.data2 > 0 &&
+      msg.data1 >= SAMPLE_NOTE_FIRST &&
+      msg.data1 < SAMPLE_NOTE_FIRST + SAMPLE_COUNT) {
+    powerLockHold(POWER_LOCK_AUDIO, millis(), AUDIO_HOLD_MS);
+    mp3Reader2.play(msg.data1 - SAMPLE_NOTE_FIRST + 1);
+    return true;
+  }
+  return false;
+}
+
+// Run the incoming MIDI messages of all transports, oldest first, and
+// feed their clock messages to the tempo tracker. Incoming MIDI and a
+// locked clock keep the CPU at its maximum clock.
+// Returns true if any message did something.
+static bool manageMidiActions() {
+  bool            acted = false;
+  MidiEvent       ev;
+  MidiClockStatus clock;
+
+  while (midiPollEvent(&ev)) {
+    powerLockHold(POWER_LOCK_INPUT, millis(), INPUT_HOLD_MS);
+    if (ev.msg.status >= MIDI_CLOCK_TICK) {
+      midiClockIn().feed(ev.msg.status, ev.us);
+    } else if (runMidiMessage(ev.msg)) {
+      acted = true;
+    }
+    midiNoteDispatched(ev, micros());
+  }
+  midiClockIn().update(micros());
+  midiClockIn().status(&clock);
+  if (clock.locked) powerLockHold(POWER_LOCK_INPUT, millis(), INPUT_HOLD_MS);
+  return acted;
+}
+
+// Run one command from the binary control link
+static ControlResult runControlCommand(const ControlCommand& cmd) {
+  MP3Player* player = cmd.arg8 == 1   ? &mp3Reader1
+                      : cmd.arg8 == 2 ? &mp3Reader2
+                                      : nullptr;
+  switch (cmd.type) {
+    case CONTROL_HELLO:
+    case CONTROL_TELEMETRY:
+      return CONTROL_OK;
+    case CONTROL_BUTTON:
+      if (cmd.arg8 >= BUTTON_COUNT) return CONTROL_ERR_ARGS;
+      runButtonAction(buttonActions[cmd.arg8]);
+      return CONTROL_OK;
+    case CONTROL_ACTION:
+      if (cmd.arg8 > ACTION_P2_STOP) return CONTROL_ERR_ARGS;
+      runButtonAction(cmd.arg8);
+      return CONTROL_OK;
+    case CONTROL_PLAY:
+      if (!player || cmd.arg16 == 0) return CONTROL_ERR_ARGS;
+      if (!player->isOnline()) return CONTROL_ERR_FAILED;
+      powerLockHold(POWER_LOCK_AUDIO, millis(), AUDIO_HOLD_MS);
+      player->play(cmd.arg16);
+      return CONTROL_OK;
+    case CONTROL_VOLUME:
+      if (!player || cmd.arg16 > 30) return CONTROL_ERR_ARGS;
+      if (!player->isOnline()) return CONTROL_ERR_FAILED;
+      powerLockHold(POWER_LOCK_AUDIO, millis(), AUDIO_HOLD_MS);
+      player->setVolume((uint8_t)cmd.arg16);
+      return CONTROL_OK;
+    case CONTROL_SCENE:
+      return selectScene(cmd.arg8) ? CONTROL_OK : CONTROL_ERR_ARGS;
+    default:
+      return CONTROL_ERR_UNKNOWN;
+  }
+}
+
+// Binary control link on the console port: run the host's commands, send
+// player changes as they happen and the status at the host's rate.
+// Returns true if a command arrived (a connected laptop keeps the pedal
+// awake, like HTTP clients).
+static bool manageControl(unsigned long now) {
+  static bool    wasUp          = false;
+  static uint8_t playersOffline = 0;  // bit per player id
+
+  bool           acted = false;
+  ControlCommand cmd;
+  while (controlPoll(&cmd)) {
+    // keep-alives and telemetry requests do not need the full clock
+    if (cmd.type >= CONTROL_BUTTON) {
+      powerLockHold(POWER_LOCK_INPUT, millis(), INPUT_HOLD_MS);
+    }
+    controlAck(cmd, runControlCommand(cmd));
+    acted = true;
+  }
+
+  // Player changes come from playerBus. A host that just connected gets
+  // the current state of both players instead. A player offline shows on
+  // the status light.
+  bool        up = controlLinkUp(now);
+  PlayerEvent pe;
+  while (playerSub.poll(&pe)) {
+    uint8_t bit    = (uint8_t)(1u << pe.player);
+    playersOffline = pe.state == PLAYER_OFFLINE
+                         ? (uint8_t)(playersOffline | bit)
+                         : (uint8_t)(playersOffline & ~bit);
+    statusLightRaise(STATUS_CAUSE_PLAYER_ERROR, playersOffline != 0);
+    if (up && wasUp) {
+      controlSendPlayer(pe.player, (ControlPlayerState)pe.state, pe.track,
+                        pe.volume);
+    }
+  }
+  if (!up) {
+    wasUp = false;
+    return acted;
+  }
+  if (!wasUp) {
+    MP3Player* players[2] = {&mp3Reader1, &mp3Reader2};
+    for (uint8_t i = 0; i < 2; ++i) {
+      controlSendPlayer(i + 1, controlPlayerState(*players[i]),
+                        players[i]->lastTrack(), players[i]->volume());
+    }
+    wasUp = true;
+  }
+
+  if (controlStatusDue(now)) {
+    ControlStatus status;
+    status.uptimeMs       = now - startMillis;
+    status.scene          = currentScene;
+    status.buttonsDown    = buttonsDown;
+    status.cpuMhz         = getCpuFrequencyMhz();
+    status.bpmX100        = currentBpmX100();
+    status.batteryPercent = batteryOk ? (int8_t)batteryPercent() : -1;
+    status.pressUs        = lastPressUs;
+    controlSendStatus(status);
+  }
+  return acted;
+}
+
+#if defined(REPLICA)
+// Share this pedal's state with the other pedals and run their presses on
+// the footswitches set to REPLICA_TRIGGER, with this pedal's mapping.
+// Returns true if a press of another pedal ran an action.
+static bool manageReplica() {
+  ReplicaState state;
+  state.buttonsDown     = buttonsDown;
+  state.scene           = currentScene;
+  MP3Player* players[2] = {&mp3Reader1, &mp3Reader2};
+  for (uint8_t i = 0; i < 2; ++i) {
+    state.players[i].state  = controlPlayerState(*players[i]);
+    state.players[i].track  = players[i]->lastTrack();
+    state.players[i].volume = players[i]->volume();
+  }
+  replicaSetLocal(state);
+  replicaPoll();
+
+  bool         acted = false;
+  ReplicaEvent ev;
+  while (replicaPollEvent(&ev)) {
+    if (ev.button >= BUTTON_COUNT || ev.type != BUTTON_EVENT_PRESSED ||
+        replicaModes[ev.button] != REPLICA_TRIGGER) {
+      continue;
+    }
+    powerLockHold(POWER_LOCK_INPUT, millis(), INPUT_HOLD_MS);
+    runButtonAction(buttonActions[ev.button]);
+    acted = true;
+  }
+  return acted;
+}
+#endif
+
+#if defined(MIDI_CLOCK_OUT)
+// Optional MIDI clock output, e.g. -D MIDI_CLOCK_OUT=120: that tempo, or
+// the tempo of the MIDI clock input while it is locked, or of the Link
+// session while other peers are in it. On Link the ticks also keep to the
+// session's beat grid, so the gear behind the pedal plays in phase with
+// the peers.
+static void manageClockOut() {
+  static uint32_t outBpmX100 = 0;
+  MidiClockStatus clock;
+
+  midiClockIn().status(&clock);
+  bool     link    = !clock.locked && linkSynced();
+  uint32_t bpmX100 = clock.locked ? clock.bpmX100
+                     : link       ? linkBpmX100()
+                                  : MIDI_CLOCK_OUT * 100;
+  if (bpmX100 != outBpmX100 && midiClockOutSetTempo(bpmX100)) {
+    outBpmX100 = bpmX100;
+  }
+  if (link) midiClockOutAlign(linkNextBeatUs());
+}
+#endif
+
+#if defined(LOOP_STATS)
+// Loop timing report for automated runs (scripts/qemu_run.py): every
+// LOOP_STATS_PERIOD_MS prints the loop count, mean and worst iteration.
+static const uint32_t LOOP_STATS_PERIOD_MS = 10000;
+
+static void noteLoopTime(unsigned long now, uint32_t loopUs) {
+  static unsigned long periodStart = 0;
+  static uint32_t      count       = 0;
+  static uint64_t      sumUs       = 0;
+  static uint32_t      maxUs       = 0;
+
+  ++count;
+  sumUs += loopUs;
+  if (loopUs > maxUs) maxUs = loopUs;
+  if (now - periodStart < LOOP_STATS_PERIOD_MS) return;
+
+  Serial.printf("[loop] n=%lu avg_us=%lu max_us=%lu\n", (unsigned long)count,
+                (unsigned long)(sumUs / count), (unsigned long)maxUs);
+  periodStart = now;
+  count       = 0;
+  sumUs       = 0;
+  maxUs       = 0;
+}
+#endif
+
+// Save mapping, player state and WiFi data to RTC memory. Done before deep
+// sleep and periodically, so a panic or watchdog reset can resume too.
+static void saveResume() {
+  memcpy(resume.buttonActions, buttonActions, sizeof(buttonActions));
+  resume.scene        = currentScene;
+  resume.volume[0]    = mp3Reader1.volume();
+  resume.volume[1]    = mp3Reader2.volume();
+  resume.lastTrack[0] = mp3Reader1.lastTrack();
+  resume.lastTrack[1] = mp3Reader2.lastTrack();
+  powerRtcSave(&resume, sizeof(resume));
+}
+
+// Network changes, for the log and the status light. HTTP, Link and
+// replication follow the link themselves.
+static void manageNetwork() {
+  NetworkEvent ev;
+  while (networkSub.poll(&ev)) {
+    // the server reconnects a lost station on its own
+    statusLightRaise(STATUS_CAUSE_RECONNECT, ev.type == NETWORK_STA_DOWN);
+    IPAddress   ip(ev.ip);
+    const char* what = ev.type == NETWORK_STA_UP   ? "up"
+                       : ev.type == NETWORK_AP_UP ? "access point"
+                                                  : "down";
+    Serial.printf("[net] %s %u.%u.%u.%u\n", what, ip[0], ip[1], ip[2],
+                  ip[3]);
+  }
+}
+
+// Status LED on, as requested over HTTP
+static void manageStatusLed() {
+  StatusLedEvent ev;
+  while (statusLedSub.poll(&ev)) {
+    statusLightRaise(STATUS_CAUSE_MANUAL, ev.on);
+  }
+}
+
+// Switch values once a second, to show the pedal is running
+static void onSwitchReport(void* arg) {
+  (void)arg;
+  Serial.printf("Switch values S1 %s, S2 %s, S3 %s, S4 %s\n",
+                (buttonsDown & 1) ? "ON" : "OFF",
+                (buttonsDown & 2) ? "ON" : "OFF",
+                (buttonsDown & 4) ? "ON" : "OFF",
+                (buttonsDown & 8) ? "ON" : "OFF");
+}
+
+static WheelTimer switchReport(onSwitchReport, nullptr);
+
+// Save the resume state and deep sleep.
+static void enterDeepSleep() {
+  saveResume();
+
+  mp3Reader1.stopPlayback();
+  mp3Reader2.stopPlayback();
+  statusLightOff();
+  ledOff();
+  displayOff();
+  linkEnd();
+  replicaEnd();
+  powerEnterDeepSleep(Board::kButtonPins, BUTTON_COUNT);
+
+  // Only reached if no footswitch can wake the chip: stay awake
+  powerNoteActivity(millis());
+}
+
+// Cold start: reset DFPlayers and start track 1 at the default volume.
+static void initPlayerCold(MP3Player& player, uint8_t num) {
+  if (!player.begin()) {
+    Serial.printf("Unable to connect to mp3 player %u:\n", num);
+    Serial.println(F("1.Please recheck the connection!"));
+    Serial.println(F("2.Please insert the SD card!"));
+  } else {
+    Serial.printf("mp3 player %u is online.\n", num);
+    player.setVolume(DEFAULT_VOLUME);
+    player.play(1);  // Play the first mp3
+  }
+}
+
+// Warm start: DFPlayers stayed powered during sleep (or kept playing through
+// a crash reset), so skip their reset and restore the volume and resume
+// track without starting playback.
+static void initPlayerWarm(MP3Player& player, uint8_t num) {
+  if (!player.begin(true, false)) {
+    Serial.printf("mp3 player %u not responding after wake\n", num);
+    return;
+  }
+  player.setVolume(resume.volume[num - 1]);
+  player.setLastTrack(resume.lastTrack[num - 1]);
 }
 
 void setup() {
+  // Warm path only after a footswitch wake or a crash reset with a valid RTC
+  // resume block
+  PowerBootPath path = powerInit(IDLE_SLEEP_MS);
+  bool warm = path != POWER_BOOT_COLD && powerRtcLoad(&resume, sizeof(resume));
+
+  heapMonitorInit();
+
   Serial.begin(115200);
-  // MP3 instance already constructed; give it a moment to settle
-  delay(100);
+  if (!warm) {
+    // MP3 instance already constructed; give it a moment to settle
+    delay(100);
+  }
+  powerMarkBootPhase("serial");
+
+  controlInit(Serial);
+  controlSetInfo(BUTTON_COUNT, 2, SCENE_COUNT, Board::kName);
+
+  crashInit();
+  Serial.printf("[crash] reset=%s crashes=%lu coredump=%lu bytes\n",
+                crashResetReason(), (unsigned long)crashCount(),
+                (unsigned long)crashDumpSize());
+
+  if (!powerDfsInit(CPU_MAX_MHZ, CPU_MIN_MHZ)) {
+    Serial.println(F("Frequency scaling unavailable, CPU stays at max"));
+  }
+
+  if (!statusLightBegin(Board::kLedPin)) {
+    Serial.println(F("Status light unavailable"));
+  }
+  if (ledInit(Board::kLedStripPin, BUTTON_COUNT)) {
+    ledSetBrightness(LED_STRIP_BRIGHTNESS);
+  } else {
+    Serial.println(F("Footswitch LEDs unavailable"));
+  }
+
+  if (warm) {
+    memcpy(buttonActions, resume.buttonActions, sizeof(buttonActions));
+    currentScene = resume.scene;
+  } else {
+    memset(&resume, 0, sizeof(resume));
+  }
+  // Subscribe before anything publishes: the players and the network
+  // already do during setup()
+  buttonBus.subscribe(buttonSub);
+  playerBus.subscribe(playerSub);
+  networkBus.subscribe(networkSub);
+  statusLedBus.subscribe(statusLedSub);
+  tickBus.subscribe(tickSub);
+  mp3Reader1.setId(1);
+  mp3Reader2.setId(2);
+
+  initButtons(Board::kButtonPins, BUTTON_COUNT, Board::kButtonsPullup);
+  setButtonReader(boardButtonsDown<Board>);
+  powerMarkBootPhase("buttons");
 
-  pinMode(LED_PIN, OUTPUT);
-  digitalWrite(LED_PIN, LOW);
+#if ARDUINO_USB_CDC_ON_BOOT
+  midiDinBegin(Serial0, Board::kMidiDinUart.rx, Board::kMidiDinUart.tx);
+#endif
 
-  initButtons(BUTTON_PINS, BUTTON_COUNT, true);
+  batteryOk = batteryInit(Board::kBatteryAdcPin, Board::kBatteryDivider);
+  if (!batteryOk) {
+    Serial.println(F("Battery monitoring unavailable"));
+  }
+
+  if (displayInit(DISPLAY_CONFIG)) {
+    timerArmPeriodic(displayRefresh, DISPLAY_REFRESH_MS);
+  } else {
+    Serial.println(F("Status display unavailable"));
+  }
 
   startMillis = millis();
 
   // Initialize WiFi + HTTP server
-  serverInit(&ledState, sState, BUTTON_COUNT, startMillis);
+  serverSetWiFiCache(&resume.wifi);
+  serverInit(BUTTON_COUNT, startMillis);
+  if (linkBegin(LINK_TEMPO_X100)) {
+    Serial.println(F("Link session started"));
+  }
+#if defined(REPLICA)
+  if (replicaBegin()) {
+    Serial.println(F("Pedal replication started"));
+  }
+#endif
+  powerMarkBootPhase("network");
 
   Serial.println();
   Serial.println(F("Dave Sample Kontrol Starting..."));
-  Serial.println(F("Initializing mp3 players ... (May take 3~5 seconds)"));
 
-  if (!mp3Reader1.begin()) {
-    Serial.println(F("Unable to connect to mp3 player 1:"));
-    Serial.println(F("1.Please recheck the connection!"));
-    Serial.println(F("2.Please insert the SD card!"));
+#if defined(UART_FAULT)
+  for (const BoardUart& u : Board::kMp3Uart) {
+    uartFault(u.num).configure(UART_FAULT_CONFIG);
+  }
+  Serial.printf("DFPlayer links: injecting %s faults, %u per mille\n",
+                uartFaultClassName(UART_FAULT_CONFIG.cls),
+                UART_FAULT_CONFIG.permille);
+#endif
+  if (warm) {
+    Serial.println(path == POWER_BOOT_CRASH
+                       ? F("Resuming mp3 players after crash reset")
+                       : F("Resuming mp3 players after deep sleep"));
+    initPlayerWarm(mp3Reader1, 1);
+    initPlayerWarm(mp3Reader2, 2);
   } else {
-    Serial.println(F("mp3 player 1 is online."));
-    mp3Reader1.setVolume(10);  // Set volume value. From 0 to 30
-    mp3Reader1.play(1);        // Play the first mp3
+    Serial.println(F("Initializing mp3 players ... (May take 3~5 seconds)"));
+    initPlayerCold(mp3Reader1, 1);
+    initPlayerCold(mp3Reader2, 2);
   }
+  powerMarkBootPhase("players");
 
-  if (!mp3Reader2.begin()) {
-    Serial.println(F("Unable to connect to mp3 player 2:"));
-    Serial.println(F("1.Please recheck the connection!"));
-    Serial.println(F("2.Please insert the SD card!"));
-  } else {
-    Serial.println(F("mp3 player 2 is online."));
-    mp3Reader2.setVolume(10);  // Set volume value. From 0 to 30
-    mp3Reader2.play(1);        // Play the first mp3
+  // after the players: the script's "on start" may use them
+  scriptInit(scriptCall);
+
+  if (!busTickStart(RESUME_SAVE_MS)) {
+    Serial.println(F("Resume ticks unavailable, saved at deep sleep only"));
   }
+  timerArmPeriodic(switchReport, 1000);
+
+  powerMarkBootPhase("ready");
+  Serial.printf("Last ready time: cold %lu us, warm %lu us, crash %lu us\n",
+                (unsigned long)powerLastColdBootUs(),
+                (unsigned long)powerLastWarmBootUs(),
+                (unsigned long)powerLastCrashBootUs());
 }
 
 void loop() {
+  uint32_t loopStart = micros();
+
+  // Attribute heap allocations to each subsystem (see lib_heap)
+  HeapSubsystem prevSub = heapEnter(HEAP_SUB_SERVER);
   serverHandleClient();
+  linkPoll();
   unsigned long now = millis();
 
-  // Process button changes and take action
-  manageButtonActions();
+  static unsigned long lastRequest = 0;
+  if (serverLastRequestMillis() != lastRequest) {
+    lastRequest = serverLastRequestMillis();
+    powerLockHold(POWER_LOCK_NETWORK, now, NETWORK_HOLD_MS);
+  }
+  manageNetwork();
+  manageStatusLed();
 
-  // optional: update mDNS (ESPmDNS handles itself mostly)
-  // small blink to indicate running: toggle every second
-  static unsigned long lastBlink = 0;
-  if (now - lastBlink >= 1000) {
-    lastBlink = now;
-    Serial.printf("Switch values S1 %s, S2 %s, S3 %s, S4 %s\n",
-                  sState[0] ? "ON" : "OFF", sState[1] ? "ON" : "OFF",
-                  sState[2] ? "ON" : "OFF", sState[3] ? "ON" : "OFF");
+  // Process button changes and take action
+  heapEnter(HEAP_SUB_BUTTONS);
+  if (manageButtonActions()) {
+    powerNoteActivity(now);
+  }
+  if (scriptPoll()) {
+    powerNoteActivity(now);
+  }
+  if (manageMidiActions()) {
+    powerNoteActivity(now);
+  }
+  if (manageControl(now)) {
+    powerNoteActivity(now);
+  }
+#if defined(REPLICA)
+  if (manageReplica()) {
+    powerNoteActivity(now);
   }
+#endif
+#if defined(MIDI_CLOCK_OUT)
+  manageClockOut();
+#endif
+  heapEnter(HEAP_SUB_MP3);
+  mp3Reader1.poll();
+  mp3Reader2.poll();
+  heapLeave(prevSub);
+  manageLeds();
 
-  // Ensure physical LED reflects library-updated ledState (server may toggle
-  // it)
-  static bool prevLedState = false;
-  if (ledState != prevLedState) {
-    prevLedState = ledState;
-    digitalWrite(LED_PIN, ledState ? HIGH : LOW);
+  // software timers due (the switch report and display refresh among them)
+  timersRun();
+
+  // Keep the RTC resume block current for a crash reset, once per tick
+  // however many arrived
+  BusTick tick;
+  bool    saveDue = false;
+  while (tickSub.poll(&tick)) saveDue = true;
+  if (saveDue) saveResume();
+
+  // Deep sleep once nothing happened for a while. Playback and HTTP clients
+  // count as activity.
+  if (mp3Reader1.isPlaying() || mp3Reader2.isPlaying()) {
+    powerNoteActivity(now);
+  } else {
+    powerNoteActivity(serverLastRequestMillis());
   }
+  if (powerIdleExpired(now)) {
+    enterDeepSleep();
+  }
+  powerDfsUpdate(now);
+
+  uint32_t loopUs = micros() - loopStart;
+  controlNoteLoopUs(loopUs);
+#if defined(LOOP_STATS)
+  noteLoopTime(now, loopUs);
+#endif
 }
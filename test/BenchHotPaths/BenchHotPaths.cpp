@@ -0,0 +1,198 @@
+// test/BenchHotPaths/BenchHotPaths.cpp
+//
+// Host microbenchmarks for the firmware hot paths:
+// - updateButtons() per call with 4 and 16 buttons
+// - /api/status JSON formatting
+// - DFPlayer frame encode / decode / streaming parse
+// - event queue push + pop
+// - event bus publish + poll (two subscribers, like buttonBus)
+//
+// Each benchmark runs REPS timed repetitions; one JSON object per line is
+// printed on stdout with the median and minimum nanoseconds per operation,
+// e.g. {"bench":"update_buttons","param":4,...,"ns_per_op":41.2,...}.
+// Compare two runs with scripts/bench_compare.py.
+//
+//   pio run -e bench -t exec                  # all benchmarks
+//   .pio/build/bench/program update_buttons   # only names containing it
+
+#include "dfplayer_frame.hpp"
+#include "lib_button.hpp"
+#include "lib_event.hpp"
+#include "status_json.hpp"
+#include <Arduino.h>
+
+#include <algorithm>
+#include <chrono>
+
+static const int REPS = 7;
+
+static const char* filter = nullptr;
+
+// Keep the optimizer from discarding benchmark results
+static volatile uint32_t sink;
+
+typedef void (*BenchFn)(uint32_t iters, uint32_t param);
+
+static double nowNs() {
+  using namespace std::chrono;
+  return (double)duration_cast<nanoseconds>(
+             steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static void run(const char* name, uint32_t param, uint32_t iters, BenchFn fn) {
+  if (filter && !strstr(name, filter)) return;
+
+  double nsPerOp[REPS];
+  fn(iters / 10 + 1, param);  // warm-up
+  for (int r = 0; r < REPS; ++r) {
+    double start = nowNs();
+    fn(iters, param);
+    nsPerOp[r] = (nowNs() - start) / iters;
+  }
+  std::sort(nsPerOp, nsPerOp + REPS);
+
+  printf("{\"bench\":\"%s\",\"param\":%u,\"iters\":%u,\"reps\":%d,"
+         "\"ns_per_op\":%.2f,\"ns_per_op_min\":%.2f,\"ns_per_op_max\":%.2f}\n",
+         name, param, iters, REPS, nsPerOp[REPS / 2], nsPerOp[0],
+         nsPerOp[REPS - 1]);
+  fflush(stdout);
+}
+
+/* updateButtons(): 1 ms between calls, one button bouncing every 50 calls
+ * so the debounce, edge and click paths run as well as the idle path. */
+static uint8_t                        benchPins[16];
+static bool                           benchState[16];
+static BusSubscriber<ButtonEvent, 32> benchSub("bench");
+
+static void setupButtons(uint32_t count) {
+  for (uint8_t i = 0; i < count; ++i) benchPins[i] = 10 + i;
+  nativeSetTimeUs(0);
+  initButtons(benchPins, count, true);
+  buttonBus.subscribe(benchSub);
+}
+
+static void benchUpdateButtons(uint32_t iters, uint32_t count) {
+  ButtonEvent ev;
+  for (uint32_t i = 0; i < iters; ++i) {
+    nativeAdvanceUs(1000);
+    if (i % 50 == 0) {
+      uint8_t pin = benchPins[(i / 50) % count];
+      nativeSetPin(pin, !digitalRead(pin));
+    }
+    updateButtons();
+    while (benchSub.poll(&ev)) sink = ev.us;
+  }
+}
+
+static void benchStatusJson(uint32_t iters, uint32_t count) {
+  char           buf[512];
+  StatusSnapshot snap;
+  snap.apMode      = false;
+  snap.ip[0]       = 192;
+  snap.ip[1]       = 168;
+  snap.ip[2]       = 1;
+  snap.ip[3]       = 42;
+  snap.rssi        = -61;
+  snap.led         = true;
+  snap.batteryMv   = 3987;
+  snap.batteryPct  = 76;
+  snap.buttons     = benchState;
+  snap.buttonCount = count;
+  for (uint32_t i = 0; i < iters; ++i) {
+    snap.uptimeMs = 123456789UL + i;
+    sink          = formatStatusJson(snap, buf, sizeof(buf));
+  }
+}
+
+static void benchDfEncode(uint32_t iters, uint32_t param) {
+  (void)param;
+  uint8_t out[DF_FRAME_LEN];
+  DfFrame frame = {0x03, true, 0};
+  for (uint32_t i = 0; i < iters; ++i) {
+    frame.param = (uint16_t)i;
+    dfEncodeFrame(frame, out);
+    sink = out[8];
+  }
+}
+
+static void benchDfDecode(uint32_t iters, uint32_t param) {
+  (void)param;
+  uint8_t in[DF_FRAME_LEN];
+  DfFrame frame = {0x3D, false, 7};  // "track finished" report
+  dfEncodeFrame(frame, in);
+  for (uint32_t i = 0; i < iters; ++i) {
+    sink = dfDecodeFrame(in, &frame) ? frame.param : 0;
+  }
+}
+
+static void benchDfParse(uint32_t iters, uint32_t param) {
+  (void)param;
+  uint8_t       in[DF_FRAME_LEN];
+  DfFrame       frame = {0x3D, false, 7};
+  DfFrameParser parser;
+  dfEncodeFrame(frame, in);
+  for (uint32_t i = 0; i < iters; ++i) {
+    for (uint8_t b = 0; b < DF_FRAME_LEN; ++b) {
+      if (parser.feed(in[b])) sink = parser.frame().param;
+    }
+  }
+}
+
+static EventQueue<ButtonEvent, 32> benchQueue;
+
+static void benchEventQueue(uint32_t iters, uint32_t batch) {
+  ButtonEvent ev = {1, BUTTON_EVENT_PRESSED, 0};
+  for (uint32_t i = 0; i < iters; i += batch) {
+    for (uint32_t j = 0; j < batch; ++j) {
+      ev.us = i + j;
+      benchQueue.push(ev);
+    }
+    for (uint32_t j = 0; j < batch; ++j) {
+      if (benchQueue.pop(&ev)) sink = ev.us;
+    }
+  }
+}
+
+// Like buttonBus on the pedal: the application and the server subscribe
+static BusTopic<ButtonEvent>          benchBus("bench");
+static BusSubscriber<ButtonEvent, 32> benchBusApp("app");
+static BusSubscriber<ButtonEvent, 32> benchBusServer("server");
+
+static void benchBusPublishPoll(uint32_t iters, uint32_t batch) {
+  ButtonEvent ev = {1, BUTTON_EVENT_PRESSED, 0};
+  for (uint32_t i = 0; i < iters; i += batch) {
+    for (uint32_t j = 0; j < batch; ++j) {
+      ev.us = i + j;
+      benchBus.publish(ev);
+    }
+    for (uint32_t j = 0; j < batch; ++j) {
+      if (benchBusApp.poll(&ev)) sink = ev.us;
+      if (benchBusServer.poll(&ev)) sink = ev.us;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) filter = argv[1];
+
+  setupButtons(4);
+  run("update_buttons", 4, 200000, benchUpdateButtons);
+  setupButtons(16);
+  run("update_buttons", 16, 200000, benchUpdateButtons);
+
+  run("status_json", 4, 200000, benchStatusJson);
+  run("df_encode", 0, 2000000, benchDfEncode);
+  run("df_decode", 0, 2000000, benchDfDecode);
+  run("df_parse_frame", 0, 1000000, benchDfParse);
+
+  // param = events pushed before draining (1 = ping-pong, 16 = burst)
+  run("event_queue_push_pop", 1, 2000000, benchEventQueue);
+  run("event_queue_push_pop", 16, 2000000, benchEventQueue);
+
+  benchBus.subscribe(benchBusApp);
+  benchBus.subscribe(benchBusServer);
+  run("bus_publish_poll", 1, 2000000, benchBusPublishPoll);
+  run("bus_publish_poll", 16, 2000000, benchBusPublishPoll);
+  return 0;
+}
@@ -0,0 +1,178 @@
+// test/BusLatency/BusLatency.cpp
+//
+// Checks lib_bus delivery across threads, on the host.
+//
+//   pio run -e bus -t exec
+//   .pio/build/bus/program --messages 200000 --slow-every-us 500
+//
+// One thread publishes numbered messages as fast as it can (bursts of
+// --burst, then a short pause), like a task or ISR publishing button
+// events. Three subscribers are polled by their own threads:
+// - "fast" spins on poll(): it must receive every message, in order.
+// - "paced" polls every 100 us with a queue deep enough for a burst: it
+//   must lose nothing either.
+// - "slow" polls every --slow-every-us with a small queue: it loses
+//   messages, and must count exactly what it lost while the others are
+//   not affected.
+// For each subscriber reports received, dropped, gaps in the numbering
+// and the delivery latency measured by the bus (avg, max) next to p50/p99
+// measured by the test.
+//
+// Prints one JSON object per subscriber and a summary. Exits with status
+// 1 if a check fails.
+
+#include "lib_bus.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+struct Options {
+  uint32_t messages    = 100000;
+  uint32_t burst       = 8;
+  uint32_t slowEveryUs = 1000;
+};
+
+struct Msg {
+  uint32_t seq;
+  uint32_t sentUs;
+};
+
+static BusTopic<Msg>          topic("test");
+static BusSubscriber<Msg, 64> fastSub("fast");
+static BusSubscriber<Msg, 32> pacedSub("paced");
+static BusSubscriber<Msg, 4>  slowSub("slow");
+
+static std::atomic<bool> publishing{true};
+
+static void sleepUs(uint32_t us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+struct Result {
+  const char*           name;
+  uint32_t              received = 0;
+  uint32_t              gaps     = 0;  // messages missing in the numbering
+  uint32_t              reorders = 0;
+  int64_t               last     = -1;  // last number received
+  std::vector<uint32_t> latencyUs;
+};
+
+template <uint16_t N>
+static void drain(BusSubscriber<Msg, N>& sub, uint32_t everyUs, Result* r) {
+  int64_t& last = r->last;
+  Msg      m;
+  for (;;) {
+    bool done = !publishing.load();
+    while (sub.poll(&m)) {
+      r->latencyUs.push_back(busNowUs() - m.sentUs);
+      if ((int64_t)m.seq <= last) {
+        ++r->reorders;
+      } else {
+        r->gaps += (uint32_t)(m.seq - last - 1);
+      }
+      last = m.seq;
+      ++r->received;
+    }
+    if (done) break;
+    if (everyUs) sleepUs(everyUs);
+  }
+}
+
+static uint32_t percentile(std::vector<uint32_t> v, double p) {
+  if (v.empty()) return 0;
+  size_t i = (size_t)(p * (v.size() - 1));
+  std::nth_element(v.begin(), v.begin() + i, v.end());
+  return v[i];
+}
+
+static bool report(const Result& r, const BusSubscriberBase& sub,
+                   uint32_t published, bool mustKeepUp) {
+  BusSubscriberStats st;
+  sub.stats(&st);
+  // lost after the last message received: missing, but not a gap
+  uint32_t missing  = r.gaps + (uint32_t)(published - 1 - r.last);
+  bool     counted  = st.received == r.received && missing == st.dropped &&
+                     st.received + st.dropped + st.pending == published;
+  bool     complete = !mustKeepUp || st.dropped == 0;
+  bool     ok       = counted && complete && r.reorders == 0;
+  printf("{\"subscriber\":\"%s\",\"capacity\":%u,\"received\":%lu,"
+         "\"dropped\":%lu,\"pending\":%u,\"gaps\":%lu,\"reorders\":%lu,"
+         "\"latency_avg_us\":%lu,\"latency_max_us\":%lu,"
+         "\"latency_p50_us\":%lu,\"latency_p99_us\":%lu,\"ok\":%s}\n",
+         r.name, st.capacity, (unsigned long)st.received,
+         (unsigned long)st.dropped, st.pending, (unsigned long)r.gaps,
+         (unsigned long)r.reorders, (unsigned long)st.latencyAvgUs,
+         (unsigned long)st.latencyMaxUs,
+         (unsigned long)percentile(r.latencyUs, 0.5),
+         (unsigned long)percentile(r.latencyUs, 0.99), ok ? "true" : "false");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  Options opt;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--messages")) {
+      opt.messages = (uint32_t)atol(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--burst")) {
+      opt.burst = (uint32_t)atol(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--slow-every-us")) {
+      opt.slowEveryUs = (uint32_t)atol(argv[i + 1]);
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (opt.burst < 1 || opt.burst > 32) opt.burst = 8;
+
+  bool ok = topic.subscribe(fastSub) && topic.subscribe(pacedSub) &&
+            topic.subscribe(slowSub) && !topic.subscribe(fastSub);
+
+  Result fast, paced, slow;
+  fast.name  = "fast";
+  paced.name = "paced";
+  slow.name  = "slow";
+  fast.latencyUs.reserve(opt.messages);
+  paced.latencyUs.reserve(opt.messages);
+  slow.latencyUs.reserve(opt.messages);
+
+  std::thread tf(drain<64>, std::ref(fastSub), 0, &fast);
+  std::thread tp(drain<32>, std::ref(pacedSub), 100, &paced);
+  std::thread ts(drain<4>, std::ref(slowSub), opt.slowEveryUs, &slow);
+
+  // Bursts of opt.burst, then a pause long enough for "paced" to catch up
+  uint32_t start = busNowUs();
+  for (uint32_t i = 0; i < opt.messages; ++i) {
+    Msg m;
+    m.seq    = i;
+    m.sentUs = busNowUs();
+    topic.publish(m);
+    if (i % opt.burst == opt.burst - 1) sleepUs(400);
+  }
+  uint32_t elapsed = busNowUs() - start;
+  publishing.store(false);
+  tf.join();
+  tp.join();
+  ts.join();
+
+  uint32_t published = topic.published();
+  ok &= published == opt.messages;
+  ok &= report(fast, fastSub, published, true);
+  ok &= report(paced, pacedSub, published, true);
+  ok &= report(slow, slowSub, published, false);
+
+  BusSubscriberStats st;
+  slowSub.stats(&st);
+  printf("{\"summary\":\"bus\",\"published\":%lu,\"burst\":%lu,"
+         "\"elapsed_ms\":%lu,\"slow_dropped\":%lu,\"ok\":%s}\n",
+         (unsigned long)published, (unsigned long)opt.burst,
+         (unsigned long)(elapsed / 1000), (unsigned long)st.dropped,
+         ok ? "true" : "false");
+  return ok ? 0 : 1;
+}
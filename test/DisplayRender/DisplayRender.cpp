@@ -0,0 +1,161 @@
+// test/DisplayRender/DisplayRender.cpp
+//
+// Renders a sequence of status screens (lib_display) on the host and checks
+// the dirty-region updates: after every flush the panel model must equal
+// the framebuffer, and a redraw that changes nothing must send nothing.
+// Measures the redraw cost per step (render and flush wall time, pixel
+// bytes sent against a full 1024 byte frame).
+//
+//   pio run -e display -t exec
+//   .pio/build/display/program --out /tmp/oled   # also /tmp/oled-NN.pbm
+//
+// Prints one JSON object per step, then a summary. Exits with status 1 if
+// the panel ever differs from the framebuffer or an unchanged screen was
+// sent.
+
+#include "display_status.hpp"
+#include "lib_display.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+struct Step {
+  const char*   what;
+  DisplayStatus status;
+};
+
+static const DisplayStatus kBase = {0,
+                                    0,
+                                    87,
+                                    {{DISPLAY_PLAYER_STOPPED, 1, "Intro"},
+                                     {DISPLAY_PLAYER_STOPPED, 0, nullptr}}};
+
+static double nowUs() {
+  using namespace std::chrono;
+  return duration<double, std::micro>(
+             steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Binary PBM, 1 = black: lit pixels are written black on white
+static bool writePbm(const char* path, const uint8_t* page) {
+  FILE* f = fopen(path, "wb");
+  if (!f) return false;
+  fprintf(f, "P4\n%d %d\n", DISPLAY_WIDTH, DISPLAY_HEIGHT);
+  for (int y = 0; y < DISPLAY_HEIGHT; ++y) {
+    uint8_t row[DISPLAY_WIDTH / 8] = {0};
+    for (int x = 0; x < DISPLAY_WIDTH; ++x) {
+      if (page[(y / 8) * DISPLAY_WIDTH + x] & (1 << (y % 8))) {
+        row[x / 8] |= (uint8_t)(0x80 >> (x % 8));
+      }
+    }
+    fwrite(row, 1, sizeof(row), f);
+  }
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  const char* out = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+      out = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--out PREFIX]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  // What a session looks like: clock locks, tempo drifts, players change
+  std::vector<Step> steps;
+  DisplayStatus     st = kBase;
+  steps.push_back({"boot", st});
+  steps.push_back({"unchanged", st});
+  st.bpmX100 = 12000;
+  steps.push_back({"clock_locked", st});
+  st.bpmX100 = 12030;
+  steps.push_back({"tempo_drift", st});
+  st.players[0].state = DISPLAY_PLAYER_PLAYING;
+  steps.push_back({"p1_play", st});
+  st.players[0].state = DISPLAY_PLAYER_PAUSED;
+  steps.push_back({"p1_pause", st});
+  st.players[1] = {DISPLAY_PLAYER_PLAYING, 12, nullptr};
+  steps.push_back({"p2_sample", st});
+  st.players[0] = {DISPLAY_PLAYER_PLAYING, 2, "Verse loop"};
+  steps.push_back({"p1_next_track", st});
+  st.scene = 1;
+  steps.push_back({"scene", st});
+  st.batteryPercent = 86;
+  steps.push_back({"battery", st});
+  steps.push_back({"unchanged", st});
+  st.players[1].state = DISPLAY_PLAYER_OFFLINE;
+  st.bpmX100          = 0;
+  steps.push_back({"p2_offline_clock_lost", st});
+
+  DisplayConfig config = {
+      DISPLAY_SH1106, DISPLAY_BUS_I2C, 10, 11, -1, -1, -1, 0x3C, 400000};
+  if (!displayInit(config)) {
+    fprintf(stderr, "displayInit failed\n");
+    return 2;
+  }
+
+  bool     failed       = false;
+  double   renderMaxUs  = 0;
+  double   flushMaxUs   = 0;
+  uint32_t changedBytes = 0;
+  uint32_t changed      = 0;
+  for (size_t i = 0; i < steps.size(); ++i) {
+    DisplayStats before, after;
+    displayGetStats(&before);
+
+    double t0 = nowUs();
+    displayStatusDraw(steps[i].status);
+    double t1 = nowUs();
+    displayFlush();
+    double t2 = nowUs();
+
+    displayGetStats(&after);
+    uint32_t bytes = after.bytes - before.bytes;
+    bool     match =
+        memcmp(displayPanel(), displayFrame(),
+               DISPLAY_PAGES * DISPLAY_WIDTH) == 0;
+    bool same = i > 0 && !memcmp(&steps[i].status, &steps[i - 1].status,
+                                 sizeof(DisplayStatus));
+    if (!match || (same && bytes)) failed = true;
+    if (i > 0 && bytes) {
+      changedBytes += bytes;
+      ++changed;
+    }
+    if (t1 - t0 > renderMaxUs) renderMaxUs = t1 - t0;
+    if (t2 - t1 > flushMaxUs) flushMaxUs = t2 - t1;
+
+    printf("{\"step\":%zu,\"what\":\"%s\",\"bytes\":%lu,\"render_us\":%.1f,"
+           "\"flush_us\":%.1f,\"panel_match\":%s}\n",
+           i, steps[i].what, (unsigned long)bytes, t1 - t0, t2 - t1,
+           match ? "true" : "false");
+
+    if (out) {
+      char path[256];
+      snprintf(path, sizeof(path), "%s-%02zu.pbm", out, i);
+      if (!writePbm(path, displayPanel())) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 2;
+      }
+    }
+  }
+
+  DisplayStats stats;
+  displayGetStats(&stats);
+  printf("{\"summary\":\"display\",\"steps\":%zu,\"frames\":%lu,"
+         "\"bytes\":%lu,\"avg_update_bytes\":%lu,\"full_frame_bytes\":%d,"
+         "\"render_us_max\":%.1f,\"flush_us_max\":%.1f,\"failed\":%s}\n",
+         steps.size(), (unsigned long)stats.frames,
+         (unsigned long)stats.bytes,
+         (unsigned long)(changed ? changedBytes / changed : 0),
+         DISPLAY_PAGES * DISPLAY_WIDTH, renderMaxUs, flushMaxUs,
+         failed ? "true" : "false");
+  return failed ? 1 : 0;
+}
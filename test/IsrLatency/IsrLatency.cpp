@@ -0,0 +1,236 @@
+// test/IsrLatency/IsrLatency.cpp
+//
+// Worst-case latency of lib_button's GPIO interrupt, on the pedal, with and
+// without flash being written at the same time.
+//
+//   pio run -e isr -t upload -t monitor        // input path in flash
+//   pio run -e isr-iram -t upload -t monitor   // built with INPUT_IRAM
+//
+// ISR_TEST_PIN (free, nothing connected) is set up as a button and then
+// switched to input/output, so the pin sees its own level changes. A
+// hardware timer interrupt, itself in IRAM so it runs throughout, toggles
+// it every PERIOD_US and notes the cycle count; the latency of an edge is
+// from that toggle to the entry of lib_button's ISR, which queues the edge
+// with its own cycle count. Edges the ISR took late in one run count from
+// the first of them.
+//
+// Three phases of PHASE_MS each, while a task on the other core:
+// - idle: does nothing
+// - nvs:  rewrites a Preferences key (NVS, as the macros and settings do)
+// - ota:  erases and writes the next OTA partition 4 KB at a time, as an
+//         update does. Whatever image was there is overwritten.
+// Prints one JSON line per phase (edges, p50/p99/max in us) and a summary.
+// With INPUT_IRAM the ISR must stay under MAX_LATENCY_US in every phase;
+// without it the flash phases show the interrupt waiting for the writes.
+
+#include "lib_button.hpp"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <driver/gpio.h>
+#include <driver/timer.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <hal/cpu_hal.h>
+#include <hal/gpio_ll.h>
+#include <soc/gpio_struct.h>
+
+#include <algorithm>
+
+#ifndef ISR_TEST_PIN
+#define ISR_TEST_PIN 13
+#endif
+
+static const uint32_t PERIOD_US      = 1000;
+static const uint32_t PHASE_MS       = 5000;
+static const uint32_t MAX_LATENCY_US = 50;
+
+#if defined(INPUT_IRAM)
+static const bool kIram = true;
+#else
+static const bool kIram = false;
+#endif
+
+enum Phase : uint8_t { PHASE_IDLE = 0, PHASE_NVS, PHASE_OTA, PHASE_COUNT };
+
+static const char* const kPhaseNames[PHASE_COUNT] = {"idle", "nvs", "ota"};
+
+static volatile uint8_t  phase    = PHASE_IDLE;
+static volatile uint32_t flashOps = 0;
+
+/* Edge source */
+
+static const uint32_t kRing = 1024;  // toggles kept: about a second
+
+static DRAM_ATTR volatile uint32_t toggleCycles[kRing];
+static DRAM_ATTR volatile uint32_t toggles = 0;
+static DRAM_ATTR volatile uint32_t level   = 1;
+
+static bool IRAM_ATTR onToggle(void* arg) {
+  (void)arg;
+  uint32_t n              = toggles;
+  level                   = !level;
+  toggleCycles[n % kRing] = cpu_hal_get_cycle_count();
+  gpio_ll_set_level(&GPIO, (gpio_num_t)ISR_TEST_PIN, level);
+  toggles = n + 1;
+  return false;
+}
+
+static bool startToggles(void) {
+  timer_config_t cfg = {};
+  cfg.alarm_en       = TIMER_ALARM_EN;
+  cfg.counter_en     = TIMER_PAUSE;
+  cfg.intr_type      = TIMER_INTR_LEVEL;
+  cfg.counter_dir    = TIMER_COUNT_UP;
+  cfg.auto_reload    = TIMER_AUTORELOAD_EN;
+  cfg.divider        = 80;  // 1 MHz from the 80 MHz APB clock
+  if (timer_init(TIMER_GROUP_0, TIMER_0, &cfg) != ESP_OK) return false;
+  timer_set_counter_value(TIMER_GROUP_0, TIMER_0, 0);
+  timer_set_alarm_value(TIMER_GROUP_0, TIMER_0, PERIOD_US);
+  if (timer_isr_callback_add(TIMER_GROUP_0, TIMER_0, onToggle, nullptr,
+                             ESP_INTR_FLAG_IRAM) != ESP_OK) {
+    return false;
+  }
+  return timer_start(TIMER_GROUP_0, TIMER_0) == ESP_OK;
+}
+
+/* Flash load, on core 0 */
+
+static uint8_t flashBuf[4096];
+
+static void flashTask(void* arg) {
+  (void)arg;
+  const esp_partition_t* ota    = esp_ota_get_next_update_partition(nullptr);
+  uint32_t               offset = 0;
+  for (;;) {
+    switch (phase) {
+      case PHASE_NVS: {
+        Preferences prefs;
+        if (prefs.begin("isrbench", false)) {
+          flashBuf[0] = (uint8_t)flashOps;
+          prefs.putBytes("k", flashBuf, 256);
+          prefs.end();
+        }
+        flashOps = flashOps + 1;
+        break;
+      }
+      case PHASE_OTA:
+        if (!ota) break;
+        if (offset + sizeof(flashBuf) > ota->size) offset = 0;
+        esp_partition_erase_range(ota, offset, sizeof(flashBuf));
+        esp_partition_write(ota, offset, flashBuf, sizeof(flashBuf));
+        offset += sizeof(flashBuf);
+        flashOps = flashOps + 1;
+        break;
+      default:
+        break;
+    }
+    vTaskDelay(1);
+  }
+}
+
+/* Measurement, on core 1 */
+
+static const uint32_t kMaxSamples = PHASE_MS * 1000 / PERIOD_US * 2;
+
+static uint32_t samples[kMaxSamples];  // cycles
+static uint32_t sampleCount = 0;
+static uint32_t served      = 0;  // first toggle no ISR run took yet
+static uint32_t overruns    = 0;  // toggles gone from the ring unserved
+
+static void collect(void) {
+  ButtonEdge e;
+  while (pollButtonEdge(&e)) {
+    uint32_t n = toggles;
+    if (n - served > kRing) {
+      overruns += n - served - kRing;
+      served = n - kRing;
+    }
+    if (served == n) continue;  // pull-up settling, not a toggle
+    uint32_t first = toggleCycles[served % kRing];
+    if ((int32_t)(e.cycles - first) < 0) continue;
+    if (sampleCount < kMaxSamples) samples[sampleCount++] = e.cycles - first;
+    // this run took every toggle up to its entry
+    while (served != n &&
+           (int32_t)(e.cycles - toggleCycles[served % kRing]) >= 0) {
+      ++served;
+    }
+  }
+}
+
+static uint32_t toUs(uint32_t cycles) {
+  return cycles / getCpuFrequencyMhz();
+}
+
+static uint32_t runPhase(Phase p) {
+  sampleCount        = 0;
+  overruns           = 0;
+  uint32_t toggles0  = toggles;
+  uint32_t flashOps0 = flashOps;
+  phase              = p;
+  uint32_t start     = millis();
+  while (millis() - start < PHASE_MS) {
+    collect();
+    taskYIELD();
+  }
+  phase = PHASE_IDLE;
+  delay(50);  // the last flash operation and its deferred edges
+  collect();
+
+  std::sort(samples, samples + sampleCount);
+  uint32_t p50 = sampleCount ? samples[sampleCount / 2] : 0;
+  uint32_t p99 = sampleCount ? samples[sampleCount * 99 / 100] : 0;
+  uint32_t max = sampleCount ? samples[sampleCount - 1] : 0;
+  ButtonIsrStats st;
+  buttonGetIsrStats(&st);
+  Serial.printf("{\"phase\":\"%s\",\"iram\":%s,\"toggles\":%lu,"
+                "\"isr_runs\":%lu,\"overruns\":%lu,\"dropped\":%lu,"
+                "\"flash_ops\":%lu,\"p50_us\":%lu,\"p99_us\":%lu,"
+                "\"max_us\":%lu}\n",
+                kPhaseNames[p], kIram ? "true" : "false",
+                (unsigned long)(toggles - toggles0),
+                (unsigned long)sampleCount, (unsigned long)overruns,
+                (unsigned long)st.dropped,
+                (unsigned long)(flashOps - flashOps0), (unsigned long)toUs(p50),
+                (unsigned long)toUs(p99), (unsigned long)toUs(max));
+  return toUs(max);
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(2000);
+  for (size_t i = 0; i < sizeof(flashBuf); ++i) flashBuf[i] = (uint8_t)i;
+
+  // a button, then looped back on itself
+  const uint8_t pins[1] = {ISR_TEST_PIN};
+  initButtons(pins, 1, true);
+  gpio_set_direction((gpio_num_t)ISR_TEST_PIN, GPIO_MODE_INPUT_OUTPUT);
+  gpio_set_level((gpio_num_t)ISR_TEST_PIN, level);
+
+  ButtonIsrStats st;
+  buttonGetIsrStats(&st);
+  if (!st.active || !startToggles()) {
+    Serial.println("ISR FAIL: no GPIO or timer interrupt");
+    return;
+  }
+  xTaskCreatePinnedToCore(flashTask, "flash", 4096, nullptr, 1, nullptr, 0);
+  delay(100);
+  ButtonEdge e;
+  while (pollButtonEdge(&e)) {
+  }
+  served = toggles;
+
+  uint32_t worst = 0;
+  for (uint8_t p = 0; p < PHASE_COUNT; ++p) {
+    worst = std::max(worst, runPhase((Phase)p));
+  }
+  bool ok = !kIram || worst <= MAX_LATENCY_US;
+  Serial.printf("{\"summary\":\"isr\",\"iram\":%s,\"max_us\":%lu,"
+                "\"limit_us\":%lu,\"ok\":%s}\n",
+                kIram ? "true" : "false", (unsigned long)worst,
+                (unsigned long)MAX_LATENCY_US, ok ? "true" : "false");
+  Serial.printf("ISR %s\n", ok ? "PASS" : "FAIL");
+}
+
+void loop() {
+  delay(1000);
+}
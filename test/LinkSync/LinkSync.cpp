@@ -0,0 +1,358 @@
+// test/LinkSync/LinkSync.cpp
+//
+// Runs several Link peers (LinkSession, lib_link) as separate processes on
+// real UDP sockets, by default on the loopback interface, and reports how
+// well they agree on tempo and beat phase.
+//
+// Each peer gets its own clock: a random offset and a rate error of up to
+// --drift-ppm, like two crystals. Peers start a little apart with
+// different tempos, so each one founds its own session first and has to
+// measure and join the oldest one. Halfway through, peer 1 changes the
+// tempo (--change-bpm), which everyone has to follow without losing the
+// phase.
+//
+//   pio run -e linksync -t exec
+//   .pio/build/linksync/program --peers 4 --seconds 30 --drift-ppm 50
+//   .pio/build/linksync/program --peers 1 --iface 192.168.1.20 --verbose
+//
+// The second form is a single peer on a real interface, to join Live or
+// another Link app on the network.
+//
+// Every 50 ms (real time) each peer reports its session beat at that
+// instant. The phase error is the spread of those beats across the peers,
+// in microseconds at the session tempo. Prints one JSON object per second
+// with --verbose, then a summary. Exits with status 1 if the peers never
+// end up in one session, do not all follow the tempo change, or if the
+// phase error after converging exceeds --tolerance-us (default 1000).
+
+#include "link_session.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+static const int64_t kGridUs    = 50000;
+static const int64_t kStaggerUs = 400000;  // between peer starts
+
+struct Options {
+  int      peers       = 3;
+  double   seconds     = 20;
+  double   driftPpm    = 40;
+  double   changeBpm   = 128;
+  int64_t  toleranceUs = 1000;
+  uint32_t iface       = 0x7F000001;  // 127.0.0.1
+  bool     verbose     = false;
+};
+
+// One report of a peer, written to the parent's pipe (atomic: < PIPE_BUF)
+struct Sample {
+  int32_t  peer;
+  int32_t  grid;
+  int64_t  beats;  // micro-beats
+  uint32_t bpmX100;
+  uint8_t  session[8];
+};
+
+static int64_t realUs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* One peer's view of time: offset and rate error against the real clock */
+struct PeerClock {
+  int64_t epochUs;  // shared start of the run, real time
+  int64_t baseUs;
+  double  rate;
+
+  int64_t hostAt(int64_t real) const {
+    return baseUs + (int64_t)((real - epochUs) * rate);
+  }
+};
+
+static bool openSockets(uint32_t iface, int* mcast, int* ucast,
+                        uint16_t* port) {
+  *mcast = socket(AF_INET, SOCK_DGRAM, 0);
+  *ucast = socket(AF_INET, SOCK_DGRAM, 0);
+  if (*mcast < 0 || *ucast < 0) return false;
+
+  int one = 1;
+  setsockopt(*mcast, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  setsockopt(*mcast, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(LINK_DISCOVERY_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(*mcast, (struct sockaddr*)&addr, sizeof(addr)) != 0) return false;
+  struct ip_mreq group;
+  group.imr_multiaddr.s_addr = htonl(LINK_MULTICAST_ADDR);
+  group.imr_interface.s_addr = htonl(iface);
+  if (setsockopt(*mcast, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group,
+                 sizeof(group)) != 0) {
+    return false;
+  }
+
+  addr.sin_port        = 0;
+  addr.sin_addr.s_addr = htonl(iface);
+  socklen_t len        = sizeof(addr);
+  if (bind(*ucast, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      getsockname(*ucast, (struct sockaddr*)&addr, &len) != 0) {
+    return false;
+  }
+  struct in_addr ifAddr;
+  ifAddr.s_addr = htonl(iface);
+  setsockopt(*ucast, IPPROTO_IP, IP_MULTICAST_IF, &ifAddr, sizeof(ifAddr));
+  *port = ntohs(addr.sin_port);
+  return true;
+}
+
+static void sendPacket(int sock, const LinkPacket& pkt) {
+  struct sockaddr_in to;
+  memset(&to, 0, sizeof(to));
+  to.sin_family      = AF_INET;
+  to.sin_port        = htons(pkt.port);
+  to.sin_addr.s_addr = htonl(pkt.ip ? pkt.ip : LINK_MULTICAST_ADDR);
+  sendto(sock, pkt.data, pkt.len, 0, (struct sockaddr*)&to, sizeof(to));
+}
+
+static void printStatus(int index, const LinkSession& session, double t) {
+  LinkStatus st;
+  session.status(&st);
+  printf("{\"peer\":%d,\"t_s\":%.1f,\"bpm\":%.2f,\"peers\":%u,\"others\":%u,"
+         "\"founder\":%s,\"joins\":%u,\"measurements\":%u,\"rtt_us\":%u,"
+         "\"rate_ppb\":%d}\n",
+         index, t, st.bpmX100 / 100.0, st.peers, st.others,
+         st.founder ? "true" : "false", st.joins, st.measurements, st.rttUs,
+         st.ghostPpb);
+  fflush(stdout);
+}
+
+// Child process: one peer until the end of the run
+static int runPeer(int index, const Options& opt, int64_t epochUs, int out) {
+  srand((unsigned)(getpid() * 7919 + index));
+  PeerClock clock;
+  double    spread = opt.peers > 1 ? 2.0 * index / (opt.peers - 1) - 1 : 0;
+  clock.epochUs    = epochUs;
+  clock.baseUs     = (int64_t)(rand() % 1000000) * 1000;
+  clock.rate       = 1 + spread * opt.driftPpm * 1e-6;
+
+  // staggered start, different tempos
+  int64_t startUs = epochUs + index * kStaggerUs;
+  while (realUs() < startUs) usleep(1000);
+
+  int      mcast, ucast;
+  uint16_t port;
+  if (!openSockets(opt.iface, &mcast, &ucast, &port)) {
+    perror("socket");
+    return 2;
+  }
+  static const char kChars[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  LinkNodeId id;
+  for (uint8_t& b : id.bytes) b = kChars[rand() % (sizeof(kChars) - 1)];
+
+  LinkSession session;
+  session.begin(id, opt.iface, port, clock.hostAt(realUs()),
+                (uint32_t)(10000 + 1000 * index));
+
+  int64_t endUs    = epochUs + (int64_t)(opt.seconds * 1e6);
+  int64_t changeUs = epochUs + (int64_t)(opt.seconds * 1e6 / 2);
+  bool    changed  = index != 1;
+  int32_t grid     = (int32_t)((realUs() - epochUs) / kGridUs) + 1;
+  int64_t nextLog  = realUs();
+  uint8_t buf[512];
+
+  while (realUs() < endUs) {
+    struct pollfd fds[2] = {{mcast, POLLIN, 0}, {ucast, POLLIN, 0}};
+    ::poll(fds, 2, 1);
+    for (int i = 0; i < 2; ++i) {
+      if (!(fds[i].revents & POLLIN)) continue;
+      struct sockaddr_in from;
+      socklen_t          len = sizeof(from);
+      ssize_t n = recvfrom(fds[i].fd, buf, sizeof(buf), MSG_DONTWAIT,
+                           (struct sockaddr*)&from, &len);
+      if (n > 0) {
+        session.receive(buf, (size_t)n, ntohl(from.sin_addr.s_addr),
+                        ntohs(from.sin_port), clock.hostAt(realUs()));
+      }
+    }
+
+    int64_t now = realUs();
+    if (!changed && now >= changeUs) {
+      session.setTempo((uint32_t)(opt.changeBpm * 100 + 0.5),
+                       clock.hostAt(now));
+      changed = true;
+    }
+    LinkPacket pkt;
+    while (session.poll(clock.hostAt(now), &pkt)) sendPacket(ucast, pkt);
+
+    // beat at the grid instant, whenever we get to it
+    int64_t gridUs = epochUs + (int64_t)grid * kGridUs;
+    if (now >= gridUs) {
+      LinkStatus st;
+      session.status(&st);
+      Sample s;
+      memset(&s, 0, sizeof(s));
+      s.peer    = index;
+      s.grid    = grid;
+      s.beats   = session.beatsAt(clock.hostAt(gridUs));
+      s.bpmX100 = st.bpmX100;
+      memcpy(s.session, session.sessionId().bytes, sizeof(s.session));
+      if (write(out, &s, sizeof(s)) != (ssize_t)sizeof(s)) return 2;
+      grid = (int32_t)((now - epochUs) / kGridUs) + 1;
+    }
+    if (opt.verbose && now >= nextLog) {
+      printStatus(index, session, (now - epochUs) / 1e6);
+      nextLog += 1000000;
+    }
+  }
+
+  LinkPacket bye;
+  if (session.leave(&bye)) sendPacket(ucast, bye);
+  close(mcast);
+  close(ucast);
+  return 0;
+}
+
+static int64_t percentile(std::vector<int64_t> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))];
+}
+
+int main(int argc, char** argv) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--peers") && i + 1 < argc) {
+      opt.peers = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      opt.seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--drift-ppm") && i + 1 < argc) {
+      opt.driftPpm = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--change-bpm") && i + 1 < argc) {
+      opt.changeBpm = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--tolerance-us") && i + 1 < argc) {
+      opt.toleranceUs = atoll(argv[++i]);
+    } else if (!strcmp(argv[i], "--iface") && i + 1 < argc) {
+      struct in_addr a;
+      if (!inet_aton(argv[++i], &a)) return 2;
+      opt.iface = ntohl(a.s_addr);
+    } else if (!strcmp(argv[i], "--verbose")) {
+      opt.verbose = true;
+    } else {
+      fprintf(stderr,
+              "usage: %s [--peers N] [--seconds S] [--drift-ppm PPM]\n"
+              "  [--change-bpm BPM] [--tolerance-us US] [--iface ADDR]\n"
+              "  [--verbose]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  if (opt.peers < 1 || opt.peers > LINK_MAX_PEERS + 1) {
+    fprintf(stderr, "--peers: 1..%d\n", LINK_MAX_PEERS + 1);
+    return 2;
+  }
+
+  int pipeFd[2];
+  if (pipe(pipeFd) != 0) return 2;
+  int64_t epochUs = realUs() + 200000;
+  for (int i = 0; i < opt.peers; ++i) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(pipeFd[0]);
+      _exit(runPeer(i, opt, epochUs, pipeFd[1]));
+    }
+    if (pid < 0) return 2;
+  }
+  close(pipeFd[1]);
+
+  // samples by grid instant
+  std::map<int32_t, std::vector<Sample>> grids;
+  Sample                                 s;
+  while (read(pipeFd[0], &s, sizeof(s)) == (ssize_t)sizeof(s)) {
+    grids[s.grid].push_back(s);
+  }
+  int failed = 0;
+  for (int i = 0; i < opt.peers; ++i) {
+    int status = 0;
+    wait(&status);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = 1;
+  }
+  if (failed) {
+    fprintf(stderr, "a peer failed\n");
+    return 2;
+  }
+
+  // The run converges at the first instant, once every peer is up, when
+  // all of them share the session and the tempo
+  int32_t  lastStart   = (int32_t)((opt.peers - 1) * kStaggerUs / kGridUs) + 1;
+  int32_t  changeGrid  = (int32_t)(opt.seconds * 1e6 / 2 / kGridUs);
+  int32_t  convergedAt = -1;
+  int32_t  followedAt  = -1;
+  uint32_t changeX100  = (uint32_t)(opt.changeBpm * 100 + 0.5);
+  uint32_t split       = 0;  // instants not in one session afterwards
+  std::vector<int64_t> errors;
+  for (const auto& g : grids) {
+    const std::vector<Sample>& v = g.second;
+    if (g.first < lastStart || (int)v.size() != opt.peers) continue;
+    bool same = true;
+    for (const Sample& x : v) {
+      same = same && !memcmp(x.session, v[0].session, sizeof(x.session)) &&
+             x.bpmX100 == v[0].bpmX100;
+    }
+    if (!same) {
+      if (convergedAt >= 0 && g.first < changeGrid) ++split;
+      continue;
+    }
+    if (convergedAt < 0) convergedAt = g.first;
+    if (opt.peers > 1 && followedAt < 0 && g.first > changeGrid &&
+        v[0].bpmX100 == changeX100) {
+      followedAt = g.first;
+    }
+
+    int64_t lo = v[0].beats, hi = v[0].beats;
+    for (const Sample& x : v) {
+      lo = std::min(lo, x.beats);
+      hi = std::max(hi, x.beats);
+    }
+    int64_t errUs = (hi - lo) * 6000000000LL / v[0].bpmX100 / 1000000;
+    errors.push_back(errUs);
+    if (opt.verbose && g.first % 20 == 0) {
+      printf("{\"t_s\":%.2f,\"bpm\":%.2f,\"phase_error_us\":%lld}\n",
+             g.first * kGridUs / 1e6, v[0].bpmX100 / 100.0,
+             (long long)errUs);
+    }
+  }
+
+  bool    ok     = convergedAt >= 0 && (opt.peers == 1 || followedAt >= 0);
+  int64_t maxErr = errors.empty() ? 0 : percentile(errors, 1.0);
+  if (maxErr > opt.toleranceUs) ok = false;
+  printf("{\"summary\":\"link_sync\",\"peers\":%d,\"seconds\":%.0f,"
+         "\"drift_ppm\":%.0f,\"converge_ms\":%lld,"
+         "\"tempo_follow_ms\":%lld,\"split_instants\":%u,"
+         "\"instants\":%zu,\"phase_p50_us\":%lld,\"phase_p95_us\":%lld,"
+         "\"phase_max_us\":%lld,\"ok\":%s}\n",
+         opt.peers, opt.seconds, opt.driftPpm,
+         convergedAt < 0 ? -1LL
+                         : (long long)((convergedAt - lastStart) * kGridUs /
+                                       1000),
+         followedAt < 0 ? -1LL
+                        : (long long)((followedAt - changeGrid) * kGridUs /
+                                      1000),
+         split, errors.size(), (long long)percentile(errors, 0.5),
+         (long long)percentile(errors, 0.95), (long long)maxErr,
+         ok ? "true" : "false");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+// test/MacroTiming/MacroTiming.cpp
+//
+// Checks the stored format of footswitch macros (macro_track, lib_macro)
+// and the replay scheduling, on the host.
+//
+//   pio run -e macro -t exec
+//   .pio/build/macro/program --sequences 2000 --isr-latency-us 8
+//
+// - Round trip: random recordings (gaps from 0 to minutes, presses and
+//   releases on every button) are written until a slot is full and read
+//   back; every event must come back with its exact time. Reports bytes
+//   per event and how many events a slot holds for a stinger of 16th notes
+//   at 120 bpm.
+// - Truncation: every prefix of a recording must read as a shorter one or
+//   be rejected, never past its end.
+// - Scheduling: a 1000-event sequence, chords and near-chords included,
+//   replayed through MacroPlayer (what lib_macro's alarm interrupt runs)
+//   on a model of the timer whose interrupt runs a random
+//   0..--isr-latency-us after its alarm. Every event must come out once,
+//   in order, no further from its time than one interrupt latency (or
+//   MACRO_LEAD_US early), however long the sequence. Re-arming each alarm
+//   relative to the interrupt that set it would add the latencies up; a
+//   model of that is reported next to it.
+// - Decode cost per event (it runs in the interrupt).
+//
+// Prints one JSON object per check. Exits with status 1 if a check fails.
+
+#include "macro_track.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+struct Options {
+  int      sequences    = 1000;
+  uint32_t isrLatencyUs = 5;
+  unsigned seed         = 1;
+};
+
+static uint32_t randomGapUs(void) {
+  switch (rand() % 6) {
+    case 0:
+      return 0;  // same instant (two switches at once)
+    case 1:
+      return (uint32_t)(rand() % 2000);  // bounce-like
+    case 2:
+      return 60000 + (uint32_t)(rand() % 440000);  // fast playing
+    case 3:
+      return 500000 + (uint32_t)(rand() % 4500000);
+    case 4:
+      return (uint32_t)(rand() % 60) * 1000000;  // long rests
+    default:
+      return 125000;  // 16th notes at 120 bpm
+  }
+}
+
+static std::vector<MacroEvent> randomRecording(size_t maxEvents) {
+  std::vector<MacroEvent> v;
+  uint32_t                t = 0;
+  for (size_t i = 0; i < maxEvents; ++i) {
+    if (i) t += randomGapUs();
+    MacroEvent ev;
+    ev.offsetUs = t;
+    ev.button   = (uint8_t)(rand() % 4);
+    ev.type     = (uint8_t)(rand() % 4);
+    v.push_back(ev);
+  }
+  return v;
+}
+
+static size_t encode(const std::vector<MacroEvent>& v, uint8_t* buf,
+                     size_t cap, size_t* written) {
+  MacroWriter w;
+  w.begin(buf, cap);
+  size_t n = 0;
+  while (n < v.size() && w.add(v[n])) ++n;
+  *written = n;
+  return w.size();
+}
+
+static bool roundTrip(const Options& opt, double* bytesPerEvent) {
+  uint64_t bytes = 0, events = 0;
+  bool     ok    = true;
+  for (int s = 0; s < opt.sequences && ok; ++s) {
+    std::vector<MacroEvent> v = randomRecording(400);
+    uint8_t                 buf[MACRO_MAX_BYTES];
+    size_t                  n;
+    size_t                  len = encode(v, buf, sizeof(buf), &n);
+
+    MacroReader r;
+    MacroEvent  ev;
+    size_t      got = 0;
+    ok = r.begin(buf, len);
+    while (ok && r.next(&ev)) {
+      ok = got < n && ev.offsetUs == v[got].offsetUs &&
+           ev.button == v[got].button && ev.type == v[got].type;
+      ++got;
+    }
+    uint16_t count;
+    uint32_t dur;
+    ok = ok && got == n && r.atEnd() && macroInspect(buf, len, &count, &dur) &&
+         count == n && dur == v[n - 1].offsetUs;
+
+    // every prefix: a shorter recording or rejected, never more events
+    for (size_t cut = 0; ok && cut < len; ++cut) {
+      if (macroInspect(buf, cut, &count, &dur)) ok = count < n;
+    }
+    bytes += len;
+    events += n;
+  }
+  *bytesPerEvent = events ? (double)bytes / events : 0;
+  return ok;
+}
+
+// Events a slot holds for presses and releases of 16th notes at 120 bpm
+static size_t stingerCapacity(void) {
+  std::vector<MacroEvent> v;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    v.push_back({i * 62500, (uint8_t)(i / 2 % 4), (uint8_t)(i % 2)});
+  }
+  uint8_t buf[MACRO_MAX_BYTES];
+  size_t  n;
+  encode(v, buf, sizeof(buf), &n);
+  return n;
+}
+
+static uint64_t randomLatency(uint32_t latency) {
+  return latency ? (uint64_t)(rand() % (latency + 1)) : 0;
+}
+
+// Replay of v, stored in data, through MacroPlayer with interrupts
+// 0..latency after their alarm. False if an event is lost, repeated, out
+// of order, or an alarm is not after the interrupt that set it.
+static bool schedule(const uint8_t* data, size_t len,
+                     const std::vector<MacroEvent>& v, uint32_t latency,
+                     uint64_t* maxErr) {
+  MacroPlayer p;
+  size_t      got = 0;
+  bool        ok  = p.begin(data, len);
+  *maxErr         = 0;
+  while (ok && !p.done()) {
+    uint64_t   counter = p.alarmUs() + randomLatency(latency);
+    size_t     before  = got;
+    MacroEvent ev;
+    while (ok && p.take(counter, &ev)) {
+      ok = got < v.size() && ev.offsetUs == v[got].offsetUs &&
+           ev.button == v[got].button && ev.type == v[got].type;
+      uint64_t err = counter > ev.offsetUs ? counter - ev.offsetUs
+                                           : ev.offsetUs - counter;
+      *maxErr      = std::max(*maxErr, err);
+      ++got;
+    }
+    ok = ok && got > before && (p.done() || p.alarmUs() > counter);
+  }
+  return ok && got == v.size();
+}
+
+// The same replay with each alarm set relative to the interrupt before
+static uint64_t scheduleRelative(const std::vector<MacroEvent>& v,
+                                 uint32_t latency) {
+  uint64_t fire = 0, maxErr = 0;
+  for (size_t i = 0; i < v.size(); ++i) {
+    uint64_t gap = i ? v[i].offsetUs - v[i - 1].offsetUs : v[i].offsetUs;
+    fire         = fire + gap + randomLatency(latency);
+    maxErr       = std::max(maxErr, fire - v[i].offsetUs);
+  }
+  return maxErr;
+}
+
+static double decodeNsPerEvent(void) {
+  std::vector<MacroEvent> v = randomRecording(400);
+  uint8_t                 buf[MACRO_MAX_BYTES];
+  size_t                  n;
+  size_t                  len = encode(v, buf, sizeof(buf), &n);
+
+  struct timespec a, b;
+  uint64_t        sum = 0, events = 0;
+  clock_gettime(CLOCK_MONOTONIC, &a);
+  for (int rep = 0; rep < 20000; ++rep) {
+    MacroReader r;
+    MacroEvent  ev;
+    r.begin(buf, len);
+    while (r.next(&ev)) {
+      sum += ev.offsetUs;
+      ++events;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &b);
+  double ns = (b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec);
+  if (sum == 1) printf("\n");  // keep the loop
+  return events ? ns / events : 0;
+}
+
+int main(int argc, char** argv) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--sequences") && i + 1 < argc) {
+      opt.sequences = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--isr-latency-us") && i + 1 < argc) {
+      opt.isrLatencyUs = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      opt.seed = (unsigned)atoi(argv[++i]);
+    } else {
+      fprintf(stderr,
+              "usage: %s [--sequences N] [--isr-latency-us US] [--seed N]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  srand(opt.seed);
+  bool ok = true;
+
+  double bytesPerEvent;
+  bool   trip = roundTrip(opt, &bytesPerEvent);
+  ok          = ok && trip;
+  printf("{\"check\":\"round_trip\",\"sequences\":%d,\"bytes_per_event\":%.2f,"
+         "\"slot_bytes\":%d,\"stinger_events_per_slot\":%zu,\"ok\":%s}\n",
+         opt.sequences, bytesPerEvent, MACRO_MAX_BYTES, stingerCapacity(),
+         trip ? "true" : "false");
+
+  // 16th notes with chords (same time) and near-chords (10 us apart),
+  // 1000 events: several slots' worth, in a buffer of its own
+  std::vector<MacroEvent> seq;
+  uint32_t                t = 0;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    if (i) t += i % 8 == 1 ? 0 : i % 8 == 5 ? 10 : 62500;
+    seq.push_back({t, (uint8_t)(i % 4), (uint8_t)(i % 2)});
+  }
+  std::vector<uint8_t> data(8192);
+  size_t               n;
+  size_t               len = encode(seq, data.data(), data.size(), &n);
+  uint64_t             absMax = 0;
+  bool                 sched =
+      n == seq.size() &&
+      schedule(data.data(), len, seq, opt.isrLatencyUs, &absMax) &&
+      absMax <= std::max<uint64_t>(opt.isrLatencyUs, MACRO_LEAD_US);
+  uint64_t relMax = scheduleRelative(seq, opt.isrLatencyUs);
+  ok              = ok && sched;
+  printf("{\"check\":\"schedule\",\"events\":%zu,\"isr_latency_us\":%u,"
+         "\"absolute_max_error_us\":%llu,\"relative_max_error_us\":%llu,"
+         "\"ok\":%s}\n",
+         seq.size(), opt.isrLatencyUs, (unsigned long long)absMax,
+         (unsigned long long)relMax, sched ? "true" : "false");
+
+  printf("{\"check\":\"decode\",\"ns_per_event\":%.1f}\n", decodeNsPerEvent());
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+// test/MidiClockReplay/MidiClockReplay.cpp
+//
+// Replays a MIDI clock stream through MidiClockTracker (lib_midi) and
+// reports how fast it locks, how close the tempo stays and how much jitter
+// it rejected. The stream is either a recording, one timestamped real-time
+// message per line ('#' starts a comment):
+//
+//   # t_us status
+//   1000000 FA
+//   1000312 F8
+//   1021150 F8
+//
+// or generated: --synth BPM[:JITTER_US[:DROP_PERMILLE]] for 60 s at a fixed
+// tempo with uniform timestamp jitter and lost ticks, optionally ramping to
+// --ramp-to BPM over the second half.
+//
+// Without either, the default run replays kDefaultCases: two jittered
+// synthetic streams with lost ticks and pedal_clock_120.txt, next to this
+// file, a capture of the pedal's own clock output (see its header). Run it
+// from the project directory:
+//
+//   pio run -e midiclock -t exec
+//   .pio/build/midiclock/program --synth 120:1500:10 --ramp-to 126
+//   .pio/build/midiclock/program capture.txt --expect-bpm 98.5
+//
+// Prints one JSON object per beat with --verbose, then a summary per
+// stream. A stream fails if the tracker never locks, if the tempo at the
+// end is off by more than --tolerance percent (default 0.5) from the
+// expected tempo (--expect-bpm, or the synthetic tempo at the end), or if
+// it is ever off by more than --max-err percent (default 1) while locked,
+// or if it bridged less than 80% of the ticks a synthetic stream lost.
+// Exits with status 1 if any stream fails.
+
+#include "midi_clock.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+struct Msg {
+  uint32_t us;
+  uint8_t  status;
+  double   refBpm;  // synthetic streams only, 0 otherwise
+};
+
+struct Limits {
+  double expectBpm;  // 0: the synthetic tempo at the end
+  double tolerance;  // percent, at the end
+  double maxErr;     // percent, anywhere while locked
+};
+
+// The default run
+struct Case {
+  const char* name;
+  const char* path;  // recorded stream, or nullptr for a synthetic one
+  double      bpm;   // synthetic: tempo; recorded: expected tempo
+  double      rampTo;
+  uint32_t    jitterUs;
+  uint32_t    dropPermille;
+};
+
+static const Case kDefaultCases[] = {
+    {"synth_120_ramp_126", nullptr, 120, 126, 1500, 10},
+    {"synth_90_rough", nullptr, 90, 90, 3000, 50},
+    {"pedal_clock_120", "test/MidiClockReplay/pedal_clock_120.txt", 120, 0,
+     0, 0},
+};
+
+/* Deterministic PRNG (xorshift32) */
+static uint32_t rng = 1;
+
+static uint32_t rnd(uint32_t lo, uint32_t hi) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return lo + rng % (hi - lo + 1);
+}
+
+static bool loadStream(const char* path, std::vector<Msg>* out) {
+  FILE* f = fopen(path, "r");
+  if (!f) return false;
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long us;
+    unsigned      status = 0xF8;
+    if (line[0] == '#') continue;
+    int n = sscanf(line, "%lu %x", &us, &status);
+    if (n >= 1) out->push_back({(uint32_t)us, (uint8_t)status, 0});
+  }
+  fclose(f);
+  return true;
+}
+
+// 60 s of clock: steady for the first half, then a linear ramp
+static uint32_t synthStream(double bpm, double rampTo, uint32_t jitterUs,
+                            uint32_t dropPermille, std::vector<Msg>* out) {
+  const double durationUs = 60e6;
+  double       t          = 1e6;
+  uint32_t     dropped    = 0;
+  out->push_back({(uint32_t)t, MIDI_CLOCK_START, bpm});
+  while (t < durationUs) {
+    double progress = (t - durationUs / 2) / (durationUs / 2);
+    double tempo    = progress > 0 ? bpm + (rampTo - bpm) * progress : bpm;
+    t += 60e6 / (tempo * MIDI_CLOCK_PPQN);
+    if (rnd(0, 999) < dropPermille) {
+      ++dropped;
+      continue;
+    }
+    int32_t noise = jitterUs ? (int32_t)rnd(0, 2 * jitterUs) - jitterUs : 0;
+    out->push_back({(uint32_t)(t + noise), MIDI_CLOCK_TICK, tempo});
+  }
+  return dropped;
+}
+
+// Replays stream, which lost dropped ticks (synthetic only), through a new
+// tracker; prints the summary of name
+static bool replay(const char* name, const std::vector<Msg>& stream,
+                   uint32_t dropped, const Limits& lim, bool verbose) {
+  double expectBpm = lim.expectBpm > 0 ? lim.expectBpm : stream.back().refBpm;
+
+  MidiClockTracker tracker;
+  MidiClockStatus  st;
+  int64_t          lockUs   = -1;
+  double           maxErr   = 0;  // percent, locked
+  uint32_t         lastBeat = 0;
+  for (const Msg& m : stream) {
+    tracker.update(m.us);
+    tracker.feed(m.status, m.us);
+    tracker.status(&st);
+    if (st.locked && lockUs < 0) lockUs = m.us - stream.front().us;
+    double ref = m.refBpm > 0 ? m.refBpm : expectBpm;
+    if (st.locked && ref > 0) {
+      double err = fabs(st.bpmX100 / 100.0 - ref) * 100 / ref;
+      if (err > maxErr) maxErr = err;
+    }
+    if (verbose && st.ticks / MIDI_CLOCK_PPQN != lastBeat) {
+      lastBeat = st.ticks / MIDI_CLOCK_PPQN;
+      printf("{\"beat\":%lu,\"t_ms\":%.3f,\"locked\":%s,\"bpm\":%.2f,"
+             "\"jitter_us\":%lu}\n",
+             (unsigned long)lastBeat, m.us / 1000.0,
+             st.locked ? "true" : "false", st.bpmX100 / 100.0,
+             (unsigned long)st.jitterUs);
+    }
+  }
+
+  double bpm    = st.bpmX100 / 100.0;
+  double endErr = expectBpm > 0 ? fabs(bpm - expectBpm) * 100 / expectBpm : 0;
+  // lost ticks must be bridged, bar some before the lock or next to a
+  // rejected one
+  bool ok = lockUs >= 0 && endErr <= lim.tolerance && maxErr <= lim.maxErr &&
+            st.bridged * 5 >= dropped * 4;
+
+  printf("{\"summary\":\"midi_clock\",\"stream\":\"%s\",\"messages\":%zu,"
+         "\"locked\":%s,\"lock_ms\":%.3f,\"bpm\":%.2f,\"expect_bpm\":%.2f,"
+         "\"end_err_pct\":%.3f,\"max_err_pct\":%.3f,\"jitter_us\":%lu,"
+         "\"jitter_max_us\":%lu,\"rejected\":%lu,\"dropped\":%lu,"
+         "\"bridged\":%lu,\"ok\":%s}\n",
+         name, stream.size(), st.locked ? "true" : "false",
+         lockUs < 0 ? -1.0 : lockUs / 1000.0, bpm, expectBpm, endErr, maxErr,
+         (unsigned long)st.jitterUs, (unsigned long)st.jitterMaxUs,
+         (unsigned long)st.rejected, (unsigned long)dropped,
+         (unsigned long)st.bridged,
+         ok ? "true" : "false");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  const char* path     = nullptr;
+  double      synthBpm = 0;
+  double      rampTo   = 0;
+  uint32_t    jitterUs = 0;
+  uint32_t    drop     = 0;
+  Limits      lim      = {0, 0.5, 1.0};
+  bool        verbose  = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--synth") && i + 1 < argc) {
+      unsigned j = 0, d = 0;
+      sscanf(argv[++i], "%lf:%u:%u", &synthBpm, &j, &d);
+      jitterUs = j;
+      drop     = d;
+    } else if (!strcmp(argv[i], "--ramp-to") && i + 1 < argc) {
+      rampTo = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--expect-bpm") && i + 1 < argc) {
+      lim.expectBpm = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+      lim.tolerance = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--max-err") && i + 1 < argc) {
+      lim.maxErr = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      rng = (uint32_t)strtoul(argv[++i], nullptr, 0);
+      if (!rng) rng = 1;
+    } else if (!strcmp(argv[i], "--verbose")) {
+      verbose = true;
+    } else if (argv[i][0] != '-') {
+      path = argv[i];
+    } else {
+      fprintf(stderr,
+              "usage: %s [STREAM | --synth BPM[:JITTER_US[:DROP_PERMILLE]]]\n"
+              "  [--ramp-to BPM] [--expect-bpm BPM] [--tolerance PCT]\n"
+              "  [--max-err PCT] [--seed N] [--verbose]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  std::vector<Case> cases;
+  if (path) {
+    cases.push_back({path, path, lim.expectBpm, 0, 0, 0});
+  } else if (synthBpm > 0) {
+    cases.push_back({"synth", nullptr, synthBpm,
+                     rampTo > 0 ? rampTo : synthBpm, jitterUs, drop});
+  } else {
+    cases.assign(kDefaultCases, kDefaultCases + sizeof(kDefaultCases) /
+                                                    sizeof(kDefaultCases[0]));
+  }
+
+  bool ok = true;
+  for (const Case& c : cases) {
+    std::vector<Msg> stream;
+    uint32_t         dropped = 0;
+    Limits           l       = lim;
+    if (c.path) {
+      if (!loadStream(c.path, &stream)) {
+        fprintf(stderr, "cannot read %s\n", c.path);
+        return 2;
+      }
+      l.expectBpm = c.bpm;
+    } else {
+      dropped =
+          synthStream(c.bpm, c.rampTo, c.jitterUs, c.dropPermille, &stream);
+    }
+    if (stream.empty()) {
+      fprintf(stderr, "empty stream %s\n", c.name);
+      return 2;
+    }
+    ok &= replay(c.name, stream, dropped, l, verbose);
+  }
+  return ok ? 0 : 1;
+}
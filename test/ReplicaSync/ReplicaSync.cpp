@@ -0,0 +1,470 @@
+// test/ReplicaSync/ReplicaSync.cpp
+//
+// Runs several pedals' replication nodes (ReplicaNode, lib_replica) as
+// separate processes on real UDP multicast over the loopback interface,
+// changes their state and presses their buttons at random, and reports
+// how fast and how completely the others see it, and the bandwidth.
+//
+// Receivers drop datagrams (--loss-permille) and hold some back for up to
+// --reorder-ms (--reorder-permille), so they arrive after later ones. The
+// last second of the run has no changes, so everything should converge.
+//
+//   pio run -e replica -t exec
+//   .pio/build/replica/program --pedals 3 --loss-permille 100
+//   .pio/build/replica/program --reorder-permille 200 --reorder-ms 30
+//
+// Convergence of a change is the time until a pedal's view of the other
+// one shows that state; changes overwritten before that are "superseded".
+// Prints the summary as one JSON object (with --verbose, each pedal's
+// counters too). Exits with status 1 if a final state never arrives, a
+// change takes longer than --max-converge-ms (default 2 snapshot periods)
+// or fewer than --min-delivery-permille (default 990) of the button events
+// arrive.
+
+#include "replica_node.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+static const int64_t  kStaggerUs = 100000;  // between pedal starts
+static const int64_t  kQuietUs   = 1000000;  // no changes at the end
+static const uint32_t kNodeBase  = 0x5eda0000;
+static const int      kUdpIpLen  = 28;  // per datagram on the wire
+
+// ButtonEventType (lib_button)
+static const uint8_t kPressed  = 0;
+static const uint8_t kReleased = 1;
+
+struct Options {
+  int     pedals          = 2;
+  double  seconds         = 10;
+  double  rate            = 10;  // changes and presses per second and pedal
+  int     lossPermille    = 0;
+  int     reorderPermille = 0;
+  int     reorderMs       = 20;
+  int64_t maxConvergeMs   = 2 * REPLICA_SNAPSHOT_MS;
+  int     minDelivery     = 990;
+  bool    verbose         = false;
+};
+
+enum : int32_t { REC_LOCAL, REC_VIEW, REC_PRESS, REC_EVENT, REC_END };
+
+// One report of a pedal, written to the parent's pipe (atomic: < PIPE_BUF)
+struct Record {
+  int32_t  kind;
+  int32_t  pedal;
+  int32_t  other;  // source pedal of a view or event
+  uint32_t value;  // state hash, event seq
+  int64_t  us;
+  ReplicaStats stats;  // REC_END
+};
+
+static int64_t realUs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t stateHash(const ReplicaState& st) {
+  uint8_t b[2 + REPLICA_PLAYERS * 4];
+  b[0] = st.buttonsDown;
+  b[1] = st.scene;
+  for (int i = 0; i < REPLICA_PLAYERS; ++i) {
+    b[2 + i * 4] = st.players[i].state;
+    b[3 + i * 4] = (uint8_t)(st.players[i].track >> 8);
+    b[4 + i * 4] = (uint8_t)st.players[i].track;
+    b[5 + i * 4] = st.players[i].volume;
+  }
+  uint32_t h = 2166136261u;  // FNV-1a
+  for (uint8_t x : b) h = (h ^ x) * 16777619u;
+  return h;
+}
+
+static int openSocket(void) {
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0) return -1;
+  int one = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(REPLICA_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  struct ip_mreq group;
+  group.imr_multiaddr.s_addr = htonl(REPLICA_MULTICAST_ADDR);
+  group.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+  struct in_addr ifAddr;
+  ifAddr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group,
+                 sizeof(group)) != 0 ||
+      setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &ifAddr,
+                 sizeof(ifAddr)) != 0) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+static void sendPacket(int sock, const ReplicaPacket& pkt) {
+  struct sockaddr_in to;
+  memset(&to, 0, sizeof(to));
+  to.sin_family      = AF_INET;
+  to.sin_port        = htons(REPLICA_PORT);
+  to.sin_addr.s_addr = htonl(REPLICA_MULTICAST_ADDR);
+  sendto(sock, pkt.data, pkt.len, 0, (struct sockaddr*)&to, sizeof(to));
+}
+
+static bool report(int out, int32_t kind, int32_t pedal, int32_t other,
+                   uint32_t value) {
+  Record r;
+  memset(&r, 0, sizeof(r));
+  r.kind  = kind;
+  r.pedal = pedal;
+  r.other = other;
+  r.value = value;
+  r.us    = realUs();
+  return write(out, &r, sizeof(r)) == (ssize_t)sizeof(r);
+}
+
+// A random change of the local state
+static void randomChange(ReplicaState* st) {
+  ReplicaPlayer& pl = st->players[rand() % REPLICA_PLAYERS];
+  switch (rand() % 4) {
+    case 0:
+      st->scene = (uint8_t)(rand() % 4);
+      break;
+    case 1:
+      pl.state = (uint8_t)(rand() % 4);
+      break;
+    case 2:
+      pl.track = (uint16_t)(1 + rand() % 200);
+      break;
+    default:
+      pl.volume = (uint8_t)(rand() % 31);
+      break;
+  }
+}
+
+struct Held {
+  int64_t       dueUs;
+  ReplicaPacket pkt;
+};
+
+// Child process: one pedal until the end of the run
+static int runPedal(int index, const Options& opt, int64_t epochUs, int out) {
+  srand((unsigned)(getpid() * 7919 + index));
+  while (realUs() < epochUs + index * kStaggerUs) usleep(1000);
+
+  int sock = openSocket();
+  if (sock < 0) {
+    perror("socket");
+    return 2;
+  }
+  ReplicaNode node;
+  node.begin(kNodeBase + (uint32_t)index, realUs());
+
+  ReplicaState local;
+  memset(&local, 0, sizeof(local));
+  node.setLocal(local);
+  report(out, REC_LOCAL, index, index, stateHash(local));
+
+  int64_t  firstUs = epochUs + opt.pedals * kStaggerUs + 300000;
+  int64_t  endUs   = epochUs + (int64_t)(opt.seconds * 1e6);
+  int64_t  nextUs  = firstUs;
+  uint32_t views[REPLICA_MAX_PEERS + 2];
+  bool     seen[REPLICA_MAX_PEERS + 2] = {};
+  int8_t   held = -1;  // button pressed, released at the next action
+  std::vector<Held> later;
+
+  while (realUs() < endUs) {
+    struct pollfd fd = {sock, POLLIN, 0};
+    ::poll(&fd, 1, 1);
+    int64_t now = realUs();
+
+    // receive, dropping and holding back some datagrams
+    ReplicaPacket pkt;
+    ssize_t       n;
+    while ((n = recv(sock, pkt.data, sizeof(pkt.data), MSG_DONTWAIT)) > 0) {
+      pkt.len = (uint16_t)n;
+      if (rand() % 1000 < opt.lossPermille) continue;
+      if (rand() % 1000 < opt.reorderPermille) {
+        later.push_back({now + 1000 * (1 + rand() % opt.reorderMs), pkt});
+        continue;
+      }
+      node.receive(pkt.data, pkt.len, now);
+    }
+    for (size_t i = 0; i < later.size();) {
+      if (later[i].dueUs > now) {
+        ++i;
+        continue;
+      }
+      node.receive(later[i].pkt.data, later[i].pkt.len, now);
+      later.erase(later.begin() + i);
+    }
+
+    // act: a button press (released at the next action) or a change
+    if (now >= nextUs && now < endUs - kQuietUs) {
+      if (held >= 0) {
+        local.buttonsDown &= (uint8_t)~(1 << held);
+        node.noteEvent((uint8_t)held, kReleased, now);
+        held = -1;
+      } else if (rand() % 3 == 0) {
+        held = (int8_t)(rand() % 4);
+        local.buttonsDown |= (uint8_t)(1 << held);
+        node.noteEvent((uint8_t)held, kPressed, now);
+        report(out, REC_PRESS, index, index, 0);
+      } else {
+        randomChange(&local);
+      }
+      node.setLocal(local);
+      report(out, REC_LOCAL, index, index, stateHash(local));
+      nextUs = now + (int64_t)(1e6 / opt.rate * (0.5 + rand() % 1000 / 1e3));
+    }
+
+    while (node.poll(now, &pkt)) sendPacket(sock, pkt);
+
+    ReplicaEvent ev;
+    while (node.pollEvent(&ev)) {
+      if (ev.type == kPressed) {
+        report(out, REC_EVENT, index, (int32_t)(ev.node - kNodeBase), ev.seq);
+      }
+    }
+    ReplicaPeerInfo info;
+    for (uint8_t i = 0; node.peer(i, &info); ++i) {
+      int32_t src = (int32_t)(info.node - kNodeBase);
+      if (src < 0 || src >= REPLICA_MAX_PEERS + 2) continue;
+      uint32_t h = stateHash(info.state);
+      if (seen[src] && views[src] == h) continue;
+      seen[src]  = true;
+      views[src] = h;
+      report(out, REC_VIEW, index, src, h);
+    }
+  }
+
+  Record end;
+  memset(&end, 0, sizeof(end));
+  end.kind  = REC_END;
+  end.pedal = index;
+  node.stats(&end.stats);
+  if (write(out, &end, sizeof(end)) != (ssize_t)sizeof(end)) return 2;
+
+  ReplicaPacket bye;
+  if (node.leave(&bye)) sendPacket(sock, bye);
+  close(sock);
+  return 0;
+}
+
+static int64_t percentile(std::vector<int64_t> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))];
+}
+
+struct Stamp {
+  int64_t  us;
+  uint32_t value;
+};
+
+int main(int argc, char** argv) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--pedals") && i + 1 < argc) {
+      opt.pedals = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      opt.seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+      opt.rate = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--loss-permille") && i + 1 < argc) {
+      opt.lossPermille = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--reorder-permille") && i + 1 < argc) {
+      opt.reorderPermille = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--reorder-ms") && i + 1 < argc) {
+      opt.reorderMs = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--max-converge-ms") && i + 1 < argc) {
+      opt.maxConvergeMs = atoll(argv[++i]);
+    } else if (!strcmp(argv[i], "--min-delivery-permille") && i + 1 < argc) {
+      opt.minDelivery = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--verbose")) {
+      opt.verbose = true;
+    } else {
+      fprintf(stderr,
+              "usage: %s [--pedals N] [--seconds S] [--rate HZ]\n"
+              "  [--loss-permille N] [--reorder-permille N] [--reorder-ms MS]\n"
+              "  [--max-converge-ms MS] [--min-delivery-permille N]"
+              " [--verbose]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  if (opt.pedals < 2 || opt.pedals > REPLICA_MAX_PEERS + 1 ||
+      opt.reorderMs < 1 || opt.rate <= 0 ||
+      opt.seconds * 1e6 < opt.pedals * kStaggerUs + 300000 + kQuietUs) {
+    fprintf(stderr, "--pedals: 2..%d, --seconds: long enough\n",
+            REPLICA_MAX_PEERS + 1);
+    return 2;
+  }
+
+  int pipeFd[2];
+  if (pipe(pipeFd) != 0) return 2;
+  int64_t epochUs = realUs() + 200000;
+  for (int i = 0; i < opt.pedals; ++i) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(pipeFd[0]);
+      _exit(runPedal(i, opt, epochUs, pipeFd[1]));
+    }
+    if (pid < 0) return 2;
+  }
+  close(pipeFd[1]);
+
+  std::vector<std::vector<Stamp>> locals(opt.pedals);
+  std::map<std::pair<int, int>, std::vector<Stamp>> views;  // observer, src
+  std::vector<std::vector<Stamp>> presses(opt.pedals);
+  std::map<std::pair<int, int>, std::map<uint32_t, int64_t>> events;
+  std::vector<ReplicaStats> stats(opt.pedals);
+  Record r;
+  while (read(pipeFd[0], &r, sizeof(r)) == (ssize_t)sizeof(r)) {
+    if (r.pedal < 0 || r.pedal >= opt.pedals) continue;
+    switch (r.kind) {
+      case REC_LOCAL:
+        locals[r.pedal].push_back({r.us, r.value});
+        break;
+      case REC_VIEW:
+        views[{r.pedal, r.other}].push_back({r.us, r.value});
+        break;
+      case REC_PRESS:
+        presses[r.pedal].push_back({r.us, 0});
+        break;
+      case REC_EVENT:
+        events[{r.pedal, r.other}][r.value] = r.us;
+        break;
+      default:
+        stats[r.pedal] = r.stats;
+        break;
+    }
+  }
+  int failed = 0;
+  for (int i = 0; i < opt.pedals; ++i) {
+    int status = 0;
+    wait(&status);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = 1;
+  }
+  if (failed) {
+    fprintf(stderr, "a pedal failed\n");
+    return 2;
+  }
+
+  // State: each change of each pedal, seen by each other pedal
+  int64_t              firstUs = epochUs + opt.pedals * kStaggerUs + 300000;
+  std::vector<int64_t> converge;
+  uint32_t             superseded = 0, unconverged = 0;
+  for (int src = 0; src < opt.pedals; ++src) {
+    const std::vector<Stamp>& ch = locals[src];
+    for (int obs = 0; obs < opt.pedals; ++obs) {
+      if (obs == src) continue;
+      const std::vector<Stamp>& v = views[{obs, src}];
+      for (size_t i = 0; i < ch.size(); ++i) {
+        if (ch[i].us < firstUs && i + 1 < ch.size()) continue;
+        bool    last  = i + 1 == ch.size();
+        int64_t until = last ? INT64_MAX : ch[i + 1].us;
+        // what the observer showed at the change, then the first match
+        int64_t at    = -1;
+        uint32_t shown = 0;
+        bool     any   = false;
+        for (const Stamp& s : v) {
+          if (s.us <= ch[i].us) {
+            shown = s.value;
+            any   = true;
+            continue;
+          }
+          if (s.value == ch[i].value) {
+            at = s.us;
+            break;
+          }
+        }
+        if (any && shown == ch[i].value) at = ch[i].us;
+        if (at >= 0 && at < until) {
+          converge.push_back(at - ch[i].us);
+        } else if (last) {
+          ++unconverged;
+        } else {
+          ++superseded;
+        }
+      }
+    }
+  }
+
+  // Button presses: event seq n of a pedal is its n-th event; presses are
+  // the odd ones (each press is followed by its release)
+  std::vector<int64_t> eventLatency;
+  uint32_t             pressCount = 0, delivered = 0;
+  for (int src = 0; src < opt.pedals; ++src) {
+    for (int obs = 0; obs < opt.pedals; ++obs) {
+      if (obs == src) continue;
+      const std::map<uint32_t, int64_t>& got = events[{obs, src}];
+      for (size_t i = 0; i < presses[src].size(); ++i) {
+        ++pressCount;
+        auto it = got.find((uint32_t)(2 * i + 1));
+        if (it == got.end()) continue;
+        ++delivered;
+        eventLatency.push_back(it->second - presses[src][i].us);
+      }
+    }
+  }
+
+  uint64_t txBytes = 0, txPackets = 0, lost = 0, stale = 0, syncs = 0;
+  for (int i = 0; i < opt.pedals; ++i) {
+    const ReplicaStats& st = stats[i];
+    txBytes += st.txBytes;
+    txPackets += st.txPackets;
+    lost += st.lost;
+    stale += st.stale;
+    syncs += st.syncs;
+    if (opt.verbose) {
+      printf("{\"pedal\":%d,\"peers\":%u,\"tx_packets\":%u,\"tx_bytes\":%u,"
+             "\"rx_packets\":%u,\"lost\":%u,\"stale\":%u,\"syncs\":%u,"
+             "\"events\":%u,\"events_lost\":%u,\"events_old\":%u}\n",
+             i, st.peers, st.txPackets, st.txBytes, st.rxPackets, st.lost,
+             st.stale, st.syncs, st.events, st.eventsLost, st.eventsOld);
+    }
+  }
+  double perPedalS = opt.seconds * opt.pedals;
+  int64_t maxUs    = converge.empty() ? 0 : percentile(converge, 1.0);
+  uint32_t deliveryPermille =
+      pressCount ? (uint32_t)(1000ULL * delivered / pressCount) : 1000;
+  bool ok = unconverged == 0 && maxUs <= opt.maxConvergeMs * 1000 &&
+            (int)deliveryPermille >= opt.minDelivery;
+  printf("{\"summary\":\"replica_sync\",\"pedals\":%d,\"seconds\":%.0f,"
+         "\"loss_permille\":%d,\"reorder_permille\":%d,\"changes\":%zu,"
+         "\"converge_p50_ms\":%.1f,\"converge_p95_ms\":%.1f,"
+         "\"converge_max_ms\":%.1f,\"superseded\":%u,\"unconverged\":%u,"
+         "\"presses\":%u,\"delivered\":%u,\"press_p50_ms\":%.1f,"
+         "\"press_max_ms\":%.1f,\"bytes_per_s\":%.0f,"
+         "\"wire_bytes_per_s\":%.0f,\"packets_per_s\":%.1f,\"lost\":%llu,"
+         "\"stale\":%llu,\"syncs\":%llu,\"ok\":%s}\n",
+         opt.pedals, opt.seconds, opt.lossPermille, opt.reorderPermille,
+         converge.size() + superseded + unconverged,
+         percentile(converge, 0.5) / 1e3, percentile(converge, 0.95) / 1e3,
+         maxUs / 1e3, superseded, unconverged, pressCount, delivered,
+         percentile(eventLatency, 0.5) / 1e3,
+         percentile(eventLatency, 1.0) / 1e3, txBytes / perPedalS,
+         (txBytes + (double)txPackets * kUdpIpLen) / perPedalS,
+         txPackets / perPedalS, (unsigned long long)lost,
+         (unsigned long long)stale, (unsigned long long)syncs,
+         ok ? "true" : "false");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,379 @@
+// test/ScriptVm/ScriptVm.cpp
+//
+// Checks and times footswitch scripts (script_vm, lib_script) on the host,
+// against a model of the pedal's players, buttons and LEDs.
+//
+//   pio run -e script -t exec
+//   .pio/build/script/program --iters 500000 --mutations 20000
+//
+// - Behaviour: the fade example of script_vm.hpp, driven by a long press
+//   of S2 and 10 ms polls, must fade player 1 to 0, stop it, restore its
+//   volume and start track 7 on player 2.
+// - Compile errors: bad scripts are rejected with the right line.
+// - Limits: an endless loop stops at SCRIPT_BUDGET instructions, a
+//   division by zero stops its handler; both are counted.
+// - Damaged images: random byte changes and truncations of a compiled
+//   script either fail to load or run within the budget (build with
+//   -fsanitize=address to check the accesses too).
+// - Cost: per handler of a few typical scripts, image bytes, instructions
+//   and microseconds per event.
+//
+// Prints one JSON object per check. Exits with status 1 if a check fails.
+
+#include "script_vm.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+struct Options {
+  uint32_t iters     = 200000;
+  uint32_t mutations = 5000;
+  unsigned seed      = 1;
+};
+
+/* The pedal as scripts see it */
+struct Model {
+  int32_t volume[2];
+  int32_t lowest[2];  // lowest volume set
+  bool    playing[2];
+  int32_t track[2];
+  bool    down[4];
+  int32_t led[4];
+  int     actions;
+  int     scene;
+};
+
+static Model model;
+
+static void resetModel() {
+  memset(&model, 0, sizeof(model));
+  model.volume[0] = model.volume[1] = 20;
+  model.lowest[0] = model.lowest[1] = 30;
+  model.playing[0]                  = true;
+  model.track[0]                    = 3;
+  for (int i = 0; i < 4; ++i) model.led[i] = -1;
+}
+
+static int32_t modelCall(uint8_t fn, const int32_t* args, void* ctx) {
+  (void)ctx;
+  int p = args[0] - 1;
+  if (fn <= SCRIPT_FN_TRACK && (p < 0 || p > 1)) return 0;
+  switch (fn) {
+    case SCRIPT_FN_PLAY:
+      model.playing[p] = true;
+      model.track[p]   = args[1];
+      return 1;
+    case SCRIPT_FN_TOGGLE:
+      model.playing[p] = !model.playing[p];
+      return 1;
+    case SCRIPT_FN_STOP:
+      model.playing[p] = false;
+      return 1;
+    case SCRIPT_FN_SETVOLUME:
+      if (args[1] < 0 || args[1] > 30) return 0;
+      model.volume[p] = args[1];
+      if (args[1] < model.lowest[p]) model.lowest[p] = args[1];
+      return 1;
+    case SCRIPT_FN_VOLUME:
+      return model.volume[p];
+    case SCRIPT_FN_PLAYING:
+      return model.playing[p];
+    case SCRIPT_FN_TRACK:
+      return model.track[p];
+    case SCRIPT_FN_DOWN:
+      return args[0] >= 1 && args[0] <= 4 && model.down[args[0] - 1];
+    case SCRIPT_FN_LED:
+      if (args[0] < 1 || args[0] > 4) return 0;
+      model.led[args[0] - 1] = args[1];
+      return 1;
+    case SCRIPT_FN_ACTION:
+      ++model.actions;
+      return 1;
+    case SCRIPT_FN_SCENE:
+      model.scene = args[0];
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static uint8_t buttonEvent(int button, int type) {
+  return (uint8_t)((button - 1) * 4 + type);
+}
+
+// The example of script_vm.hpp
+static const char* kFade =
+    "# S2 long press: fade player 1 out, then start track 7 on player 2\n"
+    "on long S2\n"
+    "  vol = volume(1)\n"
+    "  fade = vol\n"
+    "  timer(0, 50)\n"
+    "end\n"
+    "\n"
+    "on timer 0\n"
+    "  fade = fade - 1\n"
+    "  setvolume(1, fade)\n"
+    "  if fade > 0\n"
+    "    timer(0, 50)\n"
+    "  else\n"
+    "    stop(1)\n"
+    "    setvolume(1, vol)\n"
+    "    play(2, 7)\n"
+    "  end\n"
+    "end\n";
+
+static bool load(ScriptVm* vm, const char* src, uint8_t* image,
+                 size_t* len) {
+  ScriptCompileError err;
+  *len = scriptCompile(src, strlen(src), image, SCRIPT_MAX_IMAGE, &err);
+  if (!*len) {
+    fprintf(stderr, "compile error line %u: %s\n", err.line, err.msg);
+    return false;
+  }
+  return vm->load(image, *len, modelCall, nullptr);
+}
+
+static bool checkFade() {
+  uint8_t  image[SCRIPT_MAX_IMAGE];
+  size_t   len;
+  ScriptVm vm;
+  resetModel();
+  if (!load(&vm, kFade, image, &len)) return false;
+
+  uint32_t now = 1000;
+  vm.run(buttonEvent(2, 2), now);
+  while (vm.timersArmed() && now < 10000) {
+    now += 10;
+    vm.poll(now);
+  }
+  ScriptVmStats st;
+  vm.stats(&st);
+  bool ok = model.lowest[0] == 0 && !model.playing[0] &&
+            model.volume[0] == 20 && model.playing[1] && model.track[1] == 7 &&
+            now == 2000 && st.errors == 0 && st.overBudget == 0;
+  printf("{\"check\":\"fade\",\"image_bytes\":%zu,\"handlers\":%u,"
+         "\"fade_ms\":%u,\"events\":%lu,\"ok\":%s}\n",
+         len, vm.handlerCount(), now - 1000, (unsigned long)st.events,
+         ok ? "true" : "false");
+  return ok;
+}
+
+struct BadScript {
+  const char* src;
+  uint16_t    line;
+  const char* msg;
+};
+
+static bool checkErrors() {
+  static const BadScript kBad[] = {
+      {"on press S5\nend\n", 1, "button"},
+      {"on press S1\n  toggle(1)\n", 3, "'end'"},
+      {"on press S1\n  x = y + 1\nend\n", 2, "before it is set"},
+      {"on press S1\n  play(1)\nend\n", 2, "argument count"},
+      {"on press S1\n  fly(1)\nend\n", 2, "unknown function"},
+      {"on press S1\nend\non press 1\nend\n", 3, "twice"},
+      {"on press S1\n  x = (1 + 2\nend\n", 2, "')'"},
+      {"on press S1\n  x = 99999999999\nend\n", 2, "too large"},
+      {"on press S1\n  else\nend\n", 2, "without 'if'"},
+      {"on timer 7\nend\n", 1, "timer"},
+      {"on press S1\n  x = 1 $ 2\nend\n", 2, "character"},
+      {"on press S1\n  red = 1\nend\n", 2, "reserved"},
+      {"on press S1\n  toggle(1)\non press S2\nend\n", 3, "'end'"},
+      {"on press S1\n  x = ((((((((((1))))))))))\nend\n", 2, "too deep"},
+      {"on press S1\n  x = 1+(2+(3+(4+(5+(6+(7+(8+(9+(1+(2+(3+(4+(5+(6+"
+       "(7+(8+1))))))))))))))))\nend\n",
+       2, "too"},
+  };
+  bool ok     = true;
+  int  passed = 0;
+  for (const BadScript& b : kBad) {
+    uint8_t            image[SCRIPT_MAX_IMAGE];
+    ScriptCompileError err;
+
+    size_t n = scriptCompile(b.src, strlen(b.src), image, sizeof(image), &err);
+    if (n == 0 && err.line == b.line && strstr(err.msg, b.msg)) {
+      ++passed;
+      continue;
+    }
+    fprintf(stderr, "expected line %u '%s', got %zu bytes, line %u '%s'\n",
+            b.line, b.msg, n, err.line, err.msg);
+    ok = false;
+  }
+  printf("{\"check\":\"compile_errors\",\"cases\":%zu,\"passed\":%d,"
+         "\"ok\":%s}\n",
+         sizeof(kBad) / sizeof(kBad[0]), passed, ok ? "true" : "false");
+  return ok;
+}
+
+static bool checkLimits() {
+  const char* src =
+      "on press 1\n"
+      "  x = 0\n"
+      "  while 1\n"
+      "    x = x + 1\n"
+      "  end\n"
+      "end\n"
+      "on press 2\n"
+      "  d = 0\n"
+      "  led(2, red / d)\n"
+      "end\n"
+      "on press 3\n"
+      "  led(3, blue)\n"
+      "end\n";
+  uint8_t  image[SCRIPT_MAX_IMAGE];
+  size_t   len;
+  ScriptVm vm;
+  resetModel();
+  if (!load(&vm, src, image, &len)) return false;
+
+  vm.run(buttonEvent(1, 0), 0);
+  vm.run(buttonEvent(2, 0), 0);
+  vm.run(buttonEvent(3, 0), 0);
+  bool          none = !vm.run(buttonEvent(4, 0), 0);
+  ScriptVmStats st;
+  vm.stats(&st);
+  bool ok = none && st.events == 3 && st.overBudget == 1 && st.errors == 1 &&
+            st.stepsMax == SCRIPT_BUDGET && model.led[1] == -1 &&
+            model.led[2] == 0x0000FF;
+  printf("{\"check\":\"limits\",\"budget\":%d,\"steps_max\":%u,"
+         "\"over_budget\":%lu,\"errors\":%lu,\"ok\":%s}\n",
+         SCRIPT_BUDGET, st.stepsMax, (unsigned long)st.overBudget,
+         (unsigned long)st.errors, ok ? "true" : "false");
+  return ok;
+}
+
+static bool checkDamaged(const Options& opt) {
+  uint8_t  good[SCRIPT_MAX_IMAGE];
+  size_t   len;
+  ScriptVm vm;
+  if (!load(&vm, kFade, good, &len)) return false;
+
+  uint32_t rejected = 0, ran = 0, stopped = 0;
+  uint64_t maxSteps = 0;
+  for (uint32_t m = 0; m < opt.mutations; ++m) {
+    uint8_t image[SCRIPT_MAX_IMAGE];
+    memcpy(image, good, len);
+    size_t n = len;
+    if (m % 4 == 0) {
+      n = (size_t)rand() % len;
+    } else {
+      for (int k = 1 + rand() % 3; k > 0; --k) {
+        image[rand() % len] = (uint8_t)rand();
+      }
+    }
+    resetModel();
+    vm.resetStats();
+    if (!vm.load(image, n, modelCall, nullptr)) {
+      ++rejected;
+      continue;
+    }
+    for (uint8_t ev = 0; ev < SCRIPT_EVENT_COUNT; ++ev) vm.run(ev, 0);
+    ScriptVmStats st;
+    vm.stats(&st);
+    ++ran;
+    if (st.errors || st.overBudget) ++stopped;
+    if (st.stepsMax > maxSteps) maxSteps = st.stepsMax;
+  }
+  bool ok = maxSteps <= SCRIPT_BUDGET;
+  printf("{\"check\":\"damaged_images\",\"mutations\":%u,\"rejected\":%u,"
+         "\"ran\":%u,\"stopped\":%u,\"steps_max\":%llu,\"ok\":%s}\n",
+         opt.mutations, rejected, ran, stopped, (unsigned long long)maxSteps,
+         ok ? "true" : "false");
+  return ok;
+}
+
+struct CostCase {
+  const char* name;
+  const char* src;
+  uint8_t     event;
+};
+
+static void measureCost(const Options& opt) {
+  static const CostCase kCases[] = {
+      {"toggle_and_led",
+       "on press S1\n  toggle(1)\n  led(1, green)\nend\n", buttonEvent(1, 0)},
+      {"fade_start", kFade, buttonEvent(2, 2)},
+      {"fade_step", kFade, SCRIPT_EVENT_TIMER0},
+      {"conditional_mapping",
+       "on press S3\n"
+       "  if down(4)\n"
+       "    play(2, track(2) + 1)\n"
+       "  else\n"
+       "    if playing(1) && volume(1) > 10\n"
+       "      setvolume(1, volume(1) - 5)\n"
+       "    else\n"
+       "      action(1)\n"
+       "    end\n"
+       "  end\n"
+       "end\n",
+       buttonEvent(3, 0)},
+      {"loop_16",
+       "on double S4\n"
+       "  i = 0\n"
+       "  s = 0\n"
+       "  while i < 16\n"
+       "    s = s + i * 2\n"
+       "    i = i + 1\n"
+       "  end\n"
+       "  led(4, s)\n"
+       "end\n",
+       buttonEvent(4, 3)},
+  };
+  for (const CostCase& c : kCases) {
+    uint8_t  image[SCRIPT_MAX_IMAGE];
+    size_t   len;
+    ScriptVm vm;
+    resetModel();
+    if (!load(&vm, c.src, image, &len)) continue;
+    vm.run(SCRIPT_EVENT_START, 0);
+
+    // variables set by other handlers (fade_step runs after fade_start)
+    if (c.event == SCRIPT_EVENT_TIMER0) vm.run(buttonEvent(2, 2), 0);
+    vm.resetStats();
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < opt.iters; ++i) {
+      model.volume[0] = 20;  // keep the fade going
+      vm.run(c.event, i);
+    }
+    double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    ScriptVmStats st;
+    vm.stats(&st);
+    double steps = st.events ? (double)st.steps / st.events : 0;
+    printf("{\"check\":\"cost\",\"script\":\"%s\",\"image_bytes\":%zu,"
+           "\"instructions\":%.1f,\"us_per_event\":%.3f,"
+           "\"ns_per_instruction\":%.1f}\n",
+           c.name, len, steps, ns / opt.iters / 1000,
+           steps ? ns / opt.iters / steps : 0);
+  }
+}
+
+int main(int argc, char** argv) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--iters") && i + 1 < argc) {
+      opt.iters = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--mutations") && i + 1 < argc) {
+      opt.mutations = (uint32_t)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      opt.seed = (unsigned)atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--iters N] [--mutations N] [--seed N]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  srand(opt.seed);
+
+  bool ok = checkFade();
+  ok      = checkErrors() && ok;
+  ok      = checkLimits() && ok;
+  ok      = checkDamaged(opt) && ok;
+  measureCost(opt);
+  return ok ? 0 : 1;
+}
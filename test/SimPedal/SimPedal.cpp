@@ -0,0 +1,579 @@
+// test/SimPedal/SimPedal.cpp
+//
+// Whole-pedal simulator: links the real setup()/loop() from
+// src/DaveSampleKontrol.cpp against the host shim in test/native and
+// replays a gig on a virtual clock:
+// - footswitch presses with contact bounce, 20..90 s apart
+// - two DFPlayer models on Serial1/Serial2 answering with module timings
+// - two phones polling /api/status every 2 s, a metrics scrape every 15 s
+//
+// Press latency is measured from the first contact edge to the last byte of
+// the resulting DFPlayer command arriving at the module. One JSON object
+// per line on stdout: one per press, then summaries with percentiles.
+//
+//   pio run -e sim -t exec                       # 4 h gig, seed 1
+//   .pio/build/sim/program --hours 12 --seed 7 --verbose
+//
+// Link faults (uart_fault.hpp) can be injected on both DFPlayer UARTs; the
+// run then also reports ACK latency, timeouts and recovery time per link:
+//   program --hours 1 --fault drop:20 --fault-frames --fault-dir rx
+//   for f in none drop delay duplicate corrupt; do
+//     program --hours 1 --fault $f:20 | grep '"link"'; done
+//
+// With --midi and/or --din part of the presses arrive instead as MIDI Note On
+// (notes 36..39, lib_midi): USB-MIDI packets injected where the TinyUSB
+// receive callback would run, or serial MIDI bytes on UART0 at 31250 baud
+// with running status and clock bytes in the middle of messages. Their
+// latency (from the last byte) is reported as midi_latency / din_latency.
+//
+// The firmware scales the CPU clock (lib_power); a loop() iteration is taken
+// to last longer in proportion at a lower clock, and the run reports the
+// time at each clock. --fixed-cpu runs without frequency scaling, for
+// comparing press latency.
+//
+// With --link a laptop on the binary control link (lib_control) asks for
+// STATUS every 100 ms and sends a HELLO every 2 s; the run reports frames,
+// lost sequence numbers, ACK latency and bytes per status update next to
+// the size of an /api/status response.
+//
+// --capture-clock FILE writes the MIDI real-time bytes the pedal sends on
+// the DIN UART, timed at their stop bit, in the format test/MidiClockReplay
+// reads. Only firmware built with -D MIDI_CLOCK_OUT=<bpm> sends any:
+//   PLATFORMIO_BUILD_FLAGS="-D MIDI_CLOCK_OUT=120" pio run -e sim
+//   .pio/build/sim/program --hours 0.02 --capture-clock clock.txt
+//
+// Deep sleep ends the run (see esp_deep_sleep_start() in the shim).
+
+#include "control_frame.hpp"
+#include "dfplayer_model.hpp"
+#include "lib_board.hpp"
+#include "lib_control.hpp"
+#include "lib_midi.hpp"
+#include "lib_power.hpp"
+#include "sim_hooks.h"
+#include "uart_fault.hpp"
+#include <Arduino.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+void setup();
+void loop();
+
+// Footswitch GPIOs (S1..S4) and the UART of the player each one drives
+static const uint8_t* const kButtonPins     = Board::kButtonPins;
+static const uint8_t        kButtonPorts[4] = {1, 1, 2, 2};
+
+static const uint64_t kMs = 1000;
+static const uint64_t kS  = 1000 * kMs;
+
+// Loop pacing: fine steps around events, coarse steps while idle
+static const uint64_t kFineStepUs   = 50;
+static const uint64_t kCoarseStepUs = 1 * kMs;
+static const uint64_t kFineWindowUs = 200 * kMs;
+
+// Clock the loop pacing above corresponds to
+static const uint32_t kMaxMhz = 240;
+
+// A press with no player command after this long counts as missed
+static const uint64_t kMissUs = 2 * kS;
+
+static bool verbose = false;
+static bool midi    = false;
+static bool din     = false;
+static bool link    = false;
+
+// Where a press comes from
+enum PressSource : uint8_t { SRC_SWITCH = 0, SRC_USB, SRC_DIN, SRC_COUNT };
+static const char* const kSourceNames[SRC_COUNT] = {"switch", "usb", "din"};
+
+// Serial MIDI: one byte on the wire at 31250 baud, 8N1
+static const uint64_t kDinByteUs = 320;
+
+/* Deterministic PRNG (xorshift32) */
+static uint32_t rng = 1;
+
+static uint32_t rnd(uint32_t lo, uint32_t hi) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return lo + rng % (hi - lo + 1);
+}
+
+/* Scheduled pin edges */
+struct Edge {
+  uint64_t us;
+  uint8_t  pin;
+  uint8_t  level;
+};
+
+struct Press {
+  uint8_t  button;
+  uint64_t edgeUs;
+  size_t   cmdsBefore;  // player commands logged before the press
+  uint64_t latencyUs;   // 0 while pending
+  uint8_t  cmd;
+  bool     missed;
+  uint8_t  source;  // PressSource
+};
+
+// Contact bounce on both edges: a few 0.2..1.5 ms glitches, then stable
+static void addPress(std::vector<Edge>& edges, uint8_t pin, uint64_t at) {
+  uint64_t t = at;
+  for (int i = rnd(1, 4); i > 0; --i) {
+    edges.push_back({t, pin, LOW});
+    t += rnd(200, 1500);
+    edges.push_back({t, pin, HIGH});
+    t += rnd(200, 1500);
+  }
+  edges.push_back({t, pin, LOW});
+
+  t += rnd(120, 400) * kMs;  // held
+  for (int i = rnd(0, 3); i > 0; --i) {
+    edges.push_back({t, pin, HIGH});
+    t += rnd(200, 1500);
+    edges.push_back({t, pin, LOW});
+    t += rnd(200, 1500);
+  }
+  edges.push_back({t, pin, HIGH});
+}
+
+/* MIDI real-time bytes leaving on the DIN UART (port 0), one
+ * "t_us status" line each */
+class ClockCapture : public SimUartDevice {
+ public:
+  FILE* file = nullptr;
+  void  onHostByte(uint8_t b, uint64_t us) override {
+    if (b >= 0xF8) fprintf(file, "%llu %02X\n", (unsigned long long)us, b);
+  }
+};
+
+/* HTTP clients */
+struct Client {
+  const char*    path;
+  uint64_t       periodUs;
+  uint64_t       nextUs;
+  SimHttpRequest req;
+  bool           busy;
+};
+
+static void onConsole(const char* line, uint64_t us) {
+  if (strncmp(line, "[boot]", 6) == 0) {
+    printf("{\"boot\":\"%s\",\"t_ms\":%.3f}\n", line + 7, us / 1000.0);
+  }
+  if (verbose) fprintf(stderr, "%10.3f %s\n", us / 1e6, line);
+}
+
+// --fault class[:permille]
+static bool parseFault(const char* arg, UartFaultConfig* cfg) {
+  const char* colon = strchr(arg, ':');
+  size_t      n     = colon ? (size_t)(colon - arg) : strlen(arg);
+  for (uint8_t c = 0; c < UART_FAULT_CLASS_COUNT; ++c) {
+    const char* name = uartFaultClassName(c);
+    if (strlen(name) == n && !strncmp(arg, name, n)) {
+      cfg->cls      = (UartFaultClass)c;
+      cfg->permille = colon ? (uint16_t)atoi(colon + 1) : 10;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void printLink(uint8_t uart, const UartFaultConfig& cfg) {
+  UartFaultStats st;
+  uartFault(uart).stats(&st);
+  printf("{\"link\":%u,\"fault\":\"%s\",\"permille\":%u,\"scope\":\"%s\","
+         "\"injected\":%u,\"commands\":%u,\"acks\":%u,\"ack_timeouts\":%u,"
+         "\"rx_frame_errors\":%u,\"ack_latency_avg_us\":%u,"
+         "\"ack_latency_max_us\":%u,\"recoveries\":%u,"
+         "\"recovery_max_us\":%u}\n",
+         uart, uartFaultClassName(cfg.cls), cfg.permille,
+         cfg.scope == UART_FAULT_FRAMES ? "frames" : "bytes", st.injected,
+         st.commands, st.acks, st.ackTimeouts, st.rxFrameErrors,
+         st.ackLatencyAvgUs, st.ackLatencyMaxUs, st.recoveries,
+         st.maxRecoveryUs);
+}
+
+static void printCpu() {
+  PowerDfsStats st;
+  powerGetDfsStats(&st);
+  printf("{\"summary\":\"cpu\",\"dfs\":%s", st.enabled ? "true" : "false");
+  for (uint8_t i = 0; i < POWER_FREQ_SLOTS && st.freqMhz[i]; ++i) {
+    printf(",\"ms_at_%umhz\":%u", st.freqMhz[i], st.freqMs[i]);
+  }
+  for (uint8_t i = 0; i < POWER_LOCK_COUNT; ++i) {
+    printf(",\"%s_held_ms\":%u", powerLockName((PowerLock)i),
+           st.lockHeldMs[i]);
+  }
+  printf(",\"presses_scaled\":%u,\"handling_scaled_max_us\":%u,"
+         "\"presses_max\":%u,\"handling_max_max_us\":%u}\n",
+         st.pressCount[0], st.pressMaxUs[0], st.pressCount[1],
+         st.pressMaxUs[1]);
+}
+
+static uint64_t percentile(std::vector<uint64_t> v, int pct) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  size_t i = (v.size() * pct + 99) / 100;
+  return v[i ? i - 1 : 0];
+}
+
+// failKey/failed: presses without a command, or HTTP responses other than 200
+static void printSummary(const char* name, const std::vector<uint64_t>& v,
+                         const char* failKey, unsigned failed) {
+  uint64_t max = v.empty() ? 0 : *std::max_element(v.begin(), v.end());
+  printf("{\"summary\":\"%s\",\"count\":%zu,\"%s\":%u,\"p50_us\":%llu,"
+         "\"p95_us\":%llu,\"p99_us\":%llu,\"max_us\":%llu}\n",
+         name, v.size(), failKey, failed,
+         (unsigned long long)percentile(v, 50),
+         (unsigned long long)percentile(v, 95),
+         (unsigned long long)percentile(v, 99), (unsigned long long)max);
+}
+
+/* Laptop on the control link */
+struct LinkHost {
+  uint8_t               seq            = 0;
+  int                   lastRxSeq      = -1;
+  uint32_t              frames         = 0;
+  uint32_t              bad            = 0;
+  uint32_t              lost           = 0;
+  uint32_t              bytes          = 0;
+  uint32_t              status         = 0;
+  uint32_t              buttons        = 0;
+  uint32_t              players        = 0;
+  uint32_t              infos          = 0;
+  uint32_t              naks           = 0;
+  uint64_t              firstStatusUs  = 0;
+  uint64_t              lastStatusUs   = 0;
+  uint64_t              pendingUs[256] = {};
+  std::vector<uint64_t> ackLatency;
+};
+static LinkHost linkHost;
+
+static void linkSend(uint8_t type, const uint8_t* args, size_t n,
+                     uint64_t now) {
+  uint8_t payload[CONTROL_MAX_PAYLOAD] = {type, linkHost.seq};
+  if (n) memcpy(payload + 2, args, n);
+  uint8_t frame[CONTROL_MAX_FRAME];
+  size_t  len = controlEncodeFrame(payload, n + 2, frame);
+  linkHost.pendingUs[linkHost.seq++] = now;
+  for (size_t i = 0; i < len; ++i) {
+    simUartDeliver(SIM_CONSOLE_PORT, frame[i], now);
+  }
+}
+
+static void onConsoleFrame(const uint8_t* data, size_t len, uint64_t us) {
+  uint8_t p[CONTROL_MAX_PAYLOAD];
+  size_t  n = controlDecodeFrame(data, len, p);
+  linkHost.bytes += len + 2;
+  if (n < 2) {
+    ++linkHost.bad;
+    return;
+  }
+  ++linkHost.frames;
+  if (linkHost.lastRxSeq >= 0) {
+    linkHost.lost += (uint8_t)(p[1] - linkHost.lastRxSeq - 1);
+  }
+  linkHost.lastRxSeq = p[1];
+  switch (p[0]) {
+    case CONTROL_ACK:
+      if (p[4] != CONTROL_OK) ++linkHost.naks;
+      linkHost.ackLatency.push_back(us - linkHost.pendingUs[p[3]]);
+      break;
+    case CONTROL_INFO:
+      ++linkHost.infos;
+      break;
+    case CONTROL_BUTTON_EV:
+      ++linkHost.buttons;
+      break;
+    case CONTROL_PLAYER:
+      ++linkHost.players;
+      break;
+    case CONTROL_STATUS:
+      if (!linkHost.status++) linkHost.firstStatusUs = us;
+      linkHost.lastStatusUs = us;
+      break;
+  }
+}
+
+static void printLinkHost(size_t statusBytes) {
+  const LinkHost& h   = linkHost;
+  double          sec = (h.lastStatusUs - h.firstStatusUs) / 1e6;
+  ControlStats    st;
+  controlGetStats(&st);
+  printf("{\"summary\":\"control_link\",\"frames\":%u,\"bad_frames\":%u,"
+         "\"lost\":%u,\"tx_dropped\":%u,\"rx_errors\":%u,\"status\":%u,"
+         "\"status_hz\":%.1f,\"button_events\":%u,\"player_updates\":%u,"
+         "\"infos\":%u,\"naks\":%u,\"acks\":%zu,\"ack_p50_us\":%llu,"
+         "\"ack_max_us\":%llu,\"bytes\":%u,\"bytes_per_status\":%u,"
+         "\"http_status_body_bytes\":%zu}\n",
+         h.frames, h.bad, h.lost, st.txDropped, st.rxErrors, h.status,
+         sec > 0 ? (h.status - 1) / sec : 0.0, h.buttons, h.players, h.infos,
+         h.naks, h.ackLatency.size(),
+         (unsigned long long)percentile(h.ackLatency, 50),
+         (unsigned long long)(h.ackLatency.empty()
+                                  ? 0
+                                  : *std::max_element(h.ackLatency.begin(),
+                                                      h.ackLatency.end())),
+         h.bytes, h.status ? h.bytes / h.status : 0, statusBytes);
+}
+
+int main(int argc, char** argv) {
+  double          hours   = 4;
+  const char*     capture = nullptr;
+  UartFaultConfig fault   = {UART_FAULT_NONE, UART_FAULT_BYTES,
+                             UART_FAULT_TX | UART_FAULT_RX, 0, 200000, 1};
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+      hours = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      rng = (uint32_t)strtoul(argv[++i], nullptr, 0);
+      if (!rng) rng = 1;
+    } else if (!strcmp(argv[i], "--midi")) {
+      midi = true;
+    } else if (!strcmp(argv[i], "--din")) {
+      din = true;
+    } else if (!strcmp(argv[i], "--link")) {
+      link = true;
+    } else if (!strcmp(argv[i], "--fixed-cpu")) {
+      simSetPmSupported(false);
+    } else if (!strcmp(argv[i], "--verbose")) {
+      verbose = true;
+    } else if (!strcmp(argv[i], "--capture-clock") && i + 1 < argc) {
+      capture = argv[++i];
+    } else if (!strcmp(argv[i], "--fault") && i + 1 < argc &&
+               parseFault(argv[i + 1], &fault)) {
+      ++i;
+    } else if (!strcmp(argv[i], "--fault-frames")) {
+      fault.scope = UART_FAULT_FRAMES;
+    } else if (!strcmp(argv[i], "--fault-dir") && i + 1 < argc) {
+      ++i;
+      fault.dirs = !strcmp(argv[i], "tx")   ? UART_FAULT_TX
+                   : !strcmp(argv[i], "rx") ? UART_FAULT_RX
+                                            : UART_FAULT_TX | UART_FAULT_RX;
+    } else if (!strcmp(argv[i], "--fault-delay-ms") && i + 1 < argc) {
+      fault.delayUs = (uint32_t)atoi(argv[++i]) * 1000;
+    } else {
+      fprintf(stderr,
+              "usage: %s [--hours H] [--seed N] [--verbose]\n"
+              "  [--fault none|drop|delay|duplicate|corrupt[:permille]]\n"
+              "  [--fault-frames] [--fault-dir tx|rx|both] "
+              "[--fault-delay-ms MS] [--midi] [--din] [--fixed-cpu]\n"
+              "  [--link] [--capture-clock FILE]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  fault.seed = rng;
+  const uint64_t endUs = (uint64_t)(hours * 3600.0 * kS);
+  auto           wall0 = std::chrono::steady_clock::now();
+
+  DfPlayerModel  player1(1);
+  DfPlayerModel  player2(2);
+  DfPlayerModel* players[2] = {&player1, &player2};
+  simSetConsole(onConsole);
+  if (link) simSetConsoleFrames(onConsoleFrame);
+  ClockCapture clockCapture;
+  if (capture) {
+    clockCapture.file = fopen(capture, "w");
+    if (!clockCapture.file) {
+      fprintf(stderr, "cannot write %s\n", capture);
+      return 2;
+    }
+    fprintf(clockCapture.file, "# t_us status\n");
+    simAttachUart(0, &clockCapture);
+  }
+  uartFault(1).configure(fault);
+  uartFault(2).configure(fault);
+
+  // Scenario: presses spread over the gig, first one after boot settles
+  std::vector<Edge>     edges;
+  std::vector<Press>    presses;
+  std::vector<uint8_t>  pressButtons;
+  std::vector<uint64_t> pressTimes;
+  std::vector<uint8_t>  pressSources;
+  uint8_t               dinStatus = 0;  // running status on the DIN link
+  for (uint64_t t = 10 * kS; t < endUs; t += rnd(20, 90) * kS) {
+    uint8_t button = (uint8_t)rnd(0, 3);
+    uint8_t source = (uint8_t)rnd(SRC_SWITCH, SRC_DIN);
+    if ((source == SRC_USB && !midi) || (source == SRC_DIN && !din)) {
+      source = SRC_SWITCH;
+    }
+    if (source == SRC_SWITCH) addPress(edges, kButtonPins[button], t);
+    if (source == SRC_DIN) {
+      // Note On ch 10, status only when it changes, a clock byte in the
+      // middle; the press starts when its last byte is in
+      uint8_t bytes[4];
+      uint8_t n      = 0;
+      uint8_t status = rnd(0, 3) ? 0x99 : 0x98;  // mostly ch 10, some ch 9
+      if (status != dinStatus) bytes[n++] = status;
+      dinStatus  = status;
+      bytes[n++] = (uint8_t)(36 + button);
+      bytes[n++] = 0xF8;
+      bytes[n++] = 100;
+      for (uint8_t i = 0; i < n; ++i) {
+        t += kDinByteUs;
+        simUartDeliver(0, bytes[i], t);
+      }
+    }
+    pressButtons.push_back(button);
+    pressTimes.push_back(t);
+    pressSources.push_back(source);
+  }
+  std::stable_sort(edges.begin(), edges.end(),
+                   [](const Edge& a, const Edge& b) { return a.us < b.us; });
+
+  Client clients[3] = {
+      {"/api/status", 2 * kS, 5 * kS, {}, false},
+      {"/api/status", 2 * kS, 5 * kS + 700 * kMs, {}, false},
+      {"/api/metrics", 15 * kS, 6 * kS, {}, false},
+  };
+  std::vector<uint64_t> httpLatency;
+  unsigned              httpErrors      = 0;
+  size_t                httpStatusBytes = 0;
+  uint64_t              linkNextUs      = 5 * kS;
+
+  nativeSetTimeUs(0);
+  setup();
+  // link metrics cover the gig, not the player resets during boot
+  uartFault(1).resetStats();
+  uartFault(2).resetStats();
+
+  size_t   nextEdge  = 0;
+  size_t   nextPress = 0;
+  uint64_t lastEvent = 0;
+  try {
+    while (nativeTimeUs() < endUs) {
+      uint64_t now = nativeTimeUs();
+
+      while (nextEdge < edges.size() && edges[nextEdge].us <= now) {
+        const Edge& e = edges[nextEdge++];
+        nativeSetPin(e.pin, e.level);
+        lastEvent = now;
+      }
+      // a press starts at its first edge, a MIDI note when it is received
+      while (nextPress < pressTimes.size() && pressTimes[nextPress] <= now) {
+        uint8_t  src = pressSources[nextPress];
+        uint8_t  b   = pressButtons[nextPress];
+        uint64_t at  = src == SRC_DIN ? pressTimes[nextPress] : now;
+        size_t   n   = players[kButtonPorts[b] - 1]->commands().size();
+        presses.push_back({b, at, n, 0, 0, false, src});
+        if (src == SRC_USB) {
+          // Note On, cable 0, channel 10, velocity 100
+          const uint8_t packet[4] = {0x09, 0x99, (uint8_t)(36 + b), 100};
+          midiUsbReceive(packet, (uint32_t)now);
+        }
+        if (src != SRC_SWITCH) lastEvent = now;
+        ++nextPress;
+      }
+
+      for (Client& c : clients) {
+        if (c.busy || c.nextUs > now) continue;
+        c.req  = {c.path, false, now, 0, 0, 0};
+        c.busy = true;
+        simHttpSubmit(&c.req);
+        c.nextUs += c.periodUs;
+      }
+
+      if (link && linkNextUs <= now) {
+        if (linkNextUs == 5 * kS) {
+          const uint8_t period[2] = {100, 0};  // ms, little endian
+          linkSend(CONTROL_TELEMETRY, period, sizeof(period), now);
+        }
+        linkSend(CONTROL_HELLO, nullptr, 0, now);
+        linkNextUs += 2 * kS;
+      }
+
+      simRunTimers();
+      simRunUartEvents();
+      loop();
+
+      uint64_t after = nativeTimeUs();
+      for (Client& c : clients) {
+        if (!c.busy || !c.req.doneUs) continue;
+        c.busy = false;
+        httpLatency.push_back(c.req.doneUs - c.req.submitUs);
+        if (!strcmp(c.path, "/api/status")) httpStatusBytes = c.req.bodyLen;
+        if (c.req.code != 200) ++httpErrors;
+      }
+
+      for (size_t i = 0; i < presses.size(); ++i) {
+        Press& p = presses[i];
+        if (p.latencyUs || p.missed) continue;
+        const std::vector<DfPlayerModel::Command>& cmds =
+            players[kButtonPorts[p.button] - 1]->commands();
+        if (cmds.size() > p.cmdsBefore) {
+          const DfPlayerModel::Command& c = cmds[p.cmdsBefore];
+          p.latencyUs = c.us - p.edgeUs;
+          p.cmd       = c.cmd;
+          lastEvent   = after;
+        } else if (after - p.edgeUs > kMissUs) {
+          p.missed = true;
+        } else {
+          continue;
+        }
+        printf("{\"press\":%zu,\"button\":\"S%u\",\"source\":\"%s\","
+               "\"t_ms\":%.3f,",
+               i + 1, p.button + 1, kSourceNames[p.source],
+               p.edgeUs / 1000.0);
+        if (p.missed)
+          printf("\"missed\":true}\n");
+        else
+          printf("\"latency_us\":%llu,\"cmd\":\"0x%02X\"}\n",
+                 (unsigned long long)p.latencyUs, p.cmd);
+      }
+
+      // Advance to the next loop() call, never past a scheduled edge
+      uint64_t step = (after - lastEvent < kFineWindowUs)
+                          ? kFineStepUs * kMaxMhz / getCpuFrequencyMhz()
+                          : kCoarseStepUs;
+      uint64_t next = after + step;
+      if (nextEdge < edges.size() && edges[nextEdge].us < next) {
+        next      = std::max(edges[nextEdge].us, after);
+        lastEvent = next;
+      }
+      if (next > after) nativeSetTimeUs(next);
+    }
+  } catch (const SimDeepSleep& s) {
+    printf("{\"deep_sleep\":true,\"t_ms\":%.3f,\"ext1_mask\":\"0x%llx\","
+           "\"ext0_pin\":%d}\n",
+           nativeTimeUs() / 1000.0, (unsigned long long)s.ext1Mask,
+           s.ext0Pin);
+  }
+
+  std::vector<uint64_t> latency[SRC_COUNT];
+  unsigned              missedBy[SRC_COUNT] = {0, 0, 0};
+  unsigned              missed              = 0;
+  for (const Press& p : presses) {
+    if (p.missed) {
+      ++missedBy[p.source];
+      ++missed;
+    }
+    if (p.latencyUs) latency[p.source].push_back(p.latencyUs);
+  }
+  printSummary("press_latency", latency[SRC_SWITCH], "missed",
+               missedBy[SRC_SWITCH]);
+  if (midi) {
+    printSummary("midi_latency", latency[SRC_USB], "missed",
+                 missedBy[SRC_USB]);
+  }
+  if (din) {
+    printSummary("din_latency", latency[SRC_DIN], "missed",
+                 missedBy[SRC_DIN]);
+  }
+  printSummary("http_latency", httpLatency, "errors", httpErrors);
+  printCpu();
+  printLink(1, fault);
+  printLink(2, fault);
+  if (link) printLinkHost(httpStatusBytes);
+  if (clockCapture.file) fclose(clockCapture.file);
+
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                              wall0)
+                    .count();
+  fprintf(stderr, "simulated %.2f h in %.2f s (%.0fx), frame errors %u/%u\n",
+          nativeTimeUs() / 3.6e9, wall, nativeTimeUs() / 1e6 / wall,
+          player1.frameErrors(), player2.frameErrors());
+  return missed ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+#include "dfplayer_model.hpp"
+
+static const uint64_t kAckDelayUs   = 20000;
+static const uint64_t kResetDelayUs = 1500000;
+
+static const uint8_t kCmdPlay         = 0x03;
+static const uint8_t kCmdReset        = 0x0C;
+static const uint8_t kCmdStart        = 0x0D;
+static const uint8_t kCmdPause        = 0x0E;
+static const uint8_t kCmdStop         = 0x16;
+static const uint8_t kRptPlayFinished = 0x3D;
+static const uint8_t kRptOnline       = 0x3F;
+static const uint8_t kRptAck          = 0x41;
+
+DfPlayerModel::DfPlayerModel(uint8_t port)
+    : port_(port),
+      parser_(),
+      txFreeUs_(0),
+      playing_(false),
+      paused_(false),
+      track_(0),
+      trackEndUs_(0),
+      remainingUs_(0) {
+  simAttachUart(port, this);
+}
+
+uint64_t DfPlayerModel::trackLengthUs(uint16_t track) {
+  // 2:30 to 3:38, fixed per track so runs are reproducible
+  return (150ULL + 17ULL * (track % 5)) * 1000000ULL;
+}
+
+void DfPlayerModel::onHostByte(uint8_t b, uint64_t us) {
+  if (parser_.feed(b)) handle(parser_.frame(), us);
+}
+
+void DfPlayerModel::handle(const DfFrame& frame, uint64_t us) {
+  commands_.push_back({frame.cmd, frame.param, us});
+  if (frame.ack) schedule(us + kAckDelayUs, kRptAck, 0);
+
+  switch (frame.cmd) {
+    case kCmdReset:
+      cancelFinished();
+      playing_ = false;
+      paused_  = false;
+      schedule(us + kResetDelayUs, kRptOnline, 0x02);  // SD card online
+      break;
+    case kCmdPlay:
+      cancelFinished();
+      playing_    = true;
+      paused_     = false;
+      track_      = frame.param;
+      trackEndUs_ = us + trackLengthUs(track_);
+      schedule(trackEndUs_, kRptPlayFinished, track_);
+      break;
+    case kCmdPause:
+      if (playing_ && !paused_) {
+        cancelFinished();
+        paused_      = true;
+        remainingUs_ = trackEndUs_ > us ? trackEndUs_ - us : 0;
+      }
+      break;
+    case kCmdStart:
+      if (playing_ && paused_) {
+        paused_     = false;
+        trackEndUs_ = us + remainingUs_;
+        schedule(trackEndUs_, kRptPlayFinished, track_);
+      }
+      break;
+    case kCmdStop:
+      cancelFinished();
+      playing_ = false;
+      paused_  = false;
+      break;
+    default:
+      break;
+  }
+}
+
+void DfPlayerModel::schedule(uint64_t atUs, uint8_t cmd, uint16_t param) {
+  Report r = {atUs, {cmd, false, param}};
+  auto   it = pending_.begin();
+  while (it != pending_.end() && it->atUs <= atUs) ++it;
+  pending_.insert(it, r);
+}
+
+void DfPlayerModel::cancelFinished() {
+  for (auto it = pending_.begin(); it != pending_.end();) {
+    if (it->frame.cmd == kRptPlayFinished)
+      it = pending_.erase(it);
+    else
+      ++it;
+  }
+}
+
+void DfPlayerModel::poll(uint64_t us) {
+  // Reports are handed to the UART once the module starts sending them,
+  // each byte timestamped with its arrival at the ESP32.
+  uint64_t byteUs = simUartByteUs(port_);
+  while (!pending_.empty() && pending_.front().atUs <= us) {
+    Report r = pending_.front();
+    pending_.erase(pending_.begin());
+    if (r.frame.cmd == kRptPlayFinished) {
+      playing_ = false;
+      paused_  = false;
+    }
+
+    uint8_t out[DF_FRAME_LEN];
+    dfEncodeFrame(r.frame, out);
+    uint64_t t = r.atUs > txFreeUs_ ? r.atUs : txFreeUs_;
+    for (uint8_t i = 0; i < DF_FRAME_LEN; ++i) {
+      t += byteUs;
+      simUartDeliver(port_, out[i], t);
+    }
+    txFreeUs_ = t;
+  }
+}
+
+const std::vector<DfPlayerModel::Command>& DfPlayerModel::commands() const {
+  return commands_;
+}
+
+bool DfPlayerModel::playing() const {
+  return playing_ && !paused_;
+}
+
+uint32_t DfPlayerModel::frameErrors() const {
+  return parser_.errors();
+}
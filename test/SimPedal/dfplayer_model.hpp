@@ -0,0 +1,63 @@
+#ifndef SIM_DFPLAYER_MODEL_HPP
+#define SIM_DFPLAYER_MODEL_HPP
+
+#include "dfplayer_frame.hpp"
+#include "sim_hooks.h"
+
+#include <vector>
+
+/*
+ * dfplayer_model - DFPlayer Mini on a simulated UART
+ *
+ * Decodes the frames the firmware sends and answers like the module does:
+ * - ACK (0x41) ~20 ms after any command that requests one
+ * - reset (0x0C): "card online" (0x3F) after ~1.5 s
+ * - play (0x03): "track finished" (0x3D) when the track ends; pause (0x0E),
+ *   start (0x0D) and stop (0x16) move or cancel that report
+ * Every command is logged with the time its last byte arrived, which is
+ * what the simulator measures press latency against.
+ */
+
+class DfPlayerModel : public SimUartDevice {
+ public:
+  struct Command {
+    uint8_t  cmd;
+    uint16_t param;
+    uint64_t us;  // last byte arrived at the module
+  };
+
+  explicit DfPlayerModel(uint8_t port);
+
+  void onHostByte(uint8_t b, uint64_t us) override;
+  void poll(uint64_t us) override;
+
+  const std::vector<Command>& commands() const;
+  bool                        playing() const;
+  uint32_t                    frameErrors() const;
+
+  // track length (us) the model uses for a given track number
+  static uint64_t trackLengthUs(uint16_t track);
+
+ private:
+  struct Report {
+    uint64_t atUs;  // module starts transmitting
+    DfFrame  frame;
+  };
+
+  void schedule(uint64_t atUs, uint8_t cmd, uint16_t param);
+  void cancelFinished();
+  void handle(const DfFrame& frame, uint64_t us);
+
+  uint8_t              port_;
+  DfFrameParser        parser_;
+  std::vector<Command> commands_;
+  std::vector<Report>  pending_;  // sorted by atUs
+  uint64_t             txFreeUs_;
+  bool                 playing_;
+  bool                 paused_;
+  uint16_t             track_;
+  uint64_t             trackEndUs_;
+  uint64_t             remainingUs_;  // while paused
+};
+
+#endif  // SIM_DFPLAYER_MODEL_HPP
@@ -0,0 +1,137 @@
+// test/SoakHeap/SoakHeap.cpp
+//
+// Heap soak test for lib_server: a client task polls /api/status and
+// /api/metrics over loopback as fast as the server answers, standing in for
+// the web UI polling every 2 s. SOAK_DAYS simulated days are compressed into
+// a few minutes, and the internal heap is sampled every SAMPLE_EVERY
+// requests (CSV on the serial port).
+//
+// PASS when every request was answered 200 and the largest free block at
+// the end is within MAX_DRIFT_BYTES of the value after warm-up, i.e.
+// request handling does not fragment the heap.
+//
+//   pio run -e soak -t upload -t monitor
+
+#include "lib_heap.hpp"
+#include "lib_server.hpp"
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include <string.h>
+
+#ifndef SOAK_DAYS
+#define SOAK_DAYS 3
+#endif
+
+static const uint32_t UI_POLL_PERIOD_S = 2;
+static const uint32_t TOTAL_REQUESTS =
+    SOAK_DAYS * 86400UL / UI_POLL_PERIOD_S;
+static const uint32_t SAMPLE_EVERY     = 1000;
+static const uint32_t WARMUP_REQUESTS  = 2000;
+static const uint32_t MAX_DRIFT_BYTES  = 512;
+
+static volatile uint32_t requestsDone = 0;
+static volatile uint32_t requestsFail = 0;
+static volatile bool     clientDone   = false;
+
+// True if the server answered 200. The status line is kept, the rest of
+// the response read and dropped.
+static bool httpGet(const IPAddress& ip, const char* path) {
+  WiFiClient client;
+  if (!client.connect(ip, 80)) return false;
+  client.printf("GET %s HTTP/1.1\r\nHost: soak\r\nConnection: close\r\n\r\n",
+                path);
+  char          status[13] = {};  // "HTTP/1.1 200"
+  size_t        got        = 0;
+  unsigned long start      = millis();
+  while ((client.connected() || client.available()) &&
+         (millis() - start) < 2000) {
+    while (client.available()) {
+      int c = client.read();
+      if (c >= 0 && got < sizeof(status) - 1) status[got++] = (char)c;
+    }
+    delay(1);
+  }
+  client.stop();
+  return got == sizeof(status) - 1 && strncmp(status, "HTTP/1.", 7) == 0 &&
+         strcmp(status + 8, " 200") == 0;
+}
+
+static void clientTask(void* arg) {
+  (void)arg;
+  IPAddress ip = WiFi.localIP();
+  for (uint32_t i = 0; i < TOTAL_REQUESTS; ++i) {
+    // one metrics scrape for every ten UI polls
+    const char* path = (i % 10 == 9) ? "/api/metrics" : "/api/status";
+    if (!httpGet(ip, path)) requestsFail = requestsFail + 1;
+    requestsDone = i + 1;
+  }
+  clientDone = true;
+  vTaskDelete(nullptr);
+}
+
+static void printSample(uint32_t requests) {
+  HeapStats heap;
+  heapGetStats(&heap);
+  Serial.printf("%lu,%lu,%lu,%lu\n", (unsigned long)requests,
+                (unsigned long)heap.freeBytes, (unsigned long)heap.minFreeBytes,
+                (unsigned long)heap.largestFreeBlock);
+}
+
+void setup() {
+  heapMonitorInit();
+  Serial.begin(115200);
+  delay(2000);
+
+  serverInit(4, millis());
+  if (WiFi.status() != WL_CONNECTED) {
+    Serial.println("SOAK FAIL: needs a station connection for loopback");
+    return;
+  }
+
+  Serial.printf("Soak: %lu requests (%u simulated days)\n",
+                (unsigned long)TOTAL_REQUESTS, SOAK_DAYS);
+  Serial.println("requests,free,min_free,largest_block");
+  xTaskCreatePinnedToCore(clientTask, "soak", 4096, nullptr, 1, nullptr, 0);
+}
+
+void loop() {
+  static uint32_t nextSample = 0;
+  static uint32_t baseline   = 0;
+  static bool     reported   = false;
+
+  HeapSubsystem prev = heapEnter(HEAP_SUB_SERVER);
+  serverHandleClient();
+  heapLeave(prev);
+
+  uint32_t done = requestsDone;
+  if (done >= nextSample) {
+    printSample(done);
+    if (baseline == 0 && done >= WARMUP_REQUESTS) {
+      HeapStats heap;
+      heapGetStats(&heap);
+      baseline = heap.largestFreeBlock;
+    }
+    nextSample += SAMPLE_EVERY;
+  }
+
+  if (clientDone && !reported) {
+    reported = true;
+    HeapStats heap;
+    heapGetStats(&heap);
+    uint32_t drift = baseline > heap.largestFreeBlock
+                         ? baseline - heap.largestFreeBlock
+                         : 0;
+    Serial.printf("largest block: baseline %lu, final %lu, drift %lu\n",
+                  (unsigned long)baseline,
+                  (unsigned long)heap.largestFreeBlock, (unsigned long)drift);
+    for (uint8_t i = 0; i < HEAP_SUB_COUNT; ++i) {
+      Serial.printf("allocs %-8s %lu (frees %lu)\n", heapSubsystemName(i),
+                    (unsigned long)heap.allocs[i],
+                    (unsigned long)heap.frees[i]);
+    }
+    bool ok = drift <= MAX_DRIFT_BYTES && requestsFail == 0;
+    Serial.printf("SOAK %s (%lu failed requests)\n", ok ? "PASS" : "FAIL",
+                  (unsigned long)requestsFail);
+  }
+}
@@ -1,5 +1,7 @@
-#define BAT_ADC        2
-#define LED_PIN        17
+#include "lib_board.hpp"
+
+#define BAT_ADC        Board::kBatteryAdcPin
+#define LED_PIN        Board::kLedPin
 #define BUTTON_PIN     0
 #define uS_TO_S_FACTOR 1000000ULL  /* Conversion factor for micro seconds to seconds */
 #define TIME_TO_SLEEP  20        /* Time ESP32 will go to sleep (in seconds) */
@@ -27,9 +29,14 @@ bool readkey()
 
 uint32_t readADC_Cal(int ADC_Raw)
 {
-    esp_adc_cal_characteristics_t adc_chars;
+    // Characterize once, the eFuse lookup is far slower than the conversion
+    static esp_adc_cal_characteristics_t adc_chars;
+    static bool characterized = false;
 
-    esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_12, ADC_WIDTH_BIT_12, 1100, &adc_chars);
+    if (!characterized) {
+        esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_12, ADC_WIDTH_BIT_12, 1100, &adc_chars);
+        characterized = true;
+    }
     return (esp_adc_cal_raw_to_voltage(ADC_Raw, &adc_chars));
 }
 
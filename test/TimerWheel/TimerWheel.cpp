@@ -0,0 +1,334 @@
+// test/TimerWheel/TimerWheel.cpp
+//
+// Checks lib_timer's timer wheel on the host.
+//
+//   pio run -e timer -t exec
+//   .pio/build/timer/program --ops 200000 --seed 7
+//
+// Model check: a few hundred timers are armed, re-armed, cancelled and
+// made periodic at random, some re-arming themselves from their callback,
+// while the wheel is advanced by random steps, from single ticks to
+// millions. A plain list of expiry times says which timer fires at which
+// tick; every fire must match it, with now() equal to the expiry inside
+// the callback. The tick count starts just below 2^32 so it wraps.
+//
+// Cost check: with N timers waiting (N = 1 .. 10000, random delays up to
+// a minute, each re-armed when it fires) the wheel is advanced one tick
+// at a time, next to a scan of N expiry times per tick as the buttons did
+// before. Reports ns per tick of both and ns per arm and cancel; the
+// wheel must not cost more than the scan it replaces at N = 10000.
+//
+// Prints one JSON object per check and a summary. Exits with status 1 if
+// a check fails.
+
+#include "timer_wheel.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <queue>
+#include <vector>
+
+struct Options {
+  uint32_t ops  = 50000;
+  uint32_t seed = 1;
+};
+
+static uint32_t rngState = 1;
+
+static uint32_t rnd() {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+static bool after(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b) > 0;
+}
+
+static uint64_t nowNs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/* Model check */
+
+static const uint32_t kTimers = 256;
+
+struct Fire {
+  uint32_t tick;
+  uint32_t id;
+  bool operator<(const Fire& o) const {
+    return tick != o.tick ? after(o.tick, tick) : id < o.id;
+  }
+  bool operator==(const Fire& o) const {
+    return tick == o.tick && id == o.id;
+  }
+};
+
+// Model times count from the start without wrapping
+struct ModelTimer {
+  bool     armed;
+  uint64_t when;    // tick it fires at
+  uint32_t period;  // 0: one-shot
+  bool     rearms;  // re-arms itself from the callback
+  uint32_t gen;     // entries of older arms in the queue are stale
+};
+
+struct Due {
+  uint64_t when;
+  uint32_t id;
+  uint32_t gen;
+  bool operator<(const Due& o) const {
+    return when > o.when;  // earliest on top
+  }
+};
+
+static TimerWheel                modelWheel(0);
+static WheelTimer                timers[kTimers];
+static ModelTimer                model[kTimers];
+static std::priority_queue<Due>  modelDue;
+static std::vector<Fire>         fired;  // tick: now() inside the callback
+
+// delay a self re-arming timer picks at tick, the same in wheel and model
+static uint32_t rearmDelay(uint32_t id, uint32_t tick) {
+  uint32_t h = (id * 2654435761u) ^ (tick * 40503u);
+  return 1 + (h >> 7) % 300;
+}
+
+static void onFire(void* arg) {
+  uint32_t id   = (uint32_t)(uintptr_t)arg;
+  uint32_t tick = modelWheel.now();
+  Fire     f    = {tick, id};
+  fired.push_back(f);
+  if (model[id].rearms && !model[id].period) {
+    modelWheel.armAt(timers[id], tick + rearmDelay(id, tick));
+  }
+}
+
+static void modelArm(uint32_t id, uint64_t when, uint32_t period,
+                     bool rearms) {
+  ModelTimer& m = model[id];
+  m.armed       = true;
+  m.when        = when;
+  m.period      = period;
+  m.rearms      = rearms;
+  Due d         = {when, id, ++m.gen};
+  modelDue.push(d);
+}
+
+// What the model expects from advancing to tick to
+static void modelAdvance(uint64_t to, std::vector<Fire>* out) {
+  while (!modelDue.empty() && modelDue.top().when <= to) {
+    Due d = modelDue.top();
+    modelDue.pop();
+    ModelTimer& m = model[d.id];
+    if (!m.armed || d.gen != m.gen) continue;
+    Fire f = {(uint32_t)d.when, d.id};
+    out->push_back(f);
+    if (m.period) {
+      modelArm(d.id, d.when + m.period, m.period, false);
+    } else if (m.rearms) {
+      modelArm(d.id, d.when + rearmDelay(d.id, f.tick), 0, true);
+    } else {
+      m.armed = false;
+    }
+  }
+}
+
+static uint32_t randomDelay() {
+  switch (rnd() % 8) {
+    case 0:
+      return 0;
+    case 1:
+    case 2:
+    case 3:
+      return rnd() % 64;
+    case 4:
+    case 5:
+      return rnd() % 4096;
+    case 6:
+      return rnd() % (1u << 20);
+    default:
+      return rnd() % (1u << 26);  // beyond the top level
+  }
+}
+
+static uint32_t randomStep() {
+  uint32_t r = rnd() % 64;
+  if (r < 32) return 1;
+  if (r < 48) return rnd() % 64;
+  if (r < 56) return rnd() % 5000;
+  if (r < 63) return rnd() % (1u << 18);
+  return rnd() % (1u << 24);
+}
+
+// Timers that fire often (periodic, re-arming) are kept to a few ids, or
+// the long steps fire them millions of times
+static bool frequentId(uint32_t id) {
+  return id % 32 == 0;
+}
+
+static bool modelCheck(const Options& opt) {
+  // the wheel's ticks are the low 32 bits: they wrap early on
+  uint64_t now = 0xFFFF0000u;
+  modelWheel   = TimerWheel((uint32_t)now);
+  for (uint32_t i = 0; i < kTimers; ++i) {
+    timers[i].set(onFire, (void*)(uintptr_t)i);
+    model[i] = ModelTimer{false, 0, 0, false, 0};
+  }
+
+  uint32_t mismatches = 0, armedFails = 0, fires = 0;
+  for (uint32_t op = 0; op < opt.ops; ++op) {
+    uint32_t id = rnd() % kTimers;
+    uint32_t d  = randomDelay();
+    // a due or past time fires on the next tick
+    uint64_t at = now + (d ? d : 1);
+    switch (rnd() % 6) {
+      case 0:
+      case 1: {
+        bool rearms = frequentId(id);
+        modelArm(id, at, 0, rearms);
+        modelWheel.armAt(timers[id], (uint32_t)(now + d));
+        break;
+      }
+      case 2:
+        modelArm(id, at, 0, false);
+        modelWheel.arm(timers[id], d);
+        break;
+      case 3:
+        model[id].armed = false;
+        modelWheel.cancel(timers[id]);
+        break;
+      case 4: {
+        if (!frequentId(id)) break;
+        uint32_t period = 1 + rnd() % 2000;
+        modelArm(id, at, period, false);
+        modelWheel.armPeriodic(timers[id], (uint32_t)(now + d), period);
+        break;
+      }
+      default: {
+        uint64_t          to = now + randomStep();
+        std::vector<Fire> want;
+        modelAdvance(to, &want);
+        fired.clear();
+        modelWheel.advance((uint32_t)to);
+        now = to;
+        std::sort(want.begin(), want.end());
+        std::sort(fired.begin(), fired.end());
+        if (want != fired) ++mismatches;
+        fires += (uint32_t)fired.size();
+        break;
+      }
+    }
+    for (uint32_t i = 0; i < kTimers; ++i) {
+      if (timers[i].armed() != model[i].armed) ++armedFails;
+    }
+  }
+  for (uint32_t i = 0; i < kTimers; ++i) modelWheel.cancel(timers[i]);
+
+  TimerWheelStats st;
+  modelWheel.stats(&st);
+  bool ok = mismatches == 0 && armedFails == 0 && st.armed == 0 &&
+            st.fired == fires;
+  printf("{\"check\":\"model\",\"ops\":%lu,\"fired\":%lu,\"cascaded\":%lu,"
+         "\"mismatches\":%lu,\"armed_mismatches\":%lu,\"ok\":%s}\n",
+         (unsigned long)opt.ops, (unsigned long)fires,
+         (unsigned long)st.cascaded, (unsigned long)mismatches,
+         (unsigned long)armedFails, ok ? "true" : "false");
+  return ok;
+}
+
+/* Cost check */
+
+static const uint32_t kMaxDelay = 60000;
+
+static TimerWheel costWheel(0);
+
+static void onCostFire(void* arg) {
+  WheelTimer* t = (WheelTimer*)arg;
+  costWheel.armAt(*t, costWheel.now() + 1 + rnd() % kMaxDelay);
+}
+
+struct Cost {
+  double wheelTickNs;
+  double scanTickNs;
+  double armNs;
+  double cancelNs;
+};
+
+static Cost measure(uint32_t n, uint32_t ticks) {
+  Cost                    c;
+  std::vector<WheelTimer> ts(n);
+  std::vector<uint32_t>   due(n);
+  costWheel = TimerWheel(0);
+
+  uint64_t t0 = nowNs();
+  for (uint32_t i = 0; i < n; ++i) {
+    ts[i].set(onCostFire, &ts[i]);
+    costWheel.armAt(ts[i], 1 + rnd() % kMaxDelay);
+  }
+  c.armNs = (double)(nowNs() - t0) / n;
+
+  t0 = nowNs();
+  for (uint32_t tick = 1; tick <= ticks; ++tick) costWheel.advance(tick);
+  c.wheelTickNs = (double)(nowNs() - t0) / ticks;
+
+  t0 = nowNs();
+  for (uint32_t i = 0; i < n; ++i) costWheel.cancel(ts[i]);
+  c.cancelNs = (double)(nowNs() - t0) / n;
+
+  // the scan: every expiry compared with now on every tick
+  for (uint32_t i = 0; i < n; ++i) due[i] = 1 + rnd() % kMaxDelay;
+  t0 = nowNs();
+  for (uint32_t tick = 1; tick <= ticks; ++tick) {
+    for (uint32_t i = 0; i < n; ++i) {
+      if (!after(due[i], tick)) due[i] = tick + 1 + rnd() % kMaxDelay;
+    }
+  }
+  c.scanTickNs = (double)(nowNs() - t0) / ticks;
+  return c;
+}
+
+static bool costCheck() {
+  static const uint32_t sizes[] = {1, 16, 100, 1000, 10000};
+  bool                  ok      = true;
+  for (uint32_t n : sizes) {
+    Cost c       = measure(n, 200000);
+    bool cheaper = n < 10000 || c.wheelTickNs <= c.scanTickNs;
+    ok &= cheaper;
+    printf("{\"check\":\"cost\",\"timers\":%lu,\"wheel_tick_ns\":%.1f,"
+           "\"scan_tick_ns\":%.1f,\"arm_ns\":%.1f,\"cancel_ns\":%.1f,"
+           "\"ok\":%s}\n",
+           (unsigned long)n, c.wheelTickNs, c.scanTickNs, c.armNs,
+           c.cancelNs, cheaper ? "true" : "false");
+  }
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  Options opt;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--ops")) {
+      opt.ops = (uint32_t)atol(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--seed")) {
+      opt.seed = (uint32_t)atol(argv[i + 1]);
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  rngState = opt.seed ? opt.seed : 1;
+
+  bool ok = modelCheck(opt);
+  ok &= costCheck();
+  printf("{\"summary\":\"timer\",\"levels\":%u,\"seed\":%lu,\"ok\":%s}\n",
+         (unsigned)TimerWheel::kLevels, (unsigned long)opt.seed,
+         ok ? "true" : "false");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+// test/UartFault/UartFault.cpp
+//
+// Checks lib_mp3's UART fault layer (uart_fault.hpp) on the host, between
+// the DFPlayer frames a module would send and the bytes the library reads.
+//
+//   pio run -e uartfault -t exec
+//
+// Pass-through check: with no fault configured, bursts of DFPlayer reply
+// frames larger than the layer's queue arrive while nothing reads, as in a
+// long loop() stall. Every byte must come out, in order, with no overflow.
+//
+// Corrupt frame check: RX frames corrupted at 200 permille in frame scope.
+// Each hit frame must show as a frame error in the layer's metrics
+// (rx_frame_errors; a bit flipped into a 0x7E costs a second one while the
+// parser resyncs) and every other frame must still decode.
+//
+// Prints one JSON object per check and a summary. Exits with status 1 if
+// a check fails.
+
+#include "dfplayer_frame.hpp"
+#include "uart_fault.hpp"
+
+#include <Arduino.h>
+#include <sim_hooks.h>
+#include <stdio.h>
+
+#include <vector>
+
+static const uint8_t kPort = 1;
+
+// count "track finished" frames (cmd 0x3D), params first, first + 1, ...
+static std::vector<uint8_t> replyFrames(uint32_t count, uint32_t first) {
+  std::vector<uint8_t> out;
+  for (uint32_t i = 0; i < count; ++i) {
+    DfFrame f = {0x3D, false, (uint16_t)(first + i)};
+    uint8_t b[DF_FRAME_LEN];
+    dfEncodeFrame(f, b);
+    out.insert(out.end(), b, b + DF_FRAME_LEN);
+  }
+  return out;
+}
+
+static void deliver(const std::vector<uint8_t>& bytes) {
+  uint64_t at = nativeTimeUs();
+  for (uint8_t b : bytes) simUartDeliver(kPort, b, at);
+}
+
+// Everything the layer has for the reader now
+static void drain(UartFault& layer, std::vector<uint8_t>* out) {
+  while (layer.available() > 0) out->push_back((uint8_t)layer.read());
+}
+
+static bool passThroughCheck() {
+  UartFault layer;
+  layer.attach(&Serial1);
+  UartFaultConfig none = {UART_FAULT_NONE, UART_FAULT_BYTES,
+                          UART_FAULT_TX | UART_FAULT_RX, 0, 0, 1};
+  layer.configure(none);
+
+  std::vector<uint8_t> sent, got;
+  uint32_t             frames = 0;
+  // bursts of 1 .. 20 frames (10 .. 200 bytes), each read after it is all
+  // there, as loop() does after a stall
+  for (uint32_t burst = 1; burst <= 20; ++burst) {
+    std::vector<uint8_t> b = replyFrames(burst, frames);
+    frames += burst;
+    deliver(b);
+    sent.insert(sent.end(), b.begin(), b.end());
+    nativeAdvanceUs(1000);
+    drain(layer, &got);
+  }
+
+  UartFaultStats st;
+  layer.stats(&st);
+  bool ok = got == sent && st.overflows == 0 && st.injected == 0 &&
+            st.rxFrameErrors == 0;
+  printf("{\"check\":\"pass_through\",\"frames\":%lu,\"bytes_sent\":%lu,"
+         "\"bytes_read\":%lu,\"overflows\":%lu,\"queue_len\":%u,\"ok\":%s}\n",
+         (unsigned long)frames, (unsigned long)sent.size(),
+         (unsigned long)got.size(), (unsigned long)st.overflows,
+         (unsigned)UART_FAULT_QUEUE_LEN, ok ? "true" : "false");
+  return ok;
+}
+
+static bool corruptFrameCheck() {
+  UartFault layer;
+  layer.attach(&Serial1);
+  UartFaultConfig corrupt = {UART_FAULT_CORRUPT, UART_FAULT_FRAMES,
+                             UART_FAULT_RX, 200, 0, 7};
+  layer.configure(corrupt);
+
+  const uint32_t       kFrames = 1000;
+  std::vector<uint8_t> got;
+  for (uint32_t i = 0; i < kFrames; i += 2) {
+    deliver(replyFrames(2, i));
+    nativeAdvanceUs(1000);
+    drain(layer, &got);
+  }
+
+  DfFrameParser parser;
+  uint32_t      decoded = 0;
+  for (uint8_t b : got) decoded += parser.feed(b) ? 1 : 0;
+
+  UartFaultStats st;
+  layer.stats(&st);
+  bool ok = st.injected > 0 && st.rxFrameErrors >= st.injected &&
+            decoded + st.injected == kFrames && st.overflows == 0;
+  printf("{\"check\":\"corrupt_frames\",\"frames\":%lu,\"injected\":%lu,"
+         "\"rx_frame_errors\":%lu,\"decoded\":%lu,\"ok\":%s}\n",
+         (unsigned long)kFrames, (unsigned long)st.injected,
+         (unsigned long)st.rxFrameErrors, (unsigned long)decoded,
+         ok ? "true" : "false");
+  return ok;
+}
+
+int main() {
+  Serial1.begin(9600);
+  bool ok = passThroughCheck();
+  ok &= corruptFrameCheck();
+  printf("{\"summary\":\"uart_fault\",\"ok\":%s}\n", ok ? "true" : "false");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,252 @@
+#include "Arduino.h"
+#include "WiFi.h"
+#include "sim_hooks.h"
+
+#include <deque>
+
+static uint64_t timeUs = 0;
+static uint8_t  pinLevels[NATIVE_PIN_COUNT];
+
+HardwareSerial Serial(SIM_CONSOLE_PORT);
+HardwareSerial Serial0(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+EspClass       ESP;
+
+unsigned long millis(void) {
+  return (unsigned long)(timeUs / 1000);
+}
+
+unsigned long micros(void) {
+  return (unsigned long)timeUs;
+}
+
+void delay(unsigned long ms) {
+  timeUs += (uint64_t)ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us) {
+  timeUs += us;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= NATIVE_PIN_COUNT) return;
+  if (mode == INPUT_PULLUP) pinLevels[pin] = HIGH;
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < NATIVE_PIN_COUNT ? pinLevels[pin] : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin < NATIVE_PIN_COUNT) pinLevels[pin] = val ? HIGH : LOW;
+}
+
+int8_t digitalPinToAnalogChannel(uint8_t pin) {
+  // ESP32-S3: GPIO1..10 are ADC1 channels 0..9
+  return (pin >= 1 && pin <= 10) ? pin - 1 : -1;
+}
+
+uint64_t nativeTimeUs(void) {
+  return timeUs;
+}
+
+void nativeSetTimeUs(uint64_t us) {
+  timeUs = us;
+}
+
+void nativeAdvanceUs(uint64_t us) {
+  timeUs += us;
+}
+
+void nativeSetPin(uint8_t pin, int level) {
+  if (pin < NATIVE_PIN_COUNT) pinLevels[pin] = level ? HIGH : LOW;
+}
+
+int nativePinLevel(uint8_t pin) {
+  return digitalRead(pin);
+}
+
+/* Print */
+
+size_t Print::printf(const char* fmt, ...) {
+  char    buf[256];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  if (n < 0) return 0;
+  if ((size_t)n >= sizeof(buf)) n = sizeof(buf) - 1;
+  return write((const uint8_t*)buf, n);
+}
+
+size_t Print::print(const char* s) {
+  return write((const uint8_t*)s, strlen(s));
+}
+
+size_t Print::print(long v, int base) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%ld", v);
+  return print(buf);
+}
+
+size_t Print::println(void) {
+  return print("\n");
+}
+
+size_t Print::println(const char* s) {
+  return print(s) + println();
+}
+
+size_t Print::println(long v, int base) {
+  return print(v, base) + println();
+}
+
+size_t Print::println(const IPAddress& ip) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  return println(buf);
+}
+
+/* UARTs */
+
+struct SimRxByte {
+  uint8_t  b;
+  uint64_t atUs;
+};
+
+struct SimUart {
+  unsigned long         baud = 9600;
+  SimUartDevice*        dev  = nullptr;
+  uint64_t              txFreeUs = 0;  // when the transmitter is idle again
+  std::deque<SimRxByte> rx;
+  OnReceiveCb           onReceive;
+};
+
+// Function-local so it is constructed on first use, whatever the static
+// initialization order (MP3Player instances call begin() from constructors)
+static SimUart& uart(uint8_t port) {
+  static SimUart uarts[SIM_UART_COUNT + 1];
+  return uarts[port <= SIM_UART_COUNT ? port : SIM_CONSOLE_PORT];
+}
+
+static SimConsoleFn      consoleFn      = nullptr;
+static SimConsoleFrameFn consoleFrameFn = nullptr;
+static std::string       consoleLine;
+static std::string       consoleFrame;
+static bool              inConsoleFrame = false;
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rxPin,
+                           int8_t txPin) {
+  (void)config;
+  (void)rxPin;
+  (void)txPin;
+  uart(port_).baud = baud;
+}
+
+static SimUart& pollUart(uint8_t port) {
+  SimUart& u = uart(port);
+  if (u.dev) u.dev->poll(timeUs);
+  return u;
+}
+
+int HardwareSerial::available() {
+  SimUart& u = pollUart(port_);
+  int      n = 0;
+  for (const SimRxByte& r : u.rx) {
+    if (r.atUs > timeUs) break;
+    ++n;
+  }
+  return n;
+}
+
+int HardwareSerial::read() {
+  SimUart& u = pollUart(port_);
+  if (u.rx.empty() || u.rx.front().atUs > timeUs) return -1;
+  uint8_t b = u.rx.front().b;
+  u.rx.pop_front();
+  return b;
+}
+
+int HardwareSerial::peek() {
+  SimUart& u = pollUart(port_);
+  if (u.rx.empty() || u.rx.front().atUs > timeUs) return -1;
+  return u.rx.front().b;
+}
+
+size_t HardwareSerial::write(uint8_t b) {
+  if (port_ == SIM_CONSOLE_PORT) {
+    // Binary frames (lib_control) are delimited by zero bytes, which text
+    // never contains
+    if (b == 0) {
+      if (inConsoleFrame && consoleFrameFn && !consoleFrame.empty()) {
+        consoleFrameFn((const uint8_t*)consoleFrame.data(),
+                       consoleFrame.size(), timeUs);
+      }
+      consoleFrame.clear();
+      inConsoleFrame = !inConsoleFrame;
+    } else if (inConsoleFrame) {
+      consoleFrame += (char)b;
+    } else if (b == '\n') {
+      if (consoleFn) consoleFn(consoleLine.c_str(), timeUs);
+      consoleLine.clear();
+    } else if (b != '\r') {
+      consoleLine += (char)b;
+    }
+    return 1;
+  }
+
+  // Bytes leave back to back through the TX FIFO; the device sees each one
+  // when its stop bit is done. write() itself does not block.
+  SimUart& u    = uart(port_);
+  uint64_t byte = simUartByteUs(port_);
+  uint64_t done = (u.txFreeUs > timeUs ? u.txFreeUs : timeUs) + byte;
+  u.txFreeUs    = done;
+  if (u.dev) u.dev->onHostByte(b, done);
+  return 1;
+}
+
+// USB CDC: TinyUSB's TX buffer; UARTs: the hardware FIFO. Writes do not
+// take time in the simulator, so the buffers are always empty.
+int HardwareSerial::availableForWrite() {
+  return port_ == SIM_CONSOLE_PORT ? 256 : 128;
+}
+
+void HardwareSerial::onReceive(OnReceiveCb function, bool onlyOnTimeout) {
+  (void)onlyOnTimeout;
+  uart(port_).onReceive = function;
+}
+
+// Every byte raises an event in the simulator anyway
+bool HardwareSerial::setRxFIFOFull(uint8_t fifoBytes) {
+  (void)fifoBytes;
+  return true;
+}
+
+void simRunUartEvents(void) {
+  for (uint8_t port = 0; port < SIM_UART_COUNT; ++port) {
+    SimUart& u = pollUart(port);
+    if (!u.onReceive || u.rx.empty() || u.rx.front().atUs > timeUs) continue;
+    u.onReceive();
+  }
+}
+
+void simAttachUart(uint8_t port, SimUartDevice* dev) {
+  uart(port).dev = dev;
+}
+
+void simUartDeliver(uint8_t port, uint8_t b, uint64_t atUs) {
+  uart(port).rx.push_back({b, atUs});
+}
+
+uint64_t simUartByteUs(uint8_t port) {
+  return 10000000ULL / uart(port).baud;  // start + 8 data + stop bits
+}
+
+void simSetConsole(SimConsoleFn fn) {
+  consoleFn = fn;
+}
+
+void simSetConsoleFrames(SimConsoleFrameFn fn) {
+  consoleFrameFn = fn;
+}
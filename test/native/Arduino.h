@@ -0,0 +1,165 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+/*
+ * Minimal Arduino-ESP32 API for host builds (benchmarks, simulator).
+ *
+ * Time is virtual: millis()/micros() return a clock that only moves when the
+ * host advances it (or when code calls delay()), so runs are deterministic.
+ * GPIO levels are plain arrays the host drives with nativeSetPin(). UARTs
+ * are byte queues with arrival timestamps, see sim_hooks.h.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <functional>
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x01
+#define OUTPUT       0x03
+#define INPUT_PULLUP 0x05
+
+#define HEX 16
+#define DEC 10
+
+#define SERIAL_8N1 0x800001c
+
+// T7-S3 default UART1 pins
+#define RX1 18
+#define TX1 17
+
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define IRAM_ATTR
+#define F(s) (s)
+
+#define NATIVE_PIN_COUNT 64
+
+unsigned long millis(void);
+unsigned long micros(void);
+void          delay(unsigned long ms);
+void          delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int  digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+
+int8_t digitalPinToAnalogChannel(uint8_t pin);
+
+/* Current CPU clock, see esp_pm.h */
+uint32_t getCpuFrequencyMhz(void);
+
+/* Host control of the virtual clock and pins */
+uint64_t nativeTimeUs(void);
+void     nativeSetTimeUs(uint64_t us);
+void     nativeAdvanceUs(uint64_t us);
+void     nativeSetPin(uint8_t pin, int level);
+int      nativePinLevel(uint8_t pin);
+
+/* std::string-backed subset of Arduino String */
+class String {
+ public:
+  String(const char* s = "") : s_(s ? s : "") {}
+  String(const std::string& s) : s_(s) {}
+  const char* c_str() const {
+    return s_.c_str();
+  }
+  size_t length() const {
+    return s_.size();
+  }
+  long toInt() const {
+    return strtol(s_.c_str(), nullptr, 10);
+  }
+  String& operator+=(const char* s) {
+    s_ += s;
+    return *this;
+  }
+  String& operator+=(const String& s) {
+    s_ += s.s_;
+    return *this;
+  }
+  bool operator==(const char* s) const {
+    return s_ == s;
+  }
+
+ private:
+  std::string s_;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t* buf, size_t len) {
+    for (size_t i = 0; i < len; ++i) write(buf[i]);
+    return len;
+  }
+  virtual int availableForWrite() {
+    return 0;
+  }
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+  size_t print(const char* s);
+  size_t print(long v, int base = DEC);
+  size_t println(void);
+  size_t println(const char* s);
+  size_t println(long v, int base = DEC);
+  size_t println(const struct IPAddress& ip);
+};
+
+class Stream : public Print {
+ public:
+  virtual int  available() = 0;
+  virtual int  read()      = 0;
+  virtual int  peek()      = 0;
+  virtual void flush() {}
+};
+
+typedef std::function<void(void)> OnReceiveCb;
+
+/* UARTs: plain data (constant-initialized, so other static constructors can
+ * call begin()); the byte queues live in the simulator, see sim_hooks.h.
+ * onReceive() callbacks run from simRunUartEvents(), standing in for the
+ * UART event task. */
+class HardwareSerial : public Stream {
+ public:
+  constexpr explicit HardwareSerial(uint8_t port) : port_(port) {}
+  void   begin(unsigned long baud, uint32_t config = SERIAL_8N1,
+               int8_t rxPin = -1, int8_t txPin = -1);
+  int    available() override;
+  int    read() override;
+  int    peek() override;
+  size_t write(uint8_t b) override;
+  using Print::write;
+  int    availableForWrite() override;
+  void   onReceive(OnReceiveCb function, bool onlyOnTimeout = false);
+  bool   setRxFIFOFull(uint8_t fifoBytes);
+
+ private:
+  uint8_t port_;
+};
+
+extern HardwareSerial Serial;  // USB CDC console
+extern HardwareSerial Serial0;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+
+class EspClass {
+ public:
+  uint64_t getEfuseMac() {
+    return 0x00003D2A1CF0E47CULL;
+  }
+};
+extern EspClass ESP;
+
+#endif  // NATIVE_ARDUINO_H
@@ -0,0 +1,168 @@
+#include "DFRobotDFPlayerMini.h"
+
+// Command and report codes (DFPlayer Mini manual)
+static const uint8_t kCmdPlay   = 0x03;
+static const uint8_t kCmdVolume = 0x06;
+static const uint8_t kCmdReset  = 0x0C;
+static const uint8_t kCmdStart  = 0x0D;
+static const uint8_t kCmdPause  = 0x0E;
+static const uint8_t kCmdStop   = 0x16;
+
+static const uint8_t kRptCardInserted = 0x3A;
+static const uint8_t kRptCardRemoved  = 0x3B;
+static const uint8_t kRptPlayFinished = 0x3D;
+static const uint8_t kRptOnline       = 0x3F;
+static const uint8_t kRptError        = 0x40;
+static const uint8_t kRptAck          = 0x41;
+
+// virtual time per spin of a busy-wait (the real library uses delay(0))
+static const unsigned int kSpinUs = 100;
+
+DFRobotDFPlayerMini::DFRobotDFPlayerMini()
+    : serial_(nullptr),
+      parser_(),
+      ack_(true),
+      isSending_(false),
+      isAvailable_(false),
+      timeOutTimer_(0),
+      timeOutDuration_(500),
+      handleType_(TimeOut),
+      handleParameter_(0) {}
+
+bool DFRobotDFPlayerMini::begin(Stream& stream, bool isACK, bool doReset) {
+  serial_ = &stream;
+  ack_    = isACK;
+  if (doReset) {
+    reset();
+    waitAvailable(2000);
+    delay(200);
+  } else {
+    // assume same state as with reset(): online
+    handleType_ = DFPlayerCardOnline;
+  }
+  return readType() == DFPlayerCardOnline || readType() == DFPlayerUSBOnline ||
+         !isACK;
+}
+
+bool DFRobotDFPlayerMini::waitAvailable(unsigned long duration) {
+  unsigned long timer = millis();
+  if (!duration) duration = timeOutDuration_;
+  while (!available()) {
+    if (millis() - timer > duration) return handleError(TimeOut);
+    delayMicroseconds(kSpinUs);
+  }
+  return true;
+}
+
+bool DFRobotDFPlayerMini::available() {
+  while (serial_ && serial_->available()) {
+    int b = serial_->read();
+    if (b < 0) break;
+    if (parser_.feed((uint8_t)b)) {
+      parseStack(parser_.frame());
+      if (isAvailable_) return true;
+    }
+  }
+  if (isSending_ && millis() - timeOutTimer_ >= timeOutDuration_) {
+    return handleError(TimeOut);
+  }
+  return isAvailable_;
+}
+
+uint8_t DFRobotDFPlayerMini::readType() {
+  isAvailable_ = false;
+  return handleType_;
+}
+
+uint16_t DFRobotDFPlayerMini::read() {
+  isAvailable_ = false;
+  return handleParameter_;
+}
+
+void DFRobotDFPlayerMini::reset() {
+  sendStack(kCmdReset);
+}
+
+void DFRobotDFPlayerMini::volume(uint8_t volume) {
+  sendStack(kCmdVolume, volume);
+}
+
+void DFRobotDFPlayerMini::play(int fileNumber) {
+  sendStack(kCmdPlay, (uint16_t)fileNumber);
+}
+
+void DFRobotDFPlayerMini::start() {
+  sendStack(kCmdStart);
+}
+
+void DFRobotDFPlayerMini::pause() {
+  sendStack(kCmdPause);
+}
+
+void DFRobotDFPlayerMini::stop() {
+  sendStack(kCmdStop);
+}
+
+void DFRobotDFPlayerMini::sendStack(uint8_t command, uint16_t argument) {
+  if (!serial_) return;
+  if (ack_) {
+    // wait for the previous command's ACK (or its timeout)
+    while (isSending_) {
+      delayMicroseconds(kSpinUs);
+      available();
+    }
+  } else {
+    delay(10);
+  }
+
+  uint8_t       out[DF_FRAME_LEN];
+  const DfFrame frame = {command, ack_, argument};
+  dfEncodeFrame(frame, out);
+  serial_->write(out, DF_FRAME_LEN);
+  timeOutTimer_ = millis();
+  isSending_    = ack_;
+  if (!ack_) delay(10);
+}
+
+bool DFRobotDFPlayerMini::handleMessage(uint8_t type, uint16_t parameter) {
+  handleType_      = type;
+  handleParameter_ = parameter;
+  isAvailable_     = true;
+  return isAvailable_;
+}
+
+bool DFRobotDFPlayerMini::handleError(uint8_t type, uint16_t parameter) {
+  handleMessage(type, parameter);
+  isSending_ = false;
+  return false;
+}
+
+void DFRobotDFPlayerMini::parseStack(const DfFrame& frame) {
+  if (frame.cmd == kRptAck) {
+    isSending_ = false;
+    return;
+  }
+  switch (frame.cmd) {
+    case kRptPlayFinished:
+      handleMessage(DFPlayerPlayFinished, frame.param);
+      break;
+    case kRptOnline:
+      if (frame.param & 0x02)
+        handleMessage(DFPlayerCardOnline, frame.param);
+      else if (frame.param & 0x01)
+        handleMessage(DFPlayerUSBOnline, frame.param);
+      break;
+    case kRptCardInserted:
+      handleMessage(DFPlayerCardInserted, frame.param);
+      break;
+    case kRptCardRemoved:
+      handleMessage(DFPlayerCardRemoved, frame.param);
+      break;
+    case kRptError:
+      handleMessage(DFPlayerError, frame.param);
+      break;
+    default:
+      handleMessage(DFPlayerFeedBack, frame.param);
+      break;
+  }
+}
@@ -0,0 +1,67 @@
+#ifndef NATIVE_DFROBOTDFPLAYERMINI_H
+#define NATIVE_DFROBOTDFPLAYERMINI_H
+
+/*
+ * Host stand-in for DFRobotDFPlayerMini (1.0.6) with the same API subset
+ * and timing behavior as the real library:
+ * - with ACK enabled, a command first waits for the previous command's ACK
+ *   (up to 500 ms), spinning on available()
+ * - begin() with reset sends 0x0C and waits up to 2 s for the "card online"
+ *   report, then 200 ms more
+ * Frames go through dfplayer_frame, so a device model on the UART sees the
+ * exact bytes the real library sends. The real library spins with delay(0);
+ * here every spin advances the virtual clock by 100 us.
+ */
+
+#include <Arduino.h>
+
+#include "dfplayer_frame.hpp"
+
+#define TimeOut               0
+#define WrongStack            1
+#define DFPlayerCardInserted  2
+#define DFPlayerCardRemoved   3
+#define DFPlayerCardOnline    4
+#define DFPlayerPlayFinished  5
+#define DFPlayerError         6
+#define DFPlayerUSBInserted   7
+#define DFPlayerUSBRemoved    8
+#define DFPlayerUSBOnline     9
+#define DFPlayerCardUSBOnline 10
+#define DFPlayerFeedBack      11
+
+class DFRobotDFPlayerMini {
+ public:
+  DFRobotDFPlayerMini();
+
+  bool     begin(Stream& stream, bool isACK = true, bool doReset = true);
+  bool     waitAvailable(unsigned long duration = 0);
+  bool     available();
+  uint8_t  readType();
+  uint16_t read();
+
+  void reset();
+  void volume(uint8_t volume);
+  void play(int fileNumber = 1);
+  void start();
+  void pause();
+  void stop();
+
+ private:
+  void sendStack(uint8_t command, uint16_t argument = 0);
+  bool handleMessage(uint8_t type, uint16_t parameter = 0);
+  bool handleError(uint8_t type, uint16_t parameter = 0);
+  void parseStack(const DfFrame& frame);
+
+  Stream*       serial_;
+  DfFrameParser parser_;
+  bool          ack_;
+  bool          isSending_;
+  bool          isAvailable_;
+  unsigned long timeOutTimer_;
+  unsigned long timeOutDuration_;
+  uint8_t       handleType_;
+  uint16_t      handleParameter_;
+};
+
+#endif  // NATIVE_DFROBOTDFPLAYERMINI_H
@@ -0,0 +1,14 @@
+#ifndef NATIVE_ESPMDNS_H
+#define NATIVE_ESPMDNS_H
+
+class MDNSResponder {
+ public:
+  bool begin(const char* hostName) {
+    (void)hostName;
+    return true;
+  }
+};
+
+extern MDNSResponder MDNS;
+
+#endif  // NATIVE_ESPMDNS_H
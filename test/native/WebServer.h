@@ -0,0 +1,47 @@
+#ifndef NATIVE_WEBSERVER_H
+#define NATIVE_WEBSERVER_H
+
+/* Host model of the Arduino-ESP32 WebServer: requests come from in-process
+ * clients (simHttpSubmit()) instead of sockets. */
+
+#include "Arduino.h"
+
+typedef enum { HTTP_ANY, HTTP_GET, HTTP_POST } HTTPMethod;
+
+// setContentLength() of a chunked response
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+
+class WebServer {
+ public:
+  typedef void (*THandlerFunction)(void);
+
+  explicit WebServer(int port);
+  void       on(const char* uri, HTTPMethod method, THandlerFunction fn);
+  void       onNotFound(THandlerFunction fn);
+  void       begin();
+  void       handleClient();
+  void       send(int code, const char* contentType, const String& content);
+  void       send_P(int code, const char* contentType, const char* content);
+  void       send_P(int code, const char* contentType, const char* content,
+                    size_t len);
+  void       setContentLength(size_t len);
+  void       sendContent(const char* content, size_t len);
+  String     uri();
+  bool       hasArg(const char* name);
+  String     arg(const char* name);
+  HTTPMethod method();
+
+ private:
+  static const int kMaxRoutes = 16;
+  struct Route {
+    const char*      uri;
+    HTTPMethod       method;
+    THandlerFunction fn;
+  };
+  Route            routes_[kMaxRoutes];
+  int              routeCount_;
+  THandlerFunction notFound_;
+  bool             started_;
+};
+
+#endif  // NATIVE_WEBSERVER_H
@@ -0,0 +1,245 @@
+#include "WiFi.h"
+#include "ESPmDNS.h"
+#include "WebServer.h"
+#include "sim_hooks.h"
+
+#include <deque>
+
+WiFiClass     WiFi;
+MDNSResponder MDNS;
+
+/* WiFi: one AP, fixed addresses, association after a delay */
+
+static const IPAddress kStaIP(192, 168, 1, 50);
+static const IPAddress kGateway(192, 168, 1, 1);
+static const IPAddress kSubnet(255, 255, 255, 0);
+static const IPAddress kApIP(192, 168, 4, 1);
+static uint8_t         kBssid[6] = {0x02, 0x00, 0x5e, 0x10, 0x20, 0x30};
+static const int32_t   kChannel  = 6;
+
+static wifi_mode_t wifiMode      = WIFI_MODE_NULL;
+static bool        joining       = false;
+static bool        linkUp        = false;  // GOT_IP delivered
+static uint64_t    connectAtUs   = 0;
+static uint32_t    fullConnectMs = 1800;  // scan + auth + DHCP
+static uint32_t    fastConnectMs = 250;   // known BSSID/channel, static IP
+
+void simSetWiFiConnectMs(uint32_t fullMs, uint32_t fastMs) {
+  fullConnectMs = fullMs;
+  fastConnectMs = fastMs;
+}
+
+static WiFiEventFuncCb    eventCb   = nullptr;
+static arduino_event_id_t eventOnly = ARDUINO_EVENT_MAX;
+
+static void deliver(arduino_event_id_t event, uint32_t ip) {
+  if (!eventCb || (eventOnly != ARDUINO_EVENT_MAX && eventOnly != event)) {
+    return;
+  }
+  arduino_event_info_t info;
+  info.got_ip.ip_info.ip.addr = ip;
+  eventCb(event, info);
+}
+
+int WiFiClass::onEvent(WiFiEventFuncCb cb, arduino_event_id_t event) {
+  eventCb   = cb;
+  eventOnly = event;
+  return 1;
+}
+
+bool WiFiClass::mode(wifi_mode_t m) {
+  wifiMode = m;
+  return true;
+}
+
+wifi_mode_t WiFiClass::getMode() {
+  return wifiMode;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* pass,
+                             int32_t channel, const uint8_t* bssid) {
+  (void)pass;
+  if (strcmp(ssid, "sim-ap") != 0) {
+    joining = false;
+    return WL_NO_SSID_AVAIL;
+  }
+  bool fast   = bssid && channel == kChannel;
+  joining     = true;
+  connectAtUs = nativeTimeUs() +
+                (uint64_t)(fast ? fastConnectMs : fullConnectMs) * 1000;
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::config(IPAddress ip, IPAddress gateway, IPAddress subnet,
+                       IPAddress dns) {
+  (void)ip;
+  (void)gateway;
+  (void)subnet;
+  (void)dns;
+  return true;
+}
+
+bool WiFiClass::disconnect() {
+  joining = false;
+  if (linkUp) {
+    linkUp = false;
+    deliver(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, 0);
+  }
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  if (!joining || nativeTimeUs() < connectAtUs) return WL_DISCONNECTED;
+  if (!linkUp) {
+    linkUp = true;
+    deliver(ARDUINO_EVENT_WIFI_STA_GOT_IP, kStaIP);
+  }
+  return WL_CONNECTED;
+}
+
+bool WiFiClass::softAP(const char* ssid) {
+  (void)ssid;
+  deliver(ARDUINO_EVENT_WIFI_AP_START, kApIP);
+  return true;
+}
+
+IPAddress WiFiClass::softAPIP() {
+  return kApIP;
+}
+
+IPAddress WiFiClass::localIP() {
+  return status() == WL_CONNECTED ? kStaIP : IPAddress();
+}
+
+IPAddress WiFiClass::gatewayIP() {
+  return kGateway;
+}
+
+IPAddress WiFiClass::subnetMask() {
+  return kSubnet;
+}
+
+IPAddress WiFiClass::dnsIP() {
+  return kGateway;
+}
+
+uint8_t* WiFiClass::BSSID() {
+  return kBssid;
+}
+
+int32_t WiFiClass::channel() {
+  return kChannel;
+}
+
+int8_t WiFiClass::RSSI() {
+  return status() == WL_CONNECTED ? -58 : 0;
+}
+
+/* WebServer: requests come from simHttpSubmit() */
+
+static std::deque<SimHttpRequest*>& httpQueue() {
+  static std::deque<SimHttpRequest*> queue;
+  return queue;
+}
+
+static SimHttpRequest* currentRequest = nullptr;
+
+void simHttpSubmit(SimHttpRequest* req) {
+  req->doneUs = 0;
+  httpQueue().push_back(req);
+}
+
+size_t simHttpPending(void) {
+  return httpQueue().size();
+}
+
+WebServer::WebServer(int port)
+    : routeCount_(0), notFound_(nullptr), started_(false) {
+  (void)port;
+}
+
+void WebServer::on(const char* uri, HTTPMethod method, THandlerFunction fn) {
+  if (routeCount_ < kMaxRoutes) routes_[routeCount_++] = {uri, method, fn};
+}
+
+void WebServer::onNotFound(THandlerFunction fn) {
+  notFound_ = fn;
+}
+
+void WebServer::begin() {
+  started_ = true;
+}
+
+void WebServer::handleClient() {
+  // like the real server: at most one client per call
+  if (!started_ || httpQueue().empty()) return;
+  currentRequest = httpQueue().front();
+  httpQueue().pop_front();
+
+  HTTPMethod       m  = currentRequest->post ? HTTP_POST : HTTP_GET;
+  THandlerFunction fn = notFound_;
+  for (int i = 0; i < routeCount_; ++i) {
+    if (strcmp(routes_[i].uri, currentRequest->path) == 0 &&
+        (routes_[i].method == HTTP_ANY || routes_[i].method == m)) {
+      fn = routes_[i].fn;
+      break;
+    }
+  }
+  if (fn) {
+    fn();
+  } else {
+    send_P(404, "text/plain", "", 0);
+  }
+  currentRequest = nullptr;
+}
+
+void WebServer::send(int code, const char* contentType,
+                     const String& content) {
+  send_P(code, contentType, content.c_str(), content.length());
+}
+
+void WebServer::send_P(int code, const char* contentType,
+                       const char* content) {
+  send_P(code, contentType, content, strlen(content));
+}
+
+void WebServer::send_P(int code, const char* contentType, const char* content,
+                       size_t len) {
+  (void)contentType;
+  (void)content;
+  if (!currentRequest) return;
+  currentRequest->code    = code;
+  currentRequest->bodyLen = len;
+  currentRequest->doneUs  = nativeTimeUs();
+}
+
+// Streamed responses: send() with an empty body, then sendContent() chunks
+void WebServer::setContentLength(size_t len) {
+  (void)len;
+}
+
+void WebServer::sendContent(const char* content, size_t len) {
+  (void)content;
+  if (!currentRequest) return;
+  currentRequest->bodyLen += len;
+  currentRequest->doneUs   = nativeTimeUs();
+}
+
+String WebServer::uri() {
+  return String(currentRequest ? currentRequest->path : "");
+}
+
+// Simulated requests carry no query string or form
+bool WebServer::hasArg(const char* name) {
+  (void)name;
+  return false;
+}
+
+String WebServer::arg(const char* name) {
+  (void)name;
+  return String();
+}
+
+HTTPMethod WebServer::method() {
+  return (currentRequest && currentRequest->post) ? HTTP_POST : HTTP_GET;
+}
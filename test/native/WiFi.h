@@ -0,0 +1,89 @@
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+/* Host model of the Arduino-ESP32 WiFi API: a single AP that accepts the
+ * station after a configurable association delay (see sim_hooks.h). */
+
+#include "Arduino.h"
+
+struct IPAddress {
+  uint32_t addr;  // byte 0 = first octet, like the ESP32 core
+
+  IPAddress(uint32_t a = 0) : addr(a) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      : addr(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+  operator uint32_t() const {
+    return addr;
+  }
+  uint8_t operator[](int i) const {
+    return (uint8_t)(addr >> (8 * i));
+  }
+};
+
+#define INADDR_NONE IPAddress((uint32_t)0)
+
+typedef enum {
+  WIFI_MODE_NULL = 0,
+  WIFI_MODE_STA,
+  WIFI_MODE_AP,
+  WIFI_MODE_APSTA
+} wifi_mode_t;
+#define WIFI_STA WIFI_MODE_STA
+#define WIFI_AP  WIFI_MODE_AP
+
+typedef enum {
+  WL_IDLE_STATUS    = 0,
+  WL_NO_SSID_AVAIL  = 1,
+  WL_CONNECTED      = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED   = 6
+} wl_status_t;
+
+/* Link events. There is no event task: they are delivered when the firmware
+ * next looks at the link (status(), disconnect(), softAP()). */
+typedef enum {
+  ARDUINO_EVENT_WIFI_STA_GOT_IP,
+  ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+  ARDUINO_EVENT_WIFI_AP_START,
+  ARDUINO_EVENT_MAX
+} arduino_event_id_t;
+
+typedef union {
+  struct {
+    struct {
+      struct {
+        uint32_t addr;
+      } ip;
+    } ip_info;
+  } got_ip;
+} arduino_event_info_t;
+
+typedef void (*WiFiEventFuncCb)(arduino_event_id_t event,
+                                arduino_event_info_t info);
+
+class WiFiClass {
+ public:
+  int         onEvent(WiFiEventFuncCb cb,
+                      arduino_event_id_t event = ARDUINO_EVENT_MAX);
+  bool        mode(wifi_mode_t m);
+  wifi_mode_t getMode();
+  wl_status_t begin(const char* ssid, const char* pass, int32_t channel = 0,
+                    const uint8_t* bssid = nullptr);
+  bool        config(IPAddress ip, IPAddress gateway, IPAddress subnet,
+                     IPAddress dns = (uint32_t)0);
+  bool        disconnect();
+  wl_status_t status();
+  bool        softAP(const char* ssid);
+  IPAddress   softAPIP();
+  IPAddress   localIP();
+  IPAddress   gatewayIP();
+  IPAddress   subnetMask();
+  IPAddress   dnsIP();
+  uint8_t*    BSSID();
+  int32_t     channel();
+  int8_t      RSSI();
+};
+
+extern WiFiClass WiFi;
+
+#endif  // NATIVE_WIFI_H
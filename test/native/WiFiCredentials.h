@@ -0,0 +1,3 @@
+// Simulated access point (see test/native/WiFi.cpp)
+static const char* WIFI_SSID     = "sim-ap";
+static const char* WIFI_PASSWORD = "sim-password";
@@ -0,0 +1,18 @@
+#ifndef NATIVE_DRIVER_ADC_H
+#define NATIVE_DRIVER_ADC_H
+
+/* ADC1 model: every channel reads the simulated battery voltage through
+ * the 1:2 divider (simSetBatteryMv()), linear over 0..3300 mV. */
+
+#include "esp_err.h"
+
+typedef enum { ADC_UNIT_1 = 1, ADC_UNIT_2 } adc_unit_t;
+typedef enum { ADC_WIDTH_BIT_12 = 3 } adc_bits_width_t;
+typedef enum { ADC_ATTEN_DB_0 = 0, ADC_ATTEN_DB_12 = 3 } adc_atten_t;
+typedef enum { ADC1_CHANNEL_0 = 0, ADC1_CHANNEL_MAX = 10 } adc1_channel_t;
+
+esp_err_t adc1_config_width(adc_bits_width_t width);
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten);
+int       adc1_get_raw(adc1_channel_t channel);
+
+#endif  // NATIVE_DRIVER_ADC_H
@@ -0,0 +1,6 @@
+#ifndef NATIVE_DRIVER_GPIO_H
+#define NATIVE_DRIVER_GPIO_H
+
+typedef int gpio_num_t;
+
+#endif  // NATIVE_DRIVER_GPIO_H
@@ -0,0 +1,12 @@
+#ifndef NATIVE_DRIVER_RTC_IO_H
+#define NATIVE_DRIVER_RTC_IO_H
+
+#include "driver/gpio.h"
+#include "esp_err.h"
+
+/* ESP32-S3: GPIO0..21 are RTC GPIOs */
+bool      rtc_gpio_is_valid_gpio(gpio_num_t pin);
+esp_err_t rtc_gpio_pullup_en(gpio_num_t pin);
+esp_err_t rtc_gpio_pulldown_dis(gpio_num_t pin);
+
+#endif  // NATIVE_DRIVER_RTC_IO_H
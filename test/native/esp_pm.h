@@ -0,0 +1,33 @@
+#ifndef NATIVE_ESP_PM_H
+#define NATIVE_ESP_PM_H
+
+/* Power management model: once configured, the CPU runs at max_freq_mhz
+ * while any ESP_PM_CPU_FREQ_MAX lock is held and at min_freq_mhz otherwise
+ * (getCpuFrequencyMhz() reports it). simSetPmSupported(false) makes
+ * esp_pm_configure() fail like a build without CONFIG_PM_ENABLE. */
+
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+typedef enum {
+  ESP_PM_CPU_FREQ_MAX,
+  ESP_PM_APB_FREQ_MAX,
+  ESP_PM_NO_LIGHT_SLEEP
+} esp_pm_lock_type_t;
+
+typedef struct esp_pm_lock* esp_pm_lock_handle_t;
+
+typedef struct {
+  int  max_freq_mhz;
+  int  min_freq_mhz;
+  bool light_sleep_enable;
+} esp_pm_config_esp32s3_t;
+
+esp_err_t esp_pm_configure(const void* config);
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg,
+                             const char* name, esp_pm_lock_handle_t* out);
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle);
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle);
+
+#endif  // NATIVE_ESP_PM_H
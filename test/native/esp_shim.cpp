@@ -0,0 +1,338 @@
+/*
+ * esp_shim.cpp
+ *
+ * Host implementations of the ESP-IDF pieces the firmware uses: esp_timer
+ * on the virtual clock, ADC1 reading a simulated battery, heap_caps over
+ * malloc, deep sleep as an exception, a lock-driven CPU clock for esp_pm
+ * and a single-task FreeRTOS.
+ */
+
+#include "driver/adc.h"
+#include "driver/rtc_io.h"
+#include "esp_adc_cal.h"
+#include "esp_heap_caps.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "sim_hooks.h"
+#include <Arduino.h>
+
+#include <vector>
+
+/* esp_timer */
+
+struct esp_timer {
+  esp_timer_cb_t cb;
+  void*          arg;
+  uint64_t       period;  // 0 = one-shot
+  uint64_t       dueUs;
+  bool           armed;
+};
+
+static std::vector<esp_timer*>& timers() {
+  static std::vector<esp_timer*> list;
+  return list;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args,
+                           esp_timer_handle_t*            out) {
+  if (!args || !args->callback || !out) return ESP_ERR_INVALID_ARG;
+  esp_timer* t = new esp_timer{args->callback, args->arg, 0, 0, false};
+  timers().push_back(t);
+  *out = t;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+  if (!timer || period == 0) return ESP_ERR_INVALID_ARG;
+  timer->period = period;
+  timer->dueUs  = nativeTimeUs() + period;
+  timer->armed  = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout) {
+  if (!timer) return ESP_ERR_INVALID_ARG;
+  timer->period = 0;
+  timer->dueUs  = nativeTimeUs() + timeout;
+  timer->armed  = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if (!timer) return ESP_ERR_INVALID_ARG;
+  timer->armed = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  std::vector<esp_timer*>& list = timers();
+  for (size_t i = 0; i < list.size(); ++i) {
+    if (list[i] == timer) {
+      list.erase(list.begin() + i);
+      delete timer;
+      return ESP_OK;
+    }
+  }
+  return ESP_ERR_INVALID_ARG;
+}
+
+int64_t esp_timer_get_time(void) {
+  return (int64_t)nativeTimeUs();
+}
+
+void simRunTimers(void) {
+  uint64_t now = nativeTimeUs();
+  for (esp_timer* t : timers()) {
+    if (!t->armed || t->dueUs > now) continue;
+    if (t->period) {
+      // skip_unhandled_events: late periods are dropped, not replayed
+      while (t->dueUs <= now) t->dueUs += t->period;
+    } else {
+      t->armed = false;
+    }
+    t->cb(t->arg);
+  }
+}
+
+uint64_t simNextTimerUs(void) {
+  uint64_t next = UINT64_MAX;
+  for (esp_timer* t : timers()) {
+    if (t->armed && t->dueUs < next) next = t->dueUs;
+  }
+  return next;
+}
+
+/* ADC1: battery through a 1:2 divider, linear 0..3300 mV over 12 bits */
+
+static uint16_t batteryMv = 3900;
+
+void simSetBatteryMv(uint16_t mv) {
+  batteryMv = mv;
+}
+
+esp_err_t adc1_config_width(adc_bits_width_t width) {
+  (void)width;
+  return ESP_OK;
+}
+
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten) {
+  (void)channel;
+  (void)atten;
+  return ESP_OK;
+}
+
+int adc1_get_raw(adc1_channel_t channel) {
+  (void)channel;
+  uint32_t pinMv = batteryMv / 2;
+  if (pinMv > 3300) pinMv = 3300;
+  return (int)(pinMv * 4095 / 3300);
+}
+
+esp_adc_cal_value_t esp_adc_cal_characterize(
+    adc_unit_t unit, adc_atten_t atten, adc_bits_width_t width,
+    uint32_t defaultVref, esp_adc_cal_characteristics_t* chars) {
+  chars->adc_num   = unit;
+  chars->atten     = atten;
+  chars->bit_width = width;
+  chars->vref      = defaultVref;
+  return ESP_ADC_CAL_VAL_DEFAULT_VREF;
+}
+
+uint32_t esp_adc_cal_raw_to_voltage(
+    uint32_t raw, const esp_adc_cal_characteristics_t* chars) {
+  (void)chars;
+  return (raw * 3300 + 2047) / 4095;
+}
+
+/* heap_caps: one 320 KiB internal region, no PSRAM */
+
+static const size_t kInternalBytes = 320 * 1024;
+
+static size_t usedBytes    = 0;
+static size_t maxUsedBytes = 0;
+
+static bool internalCaps(uint32_t caps) {
+  return !(caps & MALLOC_CAP_SPIRAM);
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+  if (!internalCaps(caps) || usedBytes + size > kInternalBytes) return nullptr;
+  size_t* p = (size_t*)malloc(sizeof(size_t) + size);
+  if (!p) return nullptr;
+  *p        = size;
+  usedBytes += size;
+  if (usedBytes > maxUsedBytes) maxUsedBytes = usedBytes;
+  return p + 1;
+}
+
+void heap_caps_free(void* ptr) {
+  if (!ptr) return;
+  size_t* p = (size_t*)ptr - 1;
+  usedBytes -= *p;
+  free(p);
+}
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+  return internalCaps(caps) ? kInternalBytes : 0;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+  return internalCaps(caps) ? kInternalBytes - usedBytes : 0;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+  return internalCaps(caps) ? kInternalBytes - maxUsedBytes : 0;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+  return heap_caps_get_free_size(caps);
+}
+
+/* Deep sleep */
+
+static int      wakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+static uint64_t ext1Mask  = 0;
+static int      ext0Pin   = -1;
+
+void simSetWakeCause(int cause) {
+  wakeCause = cause;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void) {
+  return (esp_sleep_wakeup_cause_t)wakeCause;
+}
+
+static int resetReason = ESP_RST_POWERON;
+
+void simSetResetReason(int reason) {
+  resetReason = reason;
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+  return (esp_reset_reason_t)resetReason;
+}
+
+esp_err_t esp_sleep_pd_config(esp_sleep_pd_domain_t domain,
+                              esp_sleep_pd_option_t option) {
+  (void)domain;
+  (void)option;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t pin, int level) {
+  (void)level;
+  ext0Pin = pin;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t mask,
+                                       esp_sleep_ext1_wakeup_mode_t mode) {
+  (void)mode;
+  ext1Mask = mask;
+  return ESP_OK;
+}
+
+void esp_deep_sleep_start(void) {
+  throw SimDeepSleep{ext1Mask, ext0Pin};
+}
+
+bool rtc_gpio_is_valid_gpio(gpio_num_t pin) {
+  return pin >= 0 && pin <= 21;
+}
+
+esp_err_t rtc_gpio_pullup_en(gpio_num_t pin) {
+  pinMode(pin, INPUT_PULLUP);
+  return ESP_OK;
+}
+
+esp_err_t rtc_gpio_pulldown_dis(gpio_num_t pin) {
+  (void)pin;
+  return ESP_OK;
+}
+
+/* Power management: CPU clock from the CPU_FREQ_MAX locks held */
+
+struct esp_pm_lock {
+  esp_pm_lock_type_t type;
+  int                count;
+};
+
+static bool     pmSupported  = true;
+static bool     pmConfigured = false;
+static uint32_t pmMaxMhz     = 240;
+static uint32_t pmMinMhz     = 240;
+static int      pmMaxHeld    = 0;  // CPU_FREQ_MAX acquisitions outstanding
+
+void simSetPmSupported(bool supported) {
+  pmSupported = supported;
+}
+
+esp_err_t esp_pm_configure(const void* config) {
+  if (!pmSupported) return ESP_ERR_NOT_SUPPORTED;
+  const esp_pm_config_esp32s3_t* c = (const esp_pm_config_esp32s3_t*)config;
+  if (c->min_freq_mhz > c->max_freq_mhz) return ESP_ERR_INVALID_ARG;
+  pmMaxMhz     = (uint32_t)c->max_freq_mhz;
+  pmMinMhz     = (uint32_t)c->min_freq_mhz;
+  pmConfigured = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg,
+                             const char* name, esp_pm_lock_handle_t* out) {
+  (void)arg;
+  (void)name;
+  if (!pmSupported) return ESP_ERR_NOT_SUPPORTED;
+  *out = new esp_pm_lock{lock_type, 0};
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+  if (handle->type == ESP_PM_CPU_FREQ_MAX) ++pmMaxHeld;
+  ++handle->count;
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+  if (handle->count == 0) return ESP_ERR_INVALID_STATE;
+  if (handle->type == ESP_PM_CPU_FREQ_MAX) --pmMaxHeld;
+  --handle->count;
+  return ESP_OK;
+}
+
+uint32_t getCpuFrequencyMhz(void) {
+  if (!pmConfigured) return pmMaxMhz;
+  return pmMaxHeld > 0 ? pmMaxMhz : pmMinMhz;
+}
+
+/* FreeRTOS: the loop task only */
+
+static int loopTask;
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  return &loopTask;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  delay(ticks * portTICK_PERIOD_MS);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name,
+                                   uint32_t stackDepth, void* arg,
+                                   unsigned priority, TaskHandle_t* handle,
+                                   BaseType_t core) {
+  (void)fn;
+  (void)name;
+  (void)stackDepth;
+  (void)arg;
+  (void)priority;
+  (void)core;
+  if (handle) *handle = nullptr;
+  return pdFALSE;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  (void)task;
+}
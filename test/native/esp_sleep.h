@@ -0,0 +1,35 @@
+#ifndef NATIVE_ESP_SLEEP_H
+#define NATIVE_ESP_SLEEP_H
+
+#include <stdint.h>
+
+#include "driver/gpio.h"
+#include "esp_err.h"
+
+typedef enum {
+  ESP_SLEEP_WAKEUP_UNDEFINED = 0,
+  ESP_SLEEP_WAKEUP_ALL,
+  ESP_SLEEP_WAKEUP_EXT0,
+  ESP_SLEEP_WAKEUP_EXT1,
+  ESP_SLEEP_WAKEUP_TIMER
+} esp_sleep_wakeup_cause_t;
+
+typedef enum {
+  ESP_EXT1_WAKEUP_ALL_LOW  = 0,
+  ESP_EXT1_WAKEUP_ANY_HIGH = 1
+} esp_sleep_ext1_wakeup_mode_t;
+
+typedef enum { ESP_PD_DOMAIN_RTC_PERIPH } esp_sleep_pd_domain_t;
+typedef enum { ESP_PD_OPTION_OFF, ESP_PD_OPTION_ON } esp_sleep_pd_option_t;
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void);
+esp_err_t esp_sleep_pd_config(esp_sleep_pd_domain_t domain,
+                              esp_sleep_pd_option_t option);
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t pin, int level);
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t mask,
+                                       esp_sleep_ext1_wakeup_mode_t mode);
+
+/* Throws SimDeepSleep (sim_hooks.h) */
+[[noreturn]] void esp_deep_sleep_start(void);
+
+#endif  // NATIVE_ESP_SLEEP_H
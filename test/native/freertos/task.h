@@ -0,0 +1,23 @@
+#ifndef NATIVE_FREERTOS_TASK_H
+#define NATIVE_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* arg);
+
+/* Always the loop task */
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+/* Advances the virtual clock, like delay() */
+void vTaskDelay(TickType_t ticks);
+
+/* Tasks cannot run concurrently on the host: creation fails, so callers
+ * take their no-task fallback. */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name,
+                                   uint32_t stackDepth, void* arg,
+                                   unsigned priority, TaskHandle_t* handle,
+                                   BaseType_t core);
+void       vTaskDelete(TaskHandle_t task);
+
+#endif  // NATIVE_FREERTOS_TASK_H
@@ -0,0 +1,91 @@
+#ifndef NATIVE_SIM_HOOKS_H
+#define NATIVE_SIM_HOOKS_H
+
+/*
+ * Simulator side of the host shim: lets a host program attach device models
+ * to the UARTs, inject HTTP requests, run esp_timer callbacks and observe
+ * console output and deep sleep. Firmware code never includes this.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SIM_UART_COUNT   3  // Serial0..2
+#define SIM_CONSOLE_PORT 3  // Serial (USB CDC)
+
+/* Device attached to a UART: receives what the firmware transmits and
+ * answers through simUartDeliver(). */
+class SimUartDevice {
+ public:
+  virtual ~SimUartDevice() {}
+  // b finished arriving at the device at time us
+  virtual void onHostByte(uint8_t b, uint64_t us) = 0;
+  // the firmware is looking at the RX side at time us: deliver anything
+  // due by then (lets a device answer while the firmware busy-waits)
+  virtual void poll(uint64_t us) {
+    (void)us;
+  }
+};
+
+void simAttachUart(uint8_t port, SimUartDevice* dev);
+
+/* Queue a byte from the device to the firmware; readable from atUs on.
+ * Bytes must be queued in arrival order. */
+void simUartDeliver(uint8_t port, uint8_t b, uint64_t atUs);
+
+/* Time one byte takes on the wire at the configured baud (8N1). */
+uint64_t simUartByteUs(uint8_t port);
+
+/* Run the onReceive() callbacks of UARTs that have bytes due by now */
+void simRunUartEvents(void);
+
+/* esp_timer service */
+void     simRunTimers(void);    // run callbacks that are due now
+uint64_t simNextTimerUs(void);  // UINT64_MAX when none armed
+
+/* In-process HTTP clients: submit a request, the firmware's WebServer picks
+ * it up on its next handleClient() call. */
+struct SimHttpRequest {
+  const char* path;
+  bool        post;
+  uint64_t    submitUs;
+  uint64_t    doneUs;  // 0 until answered
+  int         code;
+  size_t      bodyLen;
+};
+void   simHttpSubmit(SimHttpRequest* req);
+size_t simHttpPending(void);
+
+/* Console (Serial) lines are passed to this callback, if set. */
+typedef void (*SimConsoleFn)(const char* line, uint64_t us);
+void simSetConsole(SimConsoleFn fn);
+
+/* Binary frames on the console (bytes between two zero delimiters, still
+ * COBS encoded) are passed to this callback instead of the line callback. */
+typedef void (*SimConsoleFrameFn)(const uint8_t* data, size_t len,
+                                  uint64_t us);
+void simSetConsoleFrames(SimConsoleFrameFn fn);
+
+/* Thrown by esp_deep_sleep_start(); static state cannot be re-initialized
+ * in-process, so the simulator treats it as the end of a run. */
+struct SimDeepSleep {
+  uint64_t ext1Mask;
+  int      ext0Pin;
+};
+
+/* Battery voltage seen by the ADC model (mV at the cell). */
+void simSetBatteryMv(uint16_t mv);
+
+/* Wakeup cause reported by esp_sleep_get_wakeup_cause() (default: reset) */
+void simSetWakeCause(int cause);
+
+/* Reset reason reported by esp_reset_reason() (default: power-on) */
+void simSetResetReason(int reason);
+
+/* Whether esp_pm_configure() succeeds (default: yes) */
+void simSetPmSupported(bool supported);
+
+/* WiFi association delays (ms): full scan + DHCP, and cached BSSID/IP */
+void simSetWiFiConnectMs(uint32_t fullMs, uint32_t fastMs);
+
+#endif  // NATIVE_SIM_HOOKS_H